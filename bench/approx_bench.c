@@ -0,0 +1,437 @@
+#include "harness.h"
+
+#include "src/approx.h"
+#include "src/regex.h"
+#include "src/logger.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Most errors benchmarked (every case is run with 1 to this many errors).
+ */
+#define APPROX_BENCH_MAX_ERRORS 3
+
+/**
+ * @struct ApproxBenchOptions
+ * @brief Command line options of the approximate matching benchmark.
+ */
+typedef struct ApproxBenchOptions {
+    BenchCommonOptions common; /**< Output, filter, corpus size and seed (of the noise too) */
+    double min_time; /**< Minimum seconds to spend measuring each version */
+    int noise; /**< Bytes edited per thousand bytes of the corpus */
+} ApproxBenchOptions;
+
+/**
+ * @struct ApproxBenchCase
+ * @brief An identifier searched with errors in the noisy lines of a corpus.
+ */
+typedef struct ApproxBenchCase {
+    const char *name; /**< Name of the case */
+    const char *word; /**< The identifier (letters only, so it is its own pattern) */
+    CorpusKind corpus; /**< Corpus the lines come from */
+} ApproxBenchCase;
+
+/**
+ * @enum ApproxBenchVersion
+ * @brief The ways of finding the lines containing the identifier with errors.
+ */
+typedef enum ApproxBenchVersion {
+    APPROX_BENCH_VARIANTS, /**< Match the alternation of every variant of the identifier (regex_match_batch()) */
+    APPROX_BENCH_APPROX, /**< Match the identifier with errors (approx_match_bytes()) */
+    APPROX_BENCH_VERSION_COUNT
+} ApproxBenchVersion;
+
+/**
+ * @struct ApproxBenchRun
+ * @brief Measurements of one version.
+ */
+typedef struct ApproxBenchRun {
+    double seconds; /**< Seconds per pass over the lines */
+    size_t matched_lines; /**< Lines matched in one pass */
+    uint64_t lines_hash; /**< FNV-1a hash of the indexes of the matched lines */
+    size_t distances[APPROX_BENCH_MAX_ERRORS + 1]; /**< Lines by best distance (approximate matching only) */
+} ApproxBenchRun;
+
+/**
+ * @struct ApproxBenchVariants
+ * @brief Distinct strings at most some edits away from the identifier.
+ */
+typedef struct ApproxBenchVariants {
+    char **strings; /**< The variants ('.' stands for any inserted or substituted byte) */
+    size_t count; /**< Number of variants */
+    size_t capacity; /**< Capacity of strings */
+} ApproxBenchVariants;
+
+/**
+ * @brief Names of the versions in the JSON output.
+ */
+static const char *const approx_bench_version_names[] = {"variants", "approx"};
+
+static const ApproxBenchCase approx_bench_cases[] = {
+    {"log/component", "scheduler", CORPUS_KIND_LOG},
+    {"log/user", "mallory", CORPUS_KIND_LOG},
+    {"log/missing", "transaction", CORPUS_KIND_LOG},
+    {"stack/exception", "SocketTimeout", CORPUS_KIND_STACK},
+    {"stack/frame", "runWorker", CORPUS_KIND_STACK},
+};
+
+/**
+ * @brief Parse an option of the benchmark (see BenchOptionParser).
+ *
+ * @param options Pointer to the ApproxBenchOptions
+ * @param name The option
+ * @param value Its value
+ *
+ * @return false if the option is unknown or its value is invalid.
+ */
+static bool approx_bench_parse_option(void *options, const char *name, const char *value);
+
+/**
+ * @brief Copy the lines of the corpus with some of their bytes edited, like OCR or transmission errors.
+ *
+ * @param corpus The corpus
+ * @param noise Bytes edited per thousand bytes
+ * @param seed Seed of the edits
+ * @param data Pointer to store the malloced bytes of the lines
+ *
+ * @return Malloced array of corpus->line_count inputs pointing into the data.
+ */
+static RegexInput *approx_bench_noisy_lines(const Corpus *corpus, int noise, uint64_t seed, char **data);
+
+/**
+ * @brief Build the alternation of the strings at most some edits away from the identifier.
+ *
+ * @param word The identifier
+ * @param errors Most edits
+ * @param count Pointer to store the number of variants
+ *
+ * @return The malloced pattern.
+ */
+static char *approx_bench_variants_pattern(const char *word, int errors, size_t *count);
+
+/**
+ * @brief Add the variant.
+ *
+ * @param variants Pointer to the variants
+ * @param string The variant (copied)
+ */
+static void approx_bench_variants_add(ApproxBenchVariants *variants, const char *string);
+
+/**
+ * @brief Sort the variants and free the duplicates.
+ *
+ * @param variants Pointer to the variants
+ */
+static void approx_bench_variants_unique(ApproxBenchVariants *variants);
+
+/**
+ * @brief Find the lines containing the identifier with errors once.
+ *
+ * @param regex Pointer to the regex of the variants
+ * @param approx Pointer to the matcher of the identifier
+ * @param inputs The lines
+ * @param count Number of lines
+ * @param errors Most errors
+ * @param version How to find the lines
+ * @param results Bitmap of (count + 63) / 64 words to store the matched lines in
+ * @param run Pointer to store the counts and the hash of the line indexes
+ */
+static void approx_bench_pass(Regex *regex, const Approx *approx, const RegexInput *inputs, size_t count, int errors,
+    ApproxBenchVersion version, uint64_t *results, ApproxBenchRun *run);
+
+/**
+ * @brief Compare two variants for qsort().
+ *
+ * @param a Pointer to the first variant
+ * @param b Pointer to the second variant
+ *
+ * @return Order of the variants.
+ */
+static int approx_bench_compare(const void *a, const void *b);
+
+int main(int argc, const char **argv) {
+    ApproxBenchOptions options = {
+        .common = {.corpus_bytes = 1024 * 1024, .seed = 42},
+        .min_time = 0.3,
+        .noise = 20,
+    };
+
+    bool valid = bench_parse_arguments(&options.common, argc, argv, approx_bench_parse_option, &options);
+    if (valid && (options.noise < 0 || options.noise > 1000)) {
+        LOG_ERROR("Noise should be between 0 and 1000");
+        valid = false;
+    }
+    if (!valid) {
+        LOG_INFO("Usage: regexer_approx_bench [--out <file>] [--filter <name>] [--size <bytes>] [--min-time <seconds>]"
+            " [--noise <per mille>] [--seed <seed>]");
+        return EXIT_FAILURE;
+    }
+
+    Corpus corpora[CORPUS_KIND_COUNT];
+    bench_generate_corpora(corpora, options.common.corpus_bytes, options.common.seed);
+
+    FILE *out = stdout;
+    if (options.common.out_path && !(out = fopen(options.common.out_path, "w"))) {
+        LOG_ERROR("Failed to open '%s' for writing", options.common.out_path);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"version\": 1,\n");
+    fprintf(out, "  \"corpus_bytes\": %zu,\n", options.common.corpus_bytes);
+    fprintf(out, "  \"noise_per_mille\": %d,\n", options.noise);
+    fprintf(out, "  \"results\": [\n");
+
+    bool consistent = true, first = true;
+    size_t case_count = sizeof(approx_bench_cases) / sizeof(approx_bench_cases[0]);
+    for (size_t i = 0; i < case_count; ++i) {
+        const ApproxBenchCase *bench_case = &approx_bench_cases[i];
+        if (options.common.filter && !strstr(bench_case->name, options.common.filter)) continue;
+
+        const Corpus *corpus = &corpora[bench_case->corpus];
+        char *data;
+        RegexInput *inputs = approx_bench_noisy_lines(corpus, options.noise, options.common.seed, &data);
+        uint64_t *results = malloc(sizeof(uint64_t) * ((corpus->line_count + 63) / 64 + 1));
+        if (!results) {
+            LOG_ERROR("Failed to allocate %zu lines", corpus->line_count);
+            return EXIT_FAILURE;
+        }
+
+        Regex regex;
+        regex_create(&regex, bench_case->word);
+        Approx approx;
+        if (approx_create(&approx, &regex) != REGEX_OK) {
+            LOG_ERROR("'%s': '%s' can't be matched with errors", bench_case->name, bench_case->word);
+            return EXIT_FAILURE;
+        }
+
+        for (int errors = 1; errors <= APPROX_BENCH_MAX_ERRORS; ++errors) {
+            size_t variant_count;
+            char *pattern = approx_bench_variants_pattern(bench_case->word, errors, &variant_count);
+            double start = bench_now();
+            Regex variants;
+            regex_create(&variants, pattern);
+            double compile_seconds = bench_now() - start;
+
+            ApproxBenchRun runs[APPROX_BENCH_VERSION_COUNT];
+            for (int version = 0; version < APPROX_BENCH_VERSION_COUNT; ++version) {
+                size_t passes = 0;
+                double elapsed;
+                start = bench_now();
+                do {
+                    approx_bench_pass(&variants, &approx, inputs, corpus->line_count, errors,
+                        (ApproxBenchVersion)version, results, &runs[version]);
+                    passes++;
+                } while ((elapsed = bench_now() - start) < options.min_time);
+                runs[version].seconds = elapsed / passes;
+
+                if (runs[version].matched_lines != runs[0].matched_lines || runs[version].lines_hash != runs[0].lines_hash) {
+                    LOG_ERROR("'%s' with %d errors: %s matched %zu lines, %s %zu", bench_case->name, errors,
+                        approx_bench_version_names[version], runs[version].matched_lines, approx_bench_version_names[0],
+                        runs[0].matched_lines);
+                    consistent = false;
+                }
+            }
+
+            const ApproxBenchRun *approx_run = &runs[APPROX_BENCH_APPROX];
+            fprintf(out, "%s    {\"name\": ", first ? "" : ",\n");
+            bench_write_json_string(out, bench_case->name);
+            fprintf(out, ", \"word\": ");
+            bench_write_json_string(out, bench_case->word);
+            fprintf(out, ", \"errors\": %d, \"lines\": %zu, \"matched_lines\": %zu, \"lines_by_distance\": [", errors,
+                corpus->line_count, approx_run->matched_lines);
+            for (int d = 0; d <= errors; ++d) fprintf(out, "%s%zu", d ? ", " : "", approx_run->distances[d]);
+            fprintf(out, "], \"variants\": %zu, \"variants_compile_ms\": %.3lf, \"variants_dfa_states\": %d",
+                variant_count, compile_seconds * 1e3, variants.use_dfa ? variants.dfa.state_count : 0);
+            for (int version = 0; version < APPROX_BENCH_VERSION_COUNT; ++version)
+                fprintf(out, ", \"%s_mb_per_s\": %.3lf", approx_bench_version_names[version],
+                    corpus->bytes / runs[version].seconds / 1e6);
+            fprintf(out, ", \"speedup\": %.3lf}", runs[APPROX_BENCH_VARIANTS].seconds / runs[APPROX_BENCH_APPROX].seconds);
+            first = false;
+
+            regex_destroy(&variants);
+            free(pattern);
+        }
+
+        approx_destroy(&approx);
+        regex_destroy(&regex);
+        free(inputs);
+        free(data);
+        free(results);
+    }
+
+    fprintf(out, "\n  ],\n");
+    fprintf(out, "  \"consistent\": %s\n", consistent ? "true" : "false");
+    fprintf(out, "}\n");
+
+    if (out != stdout) fclose(out);
+    for (int kind = 0; kind < CORPUS_KIND_COUNT; ++kind) corpus_destroy(&corpora[kind]);
+
+    return consistent ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool approx_bench_parse_option(void *options, const char *name, const char *value) {
+    ApproxBenchOptions *approx_options = options;
+    if (!strcmp(name, "--min-time")) approx_options->min_time = strtod(value, NULL);
+    else if (!strcmp(name, "--noise")) approx_options->noise = atoi(value);
+    else return false;
+
+    return true;
+}
+
+static RegexInput *approx_bench_noisy_lines(const Corpus *corpus, int noise, uint64_t seed, char **data) {
+    // An inserted byte can double a line at most
+    RegexInput *inputs = malloc(sizeof(RegexInput) * (corpus->line_count ? corpus->line_count : 1));
+    *data = malloc(2 * corpus->bytes + 1);
+    if (!inputs || !*data) {
+        LOG_ERROR("Failed to allocate %zu lines", corpus->line_count);
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t random = seed * 2654435761u + 1;
+    size_t len = 0;
+    for (size_t l = 0; l < corpus->line_count; ++l) {
+        const char *line = corpus_line(corpus, l);
+        size_t start = len;
+        for (size_t i = 0; i < corpus->lengths[l]; ++i) {
+            // xorshift64*
+            random ^= random >> 12;
+            random ^= random << 25;
+            random ^= random >> 27;
+            uint64_t value = random * 2685821657736338717ULL;
+
+            char letter = (char)('a' + (value >> 40) % 26);
+            switch ((value >> 32) % 1000 < (uint64_t)noise ? (value >> 20) % 3 : 3) {
+                case 0: // Dropped
+                    break;
+                case 1: // Replaced
+                    (*data)[len++] = letter;
+                    break;
+                case 2: // Inserted before
+                    (*data)[len++] = letter;
+                    (*data)[len++] = line[i];
+                    break;
+                default:
+                    (*data)[len++] = line[i];
+                    break;
+            }
+        }
+        inputs[l] = (RegexInput){*data + start, len - start};
+    }
+
+    return inputs;
+}
+
+static char *approx_bench_variants_pattern(const char *word, int errors, size_t *count) {
+    ApproxBenchVariants variants = {0};
+    approx_bench_variants_add(&variants, word);
+
+    // Every round edits all the variants found so far once more
+    size_t len = strlen(word) + errors;
+    char *edited = malloc(len + 2);
+    for (int round = 0; round < errors; ++round) {
+        size_t known = variants.count;
+        for (size_t v = 0; v < known; ++v) {
+            const char *string = variants.strings[v];
+            size_t string_len = strlen(string);
+            for (size_t at = 0; at <= string_len; ++at) {
+                // Inserted byte
+                snprintf(edited, len + 2, "%.*s.%s", (int)at, string, string + at);
+                approx_bench_variants_add(&variants, edited);
+                if (at == string_len) continue;
+
+                // Deleted byte
+                snprintf(edited, len + 2, "%.*s%s", (int)at, string, string + at + 1);
+                approx_bench_variants_add(&variants, edited);
+                // Substituted byte
+                snprintf(edited, len + 2, "%.*s.%s", (int)at, string, string + at + 1);
+                approx_bench_variants_add(&variants, edited);
+            }
+        }
+
+        approx_bench_variants_unique(&variants);
+    }
+    free(edited);
+
+    size_t pattern_len = 0;
+    for (size_t v = 0; v < variants.count; ++v) pattern_len += strlen(variants.strings[v]) + 1;
+    char *pattern = malloc(pattern_len + 1);
+    if (!pattern) {
+        LOG_ERROR("Failed to allocate the pattern of %zu variants", variants.count);
+        exit(EXIT_FAILURE);
+    }
+
+    // An empty variant is dropped: with at least as many errors as bytes every line matches anyway
+    pattern_len = 0;
+    for (size_t v = 0; v < variants.count; ++v) {
+        if (*variants.strings[v]) {
+            if (pattern_len) pattern[pattern_len++] = '|';
+            strcpy(pattern + pattern_len, variants.strings[v]);
+            pattern_len += strlen(variants.strings[v]);
+        }
+        free(variants.strings[v]);
+    }
+    pattern[pattern_len] = '\0';
+
+    *count = variants.count;
+    free(variants.strings);
+    return pattern;
+}
+
+static void approx_bench_variants_add(ApproxBenchVariants *variants, const char *string) {
+    if (variants->count == variants->capacity) {
+        variants->capacity = variants->capacity ? variants->capacity * 2 : 64;
+        variants->strings = realloc(variants->strings, sizeof(char *) * variants->capacity);
+    }
+
+    size_t size = strlen(string) + 1;
+    char *copy = malloc(size);
+    if (!variants->strings || !copy) {
+        LOG_ERROR("Failed to allocate %zu variants", variants->capacity);
+        exit(EXIT_FAILURE);
+    }
+    variants->strings[variants->count++] = memcpy(copy, string, size);
+}
+
+static void approx_bench_variants_unique(ApproxBenchVariants *variants) {
+    qsort(variants->strings, variants->count, sizeof(char *), approx_bench_compare);
+
+    size_t count = 0;
+    for (size_t v = 0; v < variants->count; ++v) {
+        if (count && !strcmp(variants->strings[count - 1], variants->strings[v])) free(variants->strings[v]);
+        else variants->strings[count++] = variants->strings[v];
+    }
+    variants->count = count;
+}
+
+static void approx_bench_pass(Regex *regex, const Approx *approx, const RegexInput *inputs, size_t count, int errors,
+    ApproxBenchVersion version, uint64_t *results, ApproxBenchRun *run) {
+    *run = (ApproxBenchRun){.lines_hash = BENCH_HASH_START};
+
+    if (version == APPROX_BENCH_APPROX) {
+        memset(results, 0, sizeof(uint64_t) * ((count + 63) / 64));
+        for (size_t i = 0; i < count; ++i) {
+            int distance = approx_match_bytes(approx, (const uint8_t *)inputs[i].data, inputs[i].len, errors,
+                REGEX_MATCH_EOL);
+            if (distance < 0) continue;
+            results[i / 64] |= (uint64_t)1 << (i % 64);
+            run->distances[distance]++;
+        }
+    } else {
+        regex_match_batch(regex, inputs, count, results);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if (!(results[i / 64] >> (i % 64) & 1)) continue;
+
+        run->matched_lines++;
+        run->lines_hash = bench_hash(run->lines_hash, &i, sizeof(i));
+    }
+}
+
+static int approx_bench_compare(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
@@ -0,0 +1,334 @@
+#include "harness.h"
+
+#include "src/regex.h"
+#include "src/memory.h"
+#include "src/logger.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @struct BenchResult
+ * @brief Measurements of one bench case.
+ */
+typedef struct BenchResult {
+    const BenchCase *bench_case;
+    size_t corpus_bytes; /**< Bytes scanned in one pass */
+    size_t matches; /**< Number of matching lines in one pass */
+    double mb_per_s; /**< Throughput in MB (10^6 bytes) per second */
+    double ns_per_match; /**< Nanoseconds per regex_pattern_in_line() call */
+    double batch_mb_per_s; /**< Throughput of regex_match_batch() */
+    size_t batch_matches; /**< Number of matching lines found by regex_match_batch() */
+    double no_accel_mb_per_s; /**< Throughput without the accelerated dfa states (negative if there are none) */
+    double compile_ns; /**< Nanoseconds per regex_create() */
+    size_t peak_bytes; /**< Peak bytes allocated by the engine */
+    double baseline_mb_per_s; /**< Throughput in baseline (negative if not present) */
+    bool regression; /**< Throughput dropped more than the threshold */
+} BenchResult;
+
+/**
+ * @struct BenchOptions
+ * @brief Command line options of the benchmark.
+ */
+typedef struct BenchOptions {
+    BenchCommonOptions common; /**< Output, case filter, size of each corpus and seed */
+    const char *baseline_path; /**< JSON written by previous run */
+    double threshold; /**< Allowed throughput drop in percent */
+    double min_time; /**< Minimum seconds to spend measuring each case */
+    int engine_flags; /**< RegexFlag selecting the engine */
+} BenchOptions;
+
+/**
+ * @struct BaselineEntry
+ * @brief Throughput of a case read from the baseline.
+ */
+typedef struct BaselineEntry {
+    char name[128];
+    double mb_per_s;
+} BaselineEntry;
+
+/**
+ * @brief Parse an option of the benchmark (see BenchOptionParser).
+ *
+ * @param options Pointer to the BenchOptions
+ * @param name The option
+ * @param value Its value
+ *
+ * @return false if the option is unknown or its value is invalid.
+ */
+static bool bench_parse_option(void *options, const char *name, const char *value);
+
+/**
+ * @brief Run and measure one bench case.
+ *
+ * @param bench_case The case to run
+ * @param corpus The corpus to scan
+ * @param options Pointer to the options
+ * @param result Pointer to store the result
+ *
+ * @return false if the buffers of the case could not be allocated (the error is logged).
+ */
+static bool bench_run_case(const BenchCase *bench_case, const Corpus *corpus, const BenchOptions *options, BenchResult *result);
+
+/**
+ * @brief Read the throughputs from the baseline JSON written by this benchmark.
+ *
+ * @param path Path to the baseline
+ * @param entries Pointer to store the malloced entries
+ *
+ * @return Number of entries, -1 if the file could not be read or the entries could not be allocated.
+ */
+static int bench_read_baseline(const char *path, BaselineEntry **entries);
+
+/**
+ * @brief Write the report as JSON.
+ *
+ * @param out The output file
+ * @param options Pointer to the options
+ * @param results The results
+ * @param result_count Number of results
+ */
+static void bench_write_report(FILE *out, const BenchOptions *options, const BenchResult *results, size_t result_count);
+
+int main(int argc, const char **argv) {
+    BenchOptions options = {
+        .common = {.corpus_bytes = 4 * 1024 * 1024, .seed = 42},
+        .threshold = 10.0,
+        .min_time = 0.2,
+    };
+
+    if (!bench_parse_arguments(&options.common, argc, argv, bench_parse_option, &options)) {
+        LOG_INFO("Usage: regexer_bench [--out <file>] [--baseline <file>] [--threshold <percent>]"
+            " [--filter <name>] [--size <bytes>] [--min-time <seconds>] [--seed <seed>] [--engine <auto|dfa|shift-and|nfa>]");
+        return EXIT_FAILURE;
+    }
+
+    Corpus corpora[CORPUS_KIND_COUNT];
+    bench_generate_corpora(corpora, options.common.corpus_bytes, options.common.seed);
+
+    BaselineEntry *baseline = NULL;
+    int baseline_len = 0;
+    if (options.baseline_path) {
+        baseline_len = bench_read_baseline(options.baseline_path, &baseline);
+        if (baseline_len < 0) {
+            LOG_ERROR("Failed to read baseline '%s'", options.baseline_path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    BenchResult *results = malloc(bench_case_count * sizeof(BenchResult));
+    if (!results) {
+        LOG_ERROR("Failed to allocate the results of %zu cases", bench_case_count);
+        return EXIT_FAILURE;
+    }
+    size_t result_count = 0;
+    bool regressed = false;
+
+    for (size_t i = 0; i < bench_case_count; ++i) {
+        if (options.common.filter && !strstr(bench_cases[i].name, options.common.filter)) continue;
+
+        BenchResult *result = &results[result_count++];
+        if (!bench_run_case(&bench_cases[i], &corpora[bench_cases[i].corpus], &options, result)) return EXIT_FAILURE;
+
+        for (int j = 0; j < baseline_len; ++j) {
+            if (strcmp(baseline[j].name, bench_cases[i].name)) continue;
+            // A zero throughput can't be compared against (a truncated or hand edited baseline)
+            if (baseline[j].mb_per_s <= 0) continue;
+
+            result->baseline_mb_per_s = baseline[j].mb_per_s;
+            double change = (result->mb_per_s - baseline[j].mb_per_s) * 100.0 / baseline[j].mb_per_s;
+            if (change < -options.threshold) {
+                result->regression = true;
+                regressed = true;
+                LOG_ERROR("Regression in '%s': %.2lf MB/s -> %.2lf MB/s (%.1lf%%)",
+                    bench_cases[i].name, baseline[j].mb_per_s, result->mb_per_s, change);
+            }
+            break;
+        }
+    }
+
+    FILE *out = stdout;
+    if (options.common.out_path && !(out = fopen(options.common.out_path, "w"))) {
+        LOG_ERROR("Failed to open '%s' for writing", options.common.out_path);
+        return EXIT_FAILURE;
+    }
+
+    bench_write_report(out, &options, results, result_count);
+
+    if (out != stdout) fclose(out);
+
+    free(results);
+    free(baseline);
+    for (int kind = 0; kind < CORPUS_KIND_COUNT; ++kind) corpus_destroy(&corpora[kind]);
+
+    return regressed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static bool bench_parse_option(void *options, const char *name, const char *value) {
+    BenchOptions *bench = options;
+    if (!strcmp(name, "--baseline")) bench->baseline_path = value;
+    else if (!strcmp(name, "--threshold")) bench->threshold = strtod(value, NULL);
+    else if (!strcmp(name, "--min-time")) bench->min_time = strtod(value, NULL);
+    else if (!strcmp(name, "--engine")) return bench_engine_flags(value, &bench->engine_flags);
+    else return false;
+
+    return true;
+}
+
+static bool bench_run_case(const BenchCase *bench_case, const Corpus *corpus, const BenchOptions *options, BenchResult *result) {
+    *result = (BenchResult){.bench_case = bench_case, .baseline_mb_per_s = -1.0};
+
+    memory_reset_peak_usage();
+    size_t base_bytes = memory_get_peak_usage();
+
+    // Compile time
+    Regex regex;
+    RegexOptions regex_options = {.flags = bench_case->flags | options->engine_flags};
+    size_t compiles = 0;
+    double start = bench_now(), elapsed;
+    do {
+        regex_create_with_options(&regex, bench_case->pattern, &regex_options);
+        regex_destroy(&regex);
+        compiles++;
+    } while ((elapsed = bench_now() - start) < options->min_time / 4);
+    result->compile_ns = elapsed * 1e9 / compiles;
+
+    // Matching throughput
+    regex_create_with_options(&regex, bench_case->pattern, &regex_options);
+
+    size_t passes = 0;
+    start = bench_now();
+    do {
+        size_t matches = 0;
+        for (size_t i = 0; i < corpus->line_count; ++i)
+            matches += regex_pattern_in_line(&regex, corpus_line(corpus, i));
+        result->matches = matches;
+        passes++;
+    } while ((elapsed = bench_now() - start) < options->min_time);
+
+    result->corpus_bytes = corpus->bytes;
+    result->mb_per_s = (double)corpus->bytes * passes / elapsed / 1e6;
+    result->ns_per_match = elapsed * 1e9 / ((double)corpus->line_count * passes);
+    result->peak_bytes = memory_get_peak_usage() - base_bytes;
+
+    // Batch throughput over the same lines
+    RegexInput *inputs = bench_corpus_inputs(corpus);
+    uint64_t *bitmap = malloc((corpus->line_count + 63) / 64 * sizeof(uint64_t));
+    if (!bitmap) {
+        LOG_ERROR("'%s': Failed to allocate the batch results of %zu lines", bench_case->name, corpus->line_count);
+        free(inputs);
+        regex_destroy(&regex);
+        return false;
+    }
+
+    passes = 0;
+    start = bench_now();
+    do {
+        regex_match_batch(&regex, inputs, corpus->line_count, bitmap);
+        passes++;
+    } while ((elapsed = bench_now() - start) < options->min_time);
+    result->batch_mb_per_s = (double)corpus->bytes * passes / elapsed / 1e6;
+
+    for (size_t i = 0; i < (corpus->line_count + 63) / 64; ++i)
+        for (uint64_t word = bitmap[i]; word; word &= word - 1) result->batch_matches++;
+    if (result->batch_matches != result->matches)
+        LOG_ERROR("'%s': regex_match_batch() found %zu matches, regex_pattern_in_line() %zu",
+            bench_case->name, result->batch_matches, result->matches);
+
+    free(bitmap);
+    free(inputs);
+
+    // Same lines stepping the dfa byte by byte, if some of its states skip ahead
+    result->no_accel_mb_per_s = -1.0;
+    if (regex.use_dfa && regex.dfa.accel_count) {
+        Regex stepped;
+        RegexOptions stepped_options = {.flags = regex_options.flags | REGEX_FLAG_NO_ACCEL};
+        regex_create_with_options(&stepped, bench_case->pattern, &stepped_options);
+
+        passes = 0;
+        start = bench_now();
+        do {
+            for (size_t i = 0; i < corpus->line_count; ++i) regex_pattern_in_line(&stepped, corpus_line(corpus, i));
+            passes++;
+        } while ((elapsed = bench_now() - start) < options->min_time);
+        result->no_accel_mb_per_s = (double)corpus->bytes * passes / elapsed / 1e6;
+
+        regex_destroy(&stepped);
+    }
+
+    regex_destroy(&regex);
+
+    return true;
+}
+
+static int bench_read_baseline(const char *path, BaselineEntry **entries) {
+    FILE *file = fopen(path, "r");
+    if (!file) return -1;
+
+    int len = 0, capacity = 0;
+    char line[4096];
+    while (fgets(line, sizeof(line), file)) {
+        // Each result is written in a single line by bench_write_report()
+        const char *name = strstr(line, "\"name\": \"");
+        const char *mb_per_s = strstr(line, "\"mb_per_s\": ");
+        if (!name || !mb_per_s) continue;
+
+        if (len == capacity) {
+            capacity = capacity ? capacity * 2 : 32;
+            BaselineEntry *grown = realloc(*entries, capacity * sizeof(BaselineEntry));
+            if (!grown) {
+                LOG_ERROR("Failed to allocate %d baseline entries", capacity);
+                free(*entries);
+                *entries = NULL;
+                fclose(file);
+                return -1;
+            }
+            *entries = grown;
+        }
+
+        name += strlen("\"name\": \"");
+        size_t name_len = strcspn(name, "\"");
+        if (name_len >= sizeof((*entries)[len].name)) name_len = sizeof((*entries)[len].name) - 1;
+        memcpy((*entries)[len].name, name, name_len);
+        (*entries)[len].name[name_len] = 0;
+        (*entries)[len].mb_per_s = strtod(mb_per_s + strlen("\"mb_per_s\": "), NULL);
+        len++;
+    }
+
+    fclose(file);
+    return len;
+}
+
+static void bench_write_report(FILE *out, const BenchOptions *options, const BenchResult *results, size_t result_count) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"version\": 1,\n");
+    fprintf(out, "  \"seed\": %llu,\n", (unsigned long long)options->common.seed);
+    fprintf(out, "  \"corpus_bytes\": %zu,\n", options->common.corpus_bytes);
+    fprintf(out, "  \"threshold_percent\": %.2lf,\n", options->threshold);
+    fprintf(out, "  \"results\": [\n");
+
+    for (size_t i = 0; i < result_count; ++i) {
+        const BenchResult *result = &results[i];
+        fprintf(out, "    {\"name\": ");
+        bench_write_json_string(out, result->bench_case->name);
+        fprintf(out, ", \"pattern\": ");
+        bench_write_json_string(out, result->bench_case->pattern);
+        fprintf(out, ", \"corpus\": \"%s\", \"corpus_bytes\": %zu, \"matches\": %zu, \"mb_per_s\": %.3lf, \"ns_per_match\": %.2lf"
+            ", \"batch_mb_per_s\": %.3lf, \"batch_speedup\": %.3lf, \"compile_ns\": %.1lf, \"peak_bytes\": %zu",
+            corpus_kind_name(result->bench_case->corpus), result->corpus_bytes, result->matches, result->mb_per_s,
+            result->ns_per_match, result->batch_mb_per_s, result->batch_mb_per_s / result->mb_per_s,
+            result->compile_ns, result->peak_bytes);
+        if (result->no_accel_mb_per_s >= 0)
+            fprintf(out, ", \"no_accel_mb_per_s\": %.3lf, \"accel_speedup\": %.3lf",
+                result->no_accel_mb_per_s, result->mb_per_s / result->no_accel_mb_per_s);
+        if (result->baseline_mb_per_s >= 0)
+            fprintf(out, ", \"baseline_mb_per_s\": %.3lf, \"regression\": %s",
+                result->baseline_mb_per_s, result->regression ? "true" : "false");
+        fprintf(out, "}%s\n", i + 1 < result_count ? "," : "");
+    }
+
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+}
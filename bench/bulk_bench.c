@@ -0,0 +1,281 @@
+#include "harness.h"
+
+#include "src/bulk.h"
+#include "src/logger.h"
+
+#ifdef RE_SEARCH
+#include "src/pool.h"
+#endif
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Longest generated rule (with the NUL).
+ */
+#define BULK_BENCH_RULE_SIZE 128
+
+/**
+ * @brief Maximum number of thread counts measured.
+ */
+#define BULK_BENCH_MAX_RUNS 16
+
+/**
+ * @struct BulkBenchOptions
+ * @brief Command line options of the bulk compile benchmark.
+ */
+typedef struct BulkBenchOptions {
+    BenchCommonOptions common; /**< Output, bytes of log lines every rule is matched against, and seed */
+    size_t rules; /**< Number of rules compiled */
+    int max_threads; /**< Measure 1, 2, 4... up to this many threads */
+} BulkBenchOptions;
+
+/**
+ * @struct BulkBenchRun
+ * @brief Measurements of one thread count.
+ */
+typedef struct BulkBenchRun {
+    int threads; /**< Number of workers */
+    double seconds; /**< Seconds to compile every rule */
+    BulkReport report; /**< Memory of the regexes */
+} BulkBenchRun;
+
+/**
+ * @brief Parts the rules are made of, most rules share their ending with many others.
+ */
+static const char *const bulk_bench_components[] = {"auth", "db", "cache", "http", "queue", "scheduler", "storage", "mailer"};
+
+static const char *const bulk_bench_fields[] = {"user", "session", "request", "job", "order", "account", "tenant"};
+
+static const char *const bulk_bench_verbs[] = {"created", "deleted", "updated", "failed", "rejected", "expired"};
+
+/**
+ * @brief Parse an option of the benchmark (see BenchOptionParser).
+ *
+ * @param options Pointer to the BulkBenchOptions
+ * @param name The option
+ * @param value Its value
+ *
+ * @return false if the option is unknown.
+ */
+static bool bulk_bench_parse_option(void *options, const char *name, const char *value);
+
+/**
+ * @brief Generate the rules (rule i is stored at rules + i * BULK_BENCH_RULE_SIZE).
+ *
+ * @param options Pointer to the options
+ *
+ * @return Malloced rules.
+ */
+static char *bulk_bench_generate_rules(const BulkBenchOptions *options);
+
+/**
+ * @brief Match every input with every regex.
+ *
+ * @param regexes The regexes
+ * @param count Number of regexes
+ * @param inputs The inputs
+ * @param input_count Number of inputs
+ * @param results Bitmaps of (input_count + 63) / 64 words for each regex
+ */
+static void bulk_bench_match(Regex *regexes, size_t count, const RegexInput *inputs, size_t input_count,
+    uint64_t *results);
+
+int main(int argc, const char **argv) {
+    BulkBenchOptions options = {
+        .common = {.corpus_bytes = 16 * 1024, .seed = 42},
+        .rules = 20000,
+        .max_threads = 1,
+    };
+#ifdef RE_SEARCH
+    options.max_threads = pool_processor_count();
+#endif
+
+    bool valid = bench_parse_arguments(&options.common, argc, argv, bulk_bench_parse_option, &options);
+    if (valid && (!options.rules || !options.common.corpus_bytes || options.max_threads < 1)) {
+        LOG_ERROR("Rules, check bytes and threads should be greater than zero");
+        valid = false;
+    }
+    if (!valid) {
+        LOG_INFO("Usage: regexer_bulk_bench [--out <file>] [--rules <count>] [--check-bytes <bytes>]"
+            " [--threads <max>] [--seed <seed>]");
+        return EXIT_FAILURE;
+    }
+
+    char *rules = bulk_bench_generate_rules(&options);
+    const char **patterns = malloc(sizeof(const char *) * options.rules);
+    Regex *separate = malloc(sizeof(Regex) * options.rules);
+    if (!patterns || !separate) {
+        LOG_ERROR("Failed to allocate %zu rules", options.rules);
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < options.rules; ++i) patterns[i] = rules + i * BULK_BENCH_RULE_SIZE;
+
+    Corpus corpus;
+    corpus_generate(&corpus, CORPUS_KIND_LOG, options.common.corpus_bytes, options.common.seed);
+    RegexInput *inputs = malloc(sizeof(RegexInput) * (corpus.line_count + 1));
+    size_t words = (corpus.line_count + 64) / 64;
+    uint64_t *expected = calloc(words * options.rules, sizeof(uint64_t));
+    uint64_t *results = calloc(words * options.rules, sizeof(uint64_t));
+    if (!inputs || !expected || !results) {
+        LOG_ERROR("Failed to allocate the results of %zu rules", options.rules);
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < corpus.line_count; ++i) inputs[i] = (RegexInput){corpus_line(&corpus, i), corpus.lengths[i]};
+    // A line most rules of the first template match
+    inputs[corpus.line_count] = (RegexInput){"user=bob session=42 deleted after 17ms", 38};
+    size_t input_count = corpus.line_count + 1;
+
+    // Compiled one by one
+    double start = bench_now();
+    for (size_t i = 0; i < options.rules; ++i) regex_create(&separate[i], patterns[i]);
+    double separate_seconds = bench_now() - start;
+
+    size_t separate_bytes = 0;
+    unsigned long long separate_states = 0;
+    for (size_t i = 0; i < options.rules; ++i) {
+        MemoryReport report;
+        regex_get_memory_report(&separate[i], &report);
+        separate_bytes += report.program_bytes + report.table_bytes + report.scratch_bytes;
+        separate_states += (unsigned long long)separate[i].total_states;
+    }
+    bulk_bench_match(separate, options.rules, inputs, input_count, expected);
+    for (size_t i = 0; i < options.rules; ++i) regex_destroy(&separate[i]);
+
+    bool consistent = true;
+    BulkBenchRun runs[BULK_BENCH_MAX_RUNS];
+    int run_count = 0;
+    for (int threads = 1; run_count < BULK_BENCH_MAX_RUNS; threads *= 2) {
+        if (threads > options.max_threads) threads = options.max_threads;
+
+        Bulk bulk;
+        BulkOptions bulk_options = {.threads = threads};
+        start = bench_now();
+        RegexError error = bulk_create(&bulk, patterns, options.rules, &bulk_options);
+        if (error) {
+            LOG_ERROR("Failed to compile the rules in bulk with %d threads: %s", threads, regex_error_string(error));
+            consistent = false;
+            break;
+        }
+        runs[run_count] = (BulkBenchRun){.threads = threads, .seconds = bench_now() - start};
+        bulk_get_report(&bulk, &runs[run_count].report);
+
+        memset(results, 0, sizeof(uint64_t) * words * options.rules);
+        bulk_bench_match(bulk.regexes, bulk.count, inputs, input_count, results);
+        if (memcmp(results, expected, sizeof(uint64_t) * words * options.rules)) {
+            LOG_ERROR("Rules compiled in bulk with %d threads match differently", threads);
+            consistent = false;
+        }
+        if (runs[run_count].report.separate_states != separate_states) {
+            LOG_ERROR("Bulk compile with %d threads counted %llu states, compiling one by one created %llu", threads,
+                runs[run_count].report.separate_states, separate_states);
+            consistent = false;
+        }
+
+        bulk_destroy(&bulk);
+        run_count++;
+
+        if (threads == options.max_threads) break;
+    }
+
+    FILE *out = stdout;
+    if (options.common.out_path && !(out = fopen(options.common.out_path, "w"))) {
+        LOG_ERROR("Failed to open '%s' for writing", options.common.out_path);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"version\": 1,\n");
+    fprintf(out, "  \"rules\": %zu,\n", options.rules);
+    fprintf(out, "  \"check_lines\": %zu,\n", input_count);
+    fprintf(out, "  \"separate\": {\"seconds\": %.4lf, \"rules_per_s\": %.1lf, \"states\": %llu, \"bytes\": %zu},\n",
+        separate_seconds, options.rules / separate_seconds, separate_states, separate_bytes);
+    fprintf(out, "  \"runs\": [\n");
+    for (int r = 0; r < run_count; ++r) {
+        const BulkReport *report = &runs[r].report;
+        fprintf(out, "    {\"threads\": %d, \"shards\": %d, \"seconds\": %.4lf, \"speedup\": %.3lf, \"states\": %llu,"
+            " \"separate_states\": %llu, \"bytes\": %zu, \"separate_bytes\": %zu, \"saved_bytes\": %zu,"
+            " \"saved_ratio\": %.3lf}%s\n",
+            runs[r].threads, report->shards, runs[r].seconds, separate_seconds / runs[r].seconds, report->states,
+            report->separate_states, report->bytes, report->separate_bytes, report->saved_bytes,
+            report->separate_bytes ? (double)report->saved_bytes / report->separate_bytes : 0.0,
+            r + 1 < run_count ? "," : "");
+    }
+    fprintf(out, "  ],\n");
+    fprintf(out, "  \"consistent\": %s\n", consistent ? "true" : "false");
+    fprintf(out, "}\n");
+
+    if (out != stdout) fclose(out);
+
+    corpus_destroy(&corpus);
+    free(inputs);
+    free(expected);
+    free(results);
+    free(separate);
+    free(patterns);
+    free(rules);
+
+    return consistent ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool bulk_bench_parse_option(void *options, const char *name, const char *value) {
+    BulkBenchOptions *bulk = options;
+    if (!strcmp(name, "--rules")) bulk->rules = strtoull(value, NULL, 10);
+    else if (!strcmp(name, "--check-bytes")) bulk->common.corpus_bytes = strtoull(value, NULL, 10);
+    else if (!strcmp(name, "--threads")) bulk->max_threads = atoi(value);
+    else return false;
+
+    return true;
+}
+
+static char *bulk_bench_generate_rules(const BulkBenchOptions *options) {
+    char *rules = malloc(BULK_BENCH_RULE_SIZE * options->rules);
+    if (!rules) {
+        LOG_ERROR("Failed to allocate %zu rules", options->rules);
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t random = options->common.seed | 1;
+    for (size_t i = 0; i < options->rules; ++i) {
+        // xorshift64
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+
+        const char *component = bulk_bench_components[random % 8];
+        const char *field = bulk_bench_fields[(random >> 8) % 7];
+        const char *verb = bulk_bench_verbs[(random >> 16) % 6];
+        unsigned int id = (unsigned int)(random >> 24) % 1000;
+        char *rule = rules + i * BULK_BENCH_RULE_SIZE;
+
+        switch ((random >> 40) % 5) {
+            case 0:
+                snprintf(rule, BULK_BENCH_RULE_SIZE, "%s=[a-z0-9]+ .*%s after [0-9]+ms$", field, verb);
+                break;
+            case 1:
+                snprintf(rule, BULK_BENCH_RULE_SIZE, "\\[%s\\] %s%u .*(timeout|refused|reset) on port [0-9]+",
+                    component, field, id);
+                break;
+            case 2:
+                snprintf(rule, BULK_BENCH_RULE_SIZE, "%s-%u: [A-Z][a-z]+Exception", component, id);
+                break;
+            case 3:
+                snprintf(rule, BULK_BENCH_RULE_SIZE, "(GET|POST) /api/v[0-9]/%s/%s/[0-9]+ (4|5)[0-9][0-9]", component,
+                    field);
+                break;
+            default:
+                snprintf(rule, BULK_BENCH_RULE_SIZE, "%s_%u [A-Za-z0-9_.]+@[a-z]+\\.(com|org|net)", field, id);
+                break;
+        }
+    }
+
+    return rules;
+}
+
+static void bulk_bench_match(Regex *regexes, size_t count, const RegexInput *inputs, size_t input_count,
+    uint64_t *results) {
+    size_t words = (input_count + 63) / 64;
+    for (size_t i = 0; i < count; ++i) regex_match_batch(&regexes[i], inputs, input_count, results + i * words);
+}
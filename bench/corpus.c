@@ -0,0 +1,367 @@
+#include "corpus.h"
+
+#include "src/logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @struct CorpusBuilder
+ * @brief Helper to append lines while generating the corpus.
+ */
+typedef struct CorpusBuilder {
+    Corpus *corpus;
+    size_t data_capacity;
+    size_t line_capacity;
+    uint64_t rng; /**< xorshift64* state */
+} CorpusBuilder;
+
+static const char *log_levels[] = {"INFO", "INFO", "INFO", "INFO", "INFO", "INFO", "INFO", "DEBUG", "DEBUG", "WARN", "ERROR"};
+static const char *log_components[] = {"auth", "http", "db", "cache", "scheduler", "worker"};
+static const char *log_users[] = {"alice", "bob", "carol", "dave", "somebody", "nobody", "mallory"};
+static const char *http_methods[] = {"GET", "GET", "GET", "POST", "PUT", "DELETE"};
+static const char *http_paths[] = {"/api/v1/users", "/api/v1/orders", "/static/app.js", "/health", "/api/v2/search"};
+static const char *text_words[] = {
+    "somebody", "saw", "nobody", "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog",
+    "regex", "engine", "state", "machine", "sabw", "saeiouw", "sacacbw", "lorem", "ipsum", "dolor"
+};
+
+static const char *utf8_words[] = {
+    "ошибка", "соединение", "пользователь", "запрос", "σφάλμα", "χρήστης", "αίτημα",
+    "エラー", "接続", "ユーザー", "要求", "error", "user", "request", "naïve", "café", "😀"
+};
+
+static const char *stack_exceptions[] = {
+    "java.lang.IllegalStateException: connection pool exhausted", "java.net.SocketTimeoutException: Read timed out",
+    "java.lang.NullPointerException", "java.io.IOException: Broken pipe"
+};
+static const char *stack_methods[] = {
+    "com.example.db.Pool.acquire", "com.example.http.Handler.handle", "com.example.cache.Store.get",
+    "org.eclipse.jetty.server.HttpChannel.handle", "java.util.concurrent.ThreadPoolExecutor.runWorker",
+    "com.example.auth.Session.refresh", "com.example.scheduler.Job.run"
+};
+static const char *header_values[] = {
+    "gzip, deflate, br", "keep-alive", "no-cache", "application/json", "text/html; charset=utf-8",
+    "Mozilla/5.0 (X11; Linux x86_64)", "Googlebot/2.1", "curl/8.4.0", "bingbot/2.0", "max-age=3600"
+};
+
+#define ARRAY_LEN(array) (sizeof(array) / sizeof((array)[0]))
+
+/**
+ * @brief Get the next pseudo random number (xorshift64*).
+ *
+ * @param builder Pointer to the builder
+ *
+ * @return The random number.
+ */
+static uint64_t corpus_builder_random(CorpusBuilder *builder);
+
+/**
+ * @brief Get pseudo random number in [0, bound).
+ *
+ * @param builder Pointer to the builder
+ * @param bound Upper bound (exclusive)
+ *
+ * @return The random number.
+ */
+static size_t corpus_builder_random_below(CorpusBuilder *builder, size_t bound);
+
+/**
+ * @brief Append the line to the corpus.
+ *
+ * @param builder Pointer to the builder
+ * @param line The line
+ * @param len Length of the line
+ */
+static void corpus_builder_add_line(CorpusBuilder *builder, const char *line, size_t len);
+
+/**
+ * @brief Generate one log line.
+ *
+ * @param builder Pointer to the builder
+ * @param line Output buffer
+ * @param size Size of the output buffer
+ *
+ * @return Length of the line.
+ */
+static size_t corpus_generate_log_line(CorpusBuilder *builder, char *line, size_t size);
+
+/**
+ * @brief Generate one line of random text.
+ *
+ * @param builder Pointer to the builder
+ * @param line Output buffer
+ * @param size Size of the output buffer
+ *
+ * @return Length of the line.
+ */
+static size_t corpus_generate_text_line(CorpusBuilder *builder, char *line, size_t size);
+
+/**
+ * @brief Generate one log line with mixed script message.
+ *
+ * @param builder Pointer to the builder
+ * @param line Output buffer
+ * @param size Size of the output buffer
+ *
+ * @return Length of the line.
+ */
+static size_t corpus_generate_utf8_line(CorpusBuilder *builder, char *line, size_t size);
+
+/**
+ * @brief Generate one short string (username or HTTP header value).
+ *
+ * @param builder Pointer to the builder
+ * @param line Output buffer
+ * @param size Size of the output buffer
+ *
+ * @return Length of the line.
+ */
+static size_t corpus_generate_short_line(CorpusBuilder *builder, char *line, size_t size);
+
+/**
+ * @brief Generate one log line followed by a stack trace.
+ *
+ * @param builder Pointer to the builder
+ * @param line Output buffer
+ * @param size Size of the output buffer
+ *
+ * @return Length of the line.
+ */
+static size_t corpus_generate_stack_line(CorpusBuilder *builder, char *line, size_t size);
+
+/**
+ * @brief Generate one line of repeated 'a' (sometimes with a terminating character).
+ *
+ * @param builder Pointer to the builder
+ * @param line Output buffer
+ * @param size Size of the output buffer
+ *
+ * @return Length of the line.
+ */
+static size_t corpus_generate_pathological_line(CorpusBuilder *builder, char *line, size_t size);
+
+void corpus_generate(Corpus *corpus, CorpusKind kind, size_t bytes, uint64_t seed) {
+    *corpus = (Corpus){0};
+    corpus->kind = kind;
+
+    CorpusBuilder builder = {
+        .corpus = corpus,
+        .rng = seed ? seed : 0x9E3779B97F4A7C15ull,
+    };
+
+    // Big enough for the stack traces
+    char line[16 * 1024];
+    while (corpus->bytes < bytes) {
+        size_t len = 0;
+        switch (kind) {
+            case CORPUS_KIND_LOG:
+                len = corpus_generate_log_line(&builder, line, sizeof(line));
+                break;
+            case CORPUS_KIND_TEXT:
+                len = corpus_generate_text_line(&builder, line, sizeof(line));
+                break;
+            case CORPUS_KIND_UTF8:
+                len = corpus_generate_utf8_line(&builder, line, sizeof(line));
+                break;
+            case CORPUS_KIND_SHORT:
+                len = corpus_generate_short_line(&builder, line, sizeof(line));
+                break;
+            case CORPUS_KIND_STACK:
+                len = corpus_generate_stack_line(&builder, line, sizeof(line));
+                break;
+            case CORPUS_KIND_PATHOLOGICAL:
+            default:
+                len = corpus_generate_pathological_line(&builder, line, sizeof(line));
+                break;
+        }
+        corpus_builder_add_line(&builder, line, len);
+    }
+}
+
+void corpus_destroy(Corpus *corpus) {
+    free(corpus->data);
+    free(corpus->offsets);
+    free(corpus->lengths);
+    *corpus = (Corpus){0};
+}
+
+const char *corpus_kind_name(CorpusKind kind) {
+    switch (kind) {
+        case CORPUS_KIND_LOG:
+            return "log";
+        case CORPUS_KIND_TEXT:
+            return "text";
+        case CORPUS_KIND_PATHOLOGICAL:
+            return "pathological";
+        case CORPUS_KIND_UTF8:
+            return "utf8";
+        case CORPUS_KIND_SHORT:
+            return "short";
+        case CORPUS_KIND_STACK:
+            return "stack";
+        default:
+            return "unknown";
+    }
+}
+
+static uint64_t corpus_builder_random(CorpusBuilder *builder) {
+    builder->rng ^= builder->rng >> 12;
+    builder->rng ^= builder->rng << 25;
+    builder->rng ^= builder->rng >> 27;
+    return builder->rng * 0x2545F4914F6CDD1Dull;
+}
+
+static size_t corpus_builder_random_below(CorpusBuilder *builder, size_t bound) {
+    return (size_t)(corpus_builder_random(builder) % bound);
+}
+
+static void corpus_builder_add_line(CorpusBuilder *builder, const char *line, size_t len) {
+    Corpus *corpus = builder->corpus;
+
+    size_t data_len = corpus->line_count ? corpus->offsets[corpus->line_count - 1] + corpus->lengths[corpus->line_count - 1] + 1 : 0;
+    if (data_len + len + 1 > builder->data_capacity) {
+        builder->data_capacity = (builder->data_capacity + len + 1) * 2;
+        corpus->data = realloc(corpus->data, builder->data_capacity);
+    }
+
+    if (corpus->line_count == builder->line_capacity) {
+        builder->line_capacity = builder->line_capacity ? builder->line_capacity * 2 : 1024;
+        corpus->offsets = realloc(corpus->offsets, builder->line_capacity * sizeof(size_t));
+        corpus->lengths = realloc(corpus->lengths, builder->line_capacity * sizeof(size_t));
+    }
+
+    if (!corpus->data || !corpus->offsets || !corpus->lengths) {
+        LOG_ERROR("Failed to allocate memory for the corpus");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(corpus->data + data_len, line, len);
+    corpus->data[data_len + len] = 0;
+    corpus->offsets[corpus->line_count] = data_len;
+    corpus->lengths[corpus->line_count] = len;
+    corpus->line_count++;
+    corpus->bytes += len;
+}
+
+static size_t corpus_generate_log_line(CorpusBuilder *builder, char *line, size_t size) {
+    int len = snprintf(line, size, "2024-%02zu-%02zuT%02zu:%02zu:%02zu.%03zuZ %-5s [%s] ",
+        1 + corpus_builder_random_below(builder, 12), 1 + corpus_builder_random_below(builder, 28),
+        corpus_builder_random_below(builder, 24), corpus_builder_random_below(builder, 60),
+        corpus_builder_random_below(builder, 60), corpus_builder_random_below(builder, 1000),
+        log_levels[corpus_builder_random_below(builder, ARRAY_LEN(log_levels))],
+        log_components[corpus_builder_random_below(builder, ARRAY_LEN(log_components))]);
+
+    switch (corpus_builder_random_below(builder, 4)) {
+        case 0:
+            len += snprintf(line + len, size - len, "%s %s/%zu %zu latency=%zums",
+                http_methods[corpus_builder_random_below(builder, ARRAY_LEN(http_methods))],
+                http_paths[corpus_builder_random_below(builder, ARRAY_LEN(http_paths))],
+                corpus_builder_random_below(builder, 100000),
+                corpus_builder_random_below(builder, 8) ? (size_t)200 : (size_t)500,
+                corpus_builder_random_below(builder, 2000));
+            break;
+        case 1:
+            len += snprintf(line + len, size - len, "user=%s ip=%zu.%zu.%zu.%zu action=login status=%s",
+                log_users[corpus_builder_random_below(builder, ARRAY_LEN(log_users))],
+                corpus_builder_random_below(builder, 256), corpus_builder_random_below(builder, 256),
+                corpus_builder_random_below(builder, 256), corpus_builder_random_below(builder, 256),
+                corpus_builder_random_below(builder, 10) ? "ok" : "denied");
+            break;
+        case 2:
+            len += snprintf(line + len, size - len, "query took %zums rows=%zu",
+                corpus_builder_random_below(builder, 5000), corpus_builder_random_below(builder, 100000));
+            break;
+        default:
+            len += snprintf(line + len, size - len, "connection to worker-%zu closed%s",
+                corpus_builder_random_below(builder, 64),
+                corpus_builder_random_below(builder, 16) ? "" : " after timeout");
+            break;
+    }
+
+    return (size_t)len < size ? (size_t)len : size - 1;
+}
+
+static size_t corpus_generate_text_line(CorpusBuilder *builder, char *line, size_t size) {
+    size_t target = 40 + corpus_builder_random_below(builder, 80);
+    size_t len = 0;
+
+    while (len < target && len + 32 < size) {
+        if (len) line[len++] = ' ';
+        if (corpus_builder_random_below(builder, 4)) {
+            const char *word = text_words[corpus_builder_random_below(builder, ARRAY_LEN(text_words))];
+            size_t word_len = strlen(word);
+            memcpy(line + len, word, word_len);
+            len += word_len;
+        } else {
+            size_t word_len = 1 + corpus_builder_random_below(builder, 10);
+            for (size_t i = 0; i < word_len; ++i)
+                line[len++] = (char)('a' + corpus_builder_random_below(builder, 26));
+        }
+    }
+
+    return len;
+}
+
+static size_t corpus_generate_utf8_line(CorpusBuilder *builder, char *line, size_t size) {
+    int len = snprintf(line, size, "%-5s [%s] код=%zu ",
+        log_levels[corpus_builder_random_below(builder, ARRAY_LEN(log_levels))],
+        log_components[corpus_builder_random_below(builder, ARRAY_LEN(log_components))],
+        corpus_builder_random_below(builder, 1000));
+
+    size_t words = 4 + corpus_builder_random_below(builder, 10);
+    for (size_t i = 0; i < words && (size_t)len + 64 < size; ++i)
+        len += snprintf(line + len, size - len, "%s%s", i ? " " : "",
+            utf8_words[corpus_builder_random_below(builder, ARRAY_LEN(utf8_words))]);
+
+    return (size_t)len;
+}
+
+static size_t corpus_generate_short_line(CorpusBuilder *builder, char *line, size_t size) {
+    if (corpus_builder_random_below(builder, 2)) {
+        const char *value = header_values[corpus_builder_random_below(builder, ARRAY_LEN(header_values))];
+        size_t len = strlen(value);
+        memcpy(line, value, len);
+        return len;
+    }
+
+    // Usernames, some of them with characters that are not allowed
+    size_t len = 3 + corpus_builder_random_below(builder, 14);
+    for (size_t i = 0; i < len && i + 1 < size; ++i) {
+        size_t kind = corpus_builder_random_below(builder, 16);
+        if (kind < 12) line[i] = (char)('a' + corpus_builder_random_below(builder, 26));
+        else if (kind < 14) line[i] = (char)('0' + corpus_builder_random_below(builder, 10));
+        else if (kind < 15) line[i] = '_';
+        else line[i] = "-.@ "[corpus_builder_random_below(builder, 4)];
+    }
+
+    return len < size ? len : size - 1;
+}
+
+static size_t corpus_generate_stack_line(CorpusBuilder *builder, char *line, size_t size) {
+    size_t len = corpus_generate_log_line(builder, line, size);
+    len += snprintf(line + len, size - len, " %s",
+        stack_exceptions[corpus_builder_random_below(builder, ARRAY_LEN(stack_exceptions))]);
+
+    // 16 to 256 frames, ending with the frames left out
+    size_t frames = 16 + corpus_builder_random_below(builder, 240);
+    for (size_t i = 0; i < frames && len + 128 < size; ++i)
+        len += snprintf(line + len, size - len, " at %s(%s.java:%zu)",
+            stack_methods[corpus_builder_random_below(builder, ARRAY_LEN(stack_methods))],
+            corpus_builder_random_below(builder, 2) ? "Main" : "Worker", 1 + corpus_builder_random_below(builder, 900));
+    len += snprintf(line + len, size - len, " ... %zu more", 1 + corpus_builder_random_below(builder, 64));
+
+    return len < size ? len : size - 1;
+}
+
+static size_t corpus_generate_pathological_line(CorpusBuilder *builder, char *line, size_t size) {
+    size_t len = 16 + corpus_builder_random_below(builder, 496);
+    if (len >= size) len = size - 1;
+
+    memset(line, 'a', len);
+    // Only few lines let the pathological patterns succeed
+    if (!corpus_builder_random_below(builder, 8)) line[len - 1] = corpus_builder_random_below(builder, 2) ? 'b' : 'c';
+
+    return len;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @enum CorpusKind
+ * @brief Kinds of synthetic corpora the benchmarks can generate.
+ */
+typedef enum CorpusKind {
+    CORPUS_KIND_LOG, /**< Log lines (timestamp, level, component, message) */
+    CORPUS_KIND_TEXT, /**< Random words and letters */
+    CORPUS_KIND_PATHOLOGICAL, /**< Long runs of 'a' for patterns like a*a*a*b */
+    CORPUS_KIND_UTF8, /**< Log lines mixing Latin, Cyrillic, Greek and CJK text */
+    CORPUS_KIND_SHORT, /**< Short strings like usernames and HTTP header values */
+    CORPUS_KIND_STACK, /**< Log lines followed by a stack trace on the same line (kilobytes long) */
+    CORPUS_KIND_COUNT
+} CorpusKind;
+
+/**
+ * @struct Corpus corpus.h
+ * @brief A set of lines generated deterministically from a seed.
+ *
+ * Every line is NUL-terminated (without the trailing new line) inside one
+ * buffer so it can be passed directly to regex_pattern_in_line().
+ */
+typedef struct Corpus {
+    CorpusKind kind; /**< The kind of the corpus */
+    char *data; /**< All the lines, each one NUL-terminated */
+    size_t *offsets; /**< Offset of each line in data */
+    size_t *lengths; /**< Length of each line (without NUL) */
+    size_t line_count; /**< Number of lines */
+    size_t bytes; /**< Total bytes in all lines (without NULs) */
+} Corpus;
+
+/**
+ * @brief Generate a corpus of at least the given size.
+ *
+ * The same kind, size and seed always generate the same corpus.
+ *
+ * @param corpus Pointer to the corpus
+ * @param kind The kind of corpus to generate
+ * @param bytes Minimum number of bytes to generate
+ * @param seed Seed of the pseudo random generator
+ */
+void corpus_generate(Corpus *corpus, CorpusKind kind, size_t bytes, uint64_t seed);
+
+/**
+ * @brief Free the corpus.
+ *
+ * @param corpus Pointer to the corpus
+ */
+void corpus_destroy(Corpus *corpus);
+
+/**
+ * @brief Get the line at given index.
+ *
+ * @param corpus Pointer to the corpus
+ * @param index Index of the line
+ *
+ * @return NUL-terminated line.
+ */
+static inline const char *corpus_line(const Corpus *corpus, size_t index) {
+    return corpus->data + corpus->offsets[index];
+}
+
+/**
+ * @brief Get the name of the corpus kind (used in reports).
+ *
+ * @param kind The corpus kind
+ *
+ * @return Name of the kind.
+ */
+const char *corpus_kind_name(CorpusKind kind);
@@ -0,0 +1,178 @@
+#include "harness.h"
+
+#include "src/logger.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+const BenchCase bench_cases[] = {
+    // Patterns from README
+    {"text/literal", "saw", CORPUS_KIND_TEXT, REGEX_FLAG_NONE},
+    {"text/optional", "sa?w", CORPUS_KIND_TEXT, REGEX_FLAG_NONE},
+    {"text/star", "sa*w", CORPUS_KIND_TEXT, REGEX_FLAG_NONE},
+    {"text/class_plus", "s[aeiou]+w", CORPUS_KIND_TEXT, REGEX_FLAG_NONE},
+    {"text/negated_class", "s[^A-Z]w", CORPUS_KIND_TEXT, REGEX_FLAG_NONE},
+    {"text/anchor_start", "^some", CORPUS_KIND_TEXT, REGEX_FLAG_NONE},
+    {"text/anchor_end", "y$", CORPUS_KIND_TEXT, REGEX_FLAG_NONE},
+    {"text/anchors_dot_star", "^some.*y$", CORPUS_KIND_TEXT, REGEX_FLAG_NONE},
+    {"text/alternation", "nobody|somebody", CORPUS_KIND_TEXT, REGEX_FLAG_NONE},
+    {"text/anchored_alternation", "somebody$|^nobody|saw", CORPUS_KIND_TEXT, REGEX_FLAG_NONE},
+    {"text/group_alternation", "s(a|b|c)+w", CORPUS_KIND_TEXT, REGEX_FLAG_NONE},
+    {"text/nested_group", "s((ac)*b)+w", CORPUS_KIND_TEXT, REGEX_FLAG_NONE},
+    // Log searching
+    {"log/literal", "ERROR", CORPUS_KIND_LOG, REGEX_FLAG_NONE},
+    {"log/anchored_literal", "^2024-12", CORPUS_KIND_LOG, REGEX_FLAG_NONE},
+    {"log/suffix", "timeout$", CORPUS_KIND_LOG, REGEX_FLAG_NONE},
+    {"log/user_class", "user=[a-z]+ ", CORPUS_KIND_LOG, REGEX_FLAG_NONE},
+    {"log/ipv4", "[0-9]+\\.[0-9]+\\.[0-9]+\\.[0-9]+", CORPUS_KIND_LOG, REGEX_FLAG_NONE},
+    {"log/http_alternation", "(GET|POST|PUT) /api/v[0-9]/(users|orders)", CORPUS_KIND_LOG, REGEX_FLAG_NONE},
+    {"log/status_500", " 500 latency=[0-9]+ms$", CORPUS_KIND_LOG, REGEX_FLAG_NONE},
+    {"log/dot_star", "auth.*denied", CORPUS_KIND_LOG, REGEX_FLAG_NONE},
+    {"log/icase_literal", "error", CORPUS_KIND_LOG, REGEX_FLAG_ICASE},
+    {"log/icase_class", "USER=[a-z]+ IP=", CORPUS_KIND_LOG, REGEX_FLAG_ICASE},
+    {"log/icase_alternation", "(get|post) /API/v[0-9]/", CORPUS_KIND_LOG, REGEX_FLAG_ICASE},
+    // Pathological inputs
+    {"pathological/star_chain", "a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*b", CORPUS_KIND_PATHOLOGICAL, REGEX_FLAG_NONE},
+    {"pathological/optional_chain", "a?a?a?a?a?a?a?a?a?a?a?a?a?a?a?a?aaaaaaaaaaaaaaaab", CORPUS_KIND_PATHOLOGICAL, REGEX_FLAG_NONE},
+    {"pathological/nested_alternation", "(a|aa)+c", CORPUS_KIND_PATHOLOGICAL, REGEX_FLAG_NONE},
+    {"pathological/dot_star_chain", "a.*a.*a.*a.*b", CORPUS_KIND_PATHOLOGICAL, REGEX_FLAG_NONE},
+    {"pathological/dfa_blowup", "a............b", CORPUS_KIND_PATHOLOGICAL, REGEX_FLAG_NONE},
+    // Mixed script text, same patterns in ASCII (byte) and UTF-8 mode
+    {"utf8/literal/ascii", "ошибка", CORPUS_KIND_UTF8, REGEX_FLAG_NONE},
+    {"utf8/literal/utf8", "ошибка", CORPUS_KIND_UTF8, REGEX_FLAG_UTF8},
+    {"utf8/dot_star/ascii", "ошибка.*σφάλμα", CORPUS_KIND_UTF8, REGEX_FLAG_NONE},
+    {"utf8/dot_star/utf8", "ошибка.*σφάλμα", CORPUS_KIND_UTF8, REGEX_FLAG_UTF8},
+    {"utf8/dots/ascii", "^ERROR.*接.", CORPUS_KIND_UTF8, REGEX_FLAG_NONE},
+    {"utf8/dots/utf8", "^ERROR.*接.", CORPUS_KIND_UTF8, REGEX_FLAG_UTF8},
+    {"utf8/class/utf8", "[а-яё]+ [α-ω]+", CORPUS_KIND_UTF8, REGEX_FLAG_UTF8},
+    {"utf8/negated_class/utf8", "=[0-9]+ [^a-zа-я ]+ ", CORPUS_KIND_UTF8, REGEX_FLAG_UTF8},
+    {"utf8/icase/utf8", "ОШИБКА.*Σφάλμα", CORPUS_KIND_UTF8, REGEX_FLAG_UTF8 | REGEX_FLAG_ICASE},
+    // Millions of short strings
+    {"short/literal", "admin", CORPUS_KIND_SHORT, REGEX_FLAG_NONE},
+    {"short/username", "^[a-z][a-z0-9_]*$", CORPUS_KIND_SHORT, REGEX_FLAG_NONE},
+    {"short/bots", "bot|crawler|spider|curl", CORPUS_KIND_SHORT, REGEX_FLAG_ICASE},
+    {"short/mime", "^(text|application)/[a-z]+", CORPUS_KIND_SHORT, REGEX_FLAG_NONE},
+    // Kilobytes long lines
+    {"stack/suffix", "\\.\\.\\. [0-9]+ more$", CORPUS_KIND_STACK, REGEX_FLAG_NONE},
+    {"stack/suffix_alternation", "(Main|Worker)\\.java:[0-9]+\\)$|[1-9] more$", CORPUS_KIND_STACK, REGEX_FLAG_NONE},
+    {"stack/anchored", "^[0-9-]+T[0-9:.]+Z ERROR", CORPUS_KIND_STACK, REGEX_FLAG_NONE},
+    {"stack/absent_literal", "OutOfMemoryError", CORPUS_KIND_STACK, REGEX_FLAG_NONE},
+    {"stack/component_dot_star", "\\[db\\].*NullPointerException", CORPUS_KIND_STACK, REGEX_FLAG_NONE},
+    // Word-bounded keywords
+    {"text/word_keyword", "\\bsaw\\b", CORPUS_KIND_TEXT, REGEX_FLAG_NONE},
+    {"text/word_suffix", "\\Bbody\\b", CORPUS_KIND_TEXT, REGEX_FLAG_NONE},
+    {"log/word_keywords", "\\b(worker|timeout|denied)\\b", CORPUS_KIND_LOG, REGEX_FLAG_NONE},
+    {"short/word_bots", "\\b(bot|curl)\\b", CORPUS_KIND_SHORT, REGEX_FLAG_ICASE},
+};
+
+const size_t bench_case_count = sizeof(bench_cases) / sizeof(bench_cases[0]);
+
+double bench_now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+void bench_generate_corpora(Corpus *corpora, size_t bytes, uint64_t seed) {
+    // Pathological inputs are orders of magnitude slower, keep them small
+    for (int kind = 0; kind < CORPUS_KIND_COUNT; ++kind)
+        corpus_generate(&corpora[kind], (CorpusKind)kind,
+            kind == CORPUS_KIND_PATHOLOGICAL ? bytes / 16 + 1 : bytes, seed + kind);
+}
+
+bool bench_engine_flags(const char *name, int *flags) {
+    if (!strcmp(name, "auto")) *flags = REGEX_FLAG_NONE;
+    else if (!strcmp(name, "nfa")) *flags = REGEX_FLAG_NO_DFA | REGEX_FLAG_NO_SHIFT_AND;
+    else if (!strcmp(name, "dfa")) *flags = REGEX_FLAG_NO_SHIFT_AND;
+    else if (!strcmp(name, "shift-and")) *flags = REGEX_FLAG_NO_DFA;
+    else return false;
+
+    return true;
+}
+
+RegexInput *bench_corpus_inputs(const Corpus *corpus) {
+    RegexInput *inputs = malloc(corpus->line_count * sizeof(RegexInput));
+    if (!inputs) {
+        LOG_ERROR("Failed to allocate memory for the inputs");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < corpus->line_count; ++i)
+        inputs[i] = (RegexInput){corpus_line(corpus, i), corpus->lengths[i]};
+
+    return inputs;
+}
+
+void bench_write_json_string(FILE *out, const char *str) {
+    fputc('"', out);
+    for (; *str; ++str) {
+        switch (*str) {
+            case '"':
+            case '\\':
+                fputc('\\', out);
+                /* fallthrough */
+            default:
+                if ((unsigned char)*str < 0x20) fprintf(out, "\\u%04x", (unsigned char)*str);
+                else fputc(*str, out);
+                break;
+        }
+    }
+    fputc('"', out);
+}
+
+bool bench_parse_arguments(BenchCommonOptions *common, int argc, const char **argv, BenchOptionParser parse,
+    void *options) {
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc) {
+            LOG_ERROR("Expected value after '%s'", argv[i]);
+            return false;
+        }
+
+        const char *name = argv[i], *value = argv[++i];
+        if (!strcmp(name, "--out")) common->out_path = value;
+        else if (!strcmp(name, "--filter")) common->filter = value;
+        else if (!strcmp(name, "--size")) common->corpus_bytes = strtoull(value, NULL, 10);
+        else if (!strcmp(name, "--seed")) common->seed = strtoull(value, NULL, 10);
+        else if (!parse || !parse(options, name, value)) {
+            LOG_ERROR("Invalid option '%s %s'", name, value);
+            return false;
+        }
+
+        if (!strcmp(name, "--size") && !common->corpus_bytes) {
+            LOG_ERROR("Size should be greater than zero");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+uint64_t bench_hash(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+char *bench_join_lines(const Corpus *corpus, size_t *len) {
+    char *data = malloc(corpus->bytes + corpus->line_count + 1);
+    if (!data) {
+        LOG_ERROR("Failed to allocate %zu bytes of lines", corpus->bytes + corpus->line_count);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t written = 0;
+    for (size_t i = 0; i < corpus->line_count; ++i) {
+        memcpy(data + written, corpus_line(corpus, i), corpus->lengths[i]);
+        written += corpus->lengths[i];
+        data[written++] = '\n';
+    }
+    data[written] = '\0';
+
+    *len = written;
+    return data;
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "corpus.h"
+
+#include "src/regex.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/**
+ * @struct BenchCase
+ * @brief A pattern and the corpus it is run against.
+ */
+typedef struct BenchCase {
+    const char *name; /**< Unique name (used to compare with baseline) */
+    const char *pattern; /**< The regex */
+    CorpusKind corpus; /**< The corpus to scan */
+    int flags; /**< RegexFlag used to compile the pattern */
+} BenchCase;
+
+/**
+ * @struct BenchCommonOptions
+ * @brief Command line options shared by the benchmarks (see @ref bench_parse_arguments).
+ */
+typedef struct BenchCommonOptions {
+    const char *out_path; /**< Write JSON here instead of stdout ("--out") */
+    const char *filter; /**< Only run cases whose name contains this ("--filter") */
+    size_t corpus_bytes; /**< Size of each corpus ("--size") */
+    uint64_t seed; /**< Seed for corpus generation ("--seed") */
+} BenchCommonOptions;
+
+/**
+ * @brief Parse one option of a benchmark besides the common ones.
+ *
+ * @param options Pointer to the options of the benchmark
+ * @param name The option (like "--min-time")
+ * @param value Its value
+ *
+ * @return false if the option is unknown or its value is invalid.
+ */
+typedef bool (*BenchOptionParser)(void *options, const char *name, const char *value);
+
+/**
+ * @brief Starting value of @ref bench_hash (the FNV-1a offset basis).
+ */
+#define BENCH_HASH_START 14695981039346656037ULL
+
+/**
+ * @brief The pattern matrix shared by all the benchmarks.
+ */
+extern const BenchCase bench_cases[];
+
+/**
+ * @brief Number of entries in @ref bench_cases.
+ */
+extern const size_t bench_case_count;
+
+/**
+ * @brief Get the current time in seconds.
+ *
+ * @return Time in seconds.
+ */
+double bench_now(void);
+
+/**
+ * @brief Generate all the corpora used by @ref bench_cases.
+ *
+ * @param corpora Array of CORPUS_KIND_COUNT corpora
+ * @param bytes Size of each corpus (pathological ones are smaller)
+ * @param seed Seed for the generation
+ */
+void bench_generate_corpora(Corpus *corpora, size_t bytes, uint64_t seed);
+
+/**
+ * @brief Get the RegexFlag selecting the matching engine.
+ *
+ * @param name Name of the engine ("auto", "dfa" or "shift-and" with nfa fallback, "nfa")
+ * @param flags Pointer to store the flags
+ *
+ * @return false if the engine is unknown.
+ */
+bool bench_engine_flags(const char *name, int *flags);
+
+/**
+ * @brief Get the lines of the corpus as inputs of @ref regex_match_batch.
+ *
+ * @param corpus The corpus
+ *
+ * @return Malloced array of corpus->line_count inputs.
+ */
+RegexInput *bench_corpus_inputs(const Corpus *corpus);
+
+/**
+ * @brief Write the JSON string (with quotes) escaping special characters.
+ *
+ * @param out The output file
+ * @param str The string
+ */
+void bench_write_json_string(FILE *out, const char *str);
+
+/**
+ * @brief Parse the "--name value" pairs of the command line.
+ *
+ * "--out", "--filter", "--size" and "--seed" go to the common options, the
+ * other ones to the parser of the benchmark. The size can't be zero.
+ *
+ * @param common Pointer to the common options, holding their defaults
+ * @param argc Number of arguments
+ * @param argv The arguments
+ * @param parse Parser of the other options (NULL if the benchmark has none)
+ * @param options Pointer to the options given to parse
+ *
+ * @return false if the arguments are invalid (the error is logged).
+ */
+bool bench_parse_arguments(BenchCommonOptions *common, int argc, const char **argv, BenchOptionParser parse,
+    void *options);
+
+/**
+ * @brief Add the bytes to a FNV-1a hash (used to check that versions of a benchmark give the same results).
+ *
+ * @param hash The hash so far (BENCH_HASH_START at first)
+ * @param data The bytes
+ * @param len Number of bytes
+ *
+ * @return The new hash.
+ */
+uint64_t bench_hash(uint64_t hash, const void *data, size_t len);
+
+/**
+ * @brief Join the lines of the corpus with new lines into one buffer.
+ *
+ * @param corpus The corpus
+ * @param len Pointer to store the length of the buffer
+ *
+ * @return Malloced buffer (NUL-terminated).
+ */
+char *bench_join_lines(const Corpus *corpus, size_t *len);
@@ -0,0 +1,279 @@
+#include "harness.h"
+
+#include "src/incremental.h"
+#include "src/logger.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @struct IncrementalBenchOptions
+ * @brief Command line options of the incremental matching benchmark.
+ */
+typedef struct IncrementalBenchOptions {
+    BenchCommonOptions common; /**< Output, filter, corpus size and seed (of the edits too) */
+    size_t updates; /**< Number of appends and of edits measured */
+    size_t checkpoint_bytes; /**< Bytes between two checkpoints (0 for the default) */
+} IncrementalBenchOptions;
+
+/**
+ * @enum IncrementalBenchScenario
+ * @brief How the text changes between two updates.
+ */
+typedef enum IncrementalBenchScenario {
+    INCREMENTAL_BENCH_APPEND, /**< The text starts with half of the lines, a line is appended each time */
+    INCREMENTAL_BENCH_EDIT, /**< A byte anywhere in the text is replaced each time */
+    INCREMENTAL_BENCH_SCENARIO_COUNT
+} IncrementalBenchScenario;
+
+/**
+ * @enum IncrementalBenchVersion
+ * @brief The ways of keeping the matching lines up to date.
+ */
+typedef enum IncrementalBenchVersion {
+    INCREMENTAL_BENCH_RESCAN, /**< regex_iterator_next_line() over the whole text after each change */
+    INCREMENTAL_BENCH_INCREMENTAL, /**< incremental_append() or incremental_edit() */
+    INCREMENTAL_BENCH_VERSION_COUNT
+} IncrementalBenchVersion;
+
+/**
+ * @struct IncrementalBenchRun
+ * @brief Measurements of one version in one scenario.
+ */
+typedef struct IncrementalBenchRun {
+    double seconds; /**< Seconds per update */
+    unsigned long long stepped_bytes; /**< Bytes stepped by all the updates */
+    uint64_t lines_hash; /**< FNV-1a hash of the number of matching lines after each update, and of the last ones */
+} IncrementalBenchRun;
+
+/**
+ * @brief Names of the scenarios in the JSON output.
+ */
+static const char *const incremental_bench_scenario_names[] = {"append", "edit"};
+
+/**
+ * @brief Names of the versions in the JSON output.
+ */
+static const char *const incremental_bench_version_names[] = {"rescan", "incremental"};
+
+/**
+ * @brief Parse an option of the benchmark (see BenchOptionParser).
+ *
+ * @param options Pointer to the IncrementalBenchOptions
+ * @param name The option
+ * @param value Its value
+ *
+ * @return false if the option is unknown or its value is invalid.
+ */
+static bool incremental_bench_parse_option(void *options, const char *name, const char *value);
+
+/**
+ * @brief Make the changes of the scenario to a copy of the text, keeping the matching lines up to date.
+ *
+ * @param regex Pointer to the regex
+ * @param data The text
+ * @param len Length of the text
+ * @param options Pointer to the options
+ * @param scenario How the text changes
+ * @param version How the lines are kept up to date
+ * @param run Pointer to store the measurements
+ */
+static void incremental_bench_run(Regex *regex, const char *data, size_t len, const IncrementalBenchOptions *options,
+    IncrementalBenchScenario scenario, IncrementalBenchVersion version, IncrementalBenchRun *run);
+
+int main(int argc, const char **argv) {
+    IncrementalBenchOptions options = {
+        .common = {.corpus_bytes = 4 * 1024 * 1024, .seed = 42},
+        .updates = 100,
+    };
+
+    bool valid = bench_parse_arguments(&options.common, argc, argv, incremental_bench_parse_option, &options);
+    if (valid && !options.updates) {
+        LOG_ERROR("Updates should be greater than zero");
+        valid = false;
+    }
+    if (!valid) {
+        LOG_INFO("Usage: regexer_incremental_bench [--out <file>] [--filter <name>] [--size <bytes>]"
+            " [--updates <count>] [--checkpoint <bytes>] [--seed <seed>]");
+        return EXIT_FAILURE;
+    }
+
+    Corpus corpora[CORPUS_KIND_COUNT];
+    bench_generate_corpora(corpora, options.common.corpus_bytes, options.common.seed);
+    char *buffers[CORPUS_KIND_COUNT];
+    size_t lengths[CORPUS_KIND_COUNT];
+    for (int kind = 0; kind < CORPUS_KIND_COUNT; ++kind)
+        buffers[kind] = bench_join_lines(&corpora[kind], &lengths[kind]);
+
+    FILE *out = stdout;
+    if (options.common.out_path && !(out = fopen(options.common.out_path, "w"))) {
+        LOG_ERROR("Failed to open '%s' for writing", options.common.out_path);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"version\": 1,\n");
+    fprintf(out, "  \"corpus_bytes\": %zu,\n", options.common.corpus_bytes);
+    fprintf(out, "  \"updates\": %zu,\n", options.updates);
+    fprintf(out, "  \"results\": [\n");
+
+    bool consistent = true, first = true;
+    for (size_t i = 0; i < bench_case_count; ++i) {
+        const BenchCase *bench_case = &bench_cases[i];
+        if (options.common.filter && !strstr(bench_case->name, options.common.filter)) continue;
+
+        // A log viewer filtering the lines of a document
+        Regex regex;
+        RegexOptions regex_options = {.flags = bench_case->flags | REGEX_FLAG_MULTILINE};
+        regex_create_with_options(&regex, bench_case->pattern, &regex_options);
+
+        fprintf(out, "%s    {\"name\": ", first ? "" : ",\n");
+        bench_write_json_string(out, bench_case->name);
+        fprintf(out, ", \"pattern\": ");
+        bench_write_json_string(out, bench_case->pattern);
+        fprintf(out, ", \"dfa\": %s", regex.use_dfa ? "true" : "false");
+        first = false;
+
+        for (int scenario = 0; scenario < INCREMENTAL_BENCH_SCENARIO_COUNT; ++scenario) {
+            IncrementalBenchRun runs[INCREMENTAL_BENCH_VERSION_COUNT];
+            for (int version = 0; version < INCREMENTAL_BENCH_VERSION_COUNT; ++version) {
+                incremental_bench_run(&regex, buffers[bench_case->corpus], lengths[bench_case->corpus], &options,
+                    (IncrementalBenchScenario)scenario, (IncrementalBenchVersion)version, &runs[version]);
+            }
+
+            if (runs[INCREMENTAL_BENCH_INCREMENTAL].lines_hash != runs[INCREMENTAL_BENCH_RESCAN].lines_hash) {
+                LOG_ERROR("'%s': the lines found incrementally after each %s differ from rescanning", bench_case->name,
+                    incremental_bench_scenario_names[scenario]);
+                consistent = false;
+            }
+
+            const char *name = incremental_bench_scenario_names[scenario];
+            for (int version = 0; version < INCREMENTAL_BENCH_VERSION_COUNT; ++version) {
+                fprintf(out, ", \"%s_%s_us\": %.3lf", name, incremental_bench_version_names[version],
+                    runs[version].seconds * 1e6);
+            }
+            fprintf(out, ", \"%s_stepped_bytes\": %.1lf, \"%s_speedup\": %.3lf", name,
+                (double)runs[INCREMENTAL_BENCH_INCREMENTAL].stepped_bytes / options.updates, name,
+                runs[INCREMENTAL_BENCH_RESCAN].seconds / runs[INCREMENTAL_BENCH_INCREMENTAL].seconds);
+        }
+        fprintf(out, "}");
+
+        regex_destroy(&regex);
+    }
+
+    fprintf(out, "\n  ],\n");
+    fprintf(out, "  \"consistent\": %s\n", consistent ? "true" : "false");
+    fprintf(out, "}\n");
+
+    if (out != stdout) fclose(out);
+    for (int kind = 0; kind < CORPUS_KIND_COUNT; ++kind) {
+        free(buffers[kind]);
+        corpus_destroy(&corpora[kind]);
+    }
+
+    return consistent ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool incremental_bench_parse_option(void *options, const char *name, const char *value) {
+    IncrementalBenchOptions *incremental_options = options;
+    if (!strcmp(name, "--updates")) incremental_options->updates = strtoull(value, NULL, 10);
+    else if (!strcmp(name, "--checkpoint")) incremental_options->checkpoint_bytes = strtoull(value, NULL, 10);
+    else return false;
+
+    return true;
+}
+
+static void incremental_bench_run(Regex *regex, const char *data, size_t len, const IncrementalBenchOptions *options,
+    IncrementalBenchScenario scenario, IncrementalBenchVersion version, IncrementalBenchRun *run) {
+    *run = (IncrementalBenchRun){.lines_hash = BENCH_HASH_START};
+
+    char *text = malloc(len + 1);
+    if (!text) {
+        LOG_ERROR("Failed to allocate %zu bytes of text", len);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(text, data, len);
+
+    // Appends start from the first half of the lines, edits change the whole text
+    size_t text_len = len;
+    if (scenario == INCREMENTAL_BENCH_APPEND) {
+        const char *new_line = memchr(text + len / 2, '\n', len - len / 2);
+        text_len = new_line ? (size_t)(new_line - text) + 1 : len;
+    }
+
+    // The lines are those of regex_iterator_create(), the end of the text ends the last line
+    Incremental incremental;
+    IncrementalOptions incremental_options = {.checkpoint_bytes = options->checkpoint_bytes, .flags = REGEX_MATCH_EOL};
+    if (version == INCREMENTAL_BENCH_INCREMENTAL) {
+        incremental_create(&incremental, regex, &incremental_options);
+        incremental_append(&incremental, text, text_len, NULL);
+    }
+
+    uint64_t random = options->common.seed | 1;
+    size_t line_count = 0;
+    double start = bench_now();
+    for (size_t update = 0; update < options->updates; ++update) {
+        size_t offset = text_len, removed = 0, inserted = 0;
+        if (scenario == INCREMENTAL_BENCH_APPEND) {
+            // The next line, or the first one again once the text is whole
+            const char *source = text_len < len ? text + text_len : text;
+            size_t available = text_len < len ? len - text_len : text_len;
+            const char *new_line = memchr(source, '\n', available);
+            inserted = new_line ? (size_t)(new_line - source) + 1 : available;
+            if (text_len + inserted > len) {
+                text = realloc(text, text_len + inserted + 1);
+                if (!text) {
+                    LOG_ERROR("Failed to grow the text to %zu bytes", text_len + inserted);
+                    exit(EXIT_FAILURE);
+                }
+                memmove(text + text_len, text, inserted);
+                len = text_len + inserted;
+            }
+        } else {
+            // xorshift64, a byte replaced by the byte of another place
+            random ^= random << 13;
+            random ^= random >> 7;
+            random ^= random << 17;
+            offset = random % text_len;
+            removed = inserted = 1;
+            text[offset] = text[(random >> 32) % text_len];
+        }
+        text_len += inserted - removed;
+
+        if (version == INCREMENTAL_BENCH_INCREMENTAL) {
+            IncrementalSummary summary;
+            if (!incremental_edit(&incremental, text, text_len, offset, removed, inserted, &summary)) {
+                LOG_ERROR("Replacing %zu bytes at %zu by %zu bytes doesn't give %zu bytes", removed, offset, inserted,
+                    text_len);
+                exit(EXIT_FAILURE);
+            }
+            run->stepped_bytes += summary.stopped_at - summary.resumed_at;
+            line_count = incremental.line_count;
+        } else {
+            RegexIterator iterator;
+            RegexLine line;
+            regex_iterator_create(&iterator, regex, text, text_len);
+            for (line_count = 0; regex_iterator_next_line(&iterator, &line); ++line_count) {}
+            run->stepped_bytes += text_len;
+        }
+        run->lines_hash = bench_hash(run->lines_hash, &line_count, sizeof(line_count));
+    }
+    run->seconds = (bench_now() - start) / options->updates;
+
+    // The lines after the last update
+    RegexIterator iterator;
+    RegexLine line;
+    regex_iterator_create(&iterator, regex, text, text_len);
+    for (size_t i = 0; regex_iterator_next_line(&iterator, &line); ++i) {
+        if (version == INCREMENTAL_BENCH_INCREMENTAL
+            && (i >= incremental.line_count || memcmp(&incremental.lines[i], &line, sizeof(line))))
+            run->lines_hash = bench_hash(run->lines_hash, &i, sizeof(i));
+        run->lines_hash = bench_hash(run->lines_hash, &line.number, sizeof(line.number));
+    }
+
+    if (version == INCREMENTAL_BENCH_INCREMENTAL) incremental_destroy(&incremental);
+    free(text);
+}
+
@@ -0,0 +1,216 @@
+#include "harness.h"
+
+#include "src/regex.h"
+#include "src/logger.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @struct LinesBenchOptions
+ * @brief Command line options of the multi-line benchmark.
+ */
+typedef struct LinesBenchOptions {
+    BenchCommonOptions common; /**< Output, filter, corpus size and seed */
+    double min_time; /**< Minimum seconds to spend measuring each version */
+} LinesBenchOptions;
+
+/**
+ * @enum LinesBenchVersion
+ * @brief The ways of finding the matching lines of a buffer.
+ */
+typedef enum LinesBenchVersion {
+    LINES_BENCH_PER_LINE, /**< Cut the lines and match each one with regex_match_bytes() */
+    LINES_BENCH_BATCH, /**< Cut the lines and match them 64 at a time with regex_match_batch() */
+    LINES_BENCH_ONE_PASS, /**< regex_iterator_next_line() over the whole buffer */
+    LINES_BENCH_VERSION_COUNT
+} LinesBenchVersion;
+
+/**
+ * @struct LinesBenchRun
+ * @brief Measurements of one version.
+ */
+typedef struct LinesBenchRun {
+    double seconds; /**< Seconds per pass over the buffer */
+    size_t matched_lines; /**< Lines matched in one pass */
+    uint64_t lines_hash; /**< FNV-1a hash of the numbers of the matched lines */
+} LinesBenchRun;
+
+/**
+ * @brief Names of the versions in the JSON output.
+ */
+static const char *const lines_bench_version_names[] = {"per_line", "batch", "one_pass"};
+
+/**
+ * @brief Parse an option of the benchmark (see BenchOptionParser).
+ *
+ * @param options Pointer to the LinesBenchOptions
+ * @param name The option
+ * @param value Its value
+ *
+ * @return false if the option is unknown or its value is invalid.
+ */
+static bool lines_bench_parse_option(void *options, const char *name, const char *value);
+
+/**
+ * @brief Find the matching lines of the buffer once.
+ *
+ * @param regex Pointer to the regex state
+ * @param data The buffer
+ * @param len Length of the buffer
+ * @param version How to find the lines
+ * @param run Pointer to store the counts and the hash of the line numbers
+ */
+static void lines_bench_pass(Regex *regex, const char *data, size_t len, LinesBenchVersion version,
+    LinesBenchRun *run);
+
+/**
+ * @brief Add a matched line to the counts of the run.
+ *
+ * @param run Pointer to the run
+ * @param number Number of the line
+ */
+static void lines_bench_add(LinesBenchRun *run, size_t number);
+
+int main(int argc, const char **argv) {
+    LinesBenchOptions options = {
+        .common = {.corpus_bytes = 8 * 1024 * 1024, .seed = 42},
+        .min_time = 0.3,
+    };
+
+    if (!bench_parse_arguments(&options.common, argc, argv, lines_bench_parse_option, &options)) {
+        LOG_INFO("Usage: regexer_lines_bench [--out <file>] [--filter <name>] [--size <bytes>] [--min-time <seconds>]"
+            " [--seed <seed>]");
+        return EXIT_FAILURE;
+    }
+
+    Corpus corpora[CORPUS_KIND_COUNT];
+    bench_generate_corpora(corpora, options.common.corpus_bytes, options.common.seed);
+    char *buffers[CORPUS_KIND_COUNT];
+    size_t lengths[CORPUS_KIND_COUNT];
+    for (int kind = 0; kind < CORPUS_KIND_COUNT; ++kind) buffers[kind] = bench_join_lines(&corpora[kind], &lengths[kind]);
+
+    FILE *out = stdout;
+    if (options.common.out_path && !(out = fopen(options.common.out_path, "w"))) {
+        LOG_ERROR("Failed to open '%s' for writing", options.common.out_path);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"version\": 1,\n");
+    fprintf(out, "  \"corpus_bytes\": %zu,\n", options.common.corpus_bytes);
+    fprintf(out, "  \"results\": [\n");
+
+    bool consistent = true, first = true;
+    for (size_t i = 0; i < bench_case_count; ++i) {
+        const BenchCase *bench_case = &bench_cases[i];
+        if (options.common.filter && !strstr(bench_case->name, options.common.filter)) continue;
+
+        // Each line matched on its own or in one pass, the same regex decides
+        Regex regex;
+        RegexOptions regex_options = {.flags = bench_case->flags | REGEX_FLAG_MULTILINE};
+        regex_create_with_options(&regex, bench_case->pattern, &regex_options);
+        const char *data = buffers[bench_case->corpus];
+        size_t len = lengths[bench_case->corpus];
+
+        LinesBenchRun runs[LINES_BENCH_VERSION_COUNT];
+        for (int version = 0; version < LINES_BENCH_VERSION_COUNT; ++version) {
+            size_t passes = 0;
+            double start = bench_now(), elapsed;
+            do {
+                lines_bench_pass(&regex, data, len, (LinesBenchVersion)version, &runs[version]);
+                passes++;
+            } while ((elapsed = bench_now() - start) < options.min_time);
+            runs[version].seconds = elapsed / passes;
+
+            if (runs[version].matched_lines != runs[0].matched_lines || runs[version].lines_hash != runs[0].lines_hash) {
+                LOG_ERROR("'%s': %s matched %zu lines, %s %zu", bench_case->name, lines_bench_version_names[version],
+                    runs[version].matched_lines, lines_bench_version_names[0], runs[0].matched_lines);
+                consistent = false;
+            }
+        }
+
+        fprintf(out, "%s    {\"name\": ", first ? "" : ",\n");
+        bench_write_json_string(out, bench_case->name);
+        fprintf(out, ", \"pattern\": ");
+        bench_write_json_string(out, bench_case->pattern);
+        fprintf(out, ", \"lines\": %zu, \"matched_lines\": %zu", corpora[bench_case->corpus].line_count,
+            runs[0].matched_lines);
+        for (int version = 0; version < LINES_BENCH_VERSION_COUNT; ++version)
+            fprintf(out, ", \"%s_mb_per_s\": %.3lf", lines_bench_version_names[version], len / runs[version].seconds / 1e6);
+        fprintf(out, ", \"speedup\": %.3lf, \"batch_speedup\": %.3lf}",
+            runs[LINES_BENCH_PER_LINE].seconds / runs[LINES_BENCH_ONE_PASS].seconds,
+            runs[LINES_BENCH_BATCH].seconds / runs[LINES_BENCH_ONE_PASS].seconds);
+        first = false;
+
+        regex_destroy(&regex);
+    }
+
+    fprintf(out, "\n  ],\n");
+    fprintf(out, "  \"consistent\": %s\n", consistent ? "true" : "false");
+    fprintf(out, "}\n");
+
+    if (out != stdout) fclose(out);
+    for (int kind = 0; kind < CORPUS_KIND_COUNT; ++kind) {
+        free(buffers[kind]);
+        corpus_destroy(&corpora[kind]);
+    }
+
+    return consistent ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool lines_bench_parse_option(void *options, const char *name, const char *value) {
+    LinesBenchOptions *lines_options = options;
+    if (!strcmp(name, "--min-time")) lines_options->min_time = strtod(value, NULL);
+    else return false;
+
+    return true;
+}
+
+static void lines_bench_pass(Regex *regex, const char *data, size_t len, LinesBenchVersion version,
+    LinesBenchRun *run) {
+    *run = (LinesBenchRun){.lines_hash = BENCH_HASH_START};
+
+    if (version == LINES_BENCH_ONE_PASS) {
+        RegexIterator iterator;
+        regex_iterator_create(&iterator, regex, data, len);
+        RegexLine line;
+        while (regex_iterator_next_line(&iterator, &line)) lines_bench_add(run, line.number);
+        return;
+    }
+
+    RegexInput inputs[64];
+    uint64_t matched;
+    size_t pos = 0, number = 0;
+    while (pos < len) {
+        // Cut the lines like a caller without the multi-line scan has to
+        size_t count = 0;
+        for (; count < 64 && pos < len; ++count) {
+            const char *new_line = memchr(data + pos, '\n', len - pos);
+            size_t line_len = new_line ? (size_t)(new_line - data) - pos : len - pos;
+            inputs[count] = (RegexInput){data + pos, line_len};
+            pos += line_len + 1;
+        }
+
+        if (version == LINES_BENCH_BATCH) {
+            regex_match_batch(regex, inputs, count, &matched);
+        } else {
+            matched = 0;
+            for (size_t i = 0; i < count; ++i) {
+                if (regex_match_bytes(regex, (const uint8_t *)inputs[i].data, inputs[i].len, REGEX_MATCH_EOL))
+                    matched |= (uint64_t)1 << i;
+            }
+        }
+
+        for (size_t i = 0; i < count; ++i)
+            if (matched >> i & 1) lines_bench_add(run, number + i + 1);
+        number += count;
+    }
+}
+
+static void lines_bench_add(LinesBenchRun *run, size_t number) {
+    run->matched_lines++;
+    run->lines_hash = bench_hash(run->lines_hash, &number, sizeof(number));
+}
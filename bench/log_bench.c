@@ -0,0 +1,200 @@
+#include "harness.h"
+
+#include "src/logger.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+/**
+ * @struct LogBenchOptions
+ * @brief Command line options of the logging benchmark.
+ */
+typedef struct LogBenchOptions {
+    BenchCommonOptions common; /**< Output (the logging benchmark has no corpus) */
+    const char *log_path; /**< The messages are logged here */
+    int threads; /**< Threads logging at the same time */
+    size_t messages; /**< Messages logged by each thread */
+} LogBenchOptions;
+
+/**
+ * @struct LogBenchRun
+ * @brief Measurements of one mode.
+ */
+typedef struct LogBenchRun {
+    double call_seconds; /**< Seconds spent in the calls, summed over the threads */
+    double seconds; /**< Seconds until every message was written */
+    LoggerStats stats; /**< Counters of the asynchronous mode during the run */
+} LogBenchRun;
+
+/**
+ * @struct LogBenchThread
+ * @brief One thread logging.
+ */
+typedef struct LogBenchThread {
+    thrd_t thread; /**< The thread */
+    int index; /**< Index of the thread */
+    size_t messages; /**< Messages to log */
+    double seconds; /**< Seconds spent logging */
+} LogBenchThread;
+
+/**
+ * @brief Parse an option of the benchmark (see BenchOptionParser).
+ *
+ * @param options Pointer to the LogBenchOptions
+ * @param name The option
+ * @param value Its value
+ *
+ * @return false if the option is unknown.
+ */
+static bool log_bench_parse_option(void *options, const char *name, const char *value);
+
+/**
+ * @brief Log the messages of one thread (like the trace of a match).
+ *
+ * @param arg Pointer to the LogBenchThread
+ *
+ * @return 0.
+ */
+static int log_bench_thread_run(void *arg);
+
+/**
+ * @brief Log from all the threads in one mode.
+ *
+ * @param options Pointer to the options
+ * @param async Log asynchronously
+ * @param run Pointer to store the measurements
+ *
+ * @return false if the mode could not be started.
+ */
+static bool log_bench_run(const LogBenchOptions *options, bool async, LogBenchRun *run);
+
+int main(int argc, const char **argv) {
+    LogBenchOptions options = {
+#ifdef _WIN32
+        .log_path = "NUL",
+#else
+        .log_path = "/dev/null",
+#endif
+        .threads = 4,
+        .messages = 200000,
+    };
+
+    bool valid = bench_parse_arguments(&options.common, argc, argv, log_bench_parse_option, &options);
+    if (valid && (options.threads < 1 || !options.messages)) {
+        LOG_ERROR("Threads and messages should be greater than zero");
+        valid = false;
+    }
+    if (!valid) {
+        LOG_INFO("Usage: regexer_log_bench [--out <file>] [--log <file>] [--threads <count>] [--messages <per thread>]");
+        return EXIT_FAILURE;
+    }
+
+    FILE *log = fopen(options.log_path, "w");
+    if (!log) {
+        LOG_ERROR("Failed to open '%s' for writing", options.log_path);
+        return EXIT_FAILURE;
+    }
+
+    logger_set_output(log);
+    LogBenchRun sync, async;
+    log_bench_run(&options, false, &sync);
+    bool async_available = log_bench_run(&options, true, &async);
+    logger_set_output(NULL);
+    fclose(log);
+
+    if (!async_available) {
+        LOG_ERROR("Asynchronous logging is not available");
+        return EXIT_FAILURE;
+    }
+
+    FILE *out = stdout;
+    if (options.common.out_path && !(out = fopen(options.common.out_path, "w"))) {
+        LOG_ERROR("Failed to open '%s' for writing", options.common.out_path);
+        return EXIT_FAILURE;
+    }
+
+    double messages = (double)options.messages * options.threads;
+    fprintf(out, "{\n");
+    fprintf(out, "  \"version\": 1,\n");
+    fprintf(out, "  \"log\": ");
+    bench_write_json_string(out, options.log_path);
+    fprintf(out, ",\n  \"threads\": %d,\n", options.threads);
+    fprintf(out, "  \"messages\": %.0lf,\n", messages);
+    fprintf(out, "  \"sync_call_ns\": %.1lf,\n", sync.call_seconds / messages * 1e9);
+    fprintf(out, "  \"async_call_ns\": %.1lf,\n", async.call_seconds / messages * 1e9);
+    fprintf(out, "  \"sync_written_per_s\": %.0lf,\n", messages / sync.seconds);
+    fprintf(out, "  \"async_written_per_s\": %.0lf,\n", async.stats.written / async.seconds);
+    fprintf(out, "  \"async_written\": %zu,\n", async.stats.written);
+    fprintf(out, "  \"async_dropped\": %zu,\n", async.stats.dropped);
+    fprintf(out, "  \"async_truncated\": %zu\n", async.stats.truncated);
+    fprintf(out, "}\n");
+
+    if (out != stdout) fclose(out);
+
+    return EXIT_SUCCESS;
+}
+
+static bool log_bench_parse_option(void *options, const char *name, const char *value) {
+    LogBenchOptions *log = options;
+    if (!strcmp(name, "--log")) log->log_path = value;
+    else if (!strcmp(name, "--threads")) log->threads = atoi(value);
+    else if (!strcmp(name, "--messages")) log->messages = strtoull(value, NULL, 10);
+    else return false;
+
+    return true;
+}
+
+static int log_bench_thread_run(void *arg) {
+    LogBenchThread *thread = arg;
+
+    double start = bench_now();
+    for (size_t i = 0; i < thread->messages; ++i)
+        LOG_DEBUG("thread %d: step %zu at offset %zu, %d active states", thread->index, i, i * 64, (int)(i % 17));
+    thread->seconds = bench_now() - start;
+
+    return 0;
+}
+
+static bool log_bench_run(const LogBenchOptions *options, bool async, LogBenchRun *run) {
+    *run = (LogBenchRun){0};
+    if (async && !logger_start_async()) return false;
+
+    LoggerStats before;
+    logger_get_stats(&before);
+
+    LogBenchThread *threads = calloc(options->threads, sizeof(LogBenchThread));
+    if (!threads) {
+        LOG_ERROR("Failed to allocate the threads");
+        exit(EXIT_FAILURE);
+    }
+
+    double start = bench_now();
+    for (int i = 0; i < options->threads; ++i) {
+        threads[i] = (LogBenchThread){.index = i, .messages = options->messages};
+        if (thrd_create(&threads[i].thread, log_bench_thread_run, &threads[i]) != thrd_success) {
+            LOG_ERROR("Failed to start thread %d", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < options->threads; ++i) {
+        thrd_join(threads[i].thread, NULL);
+        run->call_seconds += threads[i].seconds;
+    }
+
+    // Until the background thread wrote everything
+    logger_stop_async();
+    logger_flush();
+    run->seconds = bench_now() - start;
+
+    logger_get_stats(&run->stats);
+    run->stats.written -= before.written;
+    run->stats.dropped -= before.dropped;
+    run->stats.truncated -= before.truncated;
+
+    free(threads);
+
+    return true;
+}
@@ -0,0 +1,359 @@
+// glibc's <regex.h> is POSIX, not part of C17
+#define _POSIX_C_SOURCE 200809L
+
+#include "harness.h"
+
+#include "src/regex.h"
+#include "src/logger.h"
+
+#include <locale.h>
+#include <regex.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @struct DiffResult
+ * @brief Correctness and performance of one bench case in both engines.
+ */
+typedef struct DiffResult {
+    const BenchCase *bench_case;
+    bool posix_compiled; /**< false if regcomp() rejected the pattern */
+    size_t lines; /**< Number of lines compared */
+    size_t matches; /**< Lines matched by this engine */
+    size_t posix_matches; /**< Lines matched by regexec() */
+    size_t mismatches; /**< Lines where the engines disagree */
+    size_t span_mismatches; /**< Matched lines where the engines locate a different first match */
+    double mb_per_s; /**< Throughput of this engine */
+    double posix_mb_per_s; /**< Throughput of regexec() */
+    double compile_ns; /**< Nanoseconds per regex_create() */
+    double posix_compile_ns; /**< Nanoseconds per regcomp() */
+} DiffResult;
+
+/**
+ * @brief Lines compared for every case besides the corpus (empty, one byte and one word lines).
+ */
+static const char *const diff_edge_lines[] = {"", "b", "x", " ", "-", "bb", "a b", "b-", "-b"};
+
+/**
+ * @struct DiffEdgeCase
+ * @brief A pattern whose result on a line is known, checked without regexec().
+ */
+typedef struct DiffEdgeCase {
+    const char *pattern; /**< The pattern */
+    const char *line; /**< The line */
+    bool matched; /**< Whether the line contains the pattern */
+} DiffEdgeCase;
+
+/**
+ * @brief Empty matches at the end of a line, which the new line added after it must not start.
+ */
+static const DiffEdgeCase diff_edge_cases[] = {
+    {"\\B", "b", false},
+    {"\\B", "x", false},
+    {" *\\B", "b", false},
+    {" *\\B", "x", false},
+    {"\\B", "bb", true},
+    {"\\B", "-", true},
+    {" *\\B", "a b", false},
+    {" *\\B", "a  b", true},
+    {"x*\\b", "-", false},
+    {"\\B$", "b", false},
+    {"\\B\\z", "x", false},
+    {"\\b\\z", "x", true},
+};
+
+/**
+ * @struct DiffOptions
+ * @brief Command line options of the differential harness.
+ */
+typedef struct DiffOptions {
+    BenchCommonOptions common; /**< Output, case filter, size of each corpus and seed */
+    double min_time; /**< Minimum seconds to spend measuring each engine */
+    int show; /**< Maximum number of mismatching lines to print per case */
+    int engine_flags; /**< RegexFlag selecting the engine */
+} DiffOptions;
+
+/**
+ * @brief Parse an option of the benchmark (see BenchOptionParser).
+ *
+ * @param options Pointer to the DiffOptions
+ * @param name The option
+ * @param value Its value
+ *
+ * @return false if the option is unknown or its value is invalid.
+ */
+static bool diff_parse_option(void *options, const char *name, const char *value);
+
+/**
+ * @brief Compare the engines on one bench case.
+ *
+ * @param bench_case The case to run
+ * @param corpus The corpus to scan
+ * @param options Pointer to the options
+ * @param result Pointer to store the result
+ */
+static void diff_run_case(const BenchCase *bench_case, const Corpus *corpus, const DiffOptions *options, DiffResult *result);
+
+/**
+ * @brief Check the patterns whose result is known (see @ref diff_edge_cases).
+ *
+ * @param options Pointer to the options
+ *
+ * @return Number of wrong results.
+ */
+static size_t diff_run_edge_cases(const DiffOptions *options);
+
+/**
+ * @brief Write the report as JSON.
+ *
+ * @param out The output file
+ * @param options Pointer to the options
+ * @param results The results
+ * @param result_count Number of results
+ * @param edge_mismatches Wrong results of the edge cases
+ */
+static void diff_write_report(FILE *out, const DiffOptions *options, const DiffResult *results, size_t result_count,
+    size_t edge_mismatches);
+
+int main(int argc, const char **argv) {
+    DiffOptions options = {
+        .common = {.corpus_bytes = 1024 * 1024, .seed = 42},
+        .min_time = 0.2,
+        .show = 5,
+    };
+
+    if (!bench_parse_arguments(&options.common, argc, argv, diff_parse_option, &options)) {
+        LOG_INFO("Usage: regexer_posix_diff [--out <file>] [--filter <name>] [--size <bytes>]"
+            " [--min-time <seconds>] [--seed <seed>] [--show <count>] [--engine <auto|dfa|shift-and|nfa>]");
+        return EXIT_FAILURE;
+    }
+
+    Corpus corpora[CORPUS_KIND_COUNT];
+    bench_generate_corpora(corpora, options.common.corpus_bytes, options.common.seed);
+
+    DiffResult *results = malloc(bench_case_count * sizeof(DiffResult));
+    size_t result_count = 0;
+    size_t edge_mismatches = diff_run_edge_cases(&options);
+    bool disagreed = edge_mismatches > 0;
+
+    for (size_t i = 0; i < bench_case_count; ++i) {
+        if (options.common.filter && !strstr(bench_cases[i].name, options.common.filter)) continue;
+
+        DiffResult *result = &results[result_count++];
+        diff_run_case(&bench_cases[i], &corpora[bench_cases[i].corpus], &options, result);
+        if (result->mismatches || result->span_mismatches) disagreed = true;
+    }
+
+    FILE *out = stdout;
+    if (options.common.out_path && !(out = fopen(options.common.out_path, "w"))) {
+        LOG_ERROR("Failed to open '%s' for writing", options.common.out_path);
+        return EXIT_FAILURE;
+    }
+
+    diff_write_report(out, &options, results, result_count, edge_mismatches);
+
+    if (out != stdout) fclose(out);
+
+    free(results);
+    for (int kind = 0; kind < CORPUS_KIND_COUNT; ++kind) corpus_destroy(&corpora[kind]);
+
+    return disagreed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static bool diff_parse_option(void *options, const char *name, const char *value) {
+    DiffOptions *diff = options;
+    if (!strcmp(name, "--min-time")) diff->min_time = strtod(value, NULL);
+    else if (!strcmp(name, "--show")) diff->show = atoi(value);
+    else if (!strcmp(name, "--engine")) return bench_engine_flags(value, &diff->engine_flags);
+    else return false;
+
+    return true;
+}
+
+static void diff_run_case(const BenchCase *bench_case, const Corpus *corpus, const DiffOptions *options, DiffResult *result) {
+    *result = (DiffResult){.bench_case = bench_case, .lines = corpus->line_count};
+
+    Regex regex;
+    RegexOptions regex_options = {.flags = bench_case->flags | options->engine_flags};
+    regex_t posix;
+    int posix_flags = REG_EXTENDED | REG_NOSUB | (bench_case->flags & REGEX_FLAG_ICASE ? REG_ICASE : 0);
+
+    // Compile time of both engines
+    size_t compiles = 0;
+    double start = bench_now(), elapsed;
+    do {
+        regex_create_with_options(&regex, bench_case->pattern, &regex_options);
+        regex_destroy(&regex);
+        compiles++;
+    } while ((elapsed = bench_now() - start) < options->min_time / 4);
+    result->compile_ns = elapsed * 1e9 / compiles;
+
+    // Compare UTF-8 mode with regcomp() in a UTF-8 locale
+    setlocale(LC_ALL, bench_case->flags & REGEX_FLAG_UTF8 ? "C.UTF-8" : "C");
+
+    int error = regcomp(&posix, bench_case->pattern, posix_flags);
+    if (error) {
+        char message[256];
+        regerror(error, &posix, message, sizeof(message));
+        LOG_WARN("regcomp() rejected '%s' (%s), skipping the case", bench_case->pattern, message);
+        return;
+    }
+    regfree(&posix);
+    result->posix_compiled = true;
+
+    compiles = 0;
+    start = bench_now();
+    do {
+        regcomp(&posix, bench_case->pattern, posix_flags);
+        regfree(&posix);
+        compiles++;
+    } while ((elapsed = bench_now() - start) < options->min_time / 4);
+    result->posix_compile_ns = elapsed * 1e9 / compiles;
+
+    regex_create_with_options(&regex, bench_case->pattern, &regex_options);
+    regcomp(&posix, bench_case->pattern, posix_flags);
+    // Both are leftmost-longest, so the first match must be the same too
+    regex_t posix_spans;
+    regcomp(&posix_spans, bench_case->pattern, posix_flags & ~REG_NOSUB);
+
+    RegexInput *inputs = bench_corpus_inputs(corpus);
+    uint64_t *bitmap = malloc((corpus->line_count + 63) / 64 * sizeof(uint64_t));
+    regex_match_batch(&regex, inputs, corpus->line_count, bitmap);
+
+    // Correctness: every line must give the same answer (also in the batch)
+    for (size_t i = 0; i < corpus->line_count; ++i) {
+        const char *line = corpus_line(corpus, i);
+        bool matched = regex_pattern_in_line(&regex, line);
+        bool batch_matched = bitmap[i / 64] >> (i % 64) & 1;
+        bool posix_matched = !regexec(&posix, line, 0, NULL, 0);
+
+        result->matches += matched;
+        result->posix_matches += posix_matched;
+
+        RegexSpan span;
+        regmatch_t posix_span;
+        if (posix_matched && regex_find(&regex, line, corpus->lengths[i], 0, &span)
+            && !regexec(&posix_spans, line, 1, &posix_span, 0)
+            && (span.start != (size_t)posix_span.rm_so || span.end != (size_t)posix_span.rm_eo)) {
+            if (result->span_mismatches++ < (size_t)options->show)
+                LOG_ERROR("'%s' on \"%s\": regexer found [%zu, %zu), regexec [%d, %d)", bench_case->pattern, line,
+                    span.start, span.end, (int)posix_span.rm_so, (int)posix_span.rm_eo);
+        }
+
+        if (matched == posix_matched && batch_matched == posix_matched) continue;
+
+        if (result->mismatches++ < (size_t)options->show)
+            LOG_ERROR("'%s' on \"%s\": regexer %s (%s in batch), regexec %s", bench_case->pattern, line,
+                matched ? "matched" : "did not match", batch_matched ? "matched" : "did not match",
+                posix_matched ? "matched" : "did not match");
+    }
+
+    for (size_t i = 0; i < sizeof(diff_edge_lines) / sizeof(diff_edge_lines[0]); ++i) {
+        const char *line = diff_edge_lines[i];
+        bool matched = regex_pattern_in_line(&regex, line);
+        RegexSpan span;
+        bool found = regex_find(&regex, line, strlen(line), 0, &span);
+        bool posix_matched = !regexec(&posix, line, 0, NULL, 0);
+
+        result->lines++;
+        if (matched == posix_matched && found == posix_matched) continue;
+
+        if (result->mismatches++ < (size_t)options->show)
+            LOG_ERROR("'%s' on \"%s\": regexer %s (%s by regex_find), regexec %s", bench_case->pattern, line,
+                matched ? "matched" : "did not match", found ? "found" : "not found",
+                posix_matched ? "matched" : "did not match");
+    }
+
+    free(bitmap);
+    free(inputs);
+    regfree(&posix_spans);
+
+    // Throughput of both engines
+    size_t passes = 0;
+    start = bench_now();
+    do {
+        for (size_t i = 0; i < corpus->line_count; ++i)
+            regex_pattern_in_line(&regex, corpus_line(corpus, i));
+        passes++;
+    } while ((elapsed = bench_now() - start) < options->min_time);
+    result->mb_per_s = (double)corpus->bytes * passes / elapsed / 1e6;
+
+    passes = 0;
+    start = bench_now();
+    do {
+        for (size_t i = 0; i < corpus->line_count; ++i)
+            regexec(&posix, corpus_line(corpus, i), 0, NULL, 0);
+        passes++;
+    } while ((elapsed = bench_now() - start) < options->min_time);
+    result->posix_mb_per_s = (double)corpus->bytes * passes / elapsed / 1e6;
+
+    regfree(&posix);
+    regex_destroy(&regex);
+}
+
+static size_t diff_run_edge_cases(const DiffOptions *options) {
+    RegexOptions regex_options = {.flags = options->engine_flags};
+    size_t mismatches = 0;
+
+    for (size_t i = 0; i < sizeof(diff_edge_cases) / sizeof(diff_edge_cases[0]); ++i) {
+        const DiffEdgeCase *edge_case = &diff_edge_cases[i];
+        Regex regex;
+        regex_create_with_options(&regex, edge_case->pattern, &regex_options);
+
+        RegexSpan span;
+        bool matched = regex_pattern_in_line(&regex, edge_case->line);
+        bool found = regex_find(&regex, edge_case->line, strlen(edge_case->line), 0, &span);
+        if (matched != edge_case->matched || found != edge_case->matched) {
+            mismatches++;
+            LOG_ERROR("'%s' on \"%s\": regexer %s (%s by regex_find), expected %s", edge_case->pattern,
+                edge_case->line, matched ? "matched" : "did not match", found ? "found" : "not found",
+                edge_case->matched ? "a match" : "no match");
+        }
+
+        regex_destroy(&regex);
+    }
+
+    return mismatches;
+}
+
+static void diff_write_report(FILE *out, const DiffOptions *options, const DiffResult *results, size_t result_count,
+    size_t edge_mismatches) {
+    size_t mismatches = 0, span_mismatches = 0;
+    for (size_t i = 0; i < result_count; ++i) {
+        mismatches += results[i].mismatches;
+        span_mismatches += results[i].span_mismatches;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"version\": 1,\n");
+    fprintf(out, "  \"seed\": %llu,\n", (unsigned long long)options->common.seed);
+    fprintf(out, "  \"corpus_bytes\": %zu,\n", options->common.corpus_bytes);
+    fprintf(out, "  \"mismatches\": %zu,\n", mismatches);
+    fprintf(out, "  \"span_mismatches\": %zu,\n", span_mismatches);
+    fprintf(out, "  \"edge_mismatches\": %zu,\n", edge_mismatches);
+    fprintf(out, "  \"results\": [\n");
+
+    for (size_t i = 0; i < result_count; ++i) {
+        const DiffResult *result = &results[i];
+        fprintf(out, "    {\"name\": ");
+        bench_write_json_string(out, result->bench_case->name);
+        fprintf(out, ", \"pattern\": ");
+        bench_write_json_string(out, result->bench_case->pattern);
+        fprintf(out, ", \"corpus\": \"%s\", \"posix_compiled\": %s", corpus_kind_name(result->bench_case->corpus),
+            result->posix_compiled ? "true" : "false");
+        if (result->posix_compiled) {
+            fprintf(out, ", \"lines\": %zu, \"matches\": %zu, \"posix_matches\": %zu, \"mismatches\": %zu"
+                ", \"span_mismatches\": %zu, \"mb_per_s\": %.3lf, \"posix_mb_per_s\": %.3lf, \"speedup\": %.3lf"
+                ", \"compile_ns\": %.1lf, \"posix_compile_ns\": %.1lf, \"compile_speedup\": %.3lf",
+                result->lines, result->matches, result->posix_matches, result->mismatches, result->span_mismatches,
+                result->mb_per_s, result->posix_mb_per_s, result->mb_per_s / result->posix_mb_per_s,
+                result->compile_ns, result->posix_compile_ns, result->posix_compile_ns / result->compile_ns);
+        }
+        fprintf(out, "}%s\n", i + 1 < result_count ? "," : "");
+    }
+
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+}
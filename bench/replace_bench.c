@@ -0,0 +1,293 @@
+#include "harness.h"
+
+#include "src/regex.h"
+#include "src/logger.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @struct ReplaceBenchOptions
+ * @brief Command line options of the replace benchmark.
+ */
+typedef struct ReplaceBenchOptions {
+    BenchCommonOptions common; /**< Output, size of the log corpus and seed (no filter, there is one case) */
+    const char *pattern; /**< The regex replaced */
+    const char *template; /**< The replacement template */
+    double min_time; /**< Minimum seconds to spend measuring each version */
+    int engine_flags; /**< RegexFlag selecting the engine */
+} ReplaceBenchOptions;
+
+/**
+ * @struct ReplaceBenchRun
+ * @brief Measurements of one version.
+ */
+typedef struct ReplaceBenchRun {
+    double seconds; /**< Seconds per pass over the corpus */
+    size_t replacements; /**< Matches replaced in one pass */
+    size_t allocations; /**< Allocations made in one pass */
+    uint64_t output_hash; /**< FNV-1a hash of the output of one pass */
+} ReplaceBenchRun;
+
+/**
+ * @brief Parse an option of the benchmark (see BenchOptionParser).
+ *
+ * @param options Pointer to the ReplaceBenchOptions
+ * @param name The option
+ * @param value Its value
+ *
+ * @return false if the option is unknown or its value is invalid.
+ */
+static bool replace_bench_parse_option(void *options, const char *name, const char *value);
+
+/**
+ * @brief Check that the naive version can substitute the template.
+ *
+ * @param template The replacement template
+ *
+ * @return false if the template has another '$' sequence than "$&".
+ */
+static bool replace_bench_check_template(const char *template);
+
+/**
+ * @brief Replace the matches of every line of the corpus with regex_replace_all() into one reused buffer.
+ *
+ * @param regex Pointer to the regex state
+ * @param corpus The corpus
+ * @param template The replacement template
+ * @param buffer The reused output buffer
+ * @param hash Hash the output
+ * @param run Pointer to store the counts and the output hash
+ */
+static void replace_bench_pass(Regex *regex, const Corpus *corpus, const char *template, RegexBuffer *buffer, bool hash,
+    ReplaceBenchRun *run);
+
+/**
+ * @brief Replace the matches of every line of the corpus by first collecting the spans, then
+ * concatenating the pieces into a newly allocated string.
+ *
+ * @param regex Pointer to the regex state
+ * @param corpus The corpus
+ * @param template The replacement template (only "$&" is substituted)
+ * @param hash Hash the output
+ * @param run Pointer to store the counts and the output hash
+ */
+static void replace_bench_naive_pass(Regex *regex, const Corpus *corpus, const char *template, bool hash,
+    ReplaceBenchRun *run);
+
+/**
+ * @brief Append bytes to a string by allocating a new one (as the naive version does).
+ *
+ * @param str The string (freed)
+ * @param len Length of the string
+ * @param data The bytes to append
+ * @param data_len Number of bytes
+ * @param run Pointer to count the allocation
+ *
+ * @return The new string.
+ */
+static char *replace_bench_concat(char *str, size_t len, const char *data, size_t data_len, ReplaceBenchRun *run);
+
+/**
+ * @brief Measure passes of one version over the corpus.
+ *
+ * @param regex Pointer to the regex state
+ * @param corpus The corpus
+ * @param options Pointer to the options
+ * @param naive Measure the naive version
+ * @param run Pointer to store the measurements
+ */
+static void replace_bench_run(Regex *regex, const Corpus *corpus, const ReplaceBenchOptions *options, bool naive,
+    ReplaceBenchRun *run);
+
+int main(int argc, const char **argv) {
+    ReplaceBenchOptions options = {
+        .common = {.corpus_bytes = 16 * 1024 * 1024, .seed = 42},
+        .pattern = "user=[a-z]+",
+        .template = "user=***",
+        .min_time = 1,
+    };
+
+    if (!bench_parse_arguments(&options.common, argc, argv, replace_bench_parse_option, &options)
+        || !replace_bench_check_template(options.template)) {
+        LOG_INFO("Usage: regexer_replace_bench [--out <file>] [--pattern <regex>] [--template <template>]"
+            " [--size <bytes>] [--min-time <seconds>] [--seed <seed>] [--engine <auto|dfa|shift-and|nfa>]");
+        return EXIT_FAILURE;
+    }
+
+    Corpus corpus;
+    corpus_generate(&corpus, CORPUS_KIND_LOG, options.common.corpus_bytes, options.common.seed);
+
+    Regex regex;
+    RegexOptions regex_options = {.flags = options.engine_flags};
+    regex_create_with_options(&regex, options.pattern, &regex_options);
+
+    ReplaceBenchRun run, naive;
+    replace_bench_run(&regex, &corpus, &options, false, &run);
+    replace_bench_run(&regex, &corpus, &options, true, &naive);
+
+    regex_destroy(&regex);
+
+    bool same = run.output_hash == naive.output_hash && run.replacements == naive.replacements;
+    if (!same) LOG_ERROR("The naive version gives a different output");
+
+    FILE *out = stdout;
+    if (options.common.out_path && !(out = fopen(options.common.out_path, "w"))) {
+        LOG_ERROR("Failed to open '%s' for writing", options.common.out_path);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"version\": 1,\n");
+    fprintf(out, "  \"pattern\": ");
+    bench_write_json_string(out, options.pattern);
+    fprintf(out, ",\n  \"template\": ");
+    bench_write_json_string(out, options.template);
+    fprintf(out, ",\n  \"lines\": %zu,\n", corpus.line_count);
+    fprintf(out, "  \"bytes\": %zu,\n", corpus.bytes);
+    fprintf(out, "  \"replacements\": %zu,\n", run.replacements);
+    fprintf(out, "  \"same_output\": %s,\n", same ? "true" : "false");
+    fprintf(out, "  \"mb_per_s\": %.3lf,\n", corpus.bytes / run.seconds / 1e6);
+    fprintf(out, "  \"naive_mb_per_s\": %.3lf,\n", corpus.bytes / naive.seconds / 1e6);
+    fprintf(out, "  \"speedup\": %.3lf,\n", naive.seconds / run.seconds);
+    fprintf(out, "  \"allocations\": %zu,\n", run.allocations);
+    fprintf(out, "  \"naive_allocations\": %zu\n", naive.allocations);
+    fprintf(out, "}\n");
+
+    if (out != stdout) fclose(out);
+
+    corpus_destroy(&corpus);
+
+    return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool replace_bench_parse_option(void *options, const char *name, const char *value) {
+    ReplaceBenchOptions *replace_options = options;
+    if (!strcmp(name, "--pattern")) replace_options->pattern = value;
+    else if (!strcmp(name, "--template")) replace_options->template = value;
+    else if (!strcmp(name, "--min-time")) replace_options->min_time = strtod(value, NULL);
+    else if (!strcmp(name, "--engine")) return bench_engine_flags(value, &replace_options->engine_flags);
+    else return false;
+
+    return true;
+}
+
+static bool replace_bench_check_template(const char *template) {
+    // The naive version only knows "$&"
+    for (const char *c = template; (c = strchr(c, '$')); ++c) {
+        if (c[1] != '&') {
+            LOG_ERROR("Only \"$&\" can be used in the template of the benchmark");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void replace_bench_pass(Regex *regex, const Corpus *corpus, const char *template, RegexBuffer *buffer, bool hash,
+    ReplaceBenchRun *run) {
+    size_t capacity = buffer->capacity;
+
+    for (size_t i = 0; i < corpus->line_count; ++i) {
+        buffer->len = 0;
+        size_t count;
+        regex_replace_all(regex, corpus_line(corpus, i), corpus->lengths[i], template, buffer, &count);
+        run->replacements += count;
+        if (hash) run->output_hash = bench_hash(run->output_hash, buffer->data, buffer->len);
+        if (buffer->capacity != capacity) {
+            capacity = buffer->capacity;
+            run->allocations++;
+        }
+    }
+}
+
+static void replace_bench_naive_pass(Regex *regex, const Corpus *corpus, const char *template, bool hash,
+    ReplaceBenchRun *run) {
+    size_t template_len = strlen(template);
+
+    for (size_t i = 0; i < corpus->line_count; ++i) {
+        const char *line = corpus_line(corpus, i);
+        size_t len = corpus->lengths[i];
+
+        // Find all the matches first
+        RegexSpan *spans = NULL;
+        size_t span_count = 0;
+        RegexIterator iterator;
+        regex_iterator_create(&iterator, regex, line, len);
+        RegexSpan span;
+        while (regex_iterator_next(&iterator, &span)) {
+            spans = realloc(spans, (span_count + 1) * sizeof(RegexSpan));
+            run->allocations++;
+            spans[span_count++] = span;
+        }
+
+        // Then rebuild the line piece by piece
+        char *result = replace_bench_concat(NULL, 0, "", 0, run);
+        size_t result_len = 0, copied = 0;
+        for (size_t s = 0; s < span_count; ++s) {
+            result = replace_bench_concat(result, result_len, line + copied, spans[s].start - copied, run);
+            result_len += spans[s].start - copied;
+
+            // The template is split at each "$&"
+            for (const char *t = template, *end; t < template + template_len; t = end + 2) {
+                if (!(end = strstr(t, "$&"))) end = template + template_len;
+                result = replace_bench_concat(result, result_len, t, end - t, run);
+                result_len += end - t;
+                if (!*end) break;
+
+                result = replace_bench_concat(result, result_len, line + spans[s].start, spans[s].end - spans[s].start, run);
+                result_len += spans[s].end - spans[s].start;
+            }
+            copied = spans[s].end;
+        }
+        result = replace_bench_concat(result, result_len, line + copied, len - copied, run);
+        result_len += len - copied;
+
+        run->replacements += span_count;
+        if (hash) run->output_hash = bench_hash(run->output_hash, result, result_len);
+
+        free(result);
+        free(spans);
+    }
+}
+
+static char *replace_bench_concat(char *str, size_t len, const char *data, size_t data_len, ReplaceBenchRun *run) {
+    char *result = malloc(len + data_len + 1);
+    if (!result) {
+        LOG_ERROR("Failed to allocate the naive output");
+        exit(EXIT_FAILURE);
+    }
+    run->allocations++;
+
+    if (str) memcpy(result, str, len);
+    memcpy(result + len, data, data_len);
+    result[len + data_len] = '\0';
+
+    free(str);
+    return result;
+}
+
+static void replace_bench_run(Regex *regex, const Corpus *corpus, const ReplaceBenchOptions *options, bool naive,
+    ReplaceBenchRun *run) {
+    RegexBuffer buffer;
+    regex_buffer_create(&buffer, NULL);
+
+    // The first pass warms up (and grows the buffer), its counts and output are the ones reported
+    size_t passes = 0;
+    double start = bench_now(), elapsed;
+    do {
+        ReplaceBenchRun pass = {.output_hash = BENCH_HASH_START};
+        if (naive) replace_bench_naive_pass(regex, corpus, options->template, !passes, &pass);
+        else replace_bench_pass(regex, corpus, options->template, &buffer, !passes, &pass);
+
+        if (!passes++) {
+            *run = pass;
+            start = bench_now();
+        }
+    } while ((elapsed = bench_now() - start) < options->min_time || passes < 2);
+    run->seconds = elapsed / (passes - 1);
+
+    regex_buffer_destroy(&buffer);
+}
@@ -0,0 +1,274 @@
+#include "harness.h"
+
+#include "src/pool.h"
+#include "src/scan.h"
+#include "src/logger.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Maximum number of thread counts measured.
+ */
+#define SCAN_BENCH_MAX_RUNS 16
+
+/**
+ * @brief Chunk size of the check run, odd so that the chunks are cut anywhere.
+ */
+#define SCAN_BENCH_CHECK_CHUNK_BYTES 4099
+
+/**
+ * @enum ScanBenchInput
+ * @brief The inputs scanned.
+ */
+typedef enum ScanBenchInput {
+    SCAN_BENCH_INPUT_LOG, /**< Log lines joined with new lines (one multi-line record) */
+    SCAN_BENCH_INPUT_BINARY, /**< Random bytes */
+    SCAN_BENCH_INPUT_COUNT
+} ScanBenchInput;
+
+/**
+ * @struct ScanBenchCase
+ * @brief A pattern and the input it is run against.
+ */
+typedef struct ScanBenchCase {
+    const char *name; /**< Unique name */
+    const char *pattern; /**< The regex */
+    ScanBenchInput input; /**< The input to scan */
+} ScanBenchCase;
+
+/**
+ * @struct ScanBenchOptions
+ * @brief Command line options of the scan benchmark.
+ */
+typedef struct ScanBenchOptions {
+    BenchCommonOptions common; /**< Output, case filter, size of each input and seed */
+    size_t chunk_bytes; /**< Chunk size of the parallel scan */
+    int max_threads; /**< Measure 1, 2, 4... up to this many threads */
+    double min_time; /**< Minimum seconds to spend measuring each thread count */
+} ScanBenchOptions;
+
+/**
+ * @struct ScanBenchRun
+ * @brief Measurements of one thread count.
+ */
+typedef struct ScanBenchRun {
+    int threads; /**< Number of workers */
+    double seconds; /**< Seconds per scan */
+    ScanSummary summary; /**< How the last scan went */
+} ScanBenchRun;
+
+/**
+ * @brief Patterns measured, none of them matches early.
+ */
+static const ScanBenchCase scan_bench_cases[] = {
+    {"log/absent_literal", "OutOfMemoryError", SCAN_BENCH_INPUT_LOG},
+    {"log/late_record", "FATAL [a-z]+ mismatch", SCAN_BENCH_INPUT_LOG},
+    {"log/absent_dot_star", "status=denied.*latency=[0-9]+s ", SCAN_BENCH_INPUT_LOG},
+    {"log/absent_class", "user=[a-z]+ ip=[0-9.]+ action=logout", SCAN_BENCH_INPUT_LOG},
+    {"binary/absent_marker", "MAGIC-[0-9]+-END", SCAN_BENCH_INPUT_BINARY},
+    {"binary/late_marker", "FATAL [a-z]+ mismatch", SCAN_BENCH_INPUT_BINARY},
+};
+
+/**
+ * @brief Parse an option of the benchmark (see BenchOptionParser).
+ *
+ * @param options Pointer to the ScanBenchOptions
+ * @param name The option
+ * @param value Its value
+ *
+ * @return false if the option is unknown.
+ */
+static bool scan_bench_parse_option(void *options, const char *name, const char *value);
+
+/**
+ * @brief Generate the input, with a record that matches the late_* cases near its end.
+ *
+ * @param input The kind of input
+ * @param options Pointer to the options
+ *
+ * @return Malloced input of options->common.corpus_bytes bytes.
+ */
+static char *scan_bench_generate(ScanBenchInput input, const ScanBenchOptions *options);
+
+/**
+ * @brief Measure scanning the input with the number of threads.
+ *
+ * @param regex Pointer to the regex state
+ * @param data The input
+ * @param options Pointer to the options
+ * @param threads Number of workers (0 for the serial scan)
+ * @param run Pointer to store the measurements
+ *
+ * @return Whether the input matched.
+ */
+static bool scan_bench_run(Regex *regex, const char *data, const ScanBenchOptions *options, int threads,
+    ScanBenchRun *run);
+
+int main(int argc, const char **argv) {
+    ScanBenchOptions options = {
+        .common = {.corpus_bytes = 32 * 1024 * 1024, .seed = 42},
+        .chunk_bytes = SCAN_DEFAULT_CHUNK_BYTES,
+        .max_threads = pool_processor_count(),
+        .min_time = 0.5,
+    };
+
+    bool valid = bench_parse_arguments(&options.common, argc, argv, scan_bench_parse_option, &options);
+    if (valid && (!options.chunk_bytes || options.max_threads < 1)) {
+        LOG_ERROR("Chunk size and threads should be greater than zero");
+        valid = false;
+    }
+    if (!valid) {
+        LOG_INFO("Usage: regexer_scan_bench [--out <file>] [--filter <name>] [--size <bytes>] [--chunk <bytes>]"
+            " [--threads <max>] [--min-time <seconds>] [--seed <seed>]");
+        return EXIT_FAILURE;
+    }
+
+    char *inputs[SCAN_BENCH_INPUT_COUNT];
+    for (int input = 0; input < SCAN_BENCH_INPUT_COUNT; ++input)
+        inputs[input] = scan_bench_generate((ScanBenchInput)input, &options);
+
+    FILE *out = stdout;
+    if (options.common.out_path && !(out = fopen(options.common.out_path, "w"))) {
+        LOG_ERROR("Failed to open '%s' for writing", options.common.out_path);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"version\": 1,\n");
+    fprintf(out, "  \"bytes\": %zu,\n", options.common.corpus_bytes);
+    fprintf(out, "  \"chunk_bytes\": %zu,\n", options.chunk_bytes);
+    fprintf(out, "  \"results\": [\n");
+
+    bool consistent = true, first = true;
+    for (size_t i = 0; i < sizeof(scan_bench_cases) / sizeof(scan_bench_cases[0]); ++i) {
+        const ScanBenchCase *bench_case = &scan_bench_cases[i];
+        if (options.common.filter && !strstr(bench_case->name, options.common.filter)) continue;
+
+        Regex regex;
+        regex_create(&regex, bench_case->pattern);
+        const char *data = inputs[bench_case->input];
+
+        ScanBenchRun serial, runs[SCAN_BENCH_MAX_RUNS];
+        bool matched = scan_bench_run(&regex, data, &options, 0, &serial);
+
+        // Cut anywhere, the result must be the one of the serial scan
+        ScanBenchOptions check_options = options;
+        check_options.chunk_bytes = SCAN_BENCH_CHECK_CHUNK_BYTES;
+        check_options.min_time = 0;
+        ScanBenchRun check;
+        if (scan_bench_run(&regex, data, &check_options, options.max_threads, &check) != matched) {
+            LOG_ERROR("'%s': scan in chunks of %d bytes differs from the serial scan", bench_case->name,
+                SCAN_BENCH_CHECK_CHUNK_BYTES);
+            consistent = false;
+        }
+
+        int run_count = 0;
+        for (int threads = 1; run_count < SCAN_BENCH_MAX_RUNS; threads *= 2) {
+            if (threads > options.max_threads) threads = options.max_threads;
+
+            if (scan_bench_run(&regex, data, &options, threads, &runs[run_count]) != matched
+                || runs[run_count].summary.decided_at != check.summary.decided_at) {
+                LOG_ERROR("'%s': scan with %d threads differs from the serial scan", bench_case->name, threads);
+                consistent = false;
+            }
+            run_count++;
+
+            if (threads == options.max_threads) break;
+        }
+
+        fprintf(out, "%s    {\"name\": ", first ? "" : ",\n");
+        bench_write_json_string(out, bench_case->name);
+        fprintf(out, ", \"pattern\": ");
+        bench_write_json_string(out, bench_case->pattern);
+        fprintf(out, ", \"dfa_states\": %d, \"matched\": %s, \"decided_at\": %zu, \"serial_mb_per_s\": %.3lf, \"runs\": [",
+            regex.use_dfa ? regex.dfa.state_count : 0, matched ? "true" : "false", check.summary.decided_at,
+            options.common.corpus_bytes / serial.seconds / 1e6);
+        for (int r = 0; r < run_count; ++r) {
+            fprintf(out, "%s{\"threads\": %d, \"mb_per_s\": %.3lf, \"speedup\": %.3lf, \"states_per_byte\": %.3lf}",
+                r ? ", " : "", runs[r].threads, options.common.corpus_bytes / runs[r].seconds / 1e6, serial.seconds / runs[r].seconds,
+                runs[r].summary.states_per_byte);
+        }
+        fprintf(out, "]}");
+        first = false;
+
+        regex_destroy(&regex);
+    }
+
+    fprintf(out, "\n  ],\n");
+    fprintf(out, "  \"consistent\": %s\n", consistent ? "true" : "false");
+    fprintf(out, "}\n");
+
+    if (out != stdout) fclose(out);
+    for (int input = 0; input < SCAN_BENCH_INPUT_COUNT; ++input) free(inputs[input]);
+
+    return consistent ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool scan_bench_parse_option(void *options, const char *name, const char *value) {
+    ScanBenchOptions *scan = options;
+    if (!strcmp(name, "--chunk")) scan->chunk_bytes = strtoull(value, NULL, 10);
+    else if (!strcmp(name, "--threads")) scan->max_threads = atoi(value);
+    else if (!strcmp(name, "--min-time")) scan->min_time = strtod(value, NULL);
+    else return false;
+
+    return true;
+}
+
+static char *scan_bench_generate(ScanBenchInput input, const ScanBenchOptions *options) {
+    char *data = malloc(options->common.corpus_bytes);
+    if (!data) {
+        LOG_ERROR("Failed to allocate %zu bytes of input", options->common.corpus_bytes);
+        exit(EXIT_FAILURE);
+    }
+
+    if (input == SCAN_BENCH_INPUT_LOG) {
+        Corpus corpus;
+        corpus_generate(&corpus, CORPUS_KIND_LOG, 4 * 1024 * 1024, options->common.seed);
+
+        size_t written = 0;
+        for (size_t line = 0; written < options->common.corpus_bytes; line = (line + 1) % corpus.line_count) {
+            size_t len = corpus.lengths[line] + 1 < options->common.corpus_bytes - written ? corpus.lengths[line] : options->common.corpus_bytes - written - 1;
+            memcpy(data + written, corpus_line(&corpus, line), len);
+            written += len;
+            if (written < options->common.corpus_bytes) data[written++] = '\n';
+        }
+        corpus_destroy(&corpus);
+    } else {
+        // xorshift64
+        uint64_t random = options->common.seed | 1;
+        for (size_t i = 0; i < options->common.corpus_bytes; ++i) {
+            random ^= random << 13;
+            random ^= random >> 7;
+            random ^= random << 17;
+            data[i] = (char)(random >> 56);
+        }
+    }
+
+    // The record the late_* cases look for, in the last tenth of the input
+    static const char record[] = "FATAL checksum mismatch";
+    if (options->common.corpus_bytes > 10 * sizeof(record)) memcpy(data + options->common.corpus_bytes / 10 * 9, record, sizeof(record) - 1);
+
+    return data;
+}
+
+static bool scan_bench_run(Regex *regex, const char *data, const ScanBenchOptions *options, int threads,
+    ScanBenchRun *run) {
+    *run = (ScanBenchRun){.threads = threads};
+    ScanOptions scan_options = {.threads = threads, .chunk_bytes = options->chunk_bytes};
+    // A single chunk is the serial scan
+    if (!threads) scan_options.chunk_bytes = options->common.corpus_bytes;
+
+    bool matched;
+    size_t passes = 0;
+    double start = bench_now(), elapsed;
+    do {
+        matched = scan_match(regex, data, options->common.corpus_bytes, &scan_options, &run->summary);
+        passes++;
+    } while ((elapsed = bench_now() - start) < options->min_time);
+
+    run->seconds = elapsed / passes;
+    return matched;
+}
@@ -0,0 +1,349 @@
+// mkdtemp() and mkdir() are POSIX, not part of C17
+#define _DEFAULT_SOURCE
+
+#include "harness.h"
+
+#include "src/pool.h"
+#include "src/search.h"
+#include "src/logger.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/**
+ * @brief Maximum number of thread counts measured.
+ */
+#define SEARCH_BENCH_MAX_RUNS 64
+
+/**
+ * @struct SearchBenchOptions
+ * @brief Command line options of the search benchmark.
+ */
+typedef struct SearchBenchOptions {
+    BenchCommonOptions common; /**< Output, size of the log corpus the files are sliced from and seed */
+    const char *pattern; /**< The regex searched */
+    size_t files; /**< Number of files in the tree */
+    size_t chunk_bytes; /**< Chunk size of large files */
+    int max_threads; /**< Measure 1, 2, 4... up to this many threads */
+    const char *io; /**< Comma separated ios to measure */
+    int queue_depth; /**< Reads in flight per worker with io_uring */
+    double min_time; /**< Minimum seconds to spend measuring each thread count */
+} SearchBenchOptions;
+
+/**
+ * @struct SearchTree
+ * @brief The generated directory tree.
+ */
+typedef struct SearchTree {
+    char root[64]; /**< Path of the tree */
+    char **paths; /**< Every file and directory created, parents first */
+    size_t path_count; /**< Number of paths */
+    size_t bytes; /**< Bytes in all the files */
+    size_t binary_files; /**< Number of binary files */
+} SearchTree;
+
+/**
+ * @struct SearchBenchRun
+ * @brief Measurements of one thread count.
+ */
+typedef struct SearchBenchRun {
+    int threads; /**< Number of workers */
+    SearchIo io; /**< How the files were read */
+    double seconds; /**< Seconds per search */
+    SearchSummary summary; /**< Totals of the last search */
+    uint64_t output_hash; /**< FNV-1a hash of the output */
+} SearchBenchRun;
+
+/**
+ * @brief Parse an option of the benchmark (see BenchOptionParser).
+ *
+ * @param options Pointer to the SearchBenchOptions
+ * @param name The option
+ * @param value Its value
+ *
+ * @return false if the option is unknown.
+ */
+static bool search_bench_parse_option(void *options, const char *name, const char *value);
+
+/**
+ * @brief Generate a tree of log files of mixed sizes (a few binary ones) in a temporary directory.
+ *
+ * @param tree Pointer to the tree
+ * @param options Pointer to the options
+ */
+static void search_bench_generate_tree(SearchTree *tree, const SearchBenchOptions *options);
+
+/**
+ * @brief Remove the tree and free it.
+ *
+ * @param tree Pointer to the tree
+ */
+static void search_bench_remove_tree(SearchTree *tree);
+
+/**
+ * @brief Add a path created in the tree.
+ *
+ * @param tree Pointer to the tree
+ * @param path The path
+ */
+static void search_bench_add_path(SearchTree *tree, const char *path);
+
+/**
+ * @brief Measure searching the tree with the number of threads.
+ *
+ * @param tree Pointer to the tree
+ * @param options Pointer to the options
+ * @param io How to read the files
+ * @param threads Number of workers
+ * @param run Pointer to store the measurements
+ */
+static void search_bench_run(const SearchTree *tree, const SearchBenchOptions *options, SearchIo io, int threads,
+    SearchBenchRun *run);
+
+/**
+ * @brief Hash the contents of the file.
+ *
+ * @param file The file (read from the start)
+ *
+ * @return FNV-1a hash of the contents.
+ */
+static uint64_t search_bench_hash_file(FILE *file);
+
+int main(int argc, const char **argv) {
+    SearchBenchOptions options = {
+        .pattern = "ERROR.*(timeout|refused)",
+        .files = 2000,
+        .chunk_bytes = SEARCH_DEFAULT_CHUNK_BYTES,
+        .max_threads = pool_processor_count(),
+        .io = "read,mmap,uring",
+        .min_time = 1,
+        .common = {.corpus_bytes = 16 * 1024 * 1024, .seed = 42},
+    };
+
+    bool valid = bench_parse_arguments(&options.common, argc, argv, search_bench_parse_option, &options);
+    if (valid && (!options.files || !options.chunk_bytes || options.max_threads < 1)) {
+        LOG_ERROR("Files, chunk size and threads should be greater than zero");
+        valid = false;
+    }
+    if (!valid) {
+        LOG_INFO("Usage: regexer_search_bench [--out <file>] [--pattern <regex>] [--files <count>]"
+            " [--chunk <bytes>] [--threads <max>] [--io <read,mmap,uring>] [--queue-depth <reads>] [--min-time <seconds>]"
+            " [--size <bytes>] [--seed <seed>]");
+        return EXIT_FAILURE;
+    }
+
+    SearchTree tree;
+    search_bench_generate_tree(&tree, &options);
+
+    SearchBenchRun runs[SEARCH_BENCH_MAX_RUNS];
+    int run_count = 0;
+    bool stable = true;
+    for (SearchIo io = SEARCH_IO_READ; io <= SEARCH_IO_URING; ++io) {
+        if (!strstr(options.io, search_io_name(io))) continue;
+
+        for (int threads = 1; run_count < SEARCH_BENCH_MAX_RUNS; threads *= 2) {
+            if (threads > options.max_threads) threads = options.max_threads;
+
+            search_bench_run(&tree, &options, io, threads, &runs[run_count]);
+            // The output must not depend on the io or the number of threads
+            if (runs[run_count].output_hash != runs[0].output_hash) {
+                LOG_ERROR("Output with %s and %d threads differs from the first run", search_io_name(io), threads);
+                stable = false;
+            }
+            run_count++;
+
+            if (threads == options.max_threads) break;
+        }
+    }
+
+    search_bench_remove_tree(&tree);
+
+    FILE *out = stdout;
+    if (options.common.out_path && !(out = fopen(options.common.out_path, "w"))) {
+        LOG_ERROR("Failed to open '%s' for writing", options.common.out_path);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"version\": 1,\n");
+    fprintf(out, "  \"pattern\": ");
+    bench_write_json_string(out, options.pattern);
+    fprintf(out, ",\n  \"files\": %zu,\n", options.files);
+    fprintf(out, "  \"binary_files\": %zu,\n", tree.binary_files);
+    fprintf(out, "  \"bytes\": %zu,\n", tree.bytes);
+    fprintf(out, "  \"chunk_bytes\": %zu,\n", options.chunk_bytes);
+    fprintf(out, "  \"queue_depth\": %d,\n", options.queue_depth ? options.queue_depth : SEARCH_DEFAULT_QUEUE_DEPTH);
+    fprintf(out, "  \"stable_output\": %s,\n", stable ? "true" : "false");
+    fprintf(out, "  \"results\": [\n");
+    for (int i = 0; i < run_count; ++i) {
+        const SearchBenchRun *run = &runs[i];
+        // Speedup over the first run (one thread) of the same io
+        const SearchBenchRun *first = run;
+        while (first > runs && first[-1].io == run->io) first--;
+
+        fprintf(out, "    {\"io\": \"%s\", \"threads\": %d, \"seconds\": %.4lf, \"gb_per_s\": %.3lf"
+            ", \"files_per_s\": %.1lf, \"speedup\": %.3lf, \"matched_lines\": %llu, \"output_hash\": \"%016llx\"}%s\n",
+            search_io_name(run->io), run->threads, run->seconds, tree.bytes / run->seconds / 1e9,
+            (run->summary.files + run->summary.binary_files) / run->seconds, first->seconds / run->seconds,
+            run->summary.matched_lines, (unsigned long long)run->output_hash, i + 1 < run_count ? "," : "");
+        if (run->summary.io != run->io) LOG_WARN("%s fell back to %s", search_io_name(run->io), search_io_name(run->summary.io));
+    }
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+
+    if (out != stdout) fclose(out);
+
+    return stable ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool search_bench_parse_option(void *options, const char *name, const char *value) {
+    SearchBenchOptions *search = options;
+    if (!strcmp(name, "--pattern")) search->pattern = value;
+    else if (!strcmp(name, "--files")) search->files = strtoull(value, NULL, 10);
+    else if (!strcmp(name, "--chunk")) search->chunk_bytes = strtoull(value, NULL, 10);
+    else if (!strcmp(name, "--threads")) search->max_threads = atoi(value);
+    else if (!strcmp(name, "--io")) search->io = value;
+    else if (!strcmp(name, "--queue-depth")) search->queue_depth = atoi(value);
+    else if (!strcmp(name, "--min-time")) search->min_time = strtod(value, NULL);
+    else return false;
+
+    return true;
+}
+
+static void search_bench_generate_tree(SearchTree *tree, const SearchBenchOptions *options) {
+    *tree = (SearchTree){0};
+    strcpy(tree->root, "/tmp/regexer_search_XXXXXX");
+    if (!mkdtemp(tree->root)) {
+        LOG_ERROR("Failed to create a temporary directory");
+        exit(EXIT_FAILURE);
+    }
+    search_bench_add_path(tree, tree->root);
+
+    // The files are slices of one log corpus
+    Corpus corpus;
+    corpus_generate(&corpus, CORPUS_KIND_LOG, options->common.corpus_bytes, options->common.seed);
+
+    uint64_t random = options->common.seed | 1;
+    size_t line = 0;
+    char path[256];
+
+    for (size_t i = 0; i < options->files; ++i) {
+        // 16 directories with 8 sub directories each
+        if (i % 128 == 0 || i % 8 == 0) {
+            if (i % 128 == 0) {
+                snprintf(path, sizeof(path), "%s/dir%02zu", tree->root, i / 128);
+                mkdir(path, 0700);
+                search_bench_add_path(tree, path);
+            }
+            snprintf(path, sizeof(path), "%s/dir%02zu/sub%02zu", tree->root, i / 128, i / 8 % 16);
+            mkdir(path, 0700);
+            search_bench_add_path(tree, path);
+        }
+
+        // Mostly small files, some medium and a few large ones (split in chunks)
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        size_t size = random % 100 < 90 ? 1024 + random % (16 * 1024)
+            : random % 100 < 99 ? 64 * 1024 + random % (256 * 1024) : 2 * 1024 * 1024 + random % (4 * 1024 * 1024);
+
+        bool binary = i % 50 == 49;
+        snprintf(path, sizeof(path), "%s/dir%02zu/sub%02zu/%s%04zu.%s", tree->root, i / 128, i / 8 % 16,
+            binary ? "core" : "app", i, binary ? "bin" : "log");
+        FILE *file = fopen(path, "wb");
+        if (!file) {
+            LOG_ERROR("Failed to create '%s'", path);
+            exit(EXIT_FAILURE);
+        }
+        search_bench_add_path(tree, path);
+
+        size_t written = 0;
+        if (binary) {
+            fputc('\0', file);
+            written++;
+            tree->binary_files++;
+        }
+        while (written < size) {
+            fwrite(corpus_line(&corpus, line), 1, corpus.lengths[line], file);
+            fputc('\n', file);
+            written += corpus.lengths[line] + 1;
+            line = (line + 1) % corpus.line_count;
+        }
+        fclose(file);
+
+        if (!binary) tree->bytes += written;
+    }
+
+    corpus_destroy(&corpus);
+}
+
+static void search_bench_remove_tree(SearchTree *tree) {
+    // Children were added after their parents
+    for (size_t i = tree->path_count; i-- > 0;) {
+        if (remove(tree->paths[i])) LOG_WARN("Failed to remove '%s'", tree->paths[i]);
+        free(tree->paths[i]);
+    }
+    free(tree->paths);
+}
+
+static void search_bench_add_path(SearchTree *tree, const char *path) {
+    if (!(tree->path_count & (tree->path_count - 1))) {
+        tree->paths = realloc(tree->paths, (tree->path_count ? tree->path_count * 2 : 1) * sizeof(char *));
+        if (!tree->paths) {
+            LOG_ERROR("Failed to allocate the tree paths");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    tree->paths[tree->path_count] = malloc(strlen(path) + 1);
+    strcpy(tree->paths[tree->path_count++], path);
+}
+
+static void search_bench_run(const SearchTree *tree, const SearchBenchOptions *options, SearchIo io, int threads,
+    SearchBenchRun *run) {
+    *run = (SearchBenchRun){.threads = threads, .io = io};
+
+    SearchOptions search_options = {
+        .threads = threads,
+        .chunk_bytes = options->chunk_bytes,
+        .io = io,
+        .queue_depth = options->queue_depth,
+    };
+    const char *paths[] = {tree->root};
+
+    FILE *output = tmpfile();
+    if (!output) {
+        LOG_ERROR("Failed to create a temporary file");
+        exit(EXIT_FAILURE);
+    }
+
+    // The first search warms up the page cache, its output is the one hashed
+    size_t searches = 0;
+    double start = bench_now(), elapsed;
+    do {
+        search_paths(options->pattern, paths, 1, &search_options, output, &run->summary);
+        if (!searches++) {
+            run->output_hash = search_bench_hash_file(output);
+            start = bench_now();
+        }
+        rewind(output);
+    } while ((elapsed = bench_now() - start) < options->min_time || searches < 2);
+    run->seconds = elapsed / (searches - 1);
+
+    fclose(output);
+}
+
+static uint64_t search_bench_hash_file(FILE *file) {
+    uint64_t hash = BENCH_HASH_START;
+    fflush(file);
+    rewind(file);
+
+    char chunk[4096];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file))) hash = bench_hash(hash, chunk, read);
+
+    return hash;
+}
@@ -0,0 +1,247 @@
+#include "harness.h"
+
+#include "src/regex.h"
+#include "src/state.h"
+#include "src/logger.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Longest pattern built from the keywords (with the NUL).
+ */
+#define WORD_BENCH_PATTERN_SIZE 256
+
+/**
+ * @struct WordBenchOptions
+ * @brief Command line options of the word boundary benchmark.
+ */
+typedef struct WordBenchOptions {
+    BenchCommonOptions common; /**< Output, filter, corpus size and seed */
+    double min_time; /**< Minimum seconds to spend measuring each version */
+} WordBenchOptions;
+
+/**
+ * @struct WordBenchCase
+ * @brief Keywords searched as whole words in the lines of a corpus.
+ *
+ * No keyword is a prefix of another one, so the leftmost match of the
+ * alternation at a start is the only keyword there and the post filter
+ * version finds the same lines.
+ */
+typedef struct WordBenchCase {
+    const char *name; /**< Name of the case */
+    const char *keywords; /**< The keywords, separated by '|' */
+    CorpusKind corpus; /**< Corpus the lines come from */
+} WordBenchCase;
+
+/**
+ * @enum WordBenchVersion
+ * @brief The ways of finding the lines with a keyword as a whole word.
+ */
+typedef enum WordBenchVersion {
+    WORD_BENCH_POST_FILTER, /**< Find the keywords with regex_find(), then check the bytes around each one */
+    WORD_BENCH_DFA, /**< Match "\\b(keywords)\\b" with the dfa (regex_match_batch()) */
+    WORD_BENCH_NFA, /**< Match "\\b(keywords)\\b" by simulating the nfa (REGEX_FLAG_NO_DFA) */
+    WORD_BENCH_VERSION_COUNT
+} WordBenchVersion;
+
+/**
+ * @struct WordBenchRun
+ * @brief Measurements of one version.
+ */
+typedef struct WordBenchRun {
+    double seconds; /**< Seconds per pass over the lines */
+    size_t matched_lines; /**< Lines matched in one pass */
+    uint64_t lines_hash; /**< FNV-1a hash of the indexes of the matched lines */
+} WordBenchRun;
+
+/**
+ * @brief Names of the versions in the JSON output.
+ */
+static const char *const word_bench_version_names[] = {"post_filter", "dfa", "nfa"};
+
+static const WordBenchCase word_bench_cases[] = {
+    // Keywords that are often inside other words
+    {"text/short_words", "a|the|fox|over", CORPUS_KIND_TEXT},
+    {"text/inner_words", "body|saw|ipsum", CORPUS_KIND_TEXT},
+    {"log/components", "worker|db|auth", CORPUS_KIND_LOG},
+    {"log/status", "ok|denied|timeout", CORPUS_KIND_LOG},
+    // Every occurrence is part of a longer word, the post filter checks each one
+    {"stack/never_whole", "Exception|Timeout|Pointer", CORPUS_KIND_STACK},
+    {"short/tokens", "bot|curl|json|html", CORPUS_KIND_SHORT},
+};
+
+/**
+ * @brief Parse an option of the benchmark (see BenchOptionParser).
+ *
+ * @param options Pointer to the WordBenchOptions
+ * @param name The option
+ * @param value Its value
+ *
+ * @return false if the option is unknown or its value is invalid.
+ */
+static bool word_bench_parse_option(void *options, const char *name, const char *value);
+
+/**
+ * @brief Find the lines with a keyword as a whole word once.
+ *
+ * @param regex Pointer to the regex of the version
+ * @param inputs The lines
+ * @param count Number of lines
+ * @param version How to find the lines
+ * @param results Bitmap of (count + 63) / 64 words to store the matched lines in
+ * @param run Pointer to store the counts and the hash of the line indexes
+ */
+static void word_bench_pass(Regex *regex, const RegexInput *inputs, size_t count, WordBenchVersion version,
+    uint64_t *results, WordBenchRun *run);
+
+/**
+ * @brief Check whether a line has one of the keywords found by the regex of the alternation as a whole word.
+ *
+ * @param regex Pointer to the regex of the alternation
+ * @param input The line
+ *
+ * @return true if one of the matches is a whole word.
+ */
+static bool word_bench_post_filter(Regex *regex, const RegexInput *input);
+
+int main(int argc, const char **argv) {
+    WordBenchOptions options = {
+        .common = {.corpus_bytes = 8 * 1024 * 1024, .seed = 42},
+        .min_time = 0.3,
+    };
+
+    if (!bench_parse_arguments(&options.common, argc, argv, word_bench_parse_option, &options)) {
+        LOG_INFO("Usage: regexer_word_bench [--out <file>] [--filter <name>] [--size <bytes>] [--min-time <seconds>]"
+            " [--seed <seed>]");
+        return EXIT_FAILURE;
+    }
+
+    Corpus corpora[CORPUS_KIND_COUNT];
+    bench_generate_corpora(corpora, options.common.corpus_bytes, options.common.seed);
+
+    FILE *out = stdout;
+    if (options.common.out_path && !(out = fopen(options.common.out_path, "w"))) {
+        LOG_ERROR("Failed to open '%s' for writing", options.common.out_path);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"version\": 1,\n");
+    fprintf(out, "  \"corpus_bytes\": %zu,\n", options.common.corpus_bytes);
+    fprintf(out, "  \"results\": [\n");
+
+    bool consistent = true, first = true;
+    size_t case_count = sizeof(word_bench_cases) / sizeof(word_bench_cases[0]);
+    for (size_t i = 0; i < case_count; ++i) {
+        const WordBenchCase *bench_case = &word_bench_cases[i];
+        if (options.common.filter && !strstr(bench_case->name, options.common.filter)) continue;
+
+        const Corpus *corpus = &corpora[bench_case->corpus];
+        RegexInput *inputs = malloc(sizeof(RegexInput) * (corpus->line_count ? corpus->line_count : 1));
+        uint64_t *results = malloc(sizeof(uint64_t) * ((corpus->line_count + 63) / 64 + 1));
+        if (!inputs || !results) {
+            LOG_ERROR("Failed to allocate %zu lines", corpus->line_count);
+            return EXIT_FAILURE;
+        }
+        for (size_t l = 0; l < corpus->line_count; ++l) inputs[l] = (RegexInput){corpus_line(corpus, l), corpus->lengths[l]};
+
+        char keywords[WORD_BENCH_PATTERN_SIZE], bounded[WORD_BENCH_PATTERN_SIZE];
+        snprintf(keywords, sizeof(keywords), "(%s)", bench_case->keywords);
+        snprintf(bounded, sizeof(bounded), "\\b(%s)\\b", bench_case->keywords);
+
+        Regex regexes[WORD_BENCH_VERSION_COUNT];
+        RegexOptions nfa_options = {.flags = REGEX_FLAG_NO_DFA};
+        regex_create(&regexes[WORD_BENCH_POST_FILTER], keywords);
+        regex_create(&regexes[WORD_BENCH_DFA], bounded);
+        regex_create_with_options(&regexes[WORD_BENCH_NFA], bounded, &nfa_options);
+
+        WordBenchRun runs[WORD_BENCH_VERSION_COUNT];
+        for (int version = 0; version < WORD_BENCH_VERSION_COUNT; ++version) {
+            size_t passes = 0;
+            double start = bench_now(), elapsed;
+            do {
+                word_bench_pass(&regexes[version], inputs, corpus->line_count, (WordBenchVersion)version, results,
+                    &runs[version]);
+                passes++;
+            } while ((elapsed = bench_now() - start) < options.min_time);
+            runs[version].seconds = elapsed / passes;
+
+            if (runs[version].matched_lines != runs[0].matched_lines || runs[version].lines_hash != runs[0].lines_hash) {
+                LOG_ERROR("'%s': %s matched %zu lines, %s %zu", bench_case->name, word_bench_version_names[version],
+                    runs[version].matched_lines, word_bench_version_names[0], runs[0].matched_lines);
+                consistent = false;
+            }
+        }
+
+        fprintf(out, "%s    {\"name\": ", first ? "" : ",\n");
+        bench_write_json_string(out, bench_case->name);
+        fprintf(out, ", \"pattern\": ");
+        bench_write_json_string(out, bounded);
+        fprintf(out, ", \"lines\": %zu, \"matched_lines\": %zu, \"dfa_states\": %d", corpus->line_count,
+            runs[0].matched_lines, regexes[WORD_BENCH_DFA].use_dfa ? regexes[WORD_BENCH_DFA].dfa.state_count : 0);
+        for (int version = 0; version < WORD_BENCH_VERSION_COUNT; ++version)
+            fprintf(out, ", \"%s_mb_per_s\": %.3lf", word_bench_version_names[version],
+                corpus->bytes / runs[version].seconds / 1e6);
+        fprintf(out, ", \"speedup\": %.3lf, \"nfa_speedup\": %.3lf}",
+            runs[WORD_BENCH_POST_FILTER].seconds / runs[WORD_BENCH_DFA].seconds,
+            runs[WORD_BENCH_NFA].seconds / runs[WORD_BENCH_DFA].seconds);
+        first = false;
+
+        for (int version = 0; version < WORD_BENCH_VERSION_COUNT; ++version) regex_destroy(&regexes[version]);
+        free(inputs);
+        free(results);
+    }
+
+    fprintf(out, "\n  ],\n");
+    fprintf(out, "  \"consistent\": %s\n", consistent ? "true" : "false");
+    fprintf(out, "}\n");
+
+    if (out != stdout) fclose(out);
+    for (int kind = 0; kind < CORPUS_KIND_COUNT; ++kind) corpus_destroy(&corpora[kind]);
+
+    return consistent ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool word_bench_parse_option(void *options, const char *name, const char *value) {
+    WordBenchOptions *word_options = options;
+    if (!strcmp(name, "--min-time")) word_options->min_time = strtod(value, NULL);
+    else return false;
+
+    return true;
+}
+
+static void word_bench_pass(Regex *regex, const RegexInput *inputs, size_t count, WordBenchVersion version,
+    uint64_t *results, WordBenchRun *run) {
+    *run = (WordBenchRun){.lines_hash = BENCH_HASH_START};
+
+    if (version == WORD_BENCH_POST_FILTER) {
+        memset(results, 0, sizeof(uint64_t) * ((count + 63) / 64));
+        for (size_t i = 0; i < count; ++i)
+            if (word_bench_post_filter(regex, &inputs[i])) results[i / 64] |= (uint64_t)1 << (i % 64);
+    } else {
+        regex_match_batch(regex, inputs, count, results);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if (!(results[i / 64] >> (i % 64) & 1)) continue;
+
+        run->matched_lines++;
+        run->lines_hash = bench_hash(run->lines_hash, &i, sizeof(i));
+    }
+}
+
+static bool word_bench_post_filter(Regex *regex, const RegexInput *input) {
+    const unsigned char *data = (const unsigned char *)input->data;
+    RegexSpan span;
+    for (size_t from = 0; regex_find(regex, input->data, input->len, from, &span); from = span.start + 1) {
+        bool start = !span.start || !state_is_word_byte(data[span.start - 1]);
+        bool end = span.end == input->len || !state_is_word_byte(data[span.end]);
+        if (start && end) return true;
+    }
+
+    return false;
+}
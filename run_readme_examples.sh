@@ -1,9 +1,9 @@
 #!/bin/sh
 examples="$(cat README.md | grep '^build/regexer')"
 
-echo "$examples" | while IFS= read -r line
+printf '%s\n' "$examples" | while IFS= read -r line
 do
-    echo "Running: $line"
+    printf 'Running: %s\n' "$line"
     eval "$line"
     echo
 done
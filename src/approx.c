@@ -0,0 +1,145 @@
+#include "approx.h"
+
+#include "state.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+/**
+ * @brief Get the sets of positions before the first byte.
+ *
+ * @param approx Pointer to the matcher
+ * @param sets The set of positions of each number of errors
+ * @param follows The positions following each set
+ * @param errors Highest number of errors to compute
+ */
+static void approx_start(const Approx *approx, uint64_t *sets, uint64_t *follows, int errors);
+
+/**
+ * @brief Step the sets of positions over one byte.
+ *
+ * @param approx Pointer to the matcher
+ * @param sets The set of positions of each number of errors, updated
+ * @param follows The positions following each set, updated
+ * @param errors Highest number of errors to step
+ * @param byte The byte
+ * @param offset Offset of the byte in the input
+ */
+static void approx_step(const Approx *approx, uint64_t *sets, uint64_t *follows, int errors, unsigned char byte,
+    size_t offset);
+
+/**
+ * @brief Get the fewest errors whose set reaches a last position.
+ *
+ * @param glushkov Pointer to the automaton
+ * @param sets The set of positions of each number of errors
+ * @param errors Highest number of errors to look at
+ *
+ * @return The number of errors, or -1 if no set reaches a last position.
+ */
+static int approx_distance(const Glushkov *glushkov, const uint64_t *sets, int errors);
+
+RegexError approx_create(Approx *approx, Regex *regex) {
+    *approx = (Approx){.allocator = &regex->allocator};
+
+    // Positions are bytes, an assertion is not one, and a '^' can't start after each new line
+    if (regex->assertions || regex->multiline) return REGEX_ERROR_UNSUPPORTED;
+
+    State **entries = memory_allocate(&regex->allocator, sizeof(State *) * regex->entry_count);
+    bool *anchored = memory_allocate(&regex->allocator, sizeof(bool) * regex->entry_count);
+    for (int e = 0; e < regex->entry_count; ++e) {
+        entries[e] = regex->entries[e].state;
+        anchored[e] = regex->entries[e].anchored;
+    }
+
+    bool created = glushkov_create(&approx->glushkov, entries, anchored, regex->entry_count, regex->total_states,
+        &regex->allocator);
+
+    memory_free(&regex->allocator, entries, sizeof(State *) * regex->entry_count);
+    memory_free(&regex->allocator, anchored, sizeof(bool) * regex->entry_count);
+    if (!created) return REGEX_ERROR_UNSUPPORTED;
+
+    uint64_t other = 0;
+    for (int byte = 0; byte < 256; ++byte)
+        if (byte != LINE_END) other |= approx->glushkov.bytes[byte];
+    approx->exact = approx->glushkov.bytes[LINE_END] & ~other;
+
+    return REGEX_OK;
+}
+
+void approx_destroy(Approx *approx) {
+    if (approx->glushkov.bytes) glushkov_destroy(&approx->glushkov, approx->allocator);
+    *approx = (Approx){0};
+}
+
+int approx_match_bytes(const Approx *approx, const uint8_t *buf, size_t len, int max_errors, int flags) {
+    if (max_errors < 0 || max_errors > APPROX_MAX_ERRORS) return -1;
+
+    const Glushkov *glushkov = &approx->glushkov;
+    if (glushkov->empty) return 0;
+
+    uint64_t sets[APPROX_MAX_ERRORS + 1], follows[APPROX_MAX_ERRORS + 1];
+    approx_start(approx, sets, follows, max_errors);
+    int best = approx_distance(glushkov, sets, max_errors);
+
+    // Add new line at the end of the line, if it isn't there
+    bool new_line = (flags & REGEX_MATCH_EOL) && (!len || buf[len - 1] != LINE_END);
+    // Only the sets with fewer errors than the best match so far can improve it
+    int errors = best < 0 ? max_errors : best - 1;
+    for (size_t i = 0; i < len + new_line && errors >= 0; ++i) {
+        approx_step(approx, sets, follows, errors, i < len ? buf[i] : LINE_END, i);
+
+        int distance = approx_distance(glushkov, sets, errors);
+        if (distance >= 0) best = distance, errors = distance - 1;
+    }
+
+    return best;
+}
+
+int approx_match_line(const Approx *approx, const char *line, int max_errors) {
+    return approx_match_bytes(approx, (const uint8_t *)line, strlen(line), max_errors, REGEX_MATCH_EOL);
+}
+
+static void approx_start(const Approx *approx, uint64_t *sets, uint64_t *follows, int errors) {
+    const Glushkov *glushkov = &approx->glushkov;
+
+    // Deleting the first positions needs no byte
+    sets[0] = follows[0] = 0;
+    for (int d = 1; d <= errors; ++d) {
+        sets[d] = (follows[d - 1] | glushkov->first | glushkov->first_anchored) & ~approx->exact;
+        follows[d] = glushkov_follow(glushkov, sets[d]);
+    }
+}
+
+static void approx_step(const Approx *approx, uint64_t *sets, uint64_t *follows, int errors, unsigned char byte,
+    size_t offset) {
+    const Glushkov *glushkov = &approx->glushkov;
+    uint64_t edited = ~approx->exact, mask = glushkov->bytes[byte];
+
+    // The set of one error less, before the byte
+    uint64_t below = 0, below_follow = 0, below_starts = 0;
+    for (int d = 0; d <= errors; ++d) {
+        // The start of the line is d errors away after d inserted bytes, the '^' alternatives start from there
+        uint64_t starts = glushkov->first | ((size_t)d >= offset ? glushkov->first_anchored : 0);
+        uint64_t next = (follows[d] | starts) & mask;
+
+        if (d) {
+            // Inserted byte, substituted for a position, and deleted position after the byte (deleting a first
+            // position after the byte costs as much as substituting the byte for it)
+            next |= below | ((below_follow | below_starts | follows[d - 1]) & edited);
+        }
+
+        below = sets[d];
+        below_follow = follows[d];
+        below_starts = starts;
+        sets[d] = next;
+        follows[d] = glushkov_follow(glushkov, next);
+    }
+}
+
+static int approx_distance(const Glushkov *glushkov, const uint64_t *sets, int errors) {
+    for (int d = 0; d <= errors; ++d)
+        if (sets[d] & glushkov->last) return d;
+
+    return -1;
+}
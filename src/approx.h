@@ -0,0 +1,98 @@
+#pragma once
+
+#include "regex.h"
+#include "glushkov.h"
+#include "memory.h"
+
+#include <stdint.h>
+
+/**
+ * @brief Largest number of errors a match can have.
+ */
+#define APPROX_MAX_ERRORS 8
+
+/**
+ * @struct Approx approx.h
+ * @brief Matcher of the regex with errors, simulating its position automaton bit-parallel.
+ *
+ * The lines contain the pattern with at most k errors if they have a
+ * substring at most k edits (byte insertions, deletions and substitutions)
+ * away from a string of the pattern: the Levenshtein distance of the
+ * substring. One set of positions is kept per number of errors (Wu-Manber),
+ * and each byte steps them together:
+ *
+ *     next[d] = (follow(set[d]) | first) & bytes[byte]   the byte matched
+ *             | set[d - 1]                               the byte inserted
+ *             | follow(set[d - 1]) | first               substituted for a position
+ *             | follow(next[d - 1])                      a position deleted
+ *
+ * The best distance is the fewest errors whose set reaches a last position.
+ *
+ * A character class (or '.') is one position, so one substitution or
+ * deletion; in UTF-8 mode the errors are counted in bytes. The new line of a
+ * '$' is never edited, so '$' still only matches the end of the line, and
+ * inserting bytes before the first position of a '^' alternative costs one
+ * error each.
+ */
+typedef struct Approx {
+    Glushkov glushkov; /**< Position automaton of the regex */
+    uint64_t exact; /**< Positions only matching the new line of a '$', never substituted or deleted */
+    const Allocator *allocator; /**< Allocator of the regex */
+} Approx;
+
+/**
+ * @brief Build the matcher of the regex.
+ *
+ * The regex must fit the position automaton: at most GLUSHKOV_MAX_POSITIONS
+ * positions, without word boundaries or text anchors, and not compiled with
+ * REGEX_FLAG_MULTILINE.
+ *
+ * @note Reads the nfa of the regex, which should not be stepped meanwhile.
+ * The matcher doesn't use the regex afterwards.
+ *
+ * @param approx Pointer to the matcher
+ * @param regex Pointer to the regex state
+ *
+ * @return REGEX_OK, or REGEX_ERROR_UNSUPPORTED if the regex doesn't fit (nothing is allocated then).
+ */
+RegexError approx_create(Approx *approx, Regex *regex);
+
+/**
+ * @brief Destroy the matcher.
+ *
+ * @param approx Pointer to the matcher
+ */
+void approx_destroy(Approx *approx);
+
+/**
+ * @brief Find the fewest errors the bytes contain the pattern with.
+ *
+ * Stops as soon as the pattern is found without errors. Like @ref
+ * regex_match_bytes, a '$' only matches a new line byte of the buffer
+ * unless REGEX_MATCH_EOL is given. Nothing matches if max_errors is out of
+ * range.
+ *
+ * @param approx Pointer to the matcher
+ * @param buf The bytes (need not be NUL-terminated)
+ * @param len Number of bytes
+ * @param max_errors Most errors allowed, at most APPROX_MAX_ERRORS
+ * @param flags Combination of @ref RegexMatchFlag
+ *
+ * @return The best distance, or -1 if the bytes don't contain the pattern with at most max_errors errors (or
+ * max_errors is out of range).
+ */
+int approx_match_bytes(const Approx *approx, const uint8_t *buf, size_t len, int max_errors, int flags);
+
+/**
+ * @brief Find the fewest errors the line contains the pattern with.
+ *
+ * Same as @ref approx_match_bytes over strlen(line) bytes with REGEX_MATCH_EOL.
+ *
+ * @param approx Pointer to the matcher
+ * @param line The line
+ * @param max_errors Most errors allowed, at most APPROX_MAX_ERRORS
+ *
+ * @return The best distance, or -1 if the line doesn't contain the pattern with at most max_errors errors (or
+ * max_errors is out of range).
+ */
+int approx_match_line(const Approx *approx, const char *line, int max_errors);
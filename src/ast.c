@@ -0,0 +1,471 @@
+#include "ast.h"
+
+#include "utils.h"
+
+#include <string.h>
+
+/**
+ * @brief Free the node without its children.
+ *
+ * @param allocator The allocator used for the node
+ * @param node The node
+ */
+static void ast_free_node(const Allocator *allocator, AstNode *node);
+
+/**
+ * @brief Replace the node with its only child.
+ *
+ * @param allocator The allocator used for the node
+ * @param node The node with one child
+ *
+ * @return The child.
+ */
+static AstNode *ast_unwrap(const Allocator *allocator, AstNode *node);
+
+/**
+ * @brief Get the nodes matched one after the other by the node.
+ *
+ * @param node Pointer to the node (the array of one node for nodes other than concatenations)
+ * @param elements Pointer to store the array of nodes
+ *
+ * @return Number of nodes (0 for the empty node).
+ */
+static int ast_sequence(AstNode **node, AstNode ***elements);
+
+/**
+ * @brief Append a child to the concatenation, merging it into the previous string or dropping it if it is empty.
+ *
+ * @param allocator The allocator used for the tree
+ * @param concat The concatenation
+ * @param child The child
+ */
+static void ast_concat_append(const Allocator *allocator, AstNode *concat, AstNode *child);
+
+/**
+ * @brief Simplify the repeat node (its child is simplified).
+ *
+ * @param allocator The allocator used for the tree
+ * @param node The repeat node
+ *
+ * @return The simplified node.
+ */
+static AstNode *ast_simplify_repeat(const Allocator *allocator, AstNode *node);
+
+/**
+ * @brief Simplify the concatenation (its children are simplified).
+ *
+ * @param allocator The allocator used for the tree
+ * @param node The concatenation
+ *
+ * @return The simplified node.
+ */
+static AstNode *ast_simplify_concat(const Allocator *allocator, AstNode *node);
+
+/**
+ * @brief Simplify the alternation (its children are simplified).
+ *
+ * @param allocator The allocator used for the tree
+ * @param node The alternation
+ *
+ * @return The simplified node.
+ */
+static AstNode *ast_simplify_alternation(const Allocator *allocator, AstNode *node);
+
+/**
+ * @brief Check whether the alternatives start with the same node (or the same byte).
+ *
+ * @param first Pointer to the first alternative
+ * @param second Pointer to the second alternative
+ *
+ * @return true if the alternatives have a common prefix.
+ */
+static bool ast_same_head(AstNode **first, AstNode **second);
+
+/**
+ * @brief Factor the common prefix of the alternatives out.
+ *
+ * @param allocator The allocator used for the tree
+ * @param alternatives The alternatives (all with the same head, destroyed or reused)
+ * @param count Number of alternatives (at least 2)
+ *
+ * @return The prefix followed by the alternation of what follows it in each alternative.
+ */
+static AstNode *ast_factor(const Allocator *allocator, AstNode **alternatives, int count);
+
+AstNode *ast_create(const Allocator *allocator, AstKind kind) {
+    AstNode *node = memory_allocate(allocator, sizeof(AstNode));
+    *node = (AstNode){.kind = kind};
+    return node;
+}
+
+AstNode *ast_create_string(const Allocator *allocator, const unsigned char *bytes, int len) {
+    AstNode *node = ast_create(allocator, AST_KIND_STRING);
+    node->bytes = memory_allocate(allocator, len);
+    memcpy(node->bytes, bytes, len);
+    node->len = len;
+    return node;
+}
+
+AstNode *ast_create_repeat(const Allocator *allocator, AstNode *child, AstRepeat repeat) {
+    AstNode *node = ast_create(allocator, AST_KIND_REPEAT);
+    node->repeat = repeat;
+    ast_add_child(allocator, node, child);
+    return node;
+}
+
+void ast_add_child(const Allocator *allocator, AstNode *node, AstNode *child) {
+    if (node->child_count == node->child_capacity) {
+        int capacity = node->child_capacity ? node->child_capacity * 2 : 4;
+        node->children = memory_reallocate(allocator, node->children, sizeof(AstNode *) * node->child_capacity,
+            sizeof(AstNode *) * capacity);
+        node->child_capacity = capacity;
+    }
+
+    node->children[node->child_count++] = child;
+}
+
+void ast_destroy(const Allocator *allocator, AstNode *node) {
+    if (!node) return;
+
+    for (int i = 0; i < node->child_count; ++i) ast_destroy(allocator, node->children[i]);
+    ast_free_node(allocator, node);
+}
+
+bool ast_equal(const AstNode *first, const AstNode *second) {
+    if (first->kind != second->kind || first->child_count != second->child_count) return false;
+
+    switch (first->kind) {
+        case AST_KIND_STRING:
+            return first->len == second->len && !memcmp(first->bytes, second->bytes, first->len);
+        case AST_KIND_CLASS:
+            return first->range_count == second->range_count
+                && !memcmp(first->ranges, second->ranges, sizeof(Range) * first->range_count);
+        case AST_KIND_REPEAT:
+            if (first->repeat != second->repeat) return false;
+            break;
+        case AST_KIND_ASSERTION:
+            return first->assertion == second->assertion;
+        default:
+            break;
+    }
+
+    for (int i = 0; i < first->child_count; ++i)
+        if (!ast_equal(first->children[i], second->children[i])) return false;
+
+    return true;
+}
+
+unsigned long long ast_hash(const AstNode *node) {
+    // FNV-1a over the fields ast_equal() compares
+    unsigned long long hash = 14695981039346656037ULL;
+    hash = (hash ^ (unsigned long long)node->kind) * 1099511628211ULL;
+    hash = (hash ^ (unsigned long long)node->child_count) * 1099511628211ULL;
+
+    switch (node->kind) {
+        case AST_KIND_STRING:
+            for (int i = 0; i < node->len; ++i) hash = (hash ^ node->bytes[i]) * 1099511628211ULL;
+            break;
+        case AST_KIND_CLASS:
+            for (int i = 0; i < node->range_count; ++i) {
+                hash = (hash ^ node->ranges[i].start) * 1099511628211ULL;
+                hash = (hash ^ node->ranges[i].end) * 1099511628211ULL;
+            }
+            break;
+        case AST_KIND_REPEAT:
+            hash = (hash ^ (unsigned long long)node->repeat) * 1099511628211ULL;
+            break;
+        case AST_KIND_ASSERTION:
+            hash = (hash ^ (unsigned long long)node->assertion) * 1099511628211ULL;
+            break;
+        default:
+            break;
+    }
+
+    for (int i = 0; i < node->child_count; ++i) hash = (hash ^ ast_hash(node->children[i])) * 1099511628211ULL;
+
+    return hash;
+}
+
+bool ast_contains(const AstNode *node, AstKind kind) {
+    if (node->kind == kind) return true;
+
+    for (int i = 0; i < node->child_count; ++i)
+        if (ast_contains(node->children[i], kind)) return true;
+
+    return false;
+}
+
+bool ast_matches_empty(const AstNode *node) {
+    switch (node->kind) {
+        case AST_KIND_EMPTY:
+        case AST_KIND_LINE_START:
+        case AST_KIND_ASSERTION:
+            return true;
+        case AST_KIND_STRING:
+        case AST_KIND_ANY:
+        case AST_KIND_CLASS:
+            return false;
+        case AST_KIND_CONCAT:
+            for (int i = 0; i < node->child_count; ++i)
+                if (!ast_matches_empty(node->children[i])) return false;
+            return true;
+        case AST_KIND_ALTERNATION:
+            for (int i = 0; i < node->child_count; ++i)
+                if (ast_matches_empty(node->children[i])) return true;
+            return false;
+        case AST_KIND_REPEAT:
+            return node->repeat != AST_REPEAT_ONE_OR_MORE || ast_matches_empty(node->children[0]);
+    }
+
+    SHOULD_NOT_REACH_HERE;
+}
+
+AstNode *ast_simplify(const Allocator *allocator, AstNode *node) {
+    for (int i = 0; i < node->child_count; ++i) node->children[i] = ast_simplify(allocator, node->children[i]);
+
+    switch (node->kind) {
+        case AST_KIND_REPEAT:
+            return ast_simplify_repeat(allocator, node);
+        case AST_KIND_CONCAT:
+            return ast_simplify_concat(allocator, node);
+        case AST_KIND_ALTERNATION:
+            return ast_simplify_alternation(allocator, node);
+        default:
+            return node;
+    }
+}
+
+static void ast_free_node(const Allocator *allocator, AstNode *node) {
+    memory_free(allocator, node->bytes, node->len);
+    memory_free(allocator, node->ranges, sizeof(Range) * node->range_count);
+    memory_free(allocator, node->children, sizeof(AstNode *) * node->child_capacity);
+    memory_free(allocator, node, sizeof(AstNode));
+}
+
+static AstNode *ast_unwrap(const Allocator *allocator, AstNode *node) {
+    AstNode *child = node->children[0];
+    ast_free_node(allocator, node);
+    return child;
+}
+
+static int ast_sequence(AstNode **node, AstNode ***elements) {
+    switch ((*node)->kind) {
+        case AST_KIND_CONCAT:
+            *elements = (*node)->children;
+            return (*node)->child_count;
+        case AST_KIND_EMPTY:
+            *elements = NULL;
+            return 0;
+        default:
+            *elements = node;
+            return 1;
+    }
+}
+
+static void ast_concat_append(const Allocator *allocator, AstNode *concat, AstNode *child) {
+    if (child->kind == AST_KIND_EMPTY) {
+        ast_destroy(allocator, child);
+        return;
+    }
+
+    AstNode *last = concat->child_count ? concat->children[concat->child_count - 1] : NULL;
+    if (!last || last->kind != AST_KIND_STRING || child->kind != AST_KIND_STRING) {
+        ast_add_child(allocator, concat, child);
+        return;
+    }
+
+    last->bytes = memory_reallocate(allocator, last->bytes, last->len, last->len + child->len);
+    memcpy(last->bytes + last->len, child->bytes, child->len);
+    last->len += child->len;
+    ast_destroy(allocator, child);
+}
+
+static AstNode *ast_simplify_repeat(const Allocator *allocator, AstNode *node) {
+    AstNode *child = node->children[0];
+
+    // Repeating nothing is nothing
+    if (child->kind == AST_KIND_EMPTY) return ast_unwrap(allocator, node);
+
+    // (a*)*, (a+)?, (a|)+ and the like are a*, only (a+)+ and (a?)? stay the same
+    if (child->kind == AST_KIND_REPEAT) {
+        if (child->repeat != node->repeat) child->repeat = AST_REPEAT_ZERO_OR_MORE;
+        return ast_unwrap(allocator, node);
+    }
+
+    return node;
+}
+
+static AstNode *ast_simplify_concat(const Allocator *allocator, AstNode *node) {
+    AstNode **children = node->children;
+    int count = node->child_count, capacity = node->child_capacity;
+    node->children = NULL;
+    node->child_count = node->child_capacity = 0;
+
+    // Splice the nested concatenations (groups) and merge the adjacent bytes into strings
+    for (int i = 0; i < count; ++i) {
+        if (children[i]->kind != AST_KIND_CONCAT) {
+            ast_concat_append(allocator, node, children[i]);
+            continue;
+        }
+
+        for (int j = 0; j < children[i]->child_count; ++j) ast_concat_append(allocator, node, children[i]->children[j]);
+        ast_free_node(allocator, children[i]);
+    }
+    memory_free(allocator, children, sizeof(AstNode *) * capacity);
+
+    if (node->child_count == 1) return ast_unwrap(allocator, node);
+    if (!node->child_count) node->kind = AST_KIND_EMPTY;
+
+    return node;
+}
+
+static AstNode *ast_simplify_alternation(const Allocator *allocator, AstNode *node) {
+    AstNode **children = node->children;
+    int count = node->child_count, capacity = node->child_capacity;
+
+    // Splice the nested alternations first, everything is factored at once
+    AstNode **flat = NULL;
+    int flat_count = 0, flat_capacity = 0;
+    for (int i = 0; i < count; ++i) {
+        AstNode **from = children[i]->kind == AST_KIND_ALTERNATION ? children[i]->children : &children[i];
+        int from_count = children[i]->kind == AST_KIND_ALTERNATION ? children[i]->child_count : 1;
+
+        if (flat_count + from_count > flat_capacity) {
+            int new_capacity = (flat_count + from_count) * 2;
+            flat = memory_reallocate(allocator, flat, sizeof(AstNode *) * flat_capacity, sizeof(AstNode *) * new_capacity);
+            flat_capacity = new_capacity;
+        }
+        memcpy(flat + flat_count, from, sizeof(AstNode *) * from_count);
+        flat_count += from_count;
+
+        if (children[i]->kind == AST_KIND_ALTERNATION) ast_free_node(allocator, children[i]);
+    }
+    memory_free(allocator, children, sizeof(AstNode *) * capacity);
+    node->children = NULL;
+    node->child_count = node->child_capacity = 0;
+
+    // Alternatives starting the same way are merged into one, the rest of them is factored again (building a trie)
+    bool empty = false;
+    for (int i = 0; i < flat_count; ++i) {
+        if (!flat[i]) continue;
+
+        if (flat[i]->kind == AST_KIND_EMPTY) {
+            // Matching nothing twice is matching nothing
+            if (empty) ast_destroy(allocator, flat[i]);
+            else ast_add_child(allocator, node, flat[i]);
+            empty = true;
+            continue;
+        }
+
+        int same = 1;
+        for (int j = i + 1; j < flat_count; ++j) {
+            if (!flat[j] || !ast_same_head(&flat[i], &flat[j])) continue;
+            // Move it next to the others starting the same way
+            AstNode *moved = flat[j];
+            memmove(flat + i + same + 1, flat + i + same, sizeof(AstNode *) * (j - i - same));
+            flat[i + same++] = moved;
+        }
+
+        if (same == 1) ast_add_child(allocator, node, flat[i]);
+        else ast_add_child(allocator, node, ast_factor(allocator, flat + i, same));
+        for (int j = i; j < i + same; ++j) flat[j] = NULL;
+    }
+    memory_free(allocator, flat, sizeof(AstNode *) * flat_capacity);
+
+    if (node->child_count == 1) return ast_unwrap(allocator, node);
+    if (!empty) return node;
+
+    // (a|b|) is (a|b)?
+    int kept = 0;
+    for (int i = 0; i < node->child_count; ++i) {
+        if (node->children[i]->kind != AST_KIND_EMPTY) node->children[kept++] = node->children[i];
+        else ast_destroy(allocator, node->children[i]);
+    }
+    node->child_count = kept;
+    if (kept == 1) node = ast_unwrap(allocator, node);
+
+    return ast_simplify_repeat(allocator, ast_create_repeat(allocator, node, AST_REPEAT_ZERO_OR_ONE));
+}
+
+static bool ast_same_head(AstNode **first, AstNode **second) {
+    AstNode **first_elements, **second_elements;
+    if (!ast_sequence(first, &first_elements) || !ast_sequence(second, &second_elements)) return false;
+
+    const AstNode *first_head = first_elements[0], *second_head = second_elements[0];
+    if (first_head->kind == AST_KIND_STRING && second_head->kind == AST_KIND_STRING)
+        return first_head->bytes[0] == second_head->bytes[0];
+
+    return ast_equal(first_head, second_head);
+}
+
+static AstNode *ast_factor(const Allocator *allocator, AstNode **alternatives, int count) {
+    AstNode ***elements = memory_allocate(allocator, sizeof(AstNode **) * count);
+    int *lens = memory_allocate(allocator, sizeof(int) * count);
+    for (int i = 0; i < count; ++i) lens[i] = ast_sequence(&alternatives[i], &elements[i]);
+
+    // The whole nodes all the alternatives start with, then the bytes the next strings start with
+    int prefix = 0, prefix_bytes = 0;
+    while (true) {
+        bool equal = true, strings = true;
+        for (int i = 0; i < count && (equal || strings); ++i) {
+            if (prefix >= lens[i]) {
+                equal = strings = false;
+                break;
+            }
+            equal &= ast_equal(elements[0][prefix], elements[i][prefix]);
+            strings &= elements[i][prefix]->kind == AST_KIND_STRING;
+        }
+
+        if (equal) {
+            prefix++;
+            continue;
+        }
+
+        if (strings) {
+            prefix_bytes = elements[0][prefix]->len;
+            for (int i = 1; i < count; ++i) {
+                int same = 0;
+                const AstNode *string = elements[i][prefix];
+                while (same < prefix_bytes && same < string->len && string->bytes[same] == elements[0][prefix]->bytes[same]) same++;
+                prefix_bytes = same;
+            }
+        }
+        break;
+    }
+
+    AstNode *factored = ast_create(allocator, AST_KIND_CONCAT);
+    for (int k = 0; k < prefix; ++k) ast_add_child(allocator, factored, elements[0][k]);
+    if (prefix_bytes) ast_add_child(allocator, factored, ast_create_string(allocator, elements[0][prefix]->bytes, prefix_bytes));
+
+    AstNode *rest = ast_create(allocator, AST_KIND_ALTERNATION);
+    for (int i = 0; i < count; ++i) {
+        // Concatenations are only taken apart, other nodes are the elements themselves
+        bool wrapper = alternatives[i]->kind == AST_KIND_CONCAT || alternatives[i]->kind == AST_KIND_EMPTY;
+        for (int k = i ? 0 : prefix; k < prefix; ++k) ast_destroy(allocator, elements[i][k]);
+
+        // What is left after the prefix
+        AstNode *left = ast_create(allocator, AST_KIND_CONCAT);
+        for (int k = prefix; k < lens[i]; ++k) {
+            AstNode *element = elements[i][k];
+            if (k == prefix && prefix_bytes) {
+                if (element->len == prefix_bytes) {
+                    ast_destroy(allocator, element);
+                    continue;
+                }
+                memmove(element->bytes, element->bytes + prefix_bytes, element->len - prefix_bytes);
+                element->bytes = memory_reallocate(allocator, element->bytes, element->len, element->len - prefix_bytes);
+                element->len -= prefix_bytes;
+            }
+            ast_add_child(allocator, left, element);
+        }
+        ast_add_child(allocator, rest, left);
+
+        if (wrapper) ast_free_node(allocator, alternatives[i]);
+    }
+    ast_add_child(allocator, factored, rest);
+
+    memory_free(allocator, elements, sizeof(AstNode **) * count);
+    memory_free(allocator, lens, sizeof(int) * count);
+
+    return ast_simplify(allocator, factored);
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "range.h"
+#include "memory.h"
+
+#include <stdbool.h>
+
+/**
+ * @enum AstKind
+ * @brief Kind of the node of the pattern's syntax tree.
+ */
+typedef enum AstKind {
+    AST_KIND_EMPTY, /**< Matches the empty string (like an empty alternative of a group) */
+    AST_KIND_LINE_START, /**< '^', only first in a top-level alternative */
+    AST_KIND_STRING, /**< Bytes one after the other */
+    AST_KIND_ANY, /**< '.' (any byte) */
+    AST_KIND_CLASS, /**< Any of the ranges (of bytes, or code points in UTF-8 mode) */
+    AST_KIND_CONCAT, /**< The children one after the other */
+    AST_KIND_ALTERNATION, /**< Any of the children */
+    AST_KIND_REPEAT, /**< The only child repeated */
+    AST_KIND_ASSERTION, /**< A position matching an assertion ('\\b', '\\B', '\\A' or '\\z'), no byte */
+} AstKind;
+
+/**
+ * @enum AstAssertion
+ * @brief What the position of AST_KIND_ASSERTION has around it.
+ */
+typedef enum AstAssertion {
+    AST_ASSERTION_WORD_BOUNDARY, /**< '\\b', a word byte on one side only */
+    AST_ASSERTION_NOT_WORD_BOUNDARY, /**< '\\B', word bytes on both sides or on none */
+    AST_ASSERTION_TEXT_START, /**< '\\A', the start of the input */
+    AST_ASSERTION_TEXT_END, /**< '\\z', the end of the input */
+} AstAssertion;
+
+/**
+ * @enum AstRepeat
+ * @brief How many times the child of AST_KIND_REPEAT is repeated.
+ */
+typedef enum AstRepeat {
+    AST_REPEAT_ZERO_OR_MORE, /**< '*' */
+    AST_REPEAT_ONE_OR_MORE, /**< '+' */
+    AST_REPEAT_ZERO_OR_ONE, /**< '?' */
+} AstRepeat;
+
+typedef struct AstNode AstNode;
+
+/**
+ * @struct AstNode ast.h
+ * @brief Node of the syntax tree the parser builds, simplified before it is compiled to the nfa.
+ */
+struct AstNode {
+    AstKind kind; /**< Kind of the node */
+    AstRepeat repeat; /**< Repetition of AST_KIND_REPEAT */
+    AstAssertion assertion; /**< Assertion of AST_KIND_ASSERTION */
+    unsigned char *bytes; /**< Bytes of AST_KIND_STRING */
+    int len; /**< Number of bytes */
+    Range *ranges; /**< Sorted, non-overlapping ranges of AST_KIND_CLASS */
+    int range_count; /**< Number of ranges */
+    AstNode **children; /**< Children of AST_KIND_CONCAT, AST_KIND_ALTERNATION and AST_KIND_REPEAT */
+    int child_count; /**< Number of children */
+    int child_capacity; /**< Number of children allocated */
+};
+
+/**
+ * @brief Create a node without children.
+ *
+ * @param allocator The allocator to use (NULL for default allocator)
+ * @param kind Kind of the node
+ *
+ * @return The node.
+ */
+AstNode *ast_create(const Allocator *allocator, AstKind kind);
+
+/**
+ * @brief Create a string node.
+ *
+ * @param allocator The allocator to use
+ * @param bytes The bytes (copied)
+ * @param len Number of bytes (at least 1)
+ *
+ * @return The node.
+ */
+AstNode *ast_create_string(const Allocator *allocator, const unsigned char *bytes, int len);
+
+/**
+ * @brief Create a repeat node.
+ *
+ * @param allocator The allocator to use
+ * @param child The node repeated (owned by the new node)
+ * @param repeat The repetition
+ *
+ * @return The node.
+ */
+AstNode *ast_create_repeat(const Allocator *allocator, AstNode *child, AstRepeat repeat);
+
+/**
+ * @brief Append a child to the node.
+ *
+ * @param allocator The allocator used for the node
+ * @param node The node
+ * @param child The child (owned by the node)
+ */
+void ast_add_child(const Allocator *allocator, AstNode *node, AstNode *child);
+
+/**
+ * @brief Destroy the node and its children.
+ *
+ * @param allocator The allocator used for the node
+ * @param node The node (can be NULL)
+ */
+void ast_destroy(const Allocator *allocator, AstNode *node);
+
+/**
+ * @brief Check whether two nodes match the same strings the same way (same structure).
+ *
+ * @param first The first node
+ * @param second The second node
+ *
+ * @return true if the nodes are equal.
+ */
+bool ast_equal(const AstNode *first, const AstNode *second);
+
+/**
+ * @brief Hash the structure of the node, equal nodes (see @ref ast_equal) have equal hashes.
+ *
+ * @param node The node
+ *
+ * @return The hash.
+ */
+unsigned long long ast_hash(const AstNode *node);
+
+/**
+ * @brief Check whether the node or any node below it is of the kind.
+ *
+ * @param node The node
+ * @param kind The kind
+ *
+ * @return true if a node of the kind was found.
+ */
+bool ast_contains(const AstNode *node, AstKind kind);
+
+/**
+ * @brief Check whether the node can match the empty string.
+ *
+ * @param node The node
+ *
+ * @return true if it can match without consuming a byte.
+ */
+bool ast_matches_empty(const AstNode *node);
+
+/**
+ * @brief Simplify the tree without changing what it matches.
+ *
+ * Nested concatenations and alternations are flattened into their parent,
+ * groups with one child are replaced by it, repeated repeats are folded into
+ * one repeat, an empty alternative makes the alternation optional, adjacent
+ * bytes are merged into strings and the common prefixes of the alternatives
+ * are factored out, so that the alternatives become a trie.
+ *
+ * @param allocator The allocator used for the tree
+ * @param node The tree (destroyed or reused)
+ *
+ * @return The simplified tree.
+ */
+AstNode *ast_simplify(const Allocator *allocator, AstNode *node);
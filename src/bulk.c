@@ -0,0 +1,204 @@
+#include "bulk.h"
+
+#ifdef RE_SEARCH
+#include "pool.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @struct BulkPattern
+ * @brief A pattern and where its regex goes.
+ */
+typedef struct BulkPattern {
+    const char *pattern; /**< The pattern */
+    size_t len; /**< Length of the pattern */
+    size_t index; /**< Index of the pattern (and of its regex) */
+} BulkPattern;
+
+/**
+ * @struct BulkShard
+ * @brief Patterns compiled through one interner.
+ */
+typedef struct BulkShard {
+    Bulk *bulk; /**< The bulk */
+    CompilerInterner *interner; /**< The interner of the shard */
+    const BulkPattern *patterns; /**< The patterns of the shard */
+    size_t count; /**< Number of patterns */
+    const RegexOptions *options; /**< Options used to compile the patterns */
+} BulkShard;
+
+/**
+ * @brief Compare two patterns from their end.
+ *
+ * @param first The first pattern
+ * @param second The second pattern
+ *
+ * @return Negative, zero or positive like strcmp() on the reversed patterns.
+ */
+static int bulk_compare_reversed(const void *first, const void *second);
+
+/**
+ * @brief Compile the patterns of the shard, one after the other.
+ *
+ * @param shard The shard
+ */
+static void bulk_compile_shard(BulkShard *shard);
+
+#ifdef RE_SEARCH
+/**
+ * @brief Submit the task of each shard.
+ *
+ * @param pool The pool running the task
+ * @param worker Index of the worker running the task
+ * @param arg The shards
+ */
+static void bulk_task_root(Pool *pool, int worker, void *arg);
+
+/**
+ * @brief Compile the shard.
+ *
+ * @param pool The pool running the task
+ * @param worker Index of the worker running the task
+ * @param arg The shard
+ */
+static void bulk_task_shard(Pool *pool, int worker, void *arg);
+#endif
+
+RegexError bulk_create(Bulk *bulk, const char *const *patterns, size_t count, const BulkOptions *options) {
+    static const BulkOptions default_options = {0};
+    if (!options) options = &default_options;
+
+    *bulk = (Bulk){.count = count, .shard_count = 1};
+    bulk->allocator = options->regex.allocator ? *options->regex.allocator : *memory_default_allocator();
+
+    RegexOptions regex_options = options->regex;
+    regex_options.allocator = &bulk->allocator;
+
+    // Patterns ending the same way share the most states, put them in the same shard
+    BulkPattern *sorted = memory_try_allocate(&bulk->allocator, sizeof(BulkPattern) * (count ? count : 1));
+    if (!sorted) {
+        *bulk = (Bulk){0};
+        return REGEX_ERROR_OUT_OF_MEMORY;
+    }
+    for (size_t i = 0; i < count; ++i) sorted[i] = (BulkPattern){patterns[i], strlen(patterns[i]), i};
+    qsort(sorted, count, sizeof(BulkPattern), bulk_compare_reversed);
+
+#ifdef RE_SEARCH
+    // Without workers the patterns are compiled in one shard
+    Pool pool;
+    bool parallel = pool_create(&pool, options->threads, bulk, &bulk->allocator);
+    if (parallel && (size_t)pool.worker_count < count) bulk->shard_count = pool.worker_count;
+    else if (parallel && count) bulk->shard_count = (int)count;
+#endif
+
+    bulk->regexes = memory_try_allocate(&bulk->allocator, sizeof(Regex) * (count ? count : 1));
+    bulk->shards = memory_try_allocate(&bulk->allocator, sizeof(CompilerInterner) * bulk->shard_count);
+    BulkShard *shards = memory_try_allocate(&bulk->allocator, sizeof(BulkShard) * (bulk->shard_count + 1));
+    if (!bulk->regexes || !bulk->shards || !shards) {
+#ifdef RE_SEARCH
+        if (parallel) pool_destroy(&pool);
+#endif
+        memory_free(&bulk->allocator, shards, sizeof(BulkShard) * (bulk->shard_count + 1));
+        memory_free(&bulk->allocator, bulk->shards, sizeof(CompilerInterner) * bulk->shard_count);
+        memory_free(&bulk->allocator, bulk->regexes, sizeof(Regex) * (count ? count : 1));
+        memory_free(&bulk->allocator, sorted, sizeof(BulkPattern) * (count ? count : 1));
+        *bulk = (Bulk){0};
+        return REGEX_ERROR_OUT_OF_MEMORY;
+    }
+
+    for (int i = 0; i < bulk->shard_count; ++i) {
+        size_t first = count * i / bulk->shard_count, last = count * (i + 1) / bulk->shard_count;
+        compiler_interner_create(&bulk->shards[i], &bulk->allocator);
+        shards[i] = (BulkShard){bulk, &bulk->shards[i], sorted + first, last - first, &regex_options};
+    }
+    // Marks the end of the shards for the root task
+    shards[bulk->shard_count] = (BulkShard){0};
+
+#ifdef RE_SEARCH
+    if (parallel) {
+        pool_start(&pool, bulk_task_root, shards);
+        pool_join(&pool);
+        pool_destroy(&pool);
+    } else {
+        bulk_compile_shard(&shards[0]);
+    }
+#else
+    bulk_compile_shard(&shards[0]);
+#endif
+
+    memory_free(&bulk->allocator, shards, sizeof(BulkShard) * (bulk->shard_count + 1));
+    memory_free(&bulk->allocator, sorted, sizeof(BulkPattern) * (count ? count : 1));
+
+    return REGEX_OK;
+}
+
+void bulk_destroy(Bulk *bulk) {
+    // The regexes first, the interners own their states
+    for (size_t i = 0; i < bulk->count; ++i) regex_destroy(&bulk->regexes[i]);
+    for (int i = 0; i < bulk->shard_count; ++i) compiler_interner_destroy(&bulk->shards[i]);
+
+    memory_free(&bulk->allocator, bulk->regexes, sizeof(Regex) * (bulk->count ? bulk->count : 1));
+    memory_free(&bulk->allocator, bulk->shards, sizeof(CompilerInterner) * bulk->shard_count);
+
+    *bulk = (Bulk){0};
+}
+
+void bulk_get_report(const Bulk *bulk, BulkReport *report) {
+    *report = (BulkReport){.pattern_count = bulk->count, .shards = bulk->shard_count};
+
+    // The tables and buffers of each regex are the same either way (counted as they were built)
+    size_t regex_bytes = 0;
+    for (size_t i = 0; i < bulk->count; ++i) {
+        const Regex *regex = &bulk->regexes[i];
+        regex_bytes += regex->memory.table_bytes + regex->memory.scratch_bytes + sizeof(RegexEntry) * regex->entry_count;
+    }
+
+    size_t state_bytes = 0;
+    for (int i = 0; i < bulk->shard_count; ++i) {
+        report->separate_states += bulk->shards[i].requested_states;
+        report->states += (unsigned long long)bulk->shards[i].state_count;
+        state_bytes += compiler_interner_bytes(&bulk->shards[i]);
+    }
+
+    report->separate_bytes = regex_bytes + sizeof(State) * report->separate_states;
+    report->bytes = regex_bytes + state_bytes;
+    report->saved_bytes = report->separate_bytes > report->bytes ? report->separate_bytes - report->bytes : 0;
+}
+
+static int bulk_compare_reversed(const void *first, const void *second) {
+    const BulkPattern *a = first, *b = second;
+
+    size_t i = a->len, j = b->len;
+    while (i && j) {
+        unsigned char x = (unsigned char)a->pattern[--i], y = (unsigned char)b->pattern[--j];
+        if (x != y) return x < y ? -1 : 1;
+    }
+
+    if (i || j) return i ? 1 : -1;
+    // Keep the order of the patterns for the same text
+    return a->index < b->index ? -1 : a->index > b->index;
+}
+
+static void bulk_compile_shard(BulkShard *shard) {
+    for (size_t i = 0; i < shard->count; ++i) {
+        const BulkPattern *pattern = &shard->patterns[i];
+        regex_create_interned(&shard->bulk->regexes[pattern->index], pattern->pattern, shard->options, shard->interner);
+    }
+
+    compiler_interner_finish(shard->interner);
+}
+
+#ifdef RE_SEARCH
+static void bulk_task_root(Pool *pool, int worker, void *arg) {
+    BulkShard *shards = arg;
+    for (BulkShard *shard = shards; shard->bulk; ++shard) pool_submit(pool, worker, bulk_task_shard, shard);
+}
+
+static void bulk_task_shard(Pool *pool, int worker, void *arg) {
+    (void)pool;
+    (void)worker;
+    bulk_compile_shard(arg);
+}
+#endif
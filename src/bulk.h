@@ -0,0 +1,84 @@
+#pragma once
+
+#include "regex.h"
+#include "compiler.h"
+
+#include <stddef.h>
+
+/**
+ * @struct BulkOptions bulk.h
+ * @brief Options of @ref bulk_create.
+ */
+typedef struct BulkOptions {
+    RegexOptions regex; /**< Options used to compile every pattern */
+    int threads; /**< Number of workers (0 for number of online processors, always 1 without RE_SEARCH) */
+} BulkOptions;
+
+/**
+ * @struct BulkReport bulk.h
+ * @brief Memory used by the regexes of a @ref Bulk, against compiling the patterns one by one.
+ */
+typedef struct BulkReport {
+    size_t pattern_count; /**< Number of patterns */
+    int shards; /**< Number of interners the patterns were spread over (one per worker) */
+    unsigned long long separate_states; /**< Nfa states the patterns need when compiled one by one */
+    unsigned long long states; /**< Nfa states created (shared by the regexes of the same shard) */
+    size_t separate_bytes; /**< Bytes the regexes would use if compiled one by one */
+    size_t bytes; /**< Bytes used by the regexes and their shared states */
+    size_t saved_bytes; /**< separate_bytes - bytes */
+} BulkReport;
+
+/**
+ * @struct Bulk bulk.h
+ * @brief Many patterns compiled together, sharing their identical sub-automata.
+ */
+typedef struct Bulk {
+    Regex *regexes; /**< The regexes, in the order of the patterns */
+    size_t count; /**< Number of regexes */
+    CompilerInterner *shards; /**< The interners owning the states of the regexes */
+    int shard_count; /**< Number of interners */
+    Allocator allocator; /**< Allocator used for everything the bulk owns */
+} Bulk;
+
+/**
+ * @brief Compile the patterns, sharing the states of their identical sub-automata.
+ *
+ * The patterns are sorted by their reversed text and cut into one shard per
+ * worker, each compiled through its own interner (see CompilerInterner in
+ * compiler.h). Nfas are built from their end, so the fragments that are
+ * shared are the same strings, classes and loops followed by the same rest
+ * of the pattern (common endings, and whole duplicate patterns), and sorting
+ * the patterns from their end puts those in the same shard. Common prefixes
+ * can not be shared by regexes that must still match separately.
+ *
+ * The shards share nothing and are compiled in parallel (the dfas are built
+ * by the worker of their shard too), so the result does not depend on the
+ * number of threads except for how much is shared.
+ *
+ * @note The regexes of a bulk share states that matching with the nfa writes
+ * to: like a single regex, use the regexes of a bulk from one thread at a time.
+ *
+ * @param bulk Pointer to the bulk
+ * @param patterns The patterns
+ * @param count Number of patterns
+ * @param options The options (NULL for defaults)
+ *
+ * @return REGEX_OK (a pattern that fails to compile only sets the error of its regex), or
+ * REGEX_ERROR_OUT_OF_MEMORY if the bulk could not be allocated (the bulk is then empty).
+ */
+RegexError bulk_create(Bulk *bulk, const char *const *patterns, size_t count, const BulkOptions *options);
+
+/**
+ * @brief Destroy the regexes and their states.
+ *
+ * @param bulk Pointer to the bulk
+ */
+void bulk_destroy(Bulk *bulk);
+
+/**
+ * @brief Get the memory used by the regexes, and the memory saved by sharing their states.
+ *
+ * @param bulk Pointer to the bulk
+ * @param report Pointer to store the report
+ */
+void bulk_get_report(const Bulk *bulk, BulkReport *report);
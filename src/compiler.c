@@ -0,0 +1,637 @@
+#include "compiler.h"
+
+#include "utils.h"
+#include "regex.h"
+#include "utf8.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief Initial number of slots of the interner tables.
+ */
+#define COMPILER_INTERNER_MIN_SLOTS 64
+
+/**
+ * @brief Create a state and count it.
+ *
+ * @param compiler Pointer to compiler state
+ * @param c The character (or kind) of the state
+ * @param out The next state
+ *
+ * @return The state.
+ */
+static State *compiler_new_state(Compiler *compiler, int c, State *out);
+
+/**
+ * @brief Get the state matching c (in range if c is RANGE) then going to the outs, interned if the compiler has an interner.
+ *
+ * @param compiler Pointer to compiler state
+ * @param c The character (or kind) of the state
+ * @param out The next state
+ * @param out1 The other next state of a branch (or NULL)
+ * @param range The range of a RANGE state (zero otherwise)
+ *
+ * @return The state (an existing one if it was interned before).
+ */
+static State *compiler_shared_state(Compiler *compiler, int c, State *out, State *out1, Range range);
+
+/**
+ * @brief Hash what the state matches and where it goes.
+ *
+ * @param state The state
+ *
+ * @return The hash.
+ */
+static uint64_t compiler_state_hash(const State *state);
+
+/**
+ * @brief Find the slot of the interned state equal to the key.
+ *
+ * @param interner Pointer to the interner
+ * @param key The state looked up
+ *
+ * @return The slot of the equal state, or the free slot to store it in.
+ */
+static State **compiler_interner_find(CompilerInterner *interner, const State *key);
+
+/**
+ * @brief Find the slot of the loop.
+ *
+ * @param interner Pointer to the interner
+ * @param node The repeat node
+ * @param hash Hash of the node
+ * @param next The state after the loop
+ * @param flags Flags the loop is compiled with
+ *
+ * @return The slot of the loop (node is NULL if it was not compiled yet).
+ */
+static CompilerLoop *compiler_interner_find_loop(CompilerInterner *interner, const AstNode *node,
+    unsigned long long hash, State *next, int flags);
+
+/**
+ * @brief Give the state the next index and remember it (so that it is destroyed with the interner).
+ *
+ * @param interner Pointer to the interner
+ * @param state The new state
+ */
+static void compiler_interner_add(CompilerInterner *interner, State *state);
+
+/**
+ * @brief Double the number of slots of the state table and rehash the states.
+ *
+ * @param interner Pointer to the interner
+ */
+static void compiler_interner_grow(CompilerInterner *interner);
+
+/**
+ * @brief Double the number of slots of the loop table and rehash the loops.
+ *
+ * @param interner Pointer to the interner
+ */
+static void compiler_interner_grow_loops(CompilerInterner *interner);
+
+/**
+ * @brief Count the states reachable from the start.
+ *
+ * @param interner Pointer to the interner
+ * @param start The start state
+ *
+ * @return Number of states.
+ */
+static int compiler_interner_count(CompilerInterner *interner, State *start);
+
+/**
+ * @brief Branch to any of the states.
+ *
+ * @param compiler Pointer to compiler state
+ * @param starts The states
+ * @param count Number of states (at least 1)
+ *
+ * @return The first branch (or the only state).
+ */
+static State *compiler_join(Compiler *compiler, State *const *starts, int count);
+
+/**
+ * @brief Generate the nfa fragment matching the node.
+ *
+ * Fragments are generated from the end, so that every fragment knows the
+ * state following it and never has dangling outs.
+ *
+ * @param compiler Pointer to compiler state
+ * @param node The node
+ * @param next The state after the fragment
+ *
+ * @return The first state of the fragment (next if the node matches only the empty string).
+ */
+static State *compiler_fragment(Compiler *compiler, const AstNode *node, State *next);
+
+/**
+ * @brief Generate the nfa fragment matching the nodes one after the other.
+ *
+ * @param compiler Pointer to compiler state
+ * @param nodes The nodes
+ * @param count Number of nodes
+ * @param next The state after the fragment
+ *
+ * @return The first state of the fragment.
+ */
+static State *compiler_sequence(Compiler *compiler, AstNode *const *nodes, int count, State *next);
+
+/**
+ * @brief Generate the nfa fragment matching the bytes one after the other.
+ *
+ * In case-insensitive mode a letter is a branch to the states of both cases.
+ *
+ * @param compiler Pointer to compiler state
+ * @param node The string node
+ * @param next The state after the fragment
+ *
+ * @return The first state of the fragment.
+ */
+static State *compiler_string(Compiler *compiler, const AstNode *node, State *next);
+
+/**
+ * @brief Generate the nfa fragment matching any of the ranges.
+ *
+ * @param compiler Pointer to compiler state
+ * @param node The class node
+ * @param next The state after the fragment
+ *
+ * @return The first state of the fragment.
+ */
+static State *compiler_class(Compiler *compiler, const AstNode *node, State *next);
+
+/**
+ * @brief Get the state kind of the assertion.
+ *
+ * @param assertion The assertion
+ *
+ * @return WORD_BOUNDARY, NOT_WORD_BOUNDARY, TEXT_START or TEXT_END.
+ */
+static int compiler_assertion(AstAssertion assertion);
+
+/**
+ * @brief Generate the nfa fragment matching the repeated node.
+ *
+ * @param compiler Pointer to compiler state
+ * @param node The repeat node
+ * @param next The state after the fragment
+ *
+ * @return The first state of the fragment.
+ */
+static State *compiler_repeat(Compiler *compiler, const AstNode *node, State *next);
+
+void compiler_create(Compiler *compiler, const Allocator *allocator, int flags) {
+    *compiler = (Compiler){0};
+    compiler->allocator = allocator;
+    compiler->flags = flags;
+}
+
+void compiler_destroy(Compiler *compiler) {
+    *compiler = (Compiler){0};
+}
+
+void compiler_interner_create(CompilerInterner *interner, const Allocator *allocator) {
+    *interner = (CompilerInterner){
+        .allocator = allocator ? *allocator : *memory_default_allocator(),
+        .slot_count = COMPILER_INTERNER_MIN_SLOTS,
+        .loop_slot_count = COMPILER_INTERNER_MIN_SLOTS,
+    };
+    allocator = &interner->allocator;
+
+    interner->slots = memory_allocate(allocator, sizeof(State *) * interner->slot_count);
+    memset(interner->slots, 0, sizeof(State *) * interner->slot_count);
+    interner->loops = memory_allocate(allocator, sizeof(CompilerLoop) * interner->loop_slot_count);
+    memset(interner->loops, 0, sizeof(CompilerLoop) * interner->loop_slot_count);
+
+    interner->match = state_create(allocator, MATCH);
+    compiler_interner_add(interner, interner->match);
+}
+
+void compiler_interner_destroy(CompilerInterner *interner) {
+    compiler_interner_finish(interner);
+
+    for (int i = 0; i < interner->state_count; ++i) state_destroy(&interner->allocator, interner->states[i]);
+    memory_free(&interner->allocator, interner->states, sizeof(State *) * interner->state_capacity);
+
+    *interner = (CompilerInterner){0};
+}
+
+void compiler_interner_keep(CompilerInterner *interner, AstNode *tree) {
+    if (interner->tree_count == interner->tree_capacity) {
+        int capacity = interner->tree_capacity ? 2 * interner->tree_capacity : 16;
+        interner->trees = memory_reallocate(&interner->allocator, interner->trees,
+            sizeof(AstNode *) * interner->tree_capacity, sizeof(AstNode *) * capacity);
+        interner->tree_capacity = capacity;
+    }
+
+    interner->trees[interner->tree_count++] = tree;
+}
+
+void compiler_interner_finish(CompilerInterner *interner) {
+    const Allocator *allocator = &interner->allocator;
+
+    for (int i = 0; i < interner->tree_count; ++i) ast_destroy(allocator, interner->trees[i]);
+    if (interner->trees) memory_free(allocator, interner->trees, sizeof(AstNode *) * interner->tree_capacity);
+    if (interner->slots) memory_free(allocator, interner->slots, sizeof(State *) * interner->slot_count);
+    if (interner->loops) memory_free(allocator, interner->loops, sizeof(CompilerLoop) * interner->loop_slot_count);
+    if (interner->seen) memory_free(allocator, interner->seen, sizeof(unsigned int) * interner->state_capacity);
+    if (interner->stack) memory_free(allocator, interner->stack, sizeof(State *) * interner->stack_capacity);
+
+    interner->trees = NULL;
+    interner->tree_count = interner->tree_capacity = 0;
+    interner->slots = NULL;
+    interner->slot_count = interner->interned_count = 0;
+    interner->loops = NULL;
+    interner->loop_slot_count = interner->loop_count = 0;
+    interner->seen = NULL;
+    interner->stack = NULL;
+    interner->stack_capacity = 0;
+}
+
+size_t compiler_interner_bytes(const CompilerInterner *interner) {
+    size_t bytes = sizeof(State) * interner->state_count + sizeof(State *) * interner->state_capacity;
+    if (interner->slots) bytes += sizeof(State *) * interner->slot_count;
+    if (interner->loops) bytes += sizeof(CompilerLoop) * interner->loop_slot_count;
+    if (interner->seen) bytes += sizeof(unsigned int) * interner->state_capacity;
+    if (interner->stack) bytes += sizeof(State *) * interner->stack_capacity;
+    return bytes;
+}
+
+State *compiler_compile(Compiler *compiler, const AstNode *root) {
+    compiler->total_states = 0;
+    memset(compiler->restarts, 0, sizeof(compiler->restarts));
+    compiler->assertions = ast_contains(root, AST_KIND_ASSERTION);
+    if (compiler->interner) {
+        compiler->match = compiler->interner->match;
+        compiler->interner->requested_states++;
+    } else {
+        compiler->match = compiler_new_state(compiler, MATCH, NULL);
+    }
+
+    AstNode *const *alternatives = root->kind == AST_KIND_ALTERNATION ? root->children : (AstNode *const *)&root;
+    int count = root->kind == AST_KIND_ALTERNATION ? root->child_count : 1;
+
+    compiler->entries = memory_allocate(compiler->allocator, sizeof(RegexEntry) * count);
+    compiler->entry_count = count;
+
+    // Starts of the alternatives after the loop first, then the anchored ones
+    State **starts = memory_allocate(compiler->allocator, sizeof(State *) * (count + 1));
+    int unanchored = 0, anchored = count + 1;
+
+    for (int i = 0; i < count; ++i) {
+        const AstNode *alternative = alternatives[i];
+        AstNode *const *nodes = alternative->kind == AST_KIND_CONCAT ? alternative->children : (AstNode *const *)&alternatives[i];
+        int len = alternative->kind == AST_KIND_CONCAT ? alternative->child_count : 1;
+
+        bool is_anchored = nodes[0]->kind == AST_KIND_LINE_START;
+        State *start = is_anchored ? compiler_sequence(compiler, nodes + 1, len - 1, compiler->match)
+                                   : compiler_sequence(compiler, nodes, len, compiler->match);
+
+        compiler->entries[i] = (RegexEntry){start, is_anchored};
+        if (is_anchored) starts[--anchored] = start;
+        else starts[unanchored++] = start;
+    }
+
+    State *head;
+    bool multiline = compiler->flags & REGEX_FLAG_MULTILINE;
+    if (unanchored || multiline) {
+        // One infinite loop matching any character in front of all the alternatives,
+        // so that nfa does not die when first character doesn't match
+        State *loop = compiler_new_state(compiler, unanchored ? BRANCH : EPSILON, NULL);
+        State *skip = compiler_new_state(compiler, ANY_CHAR, loop);
+        compiler->restarts[0] = skip;
+
+        // In multi-line mode a new line also goes back to the head, where the '^' alternatives start again
+        State *new_line = NULL;
+        if (multiline) {
+            new_line = compiler_new_state(compiler, LINE_END, NULL);
+            compiler->restarts[1] = new_line;
+            skip = compiler_new_state(compiler, BRANCH, skip);
+            skip->out1 = new_line;
+        }
+
+        loop->out = unanchored ? compiler_join(compiler, starts, unanchored) : skip;
+        if (unanchored) loop->out1 = skip;
+
+        starts[--anchored] = loop;
+        head = compiler_join(compiler, starts + anchored, count + 1 - anchored);
+        if (new_line) new_line->out = head;
+    } else {
+        head = compiler_join(compiler, starts + anchored, count);
+    }
+
+    memory_free(compiler->allocator, starts, sizeof(State *) * (count + 1));
+
+    // Shared states are numbered across all the nfas of the interner
+    compiler->index_count = compiler->total_states;
+    if (compiler->interner) {
+        compiler->index_count = compiler->interner->state_count;
+        compiler->total_states = compiler_interner_count(compiler->interner, head);
+    }
+
+    return head;
+}
+
+static State *compiler_new_state(Compiler *compiler, int c, State *out) {
+    State *state = state_create(compiler->allocator, c);
+    state->out = out;
+
+    if (compiler->interner) {
+        compiler->interner->requested_states++;
+        compiler_interner_add(compiler->interner, state);
+    } else {
+        state->index = compiler->total_states++;
+    }
+
+    return state;
+}
+
+static State *compiler_shared_state(Compiler *compiler, int c, State *out, State *out1, Range range) {
+    CompilerInterner *interner = compiler->interner;
+    if (!interner) {
+        State *state = compiler_new_state(compiler, c, out);
+        state->out1 = out1;
+        state->range = range;
+        return state;
+    }
+
+    interner->requested_states++;
+    State key = {.c = c, .out = out, .out1 = out1, .range = range};
+    State **slot = compiler_interner_find(interner, &key);
+    if (*slot) return *slot;
+
+    State *state = state_create(compiler->allocator, c);
+    state->out = out;
+    state->out1 = out1;
+    state->range = range;
+    compiler_interner_add(interner, state);
+
+    *slot = state;
+    // Keep the table at most half full
+    if (2 * ++interner->interned_count > interner->slot_count) compiler_interner_grow(interner);
+
+    return state;
+}
+
+static uint64_t compiler_state_hash(const State *state) {
+    uint64_t hash = (uint64_t)(uintptr_t)state->out * 0x9E3779B97F4A7C15ULL;
+    hash ^= (uint64_t)(uintptr_t)state->out1 * 0xC2B2AE3D27D4EB4FULL;
+    hash ^= ((uint64_t)state->range.start << 32 | state->range.end) * 0x165667B19E3779F9ULL;
+    hash ^= (uint64_t)state->c * 0x27D4EB2F165667C5ULL;
+    return hash ^ hash >> 29;
+}
+
+static State **compiler_interner_find(CompilerInterner *interner, const State *key) {
+    size_t mask = (size_t)interner->slot_count - 1;
+    for (size_t i = compiler_state_hash(key) & mask;; i = (i + 1) & mask) {
+        State *state = interner->slots[i];
+        if (!state
+            || (state->c == key->c && state->out == key->out && state->out1 == key->out1
+                && state->range.start == key->range.start && state->range.end == key->range.end))
+            return &interner->slots[i];
+    }
+}
+
+static CompilerLoop *compiler_interner_find_loop(CompilerInterner *interner, const AstNode *node,
+    unsigned long long hash, State *next, int flags) {
+    size_t mask = (size_t)interner->loop_slot_count - 1;
+    uint64_t slot_hash = hash ^ (uint64_t)(uintptr_t)next * 0x9E3779B97F4A7C15ULL ^ (uint64_t)flags;
+    for (size_t i = (slot_hash ^ slot_hash >> 29) & mask;; i = (i + 1) & mask) {
+        CompilerLoop *loop = &interner->loops[i];
+        if (!loop->node
+            || (loop->hash == hash && loop->next == next && loop->flags == flags && ast_equal(loop->node, node)))
+            return loop;
+    }
+}
+
+static void compiler_interner_add(CompilerInterner *interner, State *state) {
+    if (interner->state_count == interner->state_capacity) {
+        int capacity = interner->state_capacity ? 2 * interner->state_capacity : 256;
+        interner->states = memory_reallocate(&interner->allocator, interner->states,
+            sizeof(State *) * interner->state_capacity, sizeof(State *) * capacity);
+        if (interner->seen) {
+            interner->seen = memory_reallocate(&interner->allocator, interner->seen,
+                sizeof(unsigned int) * interner->state_capacity, sizeof(unsigned int) * capacity);
+            memset(interner->seen + interner->state_capacity, 0,
+                sizeof(unsigned int) * (capacity - interner->state_capacity));
+        }
+        interner->state_capacity = capacity;
+    }
+
+    state->index = interner->state_count;
+    interner->states[interner->state_count++] = state;
+}
+
+static void compiler_interner_grow(CompilerInterner *interner) {
+    State **slots = interner->slots;
+    int slot_count = interner->slot_count;
+
+    interner->slot_count *= 2;
+    interner->slots = memory_allocate(&interner->allocator, sizeof(State *) * interner->slot_count);
+    memset(interner->slots, 0, sizeof(State *) * interner->slot_count);
+
+    for (int i = 0; i < slot_count; ++i)
+        if (slots[i]) *compiler_interner_find(interner, slots[i]) = slots[i];
+
+    memory_free(&interner->allocator, slots, sizeof(State *) * slot_count);
+}
+
+static void compiler_interner_grow_loops(CompilerInterner *interner) {
+    CompilerLoop *loops = interner->loops;
+    int loop_slot_count = interner->loop_slot_count;
+
+    interner->loop_slot_count *= 2;
+    interner->loops = memory_allocate(&interner->allocator, sizeof(CompilerLoop) * interner->loop_slot_count);
+    memset(interner->loops, 0, sizeof(CompilerLoop) * interner->loop_slot_count);
+
+    for (int i = 0; i < loop_slot_count; ++i) {
+        if (!loops[i].node) continue;
+        *compiler_interner_find_loop(interner, loops[i].node, loops[i].hash, loops[i].next, loops[i].flags) = loops[i];
+    }
+
+    memory_free(&interner->allocator, loops, sizeof(CompilerLoop) * loop_slot_count);
+}
+
+static int compiler_interner_count(CompilerInterner *interner, State *start) {
+    if (!interner->seen) {
+        interner->seen = memory_allocate(&interner->allocator, sizeof(unsigned int) * interner->state_capacity);
+        memset(interner->seen, 0, sizeof(unsigned int) * interner->state_capacity);
+    }
+
+    // Each state pushes its outs only once, so the stack never holds more than twice the states plus one
+    int needed = 2 * interner->state_count + 1;
+    if (needed > interner->stack_capacity) {
+        if (interner->stack) memory_free(&interner->allocator, interner->stack, sizeof(State *) * interner->stack_capacity);
+        interner->stack_capacity = 2 * needed;
+        interner->stack = memory_allocate(&interner->allocator, sizeof(State *) * interner->stack_capacity);
+    }
+
+    unsigned int generation = ++interner->generation;
+    int count = 0, stack_len = 0;
+    interner->stack[stack_len++] = start;
+    while (stack_len) {
+        State *state = interner->stack[--stack_len];
+        if (!state || interner->seen[state->index] == generation) continue;
+
+        interner->seen[state->index] = generation;
+        count++;
+        interner->stack[stack_len++] = state->out1;
+        interner->stack[stack_len++] = state->out;
+    }
+
+    return count;
+}
+
+static State *compiler_join(Compiler *compiler, State *const *starts, int count) {
+    State *joined = starts[count - 1];
+    for (int i = count - 2; i >= 0; --i) joined = compiler_shared_state(compiler, BRANCH, joined, starts[i], (Range){0});
+
+    return joined;
+}
+
+static State *compiler_fragment(Compiler *compiler, const AstNode *node, State *next) {
+    switch (node->kind) {
+        case AST_KIND_EMPTY:
+            return next;
+        case AST_KIND_STRING:
+            return compiler_string(compiler, node, next);
+        case AST_KIND_ANY:
+            return compiler_shared_state(compiler, ANY_CHAR, next, NULL, (Range){0});
+        case AST_KIND_CLASS:
+            return compiler_class(compiler, node, next);
+        case AST_KIND_CONCAT:
+            return compiler_sequence(compiler, node->children, node->child_count, next);
+        case AST_KIND_ALTERNATION:
+            {
+                State **starts = memory_allocate(compiler->allocator, sizeof(State *) * node->child_count);
+                for (int i = 0; i < node->child_count; ++i) starts[i] = compiler_fragment(compiler, node->children[i], next);
+                State *start = compiler_join(compiler, starts, node->child_count);
+                memory_free(compiler->allocator, starts, sizeof(State *) * node->child_count);
+                return start;
+            }
+        case AST_KIND_REPEAT:
+            return compiler_repeat(compiler, node, next);
+        case AST_KIND_ASSERTION:
+            return compiler_shared_state(compiler, compiler_assertion(node->assertion), next, NULL, (Range){0});
+        case AST_KIND_LINE_START:
+            break;
+    }
+
+    SHOULD_NOT_REACH_HERE;
+}
+
+static State *compiler_sequence(Compiler *compiler, AstNode *const *nodes, int count, State *next) {
+    for (int i = count - 1; i >= 0; --i) next = compiler_fragment(compiler, nodes[i], next);
+    return next;
+}
+
+static State *compiler_string(Compiler *compiler, const AstNode *node, State *next) {
+    for (int i = node->len - 1; i >= 0; --i) {
+        State *state = compiler_shared_state(compiler, node->bytes[i], next, NULL, (Range){0});
+
+        Range folded[RANGE_MAX_CASE_FOLDED];
+        if ((compiler->flags & REGEX_FLAG_ICASE)
+            && get_case_folded_ranges((Range){node->bytes[i], node->bytes[i]}, 0x7F, folded)) {
+            // Branch to both cases of the letter
+            State *other = compiler_shared_state(compiler, (int)folded[0].start, next, NULL, (Range){0});
+            state = compiler_shared_state(compiler, BRANCH, state, other, (Range){0});
+        }
+
+        next = state;
+    }
+
+    return next;
+}
+
+static State *compiler_class(Compiler *compiler, const AstNode *node, State *next) {
+    // Nothing matches an empty class
+    if (!node->range_count) return compiler_shared_state(compiler, DEAD, NULL, NULL, (Range){0});
+
+    State **starts = NULL;
+    int count = 0;
+
+    for (int i = 0; i < node->range_count; ++i) {
+        // Match the code points as sequences of bytes, so that matching never decodes
+        Utf8Sequence sequences[UTF8_MAX_SEQUENCES];
+        int sequence_count = 1;
+        if (compiler->flags & REGEX_FLAG_UTF8) sequence_count = utf8_split_range(node->ranges[i], sequences);
+        else sequences[0] = (Utf8Sequence){.ranges = {node->ranges[i]}, .len = 1};
+
+        starts = memory_reallocate(compiler->allocator, starts, sizeof(State *) * count,
+            sizeof(State *) * (count + sequence_count));
+        for (int j = 0; j < sequence_count; ++j) {
+            State *start = next;
+            for (int k = sequences[j].len - 1; k >= 0; --k)
+                start = compiler_shared_state(compiler, RANGE, start, NULL, sequences[j].ranges[k]);
+            starts[count++] = start;
+        }
+    }
+
+    State *start = compiler_join(compiler, starts, count);
+    memory_free(compiler->allocator, starts, sizeof(State *) * count);
+
+    return start;
+}
+
+static int compiler_assertion(AstAssertion assertion) {
+    switch (assertion) {
+        case AST_ASSERTION_WORD_BOUNDARY:
+            return WORD_BOUNDARY;
+        case AST_ASSERTION_NOT_WORD_BOUNDARY:
+            return NOT_WORD_BOUNDARY;
+        case AST_ASSERTION_TEXT_START:
+            return TEXT_START;
+        case AST_ASSERTION_TEXT_END:
+            return TEXT_END;
+    }
+
+    SHOULD_NOT_REACH_HERE;
+}
+
+static State *compiler_repeat(Compiler *compiler, const AstNode *node, State *next) {
+    // The branch skips the child
+    if (node->repeat == AST_REPEAT_ZERO_OR_ONE)
+        return compiler_shared_state(compiler, BRANCH, next, compiler_fragment(compiler, node->children[0], next),
+            (Range){0});
+
+    // A child that can match nothing goes back to the branch through LOOP_BACK,
+    // an assertion the nfa follows once per position, not forever around the loop
+    bool back = ast_matches_empty(node->children[0]);
+    compiler->assertions |= back;
+
+    CompilerInterner *interner = compiler->interner;
+    unsigned long long hash = 0, requested = 0;
+    if (interner) {
+        hash = ast_hash(node);
+        CompilerLoop *loop = compiler_interner_find_loop(interner, node, hash, next, compiler->flags);
+        if (loop->node) {
+            interner->requested_states += loop->requested_states;
+            return loop->start;
+        }
+        requested = interner->requested_states;
+    }
+
+    // The branch goes to the child and the child back to the branch
+    State *branch = compiler_new_state(compiler, BRANCH, next);
+    branch->out1 = compiler_fragment(compiler, node->children[0],
+        back ? compiler_new_state(compiler, LOOP_BACK, branch) : branch);
+    // With '+' the child is matched first
+    State *start = node->repeat == AST_REPEAT_ONE_OR_MORE ? branch->out1 : branch;
+
+    if (interner) {
+        // The child may have added loops, look the slot up again
+        *compiler_interner_find_loop(interner, node, hash, next, compiler->flags) = (CompilerLoop){
+            .node = node,
+            .hash = hash,
+            .next = next,
+            .flags = compiler->flags,
+            .start = start,
+            .requested_states = (int)(interner->requested_states - requested),
+        };
+        if (2 * ++interner->loop_count > interner->loop_slot_count) compiler_interner_grow_loops(interner);
+    }
+
+    return start;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "ast.h"
+#include "state.h"
+
+/**
+ * @struct CompilerLoop compiler.h
+ * @brief A loop ('*' or '+') compiled with an interner, looked up by its node and the state after it.
+ */
+typedef struct CompilerLoop {
+    const AstNode *node; /**< The repeat node (kept by the interner, NULL for a free slot) */
+    unsigned long long hash; /**< Hash of the node (see @ref ast_hash) */
+    State *next; /**< The state after the loop */
+    int flags; /**< Flags the loop was compiled with */
+    State *start; /**< First state of the loop */
+    int requested_states; /**< States compiling the loop created or found */
+} CompilerLoop;
+
+/**
+ * @struct CompilerInterner compiler.h
+ * @brief States shared by the nfas compiled with it (hash-consing).
+ *
+ * A state is looked up by what it matches and the states it goes to, so
+ * compiling a fragment that already exists with the same continuation (the
+ * same string, class... before the same rest of a pattern) returns the
+ * existing states. The branches of loops point back into the loop and are
+ * always new, so the loops are looked up by their node instead. All the
+ * nfas end in the same accepting state.
+ *
+ * @note The states are not owned by the regexes, and matching with the nfa
+ * writes to them: use the regexes of one interner from one thread at a time.
+ */
+typedef struct CompilerInterner {
+    Allocator allocator; /**< Allocator for the states and the tables */
+    State *match; /**< The accepting state of all the nfas */
+
+    State **states; /**< Every state created, by index */
+    int state_count; /**< Number of states created */
+    int state_capacity; /**< Length of states and seen */
+    unsigned long long requested_states; /**< States the compiler asked for (what compiling one by one creates) */
+
+    State **slots; /**< Open addressing table of the interned states (NULL for a free slot) */
+    int slot_count; /**< Number of slots (power of 2) */
+    int interned_count; /**< Number of interned states */
+
+    CompilerLoop *loops; /**< Open addressing table of the loops */
+    int loop_slot_count; /**< Number of loop slots (power of 2) */
+    int loop_count; /**< Number of loops */
+
+    AstNode **trees; /**< Trees kept for the nodes of the loops */
+    int tree_count; /**< Number of trees */
+    int tree_capacity; /**< Length of trees */
+
+    unsigned int *seen; /**< Generation each state (by index) was last reached in */
+    unsigned int generation; /**< Generation of the last traversal */
+    State **stack; /**< Stack of the traversals */
+    int stack_capacity; /**< Length of stack */
+} CompilerInterner;
+
+/**
+ * @struct Compiler compiler.h
+ * @brief Compiler state structure, builds the nfa of the syntax tree.
+ */
+typedef struct Compiler {
+    const Allocator *allocator; /**< Allocator for the states */
+    int flags; /**< Combination of RegexFlag */
+    State *match; /**< The accepting state */
+    int total_states; /**< Total number of states allocated (reachable from the start if they are interned) */
+    int index_count; /**< Bound of the indexes of the states (total_states unless they are interned) */
+    CompilerInterner *interner; /**< Shares the states with other nfas (NULL to create every state) */
+    struct RegexEntry *entries; /**< Start of each top-level alternative (owned by the caller after compiling) */
+    int entry_count; /**< Number of entries */
+    bool assertions; /**< The nfa has assertion states (see state_is_assertion()) */
+    State *restarts[STATE_MAX_RESTARTS]; /**< States going back to the start after a byte (see state_is_restart()) */
+} Compiler;
+
+/**
+ * @brief Create the compiler.
+ *
+ * @param compiler Pointer to compiler state
+ * @param allocator The allocator for the states (NULL for default allocator)
+ * @param flags Combination of RegexFlag
+ */
+void compiler_create(Compiler *compiler, const Allocator *allocator, int flags);
+
+/**
+ * @brief Create the interner.
+ *
+ * @param interner Pointer to the interner
+ * @param allocator The allocator for the states, the same the regexes are created with (NULL for default allocator)
+ */
+void compiler_interner_create(CompilerInterner *interner, const Allocator *allocator);
+
+/**
+ * @brief Destroy the interner and every state it created.
+ *
+ * @param interner Pointer to the interner
+ */
+void compiler_interner_destroy(CompilerInterner *interner);
+
+/**
+ * @brief Keep the tree until @ref compiler_interner_finish, the loops compiled from it refer to its nodes.
+ *
+ * @param interner Pointer to the interner
+ * @param tree The tree (owned by the interner)
+ */
+void compiler_interner_keep(CompilerInterner *interner, AstNode *tree);
+
+/**
+ * @brief Free the tables and trees only needed to compile, once every nfa is compiled.
+ *
+ * The states are kept until @ref compiler_interner_destroy.
+ *
+ * @param interner Pointer to the interner
+ */
+void compiler_interner_finish(CompilerInterner *interner);
+
+/**
+ * @brief Get the bytes used by the interner (the states and what is not freed yet).
+ *
+ * @param interner Pointer to the interner
+ *
+ * @return Number of bytes.
+ */
+size_t compiler_interner_bytes(const CompilerInterner *interner);
+
+/**
+ * @brief Destroy the compiler.
+ *
+ * @param compiler Pointer to compiler state
+ */
+void compiler_destroy(Compiler *compiler);
+
+/**
+ * @brief Generate the nfa of the tree.
+ *
+ * The alternatives of the top-level alternation are the entries. The ones not
+ * starting with AST_KIND_LINE_START share one loop skipping characters in
+ * front of them.
+ *
+ * @param compiler Pointer to compiler state
+ * @param root The (simplified) tree
+ *
+ * @return Pointer to starting state of nfa.
+ */
+State *compiler_compile(Compiler *compiler, const AstNode *root);
@@ -0,0 +1,625 @@
+#include "dfa.h"
+
+#include "memory.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * @struct DfaBuilder
+ * @brief State needed only while building the dfa.
+ */
+typedef struct DfaBuilder {
+    Dfa *dfa;
+    const Allocator *allocator;
+    int max_states;
+    size_t max_bytes; /**< Bytes the transitions may use */
+
+    int total_states; /**< Number of nfa states the buffers are allocated for */
+    State **nfa; /**< All the nfa states, indexed by their id */
+    int nfa_len; /**< Number of nfa states */
+    State *restarts[STATE_MAX_RESTARTS]; /**< States going back to the start after a byte (NULL if unused) */
+
+    State **stack; /**< Stack used to follow the epsilon edges */
+    unsigned int *seen; /**< Generation in which the nfa state was last added to a set */
+    unsigned int generation; /**< Current generation */
+
+    int *set; /**< The set being built */
+    int set_len; /**< Length of the set being built */
+    bool set_matched; /**< Whether the set being built contains the MATCH state */
+    bool set_waits; /**< Whether assertions wait in the set being built for the byte after its position */
+    Side before; /**< What is before the position of the set being built */
+    Side after; /**< What is after it (SIDE_UNKNOWN while stepping, the assertions wait for it) */
+    int *resolved; /**< The nfa states of a dfa state once its waiting assertions are followed */
+    bool word_boundaries; /**< The nfa has WORD_BOUNDARY or NOT_WORD_BOUNDARY states */
+
+    int *pool; /**< The nfa states of all dfa states one after other */
+    size_t pool_len; /**< Number of ints used in the pool */
+    size_t pool_capacity; /**< Number of ints allocated for the pool */
+    size_t *set_offset; /**< Offset of the nfa states of each dfa state in the pool */
+    int *set_size; /**< Number of nfa states of each dfa state */
+    Side *set_before; /**< What is before the position of each dfa state (SIDE_UNKNOWN if no assertion waits in it) */
+
+    int *buckets; /**< Open addressing hash table of the dfa states (index + 1, 0 if empty) */
+    int bucket_count; /**< Number of buckets (power of 2) */
+
+    unsigned char representatives[256]; /**< First byte of each byte class */
+} DfaBuilder;
+
+/**
+ * @brief Number all the nfa states (reachable from start) in the builder.
+ *
+ * @param builder Pointer to the builder
+ * @param start Start state of the nfa
+ */
+static void dfa_builder_collect_nfa(DfaBuilder *builder, State *start);
+
+/**
+ * @brief Compute the byte classes of the nfa.
+ *
+ * @param builder Pointer to the builder
+ */
+static void dfa_builder_compute_byte_classes(DfaBuilder *builder);
+
+/**
+ * @brief Add the epsilon closure of the state to the set being built.
+ *
+ * @param builder Pointer to the builder
+ * @param state The nfa state
+ */
+static void dfa_builder_add_closure(DfaBuilder *builder, State *state);
+
+/**
+ * @brief Follow the assertions waiting in the dfa state, now that the byte after its position is known.
+ *
+ * @param builder Pointer to the builder
+ * @param index Index of the dfa state
+ * @param after What is after the position of the dfa state
+ *
+ * @return Number of nfa states stored in resolved, -1 if the MATCH state is reached (a match ends at the position).
+ */
+static int dfa_builder_resolve(DfaBuilder *builder, int index, Side after);
+
+/**
+ * @brief Compute how the inputs ending after each dfa state match (the ends of the dfa).
+ *
+ * @param builder Pointer to the builder
+ */
+static void dfa_builder_compute_ends(DfaBuilder *builder);
+
+/**
+ * @brief Get the dfa state of the set being built (adds new state if required).
+ *
+ * @param builder Pointer to the builder
+ *
+ * @return The premultiplied state, -1 if there are too many states.
+ */
+static int dfa_builder_get_state(DfaBuilder *builder);
+
+/**
+ * @brief Add new dfa state for the set being built.
+ *
+ * @param builder Pointer to the builder
+ * @param before What is before the position of the set (SIDE_UNKNOWN if no assertion waits in it)
+ *
+ * @return Index of the new state, -1 if there are too many states.
+ */
+static int dfa_builder_add_state(DfaBuilder *builder, Side before);
+
+/**
+ * @brief Check whether the nfa state consumes given byte.
+ *
+ * @param state The nfa state
+ * @param input The byte
+ *
+ * @return true if the nfa state goes to its out on the byte.
+ */
+static bool dfa_state_accepts(const State *state, unsigned char input);
+
+/**
+ * @brief Compare two ints for qsort().
+ *
+ * @param a Pointer to first int
+ * @param b Pointer to second int
+ *
+ * @return Negative, zero or positive like strcmp().
+ */
+static int dfa_compare_ints(const void *a, const void *b);
+
+/**
+ * @brief Hash the set of nfa states.
+ *
+ * @param set The set
+ * @param len Length of the set
+ * @param before What is before the position of the set
+ *
+ * @return The hash.
+ */
+static unsigned int dfa_hash_set(const int *set, int len, Side before);
+
+/**
+ * @brief Get the bytes the state leaves on.
+ *
+ * @param dfa Pointer to the dfa
+ * @param state The state
+ * @param accel Pointer to store the exit bytes
+ *
+ * @return false if the state leaves on more than DFA_ACCEL_MAX_BYTES bytes.
+ */
+static bool dfa_find_exits(const Dfa *dfa, int state, DfaAccel *accel);
+
+/**
+ * @brief Find the first of up to DFA_ACCEL_MAX_BYTES bytes.
+ *
+ * @param input The input
+ * @param from Offset to start looking at
+ * @param len Length of the input
+ * @param bytes The bytes (DFA_ACCEL_MAX_BYTES of them, repeated if there are fewer)
+ *
+ * @return Offset of the first of the bytes at or after from (len if there is none).
+ */
+static size_t dfa_find_any(const unsigned char *input, size_t from, size_t len, const unsigned char *bytes);
+
+/**
+ * @brief Free everything allocated by the builder.
+ *
+ * @param builder Pointer to the builder
+ */
+static void dfa_builder_destroy(DfaBuilder *builder);
+
+bool dfa_create(Dfa *dfa, State *start, State *const *restarts, int total_states, int max_states, size_t max_bytes,
+    const Allocator *allocator) {
+    *dfa = (Dfa){0};
+
+    // Dead and match states are always there
+    if (max_states < 3) return false;
+
+    DfaBuilder builder = {
+        .dfa = dfa,
+        .allocator = allocator,
+        .max_states = max_states,
+        .max_bytes = max_bytes,
+        .total_states = total_states,
+    };
+    if (restarts) memcpy(builder.restarts, restarts, sizeof(builder.restarts));
+
+    builder.nfa = memory_allocate(allocator, sizeof(State *) * total_states);
+    builder.stack = memory_allocate(allocator, sizeof(State *) * (2 * total_states + 1));
+    builder.seen = memory_allocate(allocator, sizeof(unsigned int) * total_states);
+    builder.set = memory_allocate(allocator, sizeof(int) * total_states);
+    builder.resolved = memory_allocate(allocator, sizeof(int) * total_states);
+    builder.set_offset = memory_allocate(allocator, sizeof(size_t) * max_states);
+    builder.set_size = memory_allocate(allocator, sizeof(int) * max_states);
+    builder.set_before = memory_allocate(allocator, sizeof(Side) * max_states);
+
+    builder.bucket_count = 16;
+    while (builder.bucket_count < 2 * max_states) builder.bucket_count *= 2;
+    builder.buckets = memory_allocate(allocator, sizeof(int) * builder.bucket_count);
+    memset(builder.buckets, 0, sizeof(int) * builder.bucket_count);
+
+    dfa_builder_collect_nfa(&builder, start);
+    if (builder.nfa_len != total_states) LOG_ERROR("Not all nfa states reachable");
+    memset(builder.seen, 0, sizeof(unsigned int) * builder.nfa_len);
+    for (int i = 0; i < builder.nfa_len; ++i)
+        builder.word_boundaries |= builder.nfa[i]->c == WORD_BOUNDARY || builder.nfa[i]->c == NOT_WORD_BOUNDARY;
+
+    dfa_builder_compute_byte_classes(&builder);
+
+    // Dead state (empty set) and match state loop to themselves
+    builder.set_len = 0;
+    dfa_builder_add_state(&builder, SIDE_UNKNOWN);
+    dfa_builder_add_state(&builder, SIDE_UNKNOWN);
+    dfa->match = dfa->class_count;
+    for (int c = 0; c < dfa->class_count; ++c) {
+        dfa->transitions[DFA_DEAD_STATE + c] = DFA_DEAD_STATE;
+        dfa->transitions[dfa->match + c] = dfa->match;
+    }
+
+    // The assertions see the start of the input only from the first start state
+    int *starts[] = {&dfa->start, &dfa->word_start, &dfa->other_start};
+    Side befores[] = {SIDE_EDGE, SIDE_WORD, SIDE_OTHER};
+    for (int i = 0; i < 3; ++i) {
+        builder.generation++;
+        builder.set_len = 0;
+        builder.set_matched = false;
+        builder.set_waits = false;
+        builder.before = befores[i];
+        builder.after = SIDE_UNKNOWN;
+        dfa_builder_add_closure(&builder, start);
+        *starts[i] = dfa_builder_get_state(&builder);
+        if (*starts[i] < 0) dfa->start = -1;
+    }
+
+    // Every new state is appended, so walking the states in order visits them all
+    for (int index = 2; index < dfa->state_count && dfa->start >= 0; ++index) {
+        for (int c = 0; c < dfa->class_count; ++c) {
+            unsigned char input = builder.representatives[c];
+
+            // The assertions waiting in the state see the byte first, they may reach the MATCH state before it
+            const int *set = &builder.pool[builder.set_offset[index]];
+            int set_len = builder.set_size[index];
+            if (builder.set_before[index] != SIDE_UNKNOWN) {
+                set = builder.resolved;
+                set_len = dfa_builder_resolve(&builder, index, state_side_of(input));
+                if (set_len < 0) {
+                    dfa->transitions[index * dfa->class_count + c] = dfa->match;
+                    continue;
+                }
+            }
+
+            builder.generation++;
+            builder.set_len = 0;
+            builder.set_matched = false;
+            builder.set_waits = false;
+            builder.before = state_side_of(input);
+            builder.after = SIDE_UNKNOWN;
+            for (int i = 0; i < set_len; ++i) {
+                State *state = builder.nfa[set[i]];
+                if (dfa_state_accepts(state, input)) dfa_builder_add_closure(&builder, state->out);
+            }
+
+            int next = dfa_builder_get_state(&builder);
+            if (next < 0) {
+                dfa->start = -1;
+                break;
+            }
+            dfa->transitions[index * dfa->class_count + c] = next;
+        }
+    }
+
+    bool built = dfa->start >= 0;
+    if (built) dfa_builder_compute_ends(&builder);
+    dfa_builder_destroy(&builder);
+
+    if (!built) {
+        dfa_destroy(dfa, allocator);
+        return false;
+    }
+
+    dfa->accel_limit = dfa->match + dfa->class_count;
+    return true;
+}
+
+void dfa_accelerate(Dfa *dfa, const Allocator *allocator) {
+    int class_count = dfa->class_count;
+    DfaAccel *found = memory_allocate(allocator, sizeof(DfaAccel) * dfa->state_count);
+    bool *accelerated = memory_allocate(allocator, sizeof(bool) * dfa->state_count);
+
+    // The rows keep their order, except that the accelerated ones move right after the match state
+    int *order = memory_allocate(allocator, sizeof(int) * dfa->state_count);
+    int *renumbered = memory_allocate(allocator, sizeof(int) * dfa->state_count);
+    int len = 2;
+    order[0] = DFA_DEAD_STATE;
+    order[1] = dfa->match / class_count;
+    for (int row = 2; row < dfa->state_count; ++row) {
+        accelerated[row] = dfa_find_exits(dfa, row * class_count, &found[row]);
+        if (accelerated[row]) order[len++] = row;
+    }
+    dfa->accel_count = len - 2;
+    for (int row = 2; row < dfa->state_count; ++row)
+        if (!accelerated[row]) order[len++] = row;
+    for (int row = 0; row < dfa->state_count; ++row) renumbered[order[row]] = row;
+
+    if (dfa->accel_count) {
+        size_t table_len = (size_t)dfa->state_count * class_count;
+        int *transitions = memory_allocate(allocator, sizeof(int) * table_len);
+        for (int row = 0; row < dfa->state_count; ++row) {
+            const int *old = &dfa->transitions[order[row] * class_count];
+            for (int c = 0; c < class_count; ++c)
+                transitions[row * class_count + c] = renumbered[old[c] / class_count] * class_count;
+        }
+        memory_free(allocator, dfa->transitions, sizeof(int) * table_len);
+        dfa->transitions = transitions;
+        dfa->start = renumbered[dfa->start / class_count] * class_count;
+        dfa->word_start = renumbered[dfa->word_start / class_count] * class_count;
+        dfa->other_start = renumbered[dfa->other_start / class_count] * class_count;
+
+        unsigned char *ends = memory_allocate(allocator, dfa->state_count);
+        for (int row = 0; row < dfa->state_count; ++row) ends[row] = dfa->ends[order[row]];
+        memory_free(allocator, dfa->ends, dfa->state_count);
+        dfa->ends = ends;
+
+        dfa->accels = memory_allocate(allocator, sizeof(DfaAccel) * dfa->accel_count);
+        for (int i = 0; i < dfa->accel_count; ++i) dfa->accels[i] = found[order[i + 2]];
+        dfa->accel_limit = (dfa->accel_count + 2) * class_count;
+    }
+
+    memory_free(allocator, found, sizeof(DfaAccel) * dfa->state_count);
+    memory_free(allocator, accelerated, sizeof(bool) * dfa->state_count);
+    memory_free(allocator, order, sizeof(int) * dfa->state_count);
+    memory_free(allocator, renumbered, sizeof(int) * dfa->state_count);
+}
+
+size_t dfa_skip(const Dfa *dfa, int state, const unsigned char *input, size_t from, size_t len) {
+    const DfaAccel *accel = &dfa->accels[state / dfa->class_count - 2];
+
+    switch (accel->count) {
+        case 0:
+            // Loops on every byte (only the new line appended at the end can matter)
+            return len;
+        case 1: {
+            const unsigned char *next = memchr(input + from, accel->bytes[0], len - from);
+            return next ? (size_t)(next - input) : len;
+        }
+        default:
+            return dfa_find_any(input, from, len, accel->bytes);
+    }
+}
+
+void dfa_destroy(Dfa *dfa, const Allocator *allocator) {
+    memory_free(allocator, dfa->transitions, sizeof(int) * (size_t)dfa->state_count * dfa->class_count);
+    if (dfa->ends) memory_free(allocator, dfa->ends, dfa->state_count);
+    if (dfa->accels) memory_free(allocator, dfa->accels, sizeof(DfaAccel) * dfa->accel_count);
+    *dfa = (Dfa){0};
+}
+
+size_t dfa_table_bytes(const Dfa *dfa) {
+    return sizeof(int) * (size_t)dfa->state_count * dfa->class_count + sizeof(dfa->byte_classes)
+        + dfa->state_count + sizeof(DfaAccel) * dfa->accel_count;
+}
+
+static void dfa_builder_collect_nfa(DfaBuilder *builder, State *start) {
+    // Number the states in depth first order, the stack holds the states to visit
+    int stack_len = 0;
+    builder->stack[stack_len++] = start;
+    while (stack_len) {
+        State *state = builder->stack[--stack_len];
+        if (!state) continue;
+        if (state->id < builder->nfa_len && builder->nfa[state->id] == state) continue;
+
+        state->id = builder->nfa_len;
+        builder->nfa[builder->nfa_len++] = state;
+
+        builder->stack[stack_len++] = state->out1;
+        builder->stack[stack_len++] = state->out;
+    }
+}
+
+static void dfa_builder_compute_byte_classes(DfaBuilder *builder) {
+    // A new class starts at each byte where some transition starts or stops matching
+    bool boundary[257] = {0};
+    for (int i = 0; i < builder->nfa_len; ++i) {
+        const State *state = builder->nfa[i];
+        if (state->c <= LITERAL_CHAR_LAST) {
+            boundary[state->c] = boundary[state->c + 1] = true;
+        } else if (state->c == RANGE && state->range.start <= LITERAL_CHAR_LAST) {
+            unsigned int end = state->range.end > LITERAL_CHAR_LAST ? LITERAL_CHAR_LAST : state->range.end;
+            boundary[state->range.start] = boundary[end + 1] = true;
+        }
+    }
+
+    // The word boundaries look at the side of the bytes, word bytes must not share a class with others
+    if (builder->word_boundaries) {
+        for (int byte = 0; byte <= LITERAL_CHAR_LAST; ++byte)
+            if (byte && state_is_word_byte((unsigned char)byte) != state_is_word_byte((unsigned char)(byte - 1)))
+                boundary[byte] = true;
+    }
+
+    Dfa *dfa = builder->dfa;
+    dfa->class_count = 0;
+    for (int byte = 0; byte <= LITERAL_CHAR_LAST; ++byte) {
+        if (byte && boundary[byte]) dfa->class_count++;
+        if (!byte || boundary[byte]) builder->representatives[dfa->class_count] = (unsigned char)byte;
+        dfa->byte_classes[byte] = (unsigned char)dfa->class_count;
+    }
+    dfa->class_count++;
+}
+
+static void dfa_builder_add_closure(DfaBuilder *builder, State *state) {
+    int stack_len = 0;
+    builder->stack[stack_len++] = state;
+
+    while (stack_len) {
+        state = builder->stack[--stack_len];
+        if (builder->seen[state->id] == builder->generation) continue;
+        builder->seen[state->id] = builder->generation;
+
+        switch (state->c) {
+            case BRANCH:
+                builder->stack[stack_len++] = state->out1;
+                /* fallthrough */
+            case EPSILON:
+                builder->stack[stack_len++] = state->out;
+                break;
+            case MATCH:
+                builder->set_matched = true;
+                break;
+            case DEAD:
+            case LINE_START:
+                break;
+            case WORD_BOUNDARY:
+            case NOT_WORD_BOUNDARY:
+            case TEXT_START:
+            case TEXT_END:
+            case LOOP_BACK:
+                // Wait in the set for the byte after the position, unless it is known
+                if (!state_assertion_known(state->c, builder->after)) {
+                    builder->set[builder->set_len++] = state->id;
+                    builder->set_waits = true;
+                } else if (state_assertion_holds(state->c, builder->before, builder->after)) {
+                    builder->stack[stack_len++] = state->out;
+                }
+                break;
+            default:
+                builder->set[builder->set_len++] = state->id;
+                break;
+        }
+    }
+}
+
+static int dfa_builder_resolve(DfaBuilder *builder, int index, Side after) {
+    builder->generation++;
+    builder->set_len = 0;
+    builder->set_matched = false;
+    builder->set_waits = false;
+    builder->before = builder->set_before[index];
+    builder->after = after;
+
+    // The consuming states stay, the assertions are replaced by what follows them if they hold
+    for (int i = 0; i < builder->set_size[index]; ++i)
+        dfa_builder_add_closure(builder, builder->nfa[builder->pool[builder->set_offset[index] + i]]);
+    if (builder->set_matched) return -1;
+
+    memcpy(builder->resolved, builder->set, sizeof(int) * builder->set_len);
+    return builder->set_len;
+}
+
+static void dfa_builder_compute_ends(DfaBuilder *builder) {
+    Dfa *dfa = builder->dfa;
+    dfa->ends = memory_allocate(builder->allocator, dfa->state_count);
+    dfa->ends[DFA_DEAD_STATE] = 0;
+    dfa->ends[dfa->match / dfa->class_count] = DFA_END_TEXT | DFA_END_LINE;
+
+    for (int index = 2; index < dfa->state_count; ++index) {
+        // Nothing is after the end, the assertions waiting in the state see the edge
+        int len = dfa_builder_resolve(builder, index, SIDE_EDGE);
+        if (len < 0) {
+            dfa->ends[index] = DFA_END_TEXT | DFA_END_LINE;
+            continue;
+        }
+
+        // Or the new line ending the line, the end of the input comes after it (no match starts there)
+        builder->generation++;
+        builder->set_len = 0;
+        builder->set_matched = false;
+        builder->before = SIDE_OTHER;
+        builder->after = SIDE_EDGE;
+        for (int i = 0; i < len; ++i) {
+            State *state = builder->nfa[builder->resolved[i]];
+            if (dfa_state_accepts(state, '\n') && !state_is_restart(state, builder->restarts))
+                dfa_builder_add_closure(builder, state->out);
+        }
+        dfa->ends[index] = builder->set_matched ? DFA_END_LINE : 0;
+    }
+}
+
+static int dfa_builder_get_state(DfaBuilder *builder) {
+    Dfa *dfa = builder->dfa;
+    if (builder->set_matched) return dfa->match;
+    if (!builder->set_len) return DFA_DEAD_STATE;
+
+    qsort(builder->set, builder->set_len, sizeof(int), dfa_compare_ints);
+
+    // The side before only matters to the assertions waiting in the set
+    Side before = builder->set_waits ? builder->before : SIDE_UNKNOWN;
+    unsigned int mask = (unsigned int)builder->bucket_count - 1;
+    unsigned int bucket = dfa_hash_set(builder->set, builder->set_len, before) & mask;
+    for (; builder->buckets[bucket]; bucket = (bucket + 1) & mask) {
+        int index = builder->buckets[bucket] - 1;
+        if (builder->set_size[index] == builder->set_len && builder->set_before[index] == before
+            && !memcmp(&builder->pool[builder->set_offset[index]], builder->set, sizeof(int) * builder->set_len))
+            return index * dfa->class_count;
+    }
+
+    int index = dfa_builder_add_state(builder, before);
+    if (index < 0) return -1;
+
+    builder->buckets[bucket] = index + 1;
+    return index * dfa->class_count;
+}
+
+static int dfa_builder_add_state(DfaBuilder *builder, Side before) {
+    Dfa *dfa = builder->dfa;
+    size_t row_bytes = sizeof(int) * dfa->class_count;
+    if (dfa->state_count == builder->max_states) return -1;
+    // The dead and match states are always added
+    if (dfa->state_count >= 2 && row_bytes * (dfa->state_count + 1) > builder->max_bytes) return -1;
+
+    if (builder->pool_len + builder->set_len > builder->pool_capacity) {
+        size_t capacity = (builder->pool_capacity + builder->set_len) * 2;
+        builder->pool = memory_reallocate(builder->allocator, builder->pool, sizeof(int) * builder->pool_capacity, sizeof(int) * capacity);
+        builder->pool_capacity = capacity;
+    }
+
+    int index = dfa->state_count;
+    // The pool is still NULL when the dead state (empty set) is added
+    if (builder->set_len) memcpy(&builder->pool[builder->pool_len], builder->set, sizeof(int) * builder->set_len);
+    builder->set_offset[index] = builder->pool_len;
+    builder->set_size[index] = builder->set_len;
+    builder->set_before[index] = before;
+    builder->pool_len += builder->set_len;
+
+    dfa->transitions = memory_reallocate(builder->allocator, dfa->transitions, row_bytes * dfa->state_count, row_bytes * (dfa->state_count + 1));
+    dfa->state_count++;
+
+    return index;
+}
+
+static bool dfa_state_accepts(const State *state, unsigned char input) {
+    switch (state->c) {
+        case ANY_CHAR:
+            return true;
+        case RANGE:
+            return state->range.start <= input && input <= state->range.end;
+        default:
+            return state->c == input;
+    }
+}
+
+static int dfa_compare_ints(const void *a, const void *b) {
+    int first = *(const int *)a, second = *(const int *)b;
+    return (first > second) - (first < second);
+}
+
+static unsigned int dfa_hash_set(const int *set, int len, Side before) {
+    // FNV-1a over the ids
+    unsigned int hash = (2166136261u ^ (unsigned int)before) * 16777619u;
+    for (int i = 0; i < len; ++i) {
+        hash ^= (unsigned int)set[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bool dfa_find_exits(const Dfa *dfa, int state, DfaAccel *accel) {
+    accel->count = 0;
+    for (int byte = 0; byte <= LITERAL_CHAR_LAST; ++byte) {
+        if (dfa_next(dfa, state, (unsigned char)byte) == state) continue;
+        if (accel->count == DFA_ACCEL_MAX_BYTES) return false;
+        accel->bytes[accel->count++] = (unsigned char)byte;
+    }
+
+    for (int i = accel->count; i < DFA_ACCEL_MAX_BYTES; ++i) accel->bytes[i] = accel->count ? accel->bytes[i - 1] : 0;
+    return true;
+}
+
+static size_t dfa_find_any(const unsigned char *input, size_t from, size_t len, const unsigned char *bytes) {
+    size_t i = from;
+
+#ifdef __SSE2__
+    // Compare 16 bytes with each exit byte at once
+    __m128i first = _mm_set1_epi8((char)bytes[0]);
+    __m128i second = _mm_set1_epi8((char)bytes[1]);
+    __m128i third = _mm_set1_epi8((char)bytes[2]);
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(input + i));
+        __m128i equal = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, first), _mm_cmpeq_epi8(chunk, second)),
+            _mm_cmpeq_epi8(chunk, third));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(equal);
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+#endif
+
+    for (; i < len; ++i)
+        if (input[i] == bytes[0] || input[i] == bytes[1] || input[i] == bytes[2]) return i;
+    return len;
+}
+
+static void dfa_builder_destroy(DfaBuilder *builder) {
+    int total_states = builder->total_states;
+    memory_free(builder->allocator, builder->nfa, sizeof(State *) * total_states);
+    memory_free(builder->allocator, builder->stack, sizeof(State *) * (2 * total_states + 1));
+    memory_free(builder->allocator, builder->seen, sizeof(unsigned int) * total_states);
+    memory_free(builder->allocator, builder->set, sizeof(int) * total_states);
+    memory_free(builder->allocator, builder->resolved, sizeof(int) * total_states);
+    memory_free(builder->allocator, builder->set_offset, sizeof(size_t) * builder->max_states);
+    memory_free(builder->allocator, builder->set_size, sizeof(int) * builder->max_states);
+    memory_free(builder->allocator, builder->set_before, sizeof(Side) * builder->max_states);
+    memory_free(builder->allocator, builder->buckets, sizeof(int) * builder->bucket_count);
+    memory_free(builder->allocator, builder->pool, sizeof(int) * builder->pool_capacity);
+}
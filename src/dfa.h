@@ -0,0 +1,252 @@
+#pragma once
+
+#include "state.h"
+#include "memory.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief The dead state (no match possible anymore) is always the first state.
+ */
+#define DFA_DEAD_STATE 0
+
+/**
+ * @brief Default maximum number of states built by @ref dfa_create.
+ */
+#define DFA_DEFAULT_MAX_STATES 2048
+
+/**
+ * @brief Most bytes a state can leave on to be accelerated.
+ */
+#define DFA_ACCEL_MAX_BYTES 3
+
+/**
+ * @brief A skip shorter than this (in bytes) is not worth leaving the lookup loop.
+ */
+#define DFA_ACCEL_MIN_SKIP 16
+
+/**
+ * @brief Number of short skips after which @ref dfa_run steps the rest of the input byte by byte.
+ */
+#define DFA_ACCEL_MAX_SHORT_SKIPS 8
+
+/**
+ * @enum DfaEnd
+ * @brief How an input can end after a state (the bits of the ends of a @ref Dfa).
+ */
+typedef enum DfaEnd {
+    DFA_END_TEXT = 1 << 0, /**< The input ends right there */
+    DFA_END_LINE = 1 << 1, /**< The input ends with a new line, which is stepped too */
+} DfaEnd;
+
+/**
+ * @struct DfaAccel dfa.h
+ * @brief Bytes an accelerated state leaves on (every other byte loops back to it).
+ */
+typedef struct DfaAccel {
+    unsigned char bytes[DFA_ACCEL_MAX_BYTES]; /**< The exit bytes (the last one repeated if there are fewer) */
+    int count; /**< Number of exit bytes */
+} DfaAccel;
+
+/**
+ * @struct Dfa dfa.h
+ * @brief Deterministic automaton built from the nfa by subset construction.
+ *
+ * Bytes that no state can tell apart share one byte class, so each state has
+ * only a row of class_count transitions. The states are premultiplied (the
+ * state is the index of its row), so a step is a single table lookup.
+ *
+ * Every set of nfa states containing the MATCH state is merged into one
+ * absorbing match state, as the nfa never leaves the MATCH state either.
+ *
+ * The dead and match states are the first two rows, followed by the
+ * accelerated states (see @ref dfa_accelerate), so a single comparison with
+ * accel_limit tells whether the state needs anything else than a lookup.
+ *
+ * Assertions are decided between the byte before a position and the byte
+ * after it. A state is the set of nfa states together with the side of the
+ * byte stepped to reach it (see Side in state.h), the assertions wait in the
+ * set and are followed when stepping the next byte, so a match ending at an
+ * assertion is only known one byte later. The end of the input is not a
+ * byte: the ends of each state tell whether the input matches if it ends
+ * there (see @ref dfa_end). Word bytes are never in the same byte class as
+ * other bytes if the nfa has word boundaries, so the table stays one lookup
+ * per byte.
+ */
+typedef struct Dfa {
+    int *transitions; /**< Next state is transitions[state + byte_classes[byte]] */
+    unsigned char byte_classes[256]; /**< Byte class of each byte */
+    int class_count; /**< Number of byte classes */
+    int state_count; /**< Number of states */
+    int start; /**< The start state at the start of the input */
+    int word_start; /**< The start state after a word byte */
+    int other_start; /**< The start state after any other byte */
+    unsigned char *ends; /**< DfaEnd bits of the ends matching after each state (by row) */
+    int match; /**< The (absorbing) match state */
+    DfaAccel *accels; /**< Exit bytes of each accelerated state, the first one is the row after the match state */
+    int accel_count; /**< Number of accelerated states */
+    int accel_limit; /**< States below it are the dead, match and accelerated states */
+} Dfa;
+
+/**
+ * @brief Build the dfa of the nfa.
+ *
+ * @note Uses the id of the nfa states, so the nfa should not be stepped meanwhile.
+ *
+ * @param dfa Pointer to the dfa
+ * @param start Start state of the nfa
+ * @param restarts States going back to the start after a byte (STATE_MAX_RESTARTS of them, see
+ * state_is_restart()), not followed over the new line ending a line (NULL if there are none)
+ * @param total_states Total number of states in the nfa
+ * @param max_states Maximum number of dfa states to build
+ * @param max_bytes Maximum bytes of transitions to build (SIZE_MAX for no limit)
+ * @param allocator The allocator to use
+ *
+ * @return false if the dfa needs more than max_states states or max_bytes bytes (nothing is allocated then).
+ */
+bool dfa_create(Dfa *dfa, State *start, State *const *restarts, int total_states, int max_states, size_t max_bytes,
+    const Allocator *allocator);
+
+/**
+ * @brief Find the states that loop back to themselves on all but a few bytes.
+ *
+ * A state is accelerated if it leaves on at most DFA_ACCEL_MAX_BYTES bytes
+ * (like the loop skipping characters before an unanchored pattern, or the
+ * inside of "[^"]*"). Its row is moved right after the match state, so that
+ * @ref dfa_run can jump over the bytes it loops on with memchr() or SIMD
+ * compares instead of looking each of them up.
+ *
+ * @param dfa Pointer to the dfa
+ * @param allocator The allocator used to create the dfa
+ */
+void dfa_accelerate(Dfa *dfa, const Allocator *allocator);
+
+/**
+ * @brief Free the dfa.
+ *
+ * @param dfa Pointer to the dfa
+ * @param allocator The allocator used to create the dfa
+ */
+void dfa_destroy(Dfa *dfa, const Allocator *allocator);
+
+/**
+ * @brief Find the next byte the accelerated state leaves on.
+ *
+ * @param dfa Pointer to the dfa
+ * @param state The accelerated state
+ * @param input The input
+ * @param from Offset to start looking at
+ * @param len Length of the input
+ *
+ * @return Offset of the first exit byte at or after from (len if there is none).
+ */
+size_t dfa_skip(const Dfa *dfa, int state, const unsigned char *input, size_t from, size_t len);
+
+/**
+ * @brief Get the bytes used by the transition table.
+ *
+ * @param dfa Pointer to the dfa
+ *
+ * @return Size of the table in bytes.
+ */
+size_t dfa_table_bytes(const Dfa *dfa);
+
+/**
+ * @brief Get the next state on the input.
+ *
+ * @param dfa Pointer to the dfa
+ * @param state The current state
+ * @param input The input byte
+ *
+ * @return The next state.
+ */
+static inline int dfa_next(const Dfa *dfa, int state, unsigned char input) {
+    return dfa->transitions[state + dfa->byte_classes[input]];
+}
+
+/**
+ * @brief Get the start state of a match starting at the offset of the input.
+ *
+ * @param dfa Pointer to the dfa
+ * @param input The input
+ * @param offset The offset (the byte before it is read)
+ *
+ * @return The start state.
+ */
+static inline int dfa_start_at(const Dfa *dfa, const unsigned char *input, size_t offset) {
+    if (!offset) return dfa->start;
+    return state_is_word_byte(input[offset - 1]) ? dfa->word_start : dfa->other_start;
+}
+
+/**
+ * @brief Get the state after the end of the input.
+ *
+ * @param dfa Pointer to the dfa
+ * @param state The state before the end
+ * @param new_line Whether the input ends a line (a new line is stepped at its end)
+ *
+ * @return The match state if the input matched, the dead state otherwise.
+ */
+static inline int dfa_end(const Dfa *dfa, int state, bool new_line) {
+    unsigned char end = new_line ? DFA_END_LINE : DFA_END_TEXT;
+    return dfa->ends[state / dfa->class_count] & end ? dfa->match : DFA_DEAD_STATE;
+}
+
+/**
+ * @brief Check whether the state can not change anymore (dead or match state).
+ *
+ * @param dfa Pointer to the dfa
+ * @param state The state
+ *
+ * @return true if no input can change the result.
+ */
+static inline bool dfa_is_final(const Dfa *dfa, int state) {
+    // The dead and match states are the first two rows
+    return state <= dfa->match;
+}
+
+/**
+ * @brief Check whether the state jumps to its next exit byte instead of stepping.
+ *
+ * @param dfa Pointer to the dfa
+ * @param state The state
+ *
+ * @return true if the state is accelerated.
+ */
+static inline bool dfa_is_accelerated(const Dfa *dfa, int state) {
+    return state > dfa->match && state < dfa->accel_limit;
+}
+
+/**
+ * @brief Step the dfa over the input until it ends or the state is final.
+ *
+ * @param dfa Pointer to the dfa
+ * @param state The state to start from
+ * @param input The input
+ * @param len Length of the input
+ * @param offset Pointer to the offset to start at, set to the offset after the last byte stepped over
+ *
+ * @return The state reached.
+ */
+static inline int dfa_run(const Dfa *dfa, int state, const unsigned char *input, size_t len, size_t *offset) {
+    size_t i = *offset;
+    int short_skips = 0;
+    while (i < len) {
+        // Only the final and accelerated states are below the limit, the others just step
+        if (state < dfa->accel_limit) {
+            if (dfa_is_final(dfa, state)) break;
+            // Exit bytes that keep showing up make each skip cost more than the bytes it saves
+            if (short_skips < DFA_ACCEL_MAX_SHORT_SKIPS) {
+                size_t next = dfa_skip(dfa, state, input, i, len);
+                short_skips += next - i < DFA_ACCEL_MIN_SKIP;
+                i = next;
+                if (i == len) break;
+            }
+        }
+        state = dfa_next(dfa, state, input[i++]);
+    }
+
+    *offset = i;
+    return state;
+}
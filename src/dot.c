@@ -0,0 +1,272 @@
+#include "dot.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+/**
+ * @brief Write the text escaped for a quoted DOT string.
+ *
+ * @param out The stream to write to
+ * @param text The text
+ */
+static void dot_write_escaped(FILE *out, const char *text);
+
+/**
+ * @brief Describe the byte ('a', '\\n', '\\x7f'...).
+ *
+ * @param byte The byte
+ * @param text Buffer of 5 bytes to store the description
+ */
+static void dot_byte_text(int byte, char *text);
+
+/**
+ * @brief Write the fill color of a node from its visits.
+ *
+ * @param out The stream to write to
+ * @param visits Visits of the node
+ * @param max_visits Visits of the most visited node (0 if nothing is counted)
+ */
+static void dot_write_heat(FILE *out, unsigned long long visits, unsigned long long max_visits);
+
+/**
+ * @brief Get the largest count.
+ *
+ * @param visits The counts (can be NULL)
+ * @param count Number of counts
+ *
+ * @return The largest count (0 if visits is NULL).
+ */
+static unsigned long long dot_max_visits(const unsigned long long *visits, int count);
+
+/**
+ * @brief Write the nfa cluster.
+ *
+ * @param graph The automata
+ * @param out The stream to write to
+ * @param allocator The allocator to use for the traversal
+ */
+static void dot_write_nfa(const DotGraph *graph, FILE *out, const Allocator *allocator);
+
+/**
+ * @brief Write the dfa cluster.
+ *
+ * @param graph The automata
+ * @param out The stream to write to
+ */
+static void dot_write_dfa(const DotGraph *graph, FILE *out);
+
+/**
+ * @brief Write the bytes as a label ("a-z", "[^\\n]", "any"...).
+ *
+ * @param out The stream to write to
+ * @param bytes Whether each byte is in the set
+ */
+static void dot_write_byte_set(FILE *out, const bool bytes[256]);
+
+void dot_index_states(State *start, int total_states, int index_count, State **states, const Allocator *allocator) {
+    memset(states, 0, sizeof(State *) * index_count);
+
+    // Each state pushes its outs only once, the first time it is popped
+    State **stack = memory_allocate(allocator, sizeof(State *) * (2 * total_states + 1));
+    int stack_len = 0;
+    stack[stack_len++] = start;
+    while (stack_len) {
+        State *state = stack[--stack_len];
+        if (!state || states[state->index] == state) continue;
+
+        states[state->index] = state;
+        stack[stack_len++] = state->out1;
+        stack[stack_len++] = state->out;
+    }
+
+    memory_free(allocator, stack, sizeof(State *) * (2 * total_states + 1));
+}
+
+void dot_state_label(const State *state, char *label) {
+    char first[5], last[5];
+
+    switch (state->c) {
+        case MATCH: strcpy(label, "match"); break;
+        case BRANCH: strcpy(label, "branch"); break;
+        case EPSILON: strcpy(label, "epsilon"); break;
+        case LINE_START: strcpy(label, "^"); break;
+        case DEAD: strcpy(label, "dead"); break;
+        case ANY_CHAR: strcpy(label, "any"); break;
+        case WORD_BOUNDARY: strcpy(label, "\\b"); break;
+        case NOT_WORD_BOUNDARY: strcpy(label, "\\B"); break;
+        case TEXT_START: strcpy(label, "\\A"); break;
+        case TEXT_END: strcpy(label, "\\z"); break;
+        case LOOP_BACK: strcpy(label, "loop back"); break;
+        case RANGE:
+            dot_byte_text(state->range.start, first);
+            dot_byte_text(state->range.end, last);
+            snprintf(label, DOT_LABEL_SIZE, "[%s-%s]", first, last);
+            break;
+        default:
+            dot_byte_text(state->c, first);
+            snprintf(label, DOT_LABEL_SIZE, "'%s'", first);
+            break;
+    }
+}
+
+void dot_write(const DotGraph *graph, FILE *out, const Allocator *allocator) {
+    fprintf(out, "digraph regex {\n");
+    fprintf(out, "    rankdir=LR;\n");
+    fprintf(out, "    node [fontname=\"monospace\"];\n");
+    fprintf(out, "    edge [fontname=\"monospace\"];\n");
+
+    dot_write_nfa(graph, out, allocator);
+    if (graph->dfa) dot_write_dfa(graph, out);
+
+    fprintf(out, "}\n");
+}
+
+static void dot_write_escaped(FILE *out, const char *text) {
+    for (; *text; ++text) {
+        if (*text == '"' || *text == '\\') fputc('\\', out);
+        fputc(*text, out);
+    }
+}
+
+static void dot_byte_text(int byte, char *text) {
+    switch (byte) {
+        case '\n': strcpy(text, "\\n"); break;
+        case '\t': strcpy(text, "\\t"); break;
+        case '\r': strcpy(text, "\\r"); break;
+        default:
+            if (byte >= ' ' && byte < 0x7f) snprintf(text, 5, "%c", byte);
+            else snprintf(text, 5, "\\x%02x", byte & 0xff);
+            break;
+    }
+}
+
+static void dot_write_heat(FILE *out, unsigned long long visits, unsigned long long max_visits) {
+    if (!max_visits) return;
+
+    // White when never visited up to red for the hottest state (hue 0, saturation is the share of the maximum)
+    fprintf(out, ", style=filled, fillcolor=\"0.000 %.3f 1.000\"", (double)visits / (double)max_visits);
+}
+
+static unsigned long long dot_max_visits(const unsigned long long *visits, int count) {
+    unsigned long long max_visits = 0;
+    for (int i = 0; visits && i < count; ++i)
+        if (visits[i] > max_visits) max_visits = visits[i];
+    return max_visits;
+}
+
+static void dot_write_nfa(const DotGraph *graph, FILE *out, const Allocator *allocator) {
+    State **states = memory_allocate(allocator, sizeof(State *) * graph->index_count);
+    dot_index_states(graph->start, graph->total_states, graph->index_count, states, allocator);
+    unsigned long long max_visits = dot_max_visits(graph->nfa_visits, graph->index_count);
+
+    fprintf(out, "    subgraph cluster_nfa {\n");
+    fprintf(out, "        label=\"nfa (%d states)\";\n", graph->total_states);
+    fprintf(out, "        nfa_start [shape=point];\n");
+    fprintf(out, "        nfa_start -> n%d;\n", graph->start->index);
+
+    char label[DOT_LABEL_SIZE];
+    for (int i = 0; i < graph->index_count; ++i) {
+        const State *state = states[i];
+        if (!state) continue;
+
+        const char *shape = "box";
+        if (state->c == MATCH) shape = "doublecircle";
+        else if (state->c == BRANCH || state->c == EPSILON) shape = "diamond";
+
+        dot_state_label(state, label);
+        fprintf(out, "        n%d [shape=%s, label=\"%d: ", i, shape, i);
+        dot_write_escaped(out, label);
+        if (graph->nfa_visits) fprintf(out, "\\n%llu", graph->nfa_visits[i]);
+        fprintf(out, "\"");
+        dot_write_heat(out, graph->nfa_visits ? graph->nfa_visits[i] : 0, max_visits);
+        fprintf(out, "];\n");
+
+        if (state->out) fprintf(out, "        n%d -> n%d;\n", i, state->out->index);
+        if (state->out1) fprintf(out, "        n%d -> n%d [style=dashed];\n", i, state->out1->index);
+    }
+
+    fprintf(out, "    }\n");
+
+    memory_free(allocator, states, sizeof(State *) * graph->index_count);
+}
+
+static void dot_write_dfa(const DotGraph *graph, FILE *out) {
+    const Dfa *dfa = graph->dfa;
+    int class_count = dfa->class_count;
+    unsigned long long max_visits = dot_max_visits(graph->dfa_visits, dfa->state_count);
+
+    fprintf(out, "    subgraph cluster_dfa {\n");
+    fprintf(out, "        label=\"dfa (%d states, %d byte classes)\";\n", dfa->state_count, class_count);
+    fprintf(out, "        dfa_start [shape=point];\n");
+    fprintf(out, "        dfa_start -> d%d;\n", dfa->start / class_count);
+
+    for (int row = 0; row < dfa->state_count; ++row) {
+        int state = row * class_count;
+        if (state == DFA_DEAD_STATE) continue;
+
+        if (state == dfa->match) fprintf(out, "        d%d [shape=doublecircle, label=\"match", row);
+        else fprintf(out, "        d%d [shape=%s, label=\"%d", row, dfa_is_accelerated(dfa, state) ? "octagon" : "circle", row);
+        if (graph->dfa_visits) fprintf(out, "\\n%llu", graph->dfa_visits[row]);
+        fprintf(out, "\"");
+        dot_write_heat(out, graph->dfa_visits ? graph->dfa_visits[row] : 0, max_visits);
+        fprintf(out, "];\n");
+
+        // Nothing leaves the match state, and the edges into the dead state would only clutter the graph
+        if (state == dfa->match) continue;
+
+        int targets[256];
+        for (int byte = 0; byte < 256; ++byte) targets[byte] = dfa_next(dfa, state, (unsigned char)byte);
+
+        // One edge per target, labelled with all the bytes leading to it
+        bool done[256] = {false};
+        for (int byte = 0; byte < 256; ++byte) {
+            if (done[byte] || targets[byte] == DFA_DEAD_STATE) continue;
+
+            bool bytes[256];
+            for (int other = byte; other < 256; ++other) {
+                bytes[other] = targets[other] == targets[byte];
+                done[other] |= bytes[other];
+            }
+            memset(bytes, 0, sizeof(bool) * byte);
+
+            fprintf(out, "        d%d -> d%d [label=\"", row, targets[byte] / class_count);
+            dot_write_byte_set(out, bytes);
+            fprintf(out, "\"];\n");
+        }
+    }
+
+    fprintf(out, "    }\n");
+}
+
+static void dot_write_byte_set(FILE *out, const bool bytes[256]) {
+    int count = 0;
+    for (int byte = 0; byte < 256; ++byte) count += bytes[byte];
+
+    if (count == 256) {
+        fprintf(out, "any");
+        return;
+    }
+
+    // Most bytes lead to the same state after a '.' or a negated class, name the few others
+    bool negated = count > 128;
+    if (negated) fprintf(out, "[^");
+
+    char first[5], last[5];
+    for (int byte = 0; byte < 256; ++byte) {
+        if (bytes[byte] == negated) continue;
+
+        int end = byte;
+        while (end + 1 < 256 && bytes[end + 1] != negated) end++;
+
+        dot_byte_text(byte, first);
+        dot_write_escaped(out, first);
+        if (end > byte) {
+            dot_byte_text(end, last);
+            if (end > byte + 1) fputc('-', out);
+            dot_write_escaped(out, last);
+        }
+        byte = end;
+    }
+
+    if (negated) fputc(']', out);
+}
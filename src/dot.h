@@ -0,0 +1,61 @@
+#pragma once
+
+#include "state.h"
+#include "dfa.h"
+#include "memory.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * @brief Longest label @ref dot_state_label writes (with the NUL).
+ */
+#define DOT_LABEL_SIZE 32
+
+/**
+ * @struct DotGraph dot.h
+ * @brief The automata written by @ref dot_write, with the optional visit counts of their states.
+ */
+typedef struct DotGraph {
+    State *start; /**< Start state of the nfa */
+    int total_states; /**< Total number of states in the nfa */
+    int index_count; /**< Bound of the indexes of the nfa states (more than total_states if they are shared) */
+    const unsigned long long *nfa_visits; /**< Visits of each nfa state by its index (NULL if not profiled) */
+    const Dfa *dfa; /**< The dfa (NULL if it is not built) */
+    const unsigned long long *dfa_visits; /**< Visits of each dfa state by its row (NULL if not profiled) */
+} DotGraph;
+
+/**
+ * @brief Store each nfa state reachable from the start at its index.
+ *
+ * @param start Start state of the nfa
+ * @param total_states Total number of states in the nfa
+ * @param index_count Bound of the indexes of the states
+ * @param states Array of index_count to store the states (unreachable indexes are NULL)
+ * @param allocator The allocator to use for the traversal
+ */
+void dot_index_states(State *start, int total_states, int index_count, State **states, const Allocator *allocator);
+
+/**
+ * @brief Describe what the nfa state matches ("'a'", "[0-9]", "any", "match"...).
+ *
+ * @param state The nfa state
+ * @param label Buffer of DOT_LABEL_SIZE bytes to store the label (bytes outside printable ASCII are escaped)
+ */
+void dot_state_label(const State *state, char *label);
+
+/**
+ * @brief Write the automata as a Graphviz digraph (render it with `dot -Tsvg`).
+ *
+ * The nfa and the dfa are drawn as two clusters. Each node is labelled with
+ * what it matches (nfa) or its row (dfa), and with its visits if they are
+ * counted, then it is also filled from white (never visited) to red (the most
+ * visited state of its automaton). Dfa edges are labelled with their bytes,
+ * edges into the dead state and out of the match state are left out, and the
+ * accelerated dfa states are drawn as octagons.
+ *
+ * @param graph The automata
+ * @param out The stream to write to
+ * @param allocator The allocator to use for the traversal
+ */
+void dot_write(const DotGraph *graph, FILE *out, const Allocator *allocator);
@@ -0,0 +1,383 @@
+#include "glushkov.h"
+
+#include <string.h>
+
+/**
+ * @brief Nfa states consuming bytes looked at before merging them into positions.
+ */
+#define GLUSHKOV_MAX_NFA_POSITIONS 1024
+
+/**
+ * @struct GlushkovBuilder
+ * @brief State needed only while building the automaton.
+ */
+typedef struct GlushkovBuilder {
+    const Allocator *allocator;
+    int total_states; /**< Number of nfa states the buffers are allocated for */
+
+    State **nfa; /**< The nfa states reachable from the entries, indexed by their id */
+    int nfa_len; /**< Number of nfa states */
+
+    State **stack; /**< Stack used to follow the epsilon edges */
+    unsigned int *seen; /**< Generation in which the nfa state was last visited */
+    unsigned int generation; /**< Current generation */
+    int *closure; /**< Consuming states of the last closure */
+    int closure_len; /**< Length of the closure */
+    bool closure_match; /**< The last closure contains MATCH */
+
+    int *consuming; /**< Ids of the consuming nfa states, in the order they were reached */
+    int consuming_count; /**< Number of consuming states */
+    int *group; /**< Index of the group of each nfa state (-1 if it does not consume) */
+    int *group_state; /**< First consuming state (id) of each group */
+    int group_count; /**< Number of groups */
+    uint64_t *columns; /**< Bitset of the closures each consuming state is in */
+    int column_words; /**< Words of each bitset */
+} GlushkovBuilder;
+
+/**
+ * @brief Check whether the nfa state consumes a byte.
+ *
+ * @param state The nfa state
+ *
+ * @return true for literal, any character and range states.
+ */
+static bool glushkov_is_consuming(const State *state);
+
+/**
+ * @brief Number the nfa states reachable from the state (without the loop skipping characters).
+ *
+ * @param builder Pointer to the builder
+ * @param state The nfa state
+ */
+static void glushkov_builder_collect(GlushkovBuilder *builder, State *state);
+
+/**
+ * @brief Compute the consuming states reachable by epsilon edges from the state.
+ *
+ * @param builder Pointer to the builder
+ * @param state The nfa state
+ */
+static void glushkov_builder_closure(GlushkovBuilder *builder, State *state);
+
+/**
+ * @brief Merge the consuming states going to the same state from the same closures into groups.
+ *
+ * @param builder Pointer to the builder
+ * @param entries First state of each top-level alternative
+ * @param entry_count Number of entries
+ *
+ * @return false if there are more than GLUSHKOV_MAX_POSITIONS groups.
+ */
+static bool glushkov_builder_group(GlushkovBuilder *builder, State *const *entries, int entry_count);
+
+/**
+ * @brief Get the groups of the last closure as a mask.
+ *
+ * @param builder Pointer to the builder
+ *
+ * @return Bit g is set if group g is in the closure.
+ */
+static uint64_t glushkov_builder_closure_mask(const GlushkovBuilder *builder);
+
+/**
+ * @brief Move the bits of the groups to the bits of their positions.
+ *
+ * @param mask Mask of groups
+ * @param positions Position of each group
+ *
+ * @return Mask of positions.
+ */
+static uint64_t glushkov_permute(uint64_t mask, const int *positions);
+
+/**
+ * @brief Get the index of the lowest set bit.
+ *
+ * @param mask The mask (not 0)
+ *
+ * @return Index of the bit.
+ */
+static int glushkov_lowest_bit(uint64_t mask);
+
+/**
+ * @brief Free the buffers of the builder.
+ *
+ * @param builder Pointer to the builder
+ */
+static void glushkov_builder_destroy(GlushkovBuilder *builder);
+
+bool glushkov_create(Glushkov *glushkov, State *const *entries, const bool *anchored, int entry_count, int total_states,
+    const Allocator *allocator) {
+    *glushkov = (Glushkov){0};
+
+    GlushkovBuilder builder = {.allocator = allocator, .total_states = total_states};
+    builder.nfa = memory_allocate(allocator, sizeof(State *) * total_states);
+    builder.stack = memory_allocate(allocator, sizeof(State *) * total_states);
+    builder.seen = memory_allocate(allocator, sizeof(unsigned int) * total_states);
+    builder.closure = memory_allocate(allocator, sizeof(int) * total_states);
+    builder.consuming = memory_allocate(allocator, sizeof(int) * total_states);
+    builder.group = memory_allocate(allocator, sizeof(int) * total_states);
+
+    memset(builder.seen, 0, sizeof(unsigned int) * total_states);
+    for (int i = 0; i < entry_count; ++i) glushkov_builder_collect(&builder, entries[i]);
+    for (int i = 0; i < builder.nfa_len; ++i) {
+        builder.group[i] = -1;
+        if (glushkov_is_consuming(builder.nfa[i])) builder.consuming[builder.consuming_count++] = i;
+    }
+
+    if (!glushkov_builder_group(&builder, entries, entry_count)) {
+        glushkov_builder_destroy(&builder);
+        return false;
+    }
+
+    // Where each group goes, the order of the groups is the order of the pattern (mostly)
+    uint64_t follow[GLUSHKOV_MAX_POSITIONS], last = 0;
+    for (int g = 0; g < builder.group_count; ++g) {
+        glushkov_builder_closure(&builder, builder.nfa[builder.group_state[g]]->out);
+        follow[g] = glushkov_builder_closure_mask(&builder);
+        if (builder.closure_match) last |= (uint64_t)1 << g;
+    }
+
+    // Number the positions along chains of groups following each other, so that most edges are to the next position
+    int positions[GLUSHKOV_MAX_POSITIONS];
+    uint64_t numbered = 0;
+    int position_count = 0;
+    for (int g = 0; g < builder.group_count; ++g) {
+        for (int next = g; next >= 0 && !(numbered & ((uint64_t)1 << next));) {
+            positions[next] = position_count++;
+            numbered |= (uint64_t)1 << next;
+
+            uint64_t candidates = follow[next] & ~numbered;
+            next = candidates ? glushkov_lowest_bit(candidates) : -1;
+        }
+    }
+    glushkov->position_count = position_count;
+
+    // Split the edges into the ones to the next position and the others
+    uint64_t irregular[GLUSHKOV_MAX_POSITIONS] = {0};
+    for (int g = 0; g < builder.group_count; ++g) {
+        int position = positions[g];
+        uint64_t to = glushkov_permute(follow[g], positions);
+        uint64_t next = position + 1 < GLUSHKOV_MAX_POSITIONS ? (uint64_t)1 << (position + 1) : 0;
+        if (to & next) glushkov->shift |= (uint64_t)1 << position;
+        irregular[position] = to & ~next;
+    }
+    glushkov->last = glushkov_permute(last, positions);
+
+    for (int e = 0; e < entry_count; ++e) {
+        glushkov_builder_closure(&builder, entries[e]);
+        glushkov->empty |= builder.closure_match;
+        uint64_t first = glushkov_permute(glushkov_builder_closure_mask(&builder), positions);
+        if (anchored[e]) glushkov->first_anchored |= first;
+        else glushkov->first |= first;
+    }
+
+    // One table for each chunk of positions having irregular edges
+    for (int k = 0; k * GLUSHKOV_CHUNK_BITS < position_count; ++k) {
+        uint64_t any = 0;
+        for (int b = 0; b < GLUSHKOV_CHUNK_BITS; ++b) any |= irregular[k * GLUSHKOV_CHUNK_BITS + b];
+        if (any) glushkov->chunks[glushkov->chunk_count++] = k;
+    }
+
+    size_t rows = 1 << GLUSHKOV_CHUNK_BITS;
+    glushkov->bytes = memory_allocate(allocator, glushkov_table_bytes(glushkov));
+    glushkov->follow = glushkov->bytes + 256;
+    memset(glushkov->bytes, 0, glushkov_table_bytes(glushkov));
+
+    for (int i = 0; i < builder.consuming_count; ++i) {
+        const State *state = builder.nfa[builder.consuming[i]];
+        uint64_t bit = (uint64_t)1 << positions[builder.group[state->id]];
+
+        unsigned int start = state->c, end = state->c;
+        if (state->c == ANY_CHAR) start = 0, end = 255;
+        else if (state->c == RANGE) start = state->range.start, end = state->range.end < 255 ? state->range.end : 255;
+        for (unsigned int byte = start; byte <= end; ++byte) glushkov->bytes[byte] |= bit;
+    }
+
+    for (int t = 0; t < glushkov->chunk_count; ++t) {
+        uint64_t *table = glushkov->follow + t * rows;
+        const uint64_t *chunk = irregular + glushkov->chunks[t] * GLUSHKOV_CHUNK_BITS;
+        // Each row is a smaller row plus the edges of its lowest position
+        for (size_t row = 1; row < rows; ++row) table[row] = table[row & (row - 1)] | chunk[glushkov_lowest_bit(row)];
+    }
+
+    glushkov_builder_destroy(&builder);
+    return true;
+}
+
+void glushkov_destroy(Glushkov *glushkov, const Allocator *allocator) {
+    memory_free(allocator, glushkov->bytes, glushkov_table_bytes(glushkov));
+    *glushkov = (Glushkov){0};
+}
+
+size_t glushkov_table_bytes(const Glushkov *glushkov) {
+    return sizeof(uint64_t) * (256 + ((size_t)glushkov->chunk_count << GLUSHKOV_CHUNK_BITS));
+}
+
+bool glushkov_run(const Glushkov *glushkov, uint64_t *set, const unsigned char *input, size_t *offset, size_t end) {
+    if (glushkov->empty) return true;
+
+    uint64_t current = *set, last = glushkov->last;
+    bool anchored_only = !glushkov->first;
+
+    // The first byte can start the '^' alternatives too
+    size_t i = *offset;
+    if (!i && end) {
+        current = glushkov_next(glushkov, 0, input[0]) | (glushkov->first_anchored & glushkov->bytes[input[0]]);
+        i = 1;
+    }
+
+    // Nothing changes after matching, or once no position is left (only '^' alternatives)
+    for (; i < end && !(current & last) && (current || !anchored_only); ++i) current = glushkov_next(glushkov, current, input[i]);
+
+    *set = current;
+    *offset = i;
+    return (current & last) || (i && !current && anchored_only);
+}
+
+bool glushkov_end(const Glushkov *glushkov, uint64_t set, const unsigned char *input, size_t len, bool end_of_line,
+    size_t *offset) {
+    if (glushkov->empty) return true;
+
+    // Add new line at the end of each line, if they aren't there
+    if (*offset == len && !(set & glushkov->last) && end_of_line && (!len || input[len - 1] != '\n')) {
+        set = glushkov_next(glushkov, set, '\n') | (len ? 0 : glushkov->first_anchored & glushkov->bytes['\n']);
+        (*offset)++;
+    }
+
+    return set & glushkov->last;
+}
+
+static bool glushkov_is_consuming(const State *state) {
+    return state->c <= LITERAL_CHAR_LAST || state->c == ANY_CHAR || state->c == RANGE;
+}
+
+static void glushkov_builder_collect(GlushkovBuilder *builder, State *state) {
+    // Same depth first walk as the other passes, ids are the visiting order
+    if (!state || (state->id < builder->nfa_len && builder->nfa[state->id] == state)) return;
+
+    state->id = builder->nfa_len;
+    builder->nfa[builder->nfa_len++] = state;
+
+    glushkov_builder_collect(builder, state->out);
+    glushkov_builder_collect(builder, state->out1);
+}
+
+static void glushkov_builder_closure(GlushkovBuilder *builder, State *state) {
+    builder->generation++;
+    builder->closure_len = 0;
+    builder->closure_match = false;
+
+    int top = 0;
+    builder->stack[top++] = state;
+    builder->seen[state->id] = builder->generation;
+
+    while (top) {
+        State *current = builder->stack[--top];
+        State *outs[2] = {NULL, NULL};
+        switch (current->c) {
+            case BRANCH:
+                outs[1] = current->out1;
+                /* fallthrough */
+            case EPSILON:
+                outs[0] = current->out;
+                break;
+            case MATCH:
+                builder->closure_match = true;
+                break;
+            default:
+                if (glushkov_is_consuming(current)) builder->closure[builder->closure_len++] = current->id;
+                break;
+        }
+
+        for (int i = 0; i < 2; ++i) {
+            if (!outs[i] || builder->seen[outs[i]->id] == builder->generation) continue;
+            builder->seen[outs[i]->id] = builder->generation;
+            builder->stack[top++] = outs[i];
+        }
+    }
+}
+
+static bool glushkov_builder_group(GlushkovBuilder *builder, State *const *entries, int entry_count) {
+    if (builder->consuming_count > GLUSHKOV_MAX_NFA_POSITIONS) return false;
+
+    // Which closures (of the entries and after each consuming state) contain each consuming state
+    int closure_count = entry_count + builder->consuming_count;
+    builder->column_words = (closure_count + 63) / 64;
+    size_t column_bytes = sizeof(uint64_t) * builder->column_words * builder->consuming_count;
+    builder->columns = memory_allocate(builder->allocator, column_bytes);
+    builder->group_state = memory_allocate(builder->allocator, sizeof(int) * GLUSHKOV_MAX_POSITIONS);
+    memset(builder->columns, 0, column_bytes);
+
+    int *column_of = builder->group; // Reused, the groups are computed after the columns
+    for (int i = 0; i < builder->consuming_count; ++i) column_of[builder->consuming[i]] = i;
+
+    for (int j = 0; j < closure_count; ++j) {
+        State *from = j < entry_count ? entries[j] : builder->nfa[builder->consuming[j - entry_count]]->out;
+        glushkov_builder_closure(builder, from);
+        for (int i = 0; i < builder->closure_len; ++i)
+            builder->columns[column_of[builder->closure[i]] * builder->column_words + j / 64] |= (uint64_t)1 << (j % 64);
+    }
+
+    // Consuming states going to the same state from the same places are one position
+    int *representative = builder->closure; // Reused, no more closures until the groups are known
+    for (int i = 0; i < builder->consuming_count; ++i) {
+        const State *state = builder->nfa[builder->consuming[i]];
+        const uint64_t *column = builder->columns + i * builder->column_words;
+
+        int same = -1;
+        for (int r = 0; r < builder->group_count && same < 0; ++r) {
+            const State *other = builder->nfa[builder->consuming[representative[r]]];
+            const uint64_t *other_column = builder->columns + representative[r] * builder->column_words;
+            if (other->out == state->out && !memcmp(column, other_column, sizeof(uint64_t) * builder->column_words))
+                same = r;
+        }
+
+        if (same < 0) {
+            if (builder->group_count == GLUSHKOV_MAX_POSITIONS) return false;
+            same = builder->group_count++;
+            representative[same] = i;
+            builder->group_state[same] = builder->consuming[i];
+        }
+        column_of[builder->consuming[i]] = same;
+    }
+
+    return true;
+}
+
+static uint64_t glushkov_builder_closure_mask(const GlushkovBuilder *builder) {
+    uint64_t mask = 0;
+    for (int i = 0; i < builder->closure_len; ++i) mask |= (uint64_t)1 << builder->group[builder->closure[i]];
+
+    return mask;
+}
+
+static uint64_t glushkov_permute(uint64_t mask, const int *positions) {
+    uint64_t permuted = 0;
+    for (; mask; mask &= mask - 1) permuted |= (uint64_t)1 << positions[glushkov_lowest_bit(mask)];
+
+    return permuted;
+}
+
+static int glushkov_lowest_bit(uint64_t mask) {
+    int bit = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        bit++;
+    }
+
+    return bit;
+}
+
+static void glushkov_builder_destroy(GlushkovBuilder *builder) {
+    const Allocator *allocator = builder->allocator;
+    int total_states = builder->total_states;
+
+    memory_free(allocator, builder->nfa, sizeof(State *) * total_states);
+    memory_free(allocator, builder->stack, sizeof(State *) * total_states);
+    memory_free(allocator, builder->seen, sizeof(unsigned int) * total_states);
+    memory_free(allocator, builder->closure, sizeof(int) * total_states);
+    memory_free(allocator, builder->consuming, sizeof(int) * total_states);
+    memory_free(allocator, builder->group, sizeof(int) * total_states);
+    memory_free(allocator, builder->columns, sizeof(uint64_t) * builder->column_words * builder->consuming_count);
+    memory_free(allocator, builder->group_state, sizeof(int) * GLUSHKOV_MAX_POSITIONS);
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "state.h"
+#include "memory.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Maximum number of positions, one bit of the state word each.
+ */
+#define GLUSHKOV_MAX_POSITIONS 64
+
+/**
+ * @brief Positions per follow table (each table has 2^GLUSHKOV_CHUNK_BITS rows).
+ */
+#define GLUSHKOV_CHUNK_BITS 8
+
+/**
+ * @brief Maximum number of follow tables.
+ */
+#define GLUSHKOV_MAX_CHUNKS (GLUSHKOV_MAX_POSITIONS / GLUSHKOV_CHUNK_BITS)
+
+/**
+ * @struct Glushkov glushkov.h
+ * @brief Position (Glushkov) automaton of the pattern, simulated bit-parallel.
+ *
+ * Every position is a byte consuming state of the nfa, the states reached by
+ * epsilon edges are resolved when it is built, so it has no epsilon edges.
+ * Positions consuming the same bytes in the same places (like the ranges of a
+ * character class) are merged into one. The set of positions the automaton
+ * is in fits in a 64-bit word, so a step is
+ *
+ *     next = (((set & shift) << 1) | follow tables | first) & bytes[byte]
+ *
+ * Positions are numbered in pattern order, so most positions are followed by
+ * the next one and the shift handles them (that is Shift-And for literals).
+ * The other edges (loops, alternatives) are looked up in one table per
+ * GLUSHKOV_CHUNK_BITS positions that have any.
+ */
+typedef struct Glushkov {
+    uint64_t *bytes; /**< Positions consuming each byte (256 masks) */
+    uint64_t *follow; /**< Positions following any set of positions of a chunk (256 masks per table) */
+    int chunks[GLUSHKOV_MAX_CHUNKS]; /**< Chunk (positions / GLUSHKOV_CHUNK_BITS) of each follow table */
+    int chunk_count; /**< Number of follow tables */
+    uint64_t shift; /**< Positions followed by the next position */
+    uint64_t first; /**< Positions starting a match anywhere */
+    uint64_t first_anchored; /**< Positions starting a match only at the start of the line */
+    uint64_t last; /**< Positions ending a match */
+    bool empty; /**< The pattern matches the empty string (every line matches) */
+    int position_count; /**< Number of positions */
+} Glushkov;
+
+/**
+ * @brief Build the position automaton of the alternatives.
+ *
+ * @note Overwrites the id of the nfa states, so the nfa should not be stepped meanwhile.
+ *
+ * @param glushkov Pointer to the automaton
+ * @param entries First state of each top-level alternative (without the loop skipping characters)
+ * @param anchored Whether each alternative starts with '^'
+ * @param entry_count Number of entries
+ * @param total_states Total number of states in the nfa
+ * @param allocator The allocator to use
+ *
+ * @return false if there are more than GLUSHKOV_MAX_POSITIONS positions (nothing is allocated then).
+ */
+bool glushkov_create(Glushkov *glushkov, State *const *entries, const bool *anchored, int entry_count, int total_states,
+    const Allocator *allocator);
+
+/**
+ * @brief Free the automaton.
+ *
+ * @param glushkov Pointer to the automaton
+ * @param allocator The allocator used to create it
+ */
+void glushkov_destroy(Glushkov *glushkov, const Allocator *allocator);
+
+/**
+ * @brief Get the bytes used by the tables.
+ *
+ * @param glushkov Pointer to the automaton
+ *
+ * @return Size of the tables in bytes.
+ */
+size_t glushkov_table_bytes(const Glushkov *glushkov);
+
+/**
+ * @brief Step the automaton over the bytes of the line from the offset up to the end.
+ *
+ * Starting at offset 0 steps the first byte, which starts the '^'
+ * alternatives too. Stepping stops early once nothing changes anymore (a
+ * match, or no position left when only '^' alternatives start), so the line
+ * can be stepped in several runs and stopped between them.
+ *
+ * @param glushkov Pointer to the automaton
+ * @param set Pointer to the set of positions (0 before the first byte)
+ * @param input The line
+ * @param offset Pointer to the offset to start at, set to the offset stepping stopped at
+ * @param end Offset to stop at (not stepped)
+ *
+ * @return true if nothing changes anymore.
+ */
+bool glushkov_run(const Glushkov *glushkov, uint64_t *set, const unsigned char *input, size_t *offset, size_t end);
+
+/**
+ * @brief Finish the line stepped by @ref glushkov_run, and tell whether it contains the pattern.
+ *
+ * @param glushkov Pointer to the automaton
+ * @param set The set of positions
+ * @param input The line
+ * @param len Length of the line
+ * @param end_of_line Whether the end of the input ends a line (a new line is added at the end if it isn't there)
+ * @param offset Pointer to the offset stepping stopped at, incremented if the new line is stepped
+ *
+ * @return true if the line contains the pattern.
+ */
+bool glushkov_end(const Glushkov *glushkov, uint64_t set, const unsigned char *input, size_t len, bool end_of_line,
+    size_t *offset);
+
+/**
+ * @brief Get the positions following the set, whatever byte comes next.
+ *
+ * @param glushkov Pointer to the automaton
+ * @param set The current set of positions
+ *
+ * @return The positions following the set (first and first_anchored are not added).
+ */
+static inline uint64_t glushkov_follow(const Glushkov *glushkov, uint64_t set) {
+    uint64_t next = (set & glushkov->shift) << 1;
+    for (int k = 0; k < glushkov->chunk_count; ++k)
+        next |= glushkov->follow[(k << GLUSHKOV_CHUNK_BITS)
+            | ((set >> (glushkov->chunks[k] * GLUSHKOV_CHUNK_BITS)) & ((1 << GLUSHKOV_CHUNK_BITS) - 1))];
+
+    return next;
+}
+
+/**
+ * @brief Get the next set of positions on the input.
+ *
+ * @param glushkov Pointer to the automaton
+ * @param set The current set of positions
+ * @param input The input byte
+ *
+ * @return The next set of positions (first_anchored is not added).
+ */
+static inline uint64_t glushkov_next(const Glushkov *glushkov, uint64_t set, unsigned char input) {
+    return (glushkov_follow(glushkov, set) | glushkov->first) & glushkov->bytes[input];
+}
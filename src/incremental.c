@@ -0,0 +1,389 @@
+#include "incremental.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief Update the lines of the text after bytes were replaced.
+ *
+ * @param incremental Pointer to the matcher
+ * @param data The edited text
+ * @param len Length of the text
+ * @param offset Offset of the first replaced byte
+ * @param removed Number of bytes removed at the offset
+ * @param inserted Number of bytes inserted in their place
+ * @param summary Pointer to store how the update went (can be NULL)
+ */
+static void incremental_update(Incremental *incremental, const unsigned char *data, size_t len, size_t offset,
+    size_t removed, size_t inserted, IncrementalSummary *summary);
+
+/**
+ * @brief Find the matching lines of the whole text again (for regexes without a dfa).
+ *
+ * @param incremental Pointer to the matcher
+ * @param data The text
+ * @param len Length of the text
+ */
+static void incremental_rescan(Incremental *incremental, const unsigned char *data, size_t len);
+
+/**
+ * @brief Step the bytes up to the stop, adding the lines that match to the new lines.
+ *
+ * @param incremental Pointer to the matcher
+ * @param data The text
+ * @param stop Offset to stop at
+ * @param at The checkpoint to step from, updated to the stop
+ * @param line_count Pointer to the number of new lines
+ */
+static void incremental_scan(Incremental *incremental, const unsigned char *data, size_t stop,
+    IncrementalCheckpoint *at, size_t *line_count);
+
+/**
+ * @brief Check whether the scan is where the previous scan was at a checkpoint after the edit.
+ *
+ * @param at Where the scan is
+ * @param old The old checkpoint (offset not moved yet)
+ * @param offset Offset of the first replaced byte
+ * @param removed Number of bytes removed at the offset
+ * @param inserted Number of bytes inserted in their place
+ *
+ * @return true if the rest of the text is stepped the same way as before.
+ */
+static bool incremental_lines_up(const IncrementalCheckpoint *at, const IncrementalCheckpoint *old, size_t offset,
+    size_t removed, size_t inserted);
+
+/**
+ * @brief Add the line matching at the end of the text, if there is one.
+ *
+ * @param incremental Pointer to the matcher
+ * @param data The text
+ * @param len Length of the text
+ */
+static void incremental_end(Incremental *incremental, const unsigned char *data, size_t len);
+
+/**
+ * @brief Find the first checkpoint at or after the offset.
+ *
+ * @param incremental Pointer to the matcher
+ * @param offset The offset
+ *
+ * @return Index of the checkpoint (checkpoint_count if there is none).
+ */
+static size_t incremental_find_checkpoint(const Incremental *incremental, size_t offset);
+
+/**
+ * @brief Find the first line ending at or after the offset.
+ *
+ * @param incremental Pointer to the matcher
+ * @param offset The offset
+ *
+ * @return Index of the line (line_count if there is none).
+ */
+static size_t incremental_find_line(const Incremental *incremental, size_t offset);
+
+/**
+ * @brief Grow the array so it holds at least one more element than count.
+ *
+ * @param allocator The allocator
+ * @param array The array
+ * @param capacity Pointer to the capacity of the array
+ * @param count Number of elements in the array
+ * @param size Size of an element
+ *
+ * @return The array, reallocated if it was full.
+ */
+static void *incremental_reserve(const Allocator *allocator, void *array, size_t *capacity, size_t count, size_t size);
+
+/**
+ * @brief Replace the elements between kept and from by the inserted ones.
+ *
+ * @param allocator The allocator
+ * @param array The array
+ * @param count Pointer to the number of elements in the array
+ * @param capacity Pointer to the capacity of the array
+ * @param kept Number of elements kept in front
+ * @param inserted The elements put after them
+ * @param inserted_count Number of inserted elements
+ * @param from Index of the first element kept after them
+ * @param size Size of an element
+ *
+ * @return The array, reallocated if it was too small.
+ */
+static void *incremental_splice(const Allocator *allocator, void *array, size_t *count, size_t *capacity, size_t kept,
+    const void *inserted, size_t inserted_count, size_t from, size_t size);
+
+void incremental_create(Incremental *incremental, Regex *regex, const IncrementalOptions *options) {
+    static const IncrementalOptions default_options = {0};
+    if (!options) options = &default_options;
+
+    *incremental = (Incremental){
+        .regex = regex,
+        .allocator = &regex->allocator,
+        .checkpoint_bytes = options->checkpoint_bytes ? options->checkpoint_bytes : INCREMENTAL_DEFAULT_CHECKPOINT_BYTES,
+        .end_of_line = options->flags & REGEX_MATCH_EOL,
+    };
+
+    // The empty text ends where it starts
+    if (!regex->use_dfa) return;
+    incremental->checkpoints = incremental_reserve(incremental->allocator, NULL, &incremental->checkpoint_capacity, 0,
+        sizeof(IncrementalCheckpoint));
+    incremental->checkpoints[0] = (IncrementalCheckpoint){.state = regex->dfa.start, .fresh = true};
+    incremental->checkpoint_count = 1;
+}
+
+void incremental_destroy(Incremental *incremental) {
+    const Allocator *allocator = incremental->allocator;
+    memory_free(allocator, incremental->checkpoints, sizeof(IncrementalCheckpoint) * incremental->checkpoint_capacity);
+    memory_free(allocator, incremental->new_checkpoints,
+        sizeof(IncrementalCheckpoint) * incremental->new_checkpoint_capacity);
+    memory_free(allocator, incremental->lines, sizeof(RegexLine) * incremental->line_capacity);
+    memory_free(allocator, incremental->new_lines, sizeof(RegexLine) * incremental->new_line_capacity);
+    *incremental = (Incremental){0};
+}
+
+bool incremental_append(Incremental *incremental, const char *data, size_t len, IncrementalSummary *summary) {
+    // The text got shorter instead of growing
+    if (len < incremental->len) return false;
+
+    incremental_update(incremental, (const unsigned char *)data, len, incremental->len, 0, len - incremental->len,
+        summary);
+    return true;
+}
+
+bool incremental_edit(Incremental *incremental, const char *data, size_t len, size_t offset, size_t removed,
+    size_t inserted, IncrementalSummary *summary) {
+    // Replacing the bytes of the previous text doesn't give a text of this length
+    if (offset > incremental->len || removed > incremental->len - offset
+        || len != incremental->len - removed + inserted)
+        return false;
+
+    incremental_update(incremental, (const unsigned char *)data, len, offset, removed, inserted, summary);
+    return true;
+}
+
+static void incremental_update(Incremental *incremental, const unsigned char *data, size_t len, size_t offset,
+    size_t removed, size_t inserted, IncrementalSummary *summary) {
+    const Regex *regex = incremental->regex;
+
+    // The line matching at the end of the text depends on where the text ends, it is found again
+    if (incremental->end_matched) incremental->line_count--;
+    incremental->end_matched = false;
+    incremental->len = len;
+
+    if (!regex->use_dfa) {
+        incremental_rescan(incremental, data, len);
+        if (summary) *summary = (IncrementalSummary){.stopped_at = len};
+        return;
+    }
+
+    IncrementalCheckpoint *old = incremental->checkpoints;
+    size_t count = incremental->checkpoint_count;
+
+    // The new line ending the text is not stepped when the end of the text ends the line anyway
+    size_t text_len = len - (regex->multiline && incremental->end_of_line && len && data[len - 1] == '\n');
+
+    // The bytes before the edit are the same, resume from the last checkpoint before it. A checkpoint
+    // closer than checkpoint_bytes to the previous one was the end of the text, it is not kept.
+    size_t resume = incremental_find_checkpoint(incremental, (offset < text_len ? offset : text_len) + 1) - 1;
+    size_t resumed_at = old[resume].offset;
+    IncrementalCheckpoint at = old[resume];
+    size_t kept = resume + (!resume || at.offset - old[resume - 1].offset >= incremental->checkpoint_bytes);
+    size_t kept_lines = incremental_find_line(incremental, at.offset);
+
+    // The old checkpoints after the edit, where the scan can line up with the previous one
+    size_t next = incremental_find_checkpoint(incremental, offset + removed);
+    if (next <= resume) next = resume + 1;
+
+    size_t edit_end = offset + inserted;
+    size_t grid = old[kept - 1].offset + incremental->checkpoint_bytes;
+    size_t new_count = 0, new_line_count = 0;
+    bool converged = false;
+    while (true) {
+        // New checkpoints every checkpoint_bytes over the edit, then at the old ones
+        size_t old_at = next < count ? old[next].offset - removed + inserted : SIZE_MAX;
+        size_t stop = at.offset < edit_end || old_at > text_len ? grid : SIZE_MAX;
+        if (old_at < stop) stop = old_at;
+        if (stop > text_len) stop = text_len;
+
+        incremental_scan(incremental, data, stop, &at, &new_line_count);
+        if (stop == old_at && incremental_lines_up(&at, &old[next], offset, removed, inserted)) {
+            converged = true;
+            break;
+        }
+        if (stop == text_len) break;
+
+        incremental->new_checkpoints = incremental_reserve(incremental->allocator, incremental->new_checkpoints,
+            &incremental->new_checkpoint_capacity, new_count, sizeof(IncrementalCheckpoint));
+        incremental->new_checkpoints[new_count++] = at;
+        grid = stop + incremental->checkpoint_bytes;
+        if (stop == old_at) next++;
+    }
+
+    // The end of the text, unless nothing was stepped since the last kept checkpoint
+    if (!converged && (new_count || old[kept - 1].offset != at.offset)) {
+        incremental->new_checkpoints = incremental_reserve(incremental->allocator, incremental->new_checkpoints,
+            &incremental->new_checkpoint_capacity, new_count, sizeof(IncrementalCheckpoint));
+        incremental->new_checkpoints[new_count++] = at;
+    }
+
+    // The lines and checkpoints after the scan are the old ones, moved by the length difference
+    size_t from = converged ? next : count, from_lines = incremental->line_count;
+    if (converged) from_lines = incremental_find_line(incremental, old[next].offset);
+    size_t old_lines = converged ? old[next].lines : 0;
+
+    incremental->checkpoints = incremental_splice(incremental->allocator, incremental->checkpoints,
+        &incremental->checkpoint_count, &incremental->checkpoint_capacity, kept, incremental->new_checkpoints,
+        new_count, from, sizeof(IncrementalCheckpoint));
+    for (size_t i = kept + new_count; i < incremental->checkpoint_count; ++i) {
+        IncrementalCheckpoint *checkpoint = &incremental->checkpoints[i];
+        if (checkpoint->line_start >= offset + removed) checkpoint->line_start = checkpoint->line_start - removed + inserted;
+        checkpoint->offset = checkpoint->offset - removed + inserted;
+        checkpoint->lines = checkpoint->lines - old_lines + at.lines;
+    }
+
+    incremental->lines = incremental_splice(incremental->allocator, incremental->lines, &incremental->line_count,
+        &incremental->line_capacity, kept_lines, incremental->new_lines, new_line_count, from_lines, sizeof(RegexLine));
+    for (size_t i = kept_lines + new_line_count; i < incremental->line_count; ++i) {
+        RegexLine *line = &incremental->lines[i];
+        if (line->start >= offset + removed) line->start = line->start - removed + inserted;
+        line->end = line->end - removed + inserted;
+        line->number = line->number - old_lines + at.lines;
+    }
+
+    incremental_end(incremental, data, len);
+
+    if (summary) *summary = (IncrementalSummary){resumed_at, at.offset, converged};
+}
+
+static void incremental_rescan(Incremental *incremental, const unsigned char *data, size_t len) {
+    RegexIterator iterator;
+    regex_iterator_create_bytes(&iterator, incremental->regex, data, len, incremental->end_of_line ? REGEX_MATCH_EOL : 0);
+
+    RegexLine line;
+    incremental->line_count = 0;
+    while (regex_iterator_next_line(&iterator, &line)) {
+        incremental->lines = incremental_reserve(incremental->allocator, incremental->lines, &incremental->line_capacity,
+            incremental->line_count, sizeof(RegexLine));
+        incremental->lines[incremental->line_count++] = line;
+    }
+}
+
+static void incremental_scan(Incremental *incremental, const unsigned char *data, size_t stop,
+    IncrementalCheckpoint *at, size_t *line_count) {
+    const Regex *regex = incremental->regex;
+    const Dfa *dfa = &regex->dfa;
+
+    size_t i = at->offset;
+    int state = at->state;
+    while (i < stop) {
+        const unsigned char *new_line = memchr(data + i, '\n', stop - i);
+        size_t end = new_line ? (size_t)(new_line - data) : stop;
+        at->fresh &= end == i;
+
+        // Nothing changes after reaching the dead or match state, until the end of the line
+        if (!dfa_is_final(dfa, state)) state = dfa_run(dfa, state, data, end, &i);
+        i = end;
+        if (!new_line) break;
+
+        // Lines are matched on their own, or by one run going back to the start after each new line
+        bool matched;
+        if (regex->multiline) {
+            if (state != dfa->match) state = dfa_next(dfa, state, '\n');
+            matched = state == dfa->match;
+        } else {
+            matched = state == dfa->match || (state != DFA_DEAD_STATE && dfa_end(dfa, state, true) == dfa->match);
+        }
+
+        if (matched) {
+            incremental->new_lines = incremental_reserve(incremental->allocator, incremental->new_lines,
+                &incremental->new_line_capacity, *line_count, sizeof(RegexLine));
+            incremental->new_lines[(*line_count)++] = (RegexLine){at->lines + 1, at->line_start, i};
+        }
+
+        // The search starts again after a matching line like regex_iterator_next_line() does
+        at->fresh = matched || !regex->multiline;
+        if (at->fresh) state = regex->multiline ? dfa->other_start : dfa->start;
+        at->lines++;
+        at->line_start = ++i;
+    }
+
+    at->offset = i;
+    at->state = state;
+}
+
+static bool incremental_lines_up(const IncrementalCheckpoint *at, const IncrementalCheckpoint *old, size_t offset,
+    size_t removed, size_t inserted) {
+    size_t line_start = old->line_start >= offset + removed ? old->line_start - removed + inserted : old->line_start;
+    return at->state == old->state && at->fresh == old->fresh && at->line_start == line_start;
+}
+
+static void incremental_end(Incremental *incremental, const unsigned char *data, size_t len) {
+    const Dfa *dfa = &incremental->regex->dfa;
+    const IncrementalCheckpoint *end = &incremental->checkpoints[incremental->checkpoint_count - 1];
+
+    // No search starts before the end after a matching line ended the text
+    if (!len || (end->fresh && end->offset == len)) return;
+    if (end->state != dfa->match
+        && (end->state == DFA_DEAD_STATE || dfa_end(dfa, end->state, incremental->end_of_line) != dfa->match)) return;
+
+    RegexLine line = {end->lines + 1, end->line_start, end->offset};
+    if (end->offset == len && data[len - 1] == '\n') {
+        // The last new line was stepped (multi-line without REGEX_MATCH_EOL), the match is in the line it ends
+        size_t start = len - 1;
+        while (start && data[start - 1] != '\n') start--;
+        line = (RegexLine){end->lines, start, len - 1};
+    }
+
+    incremental->lines = incremental_reserve(incremental->allocator, incremental->lines, &incremental->line_capacity,
+        incremental->line_count, sizeof(RegexLine));
+    incremental->lines[incremental->line_count++] = line;
+    incremental->end_matched = true;
+}
+
+static size_t incremental_find_checkpoint(const Incremental *incremental, size_t offset) {
+    size_t low = 0, high = incremental->checkpoint_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (incremental->checkpoints[middle].offset < offset) low = middle + 1;
+        else high = middle;
+    }
+
+    return low;
+}
+
+static size_t incremental_find_line(const Incremental *incremental, size_t offset) {
+    size_t low = 0, high = incremental->line_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (incremental->lines[middle].end < offset) low = middle + 1;
+        else high = middle;
+    }
+
+    return low;
+}
+
+static void *incremental_reserve(const Allocator *allocator, void *array, size_t *capacity, size_t count, size_t size) {
+    if (count < *capacity) return array;
+
+    size_t new_capacity = *capacity ? *capacity * 2 : 16;
+    array = memory_reallocate(allocator, array, *capacity * size, new_capacity * size);
+    *capacity = new_capacity;
+    return array;
+}
+
+static void *incremental_splice(const Allocator *allocator, void *array, size_t *count, size_t *capacity, size_t kept,
+    const void *inserted, size_t inserted_count, size_t from, size_t size) {
+    size_t new_count = kept + inserted_count + (*count - from);
+    if (new_count > *capacity) {
+        size_t new_capacity = *capacity ? *capacity : 16;
+        while (new_capacity < new_count) new_capacity *= 2;
+        array = memory_reallocate(allocator, array, *capacity * size, new_capacity * size);
+        *capacity = new_capacity;
+    }
+
+    unsigned char *bytes = array;
+    if (*count > from) memmove(bytes + (kept + inserted_count) * size, bytes + from * size, (*count - from) * size);
+    if (inserted_count) memcpy(bytes + kept * size, inserted, inserted_count * size);
+    *count = new_count;
+    return array;
+}
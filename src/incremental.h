@@ -0,0 +1,127 @@
+#pragma once
+
+#include "regex.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief The state of the dfa is recorded every this many bytes by default.
+ */
+#define INCREMENTAL_DEFAULT_CHECKPOINT_BYTES 4096
+
+/**
+ * @struct IncrementalOptions incremental.h
+ * @brief Options of @ref incremental_create.
+ */
+typedef struct IncrementalOptions {
+    size_t checkpoint_bytes; /**< Bytes between two checkpoints (0 for INCREMENTAL_DEFAULT_CHECKPOINT_BYTES) */
+    int flags; /**< REGEX_MATCH_EOL if the end of the text ends its last line (see @ref regex_iterator_create_bytes) */
+} IncrementalOptions;
+
+/**
+ * @struct IncrementalCheckpoint incremental.h
+ * @brief Everything the scan of the lines needs to resume at an offset.
+ */
+typedef struct IncrementalCheckpoint {
+    size_t offset; /**< Offset of the next byte to step */
+    size_t line_start; /**< Offset of the first byte of the line holding the offset */
+    size_t lines; /**< Number of new lines before the offset */
+    int state; /**< The dfa state before the byte at the offset */
+    bool fresh; /**< Whether a new search starts at the offset (after the new line of a matched line) */
+} IncrementalCheckpoint;
+
+/**
+ * @struct IncrementalSummary incremental.h
+ * @brief How one update went.
+ */
+typedef struct IncrementalSummary {
+    size_t resumed_at; /**< Offset of the checkpoint the scan resumed from */
+    size_t stopped_at; /**< Offset the scan stopped at, the rest of the results were kept */
+    bool converged; /**< true if the scan lined up with a checkpoint of the previous scan */
+} IncrementalSummary;
+
+/**
+ * @struct Incremental incremental.h
+ * @brief The matching lines of a text, kept up to date while it is edited.
+ *
+ * The lines are the ones @ref regex_iterator_next_line finds in the text.
+ * The dfa run over the text is recorded every checkpoint_bytes bytes (and at
+ * the end of the text). After an edit the run resumes from the last
+ * checkpoint before it, and once past the edited bytes it stops at the first
+ * old checkpoint it reaches in the same state: the rest of the text is
+ * stepped like before, so the lines and checkpoints after it are kept and
+ * only moved by the length difference. Appending resumes from the end of
+ * the text, so it costs the new bytes only.
+ *
+ * A regex without a dfa has no state to record, the whole text is matched
+ * again after each edit.
+ */
+typedef struct Incremental {
+    Regex *regex; /**< The regex */
+    const Allocator *allocator; /**< Allocator of the regex */
+    size_t checkpoint_bytes; /**< Bytes between two checkpoints */
+    bool end_of_line; /**< Whether the end of the text ends its last line */
+    size_t len; /**< Length of the text */
+
+    IncrementalCheckpoint *checkpoints; /**< The checkpoints by offset, the last one is at the end of the text */
+    size_t checkpoint_count; /**< Number of checkpoints */
+    size_t checkpoint_capacity; /**< Capacity of checkpoints */
+
+    RegexLine *lines; /**< The matching lines */
+    size_t line_count; /**< Number of matching lines */
+    size_t line_capacity; /**< Capacity of lines */
+    bool end_matched; /**< Whether the last line was found by matching the end of the text */
+
+    IncrementalCheckpoint *new_checkpoints; /**< Checkpoints of the current scan, before they replace the old ones */
+    size_t new_checkpoint_capacity; /**< Capacity of new_checkpoints */
+    RegexLine *new_lines; /**< Lines of the current scan, before they replace the old ones */
+    size_t new_line_capacity; /**< Capacity of new_lines */
+} Incremental;
+
+/**
+ * @brief Create the matcher of an empty text.
+ *
+ * @note The regex is only read when it has a dfa, but like the regex use
+ * the matcher from one thread at a time.
+ *
+ * @param incremental Pointer to the matcher
+ * @param regex Pointer to the regex state (destroy the matcher first)
+ * @param options The options (NULL for defaults)
+ */
+void incremental_create(Incremental *incremental, Regex *regex, const IncrementalOptions *options);
+
+/**
+ * @brief Destroy the matcher.
+ *
+ * @param incremental Pointer to the matcher
+ */
+void incremental_destroy(Incremental *incremental);
+
+/**
+ * @brief Update the matching lines after bytes were appended to the text.
+ *
+ * @param incremental Pointer to the matcher
+ * @param data The whole text (need not be NUL-terminated), starting with the previous one
+ * @param len Length of the text
+ * @param summary Pointer to store how the update went (can be NULL)
+ *
+ * @return false if the text is shorter than the previous one (nothing is updated then).
+ */
+bool incremental_append(Incremental *incremental, const char *data, size_t len, IncrementalSummary *summary);
+
+/**
+ * @brief Update the matching lines after some bytes of the text were replaced.
+ *
+ * @param incremental Pointer to the matcher
+ * @param data The whole edited text (need not be NUL-terminated)
+ * @param len Length of the text
+ * @param offset Offset of the first replaced byte
+ * @param removed Number of bytes removed from the previous text at the offset
+ * @param inserted Number of bytes inserted in their place
+ * @param summary Pointer to store how the update went (can be NULL)
+ *
+ * @return false if the lengths don't add up with the previous text (nothing is updated then).
+ */
+bool incremental_edit(Incremental *incremental, const char *data, size_t len, size_t offset, size_t removed,
+    size_t inserted, IncrementalSummary *summary);
@@ -5,6 +5,7 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 
 #ifdef OS_WINDOWS
 #include <windows.h>
@@ -12,6 +13,13 @@
 #include <unistd.h>
 #endif
 
+#ifdef RE_LOG_ASYNC
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <threads.h>
+#include <time.h>
+#endif
+
 static const char *log_level_strings[] = {
     "[FATAL]: ", "[ERROR]: ", "[WARN]: ", "[INFO]: ", "[DEBUG]: ", "[TRACE]: "
 };
@@ -20,64 +28,449 @@ static const char *colors[] = {
     "1;41", "1;31",  "0;33", "0;32", "0;34", "0;37"
 };
 
+/**
+ * @brief Output set by @ref logger_set_output (NULL for stdout and stderr).
+ */
+static FILE *logger_output = NULL;
+
 #ifdef OS_WINDOWS
 static bool enableVTProcessing(DWORD handle_type);
 #endif
 
-void logger_log(LogLevel level, const char *restrict msg, ...) {
-#ifdef OS_WINDOWS
-    // Track whether VT process is enabled for handle
-    // 0 -> STD_OUTPUT_HANDLE, 1 -> STD_ERROR_HANDLE
-    static bool vt_enabled[2] = {false, false};
+/**
+ * @brief Get the file the message goes to.
+ *
+ * @param level LogLevel of message
+ * @param colored Pointer to store whether the message should be colored
+ *
+ * @return The file.
+ */
+static FILE *logger_file(LogLevel level, bool *colored);
 
-    // true = 1 and false = 0
-    // Using int just because it is used to access the elements of vt_enabled.
-    int error = level < LOG_LEVEL_WARN;  // Fatal or Error is error
-    FILE *out_file = error ? stderr : stdout;
+/**
+ * @brief Print the color and the level of the message.
+ *
+ * @param level LogLevel of message
+ * @param colored Pointer to store whether the color should be reset after the message
+ *
+ * @return The file the message goes to.
+ */
+static FILE *logger_begin(LogLevel level, bool *colored);
 
-    // Try to enable VT processing
-    if (!vt_enabled[error])  // VT processing is not enabled, try to turn on
-        vt_enabled[error] =
-            enableVTProcessing(error ? STD_ERROR_HANDLE : STD_OUTPUT_HANDLE);
+/**
+ * @brief Reset the color, end the line and flush if the message is an error.
+ *
+ * @param level LogLevel of message
+ * @param out_file The file the message went to
+ * @param colored Whether the color should be reset
+ */
+static void logger_end(LogLevel level, FILE *out_file, bool colored);
 
-    // If VT processing enabled, we can print color
-    if (vt_enabled[error]) fprintf(out_file, "\x1b[%sm", colors[level]);
-#else
-    // Track whether we are writitng to terminal or not
-    // 0 -> stdout 1 -> stderr
-    static bool is_terminal[2] = {false, false};
+#ifdef RE_LOG_ASYNC
+/**
+ * @brief Bytes of the lines the background thread writes at once.
+ */
+#define LOGGER_BATCH_BYTES (64 * 1024)
 
-    int error = level < LOG_LEVEL_WARN;  // Fatal or Error is error
-    FILE *out_file = error ? stderr : stdout;
+/**
+ * @struct LoggerRecord
+ * @brief A formatted message waiting in a ring buffer.
+ */
+typedef struct LoggerRecord {
+    LogLevel level; /**< LogLevel of message */
+    int len; /**< Length of the text */
+    char text[LOGGER_RECORD_BYTES]; /**< The formatted message */
+} LoggerRecord;
 
-    if (!is_terminal[error])
-        is_terminal[error] = isatty(error ? STDERR_FILENO : STDOUT_FILENO);
+typedef struct LoggerRing LoggerRing;
 
-    // If terminal, we can print color
-    if (is_terminal[error]) fprintf(out_file, "\x1b[%sm", colors[level]);
-#endif
+/**
+ * @struct LoggerRing
+ * @brief Single producer (the owning thread), single consumer (the background thread) ring buffer.
+ *
+ * Rings are never freed, the ring of a thread that exited is taken over by
+ * the next thread that logs once its records are written.
+ */
+struct LoggerRing {
+    LoggerRing *next; /**< Next ring of the list (set before the ring is published) */
+    atomic_bool owned; /**< A thread logs into the ring */
+    atomic_size_t head; /**< Records before it were written (advanced by the background thread) */
+    atomic_size_t tail; /**< Records before it were logged (advanced by the owner) */
+    atomic_size_t dropped; /**< Records dropped because the ring was full */
+    atomic_size_t truncated; /**< Records truncated to LOGGER_RECORD_BYTES */
+    LoggerRecord records[LOGGER_RING_RECORDS]; /**< The records */
+};
 
-    fprintf(out_file, "%s", log_level_strings[level]);
+/**
+ * @brief All the rings (pushed lock-free, never removed).
+ */
+static _Atomic(LoggerRing *) logger_rings = NULL;
+
+/**
+ * @brief Ring of the calling thread.
+ */
+static thread_local LoggerRing *logger_thread_ring = NULL;
+
+/**
+ * @brief Releases the ring of a thread when it exits.
+ */
+static tss_t logger_ring_key;
+
+/**
+ * @brief Whether logger_ring_key was created.
+ */
+static bool logger_ring_key_created = false;
+
+/**
+ * @brief Guards the one time initialization.
+ */
+static once_flag logger_once = ONCE_FLAG_INIT;
+
+/**
+ * @brief Messages go to the rings.
+ */
+static atomic_bool logger_async = false;
+
+/**
+ * @brief Tells the background thread to write what is left and stop.
+ */
+static atomic_bool logger_stopping = false;
+
+/**
+ * @brief The background thread.
+ */
+static thrd_t logger_thread;
+
+/**
+ * @brief Records written by the background thread.
+ */
+static atomic_size_t logger_written = 0;
+
+/**
+ * @brief Create the key releasing the rings and stop the asynchronous mode at exit.
+ */
+static void logger_init(void);
+
+/**
+ * @brief Let another thread take over the ring (destructor of logger_ring_key).
+ *
+ * @param ring The ring of the exiting thread
+ */
+static void logger_release_ring(void *ring);
+
+/**
+ * @brief Get the ring of the calling thread, taking over a released one or creating it.
+ *
+ * @return The ring (NULL if it could not be allocated).
+ */
+static LoggerRing *logger_claim_ring(void);
+
+/**
+ * @brief Format the message into the ring of the calling thread.
+ *
+ * @param level LogLevel of message
+ * @param msg The format string
+ * @param args Arguments for format string
+ *
+ * @return false if the thread has no ring (the message should be written synchronously).
+ */
+static bool logger_push(LogLevel level, const char *restrict msg, va_list args);
+
+/**
+ * @brief Write the records of all the rings.
+ *
+ * @return Number of records written.
+ */
+static size_t logger_drain(void);
+
+/**
+ * @brief Main function of the background thread.
+ *
+ * @param arg Unused
+ *
+ * @return 0.
+ */
+static int logger_run(void *arg);
+#endif
 
+void logger_log(LogLevel level, const char *restrict msg, ...) {
     va_list args;
     va_start(args, msg);
+
+#ifdef RE_LOG_ASYNC
+    if (atomic_load_explicit(&logger_async, memory_order_relaxed) && logger_push(level, msg, args)) {
+        va_end(args);
+        return;
+    }
+#endif
+
+    bool colored;
+    FILE *out_file = logger_begin(level, &colored);
     vfprintf(out_file, msg, args);
     va_end(args);
+    logger_end(level, out_file, colored);
+}
+
+void logger_set_output(FILE *file) {
+    logger_output = file;
+}
 
+static FILE *logger_file(LogLevel level, bool *colored) {
+    // true = 1 and false = 0
+    // Using int just because it is used to access the elements of the arrays below.
+    int error = level < LOG_LEVEL_WARN;  // Fatal or Error is error
+    FILE *out_file = error ? stderr : stdout;
+    *colored = false;
+
+    if (logger_output) {
+        // Colors are only for the terminal
+        out_file = logger_output;
+    } else {
 #ifdef OS_WINDOWS
-    // If VT processing enabled, reset the color after printing the message
-    if (vt_enabled[error]) fprintf(out_file, "\x1b[0m");
+        // Track whether VT process is enabled for handle
+        // 0 -> STD_OUTPUT_HANDLE, 1 -> STD_ERROR_HANDLE
+        static bool vt_enabled[2] = {false, false};
+
+        // Try to enable VT processing
+        if (!vt_enabled[error])  // VT processing is not enabled, try to turn on
+            vt_enabled[error] =
+                enableVTProcessing(error ? STD_ERROR_HANDLE : STD_OUTPUT_HANDLE);
+
+        // If VT processing enabled, we can print color
+        *colored = vt_enabled[error];
 #else
-    // If terminal, reset the color after printing the message
-    if (is_terminal[error]) fprintf(out_file, "\x1b[0m");
+        // Track whether we are writitng to terminal or not
+        // 0 -> stdout 1 -> stderr
+        static bool is_terminal[2] = {false, false};
+
+        if (!is_terminal[error])
+            is_terminal[error] = isatty(error ? STDERR_FILENO : STDOUT_FILENO);
+
+        // If terminal, we can print color
+        *colored = is_terminal[error];
 #endif
+    }
+
+    return out_file;
+}
+
+static FILE *logger_begin(LogLevel level, bool *colored) {
+    FILE *out_file = logger_file(level, colored);
+
+    if (*colored) fprintf(out_file, "\x1b[%sm", colors[level]);
+
+    fprintf(out_file, "%s", log_level_strings[level]);
+
+    return out_file;
+}
+
+static void logger_end(LogLevel level, FILE *out_file, bool colored) {
+    // Reset the color after printing the message
+    if (colored) fprintf(out_file, "\x1b[0m");
 
     fprintf(out_file, "\n");
 
     // Make sure to flush the message if it is error
-    if (error) fflush(NULL);
+    if (level < LOG_LEVEL_WARN) fflush(NULL);
+}
+
+#ifdef RE_LOG_ASYNC
+bool logger_start_async(void) {
+    call_once(&logger_once, logger_init);
+    if (!logger_ring_key_created) return false;
+    if (atomic_load(&logger_async)) return true;
+
+    atomic_store(&logger_stopping, false);
+    if (thrd_create(&logger_thread, logger_run, NULL) != thrd_success) return false;
+
+    atomic_store(&logger_async, true);
+    return true;
+}
+
+void logger_flush(void) {
+    if (!atomic_load(&logger_async)) {
+        fflush(logger_output ? logger_output : stdout);
+        return;
+    }
+
+    // Wait until the background thread wrote what each ring has now
+    for (LoggerRing *ring = atomic_load(&logger_rings); ring; ring = ring->next) {
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        while (atomic_load_explicit(&ring->head, memory_order_acquire) < tail && atomic_load(&logger_async))
+            thrd_sleep(&(struct timespec){.tv_nsec = 100000}, NULL);
+    }
+}
+
+void logger_stop_async(void) {
+    if (!atomic_exchange(&logger_async, false)) return;
+
+    atomic_store(&logger_stopping, true);
+    thrd_join(logger_thread, NULL);
+
+    // Messages logged while stopping
+    logger_drain();
+}
+
+void logger_get_stats(LoggerStats *stats) {
+    *stats = (LoggerStats){.written = atomic_load(&logger_written)};
+    for (LoggerRing *ring = atomic_load(&logger_rings); ring; ring = ring->next) {
+        stats->dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+        stats->truncated += atomic_load_explicit(&ring->truncated, memory_order_relaxed);
+    }
+}
+
+static void logger_init(void) {
+    logger_ring_key_created = tss_create(&logger_ring_key, logger_release_ring) == thrd_success;
+    // Don't lose the messages still in the rings when the program exits
+    if (logger_ring_key_created) atexit(logger_stop_async);
+}
+
+static void logger_release_ring(void *ring) {
+    atomic_store_explicit(&((LoggerRing *)ring)->owned, false, memory_order_release);
+}
+
+static LoggerRing *logger_claim_ring(void) {
+    LoggerRing *ring;
+    // Take over a released ring once it was written, so that the records of the exited thread don't take its space
+    for (ring = atomic_load(&logger_rings); ring; ring = ring->next) {
+        bool owned = false;
+        if (atomic_load_explicit(&ring->head, memory_order_acquire) != atomic_load_explicit(&ring->tail, memory_order_relaxed))
+            continue;
+        if (atomic_compare_exchange_strong(&ring->owned, &owned, true)) break;
+    }
+
+    if (!ring) {
+        ring = calloc(1, sizeof(LoggerRing));
+        if (!ring) return NULL;
+        atomic_init(&ring->owned, true);
+
+        ring->next = atomic_load(&logger_rings);
+        while (!atomic_compare_exchange_weak(&logger_rings, &ring->next, ring));
+    }
+
+    tss_set(logger_ring_key, ring);
+    logger_thread_ring = ring;
+
+    return ring;
+}
+
+static bool logger_push(LogLevel level, const char *restrict msg, va_list args) {
+    LoggerRing *ring = logger_thread_ring ? logger_thread_ring : logger_claim_ring();
+    if (!ring) return false;
+
+    bool error = level < LOG_LEVEL_WARN;
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    // Errors are never dropped, they wait for the ring to be written instead
+    while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == LOGGER_RING_RECORDS) {
+        if (!error) {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return true;
+        }
+        logger_flush();
+    }
+
+    LoggerRecord *record = &ring->records[tail % LOGGER_RING_RECORDS];
+    int len = vsnprintf(record->text, LOGGER_RECORD_BYTES, msg, args);
+    if (len < 0) len = 0;
+    if (len >= LOGGER_RECORD_BYTES) {
+        atomic_fetch_add_explicit(&ring->truncated, 1, memory_order_relaxed);
+        len = LOGGER_RECORD_BYTES - 1;
+    }
+    record->level = level;
+    record->len = len;
+
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+    // Errors are written before returning, like in synchronous mode
+    if (error) logger_flush();
+
+    return true;
+}
+
+static size_t logger_drain(void) {
+    // Lines are collected and written with one call per file, instead of a few locked stdio calls each
+    static char batch[LOGGER_BATCH_BYTES];
+    size_t batch_len = 0;
+    FILE *batch_file = NULL;
+    size_t written = 0;
+
+    for (LoggerRing *ring = atomic_load(&logger_rings); ring; ring = ring->next) {
+        size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        written += tail - head;
+
+        for (; head != tail; ++head) {
+            const LoggerRecord *record = &ring->records[head % LOGGER_RING_RECORDS];
+            bool colored;
+            FILE *out_file = logger_file(record->level, &colored);
+
+            // Color, level, text, color reset and new line always fit in an empty batch
+            if (out_file != batch_file || batch_len + LOGGER_RECORD_BYTES + 32 > LOGGER_BATCH_BYTES) {
+                if (batch_len) fwrite(batch, 1, batch_len, batch_file);
+                batch_len = 0;
+                batch_file = out_file;
+            }
+
+            if (colored) batch_len += snprintf(batch + batch_len, LOGGER_BATCH_BYTES - batch_len, "\x1b[%sm", colors[record->level]);
+            batch_len += snprintf(batch + batch_len, LOGGER_BATCH_BYTES - batch_len, "%s", log_level_strings[record->level]);
+            memcpy(batch + batch_len, record->text, record->len);
+            batch_len += record->len;
+            if (colored) batch_len += snprintf(batch + batch_len, LOGGER_BATCH_BYTES - batch_len, "\x1b[0m");
+            batch[batch_len++] = '\n';
+
+            // Make sure to flush the message if it is error
+            if (record->level < LOG_LEVEL_WARN) {
+                fwrite(batch, 1, batch_len, batch_file);
+                batch_len = 0;
+                fflush(NULL);
+            }
+        }
+
+        atomic_store_explicit(&ring->head, tail, memory_order_release);
+    }
+
+    if (batch_len) fwrite(batch, 1, batch_len, batch_file);
+
+    if (written) {
+        atomic_fetch_add(&logger_written, written);
+        fflush(logger_output ? logger_output : stdout);
+    }
+
+    return written;
+}
+
+static int logger_run(void *arg) {
+    (void)arg;
+
+    while (true) {
+        bool stopping = atomic_load(&logger_stopping);
+        if (logger_drain()) continue;
+        if (stopping) break;
+
+        // Nothing to write, poll again in a millisecond
+        thrd_sleep(&(struct timespec){.tv_nsec = 1000000}, NULL);
+    }
+
+    return 0;
+}
+#else
+bool logger_start_async(void) {
+    return false;
+}
+
+void logger_flush(void) {
+    fflush(logger_output ? logger_output : stdout);
+}
+
+void logger_stop_async(void) {
 }
 
+void logger_get_stats(LoggerStats *stats) {
+    *stats = (LoggerStats){0};
+}
+#endif
+
 #ifdef OS_WINDOWS
 static bool enableVTProcessing(DWORD handle_type) {
     HANDLE handle = GetStdHandle(handle_type);
@@ -93,4 +486,3 @@ static bool enableVTProcessing(DWORD handle_type) {
     return true;
 }
 #endif
-
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
 /**
  * @enum LogLevel
  * @brief Different levels of logging.
@@ -13,15 +17,79 @@ typedef enum LogLevel {
     LOG_LEVEL_TRACE
 } LogLevel;
 
+/**
+ * @brief Number of records in the ring buffer of each thread in asynchronous mode.
+ */
+#define LOGGER_RING_RECORDS 1024
+
+/**
+ * @brief Bytes of a formatted message in asynchronous mode (longer messages are truncated).
+ */
+#define LOGGER_RECORD_BYTES 256
+
+/**
+ * @struct LoggerStats logger.h
+ * @brief Counters of the asynchronous mode (since the first @ref logger_start_async).
+ */
+typedef struct LoggerStats {
+    size_t written; /**< Records written to the output by the background thread */
+    size_t dropped; /**< Records dropped because the ring buffer of their thread was full */
+    size_t truncated; /**< Records longer than LOGGER_RECORD_BYTES */
+} LoggerStats;
+
 /**
  * @brief Log a message of given log level.
  *
+ * In asynchronous mode the message is formatted into the ring buffer of the
+ * calling thread and written later by the background thread. Fatal and error
+ * messages still wait until they are written.
+ *
  * @param level LogLevel of message
  * @param msg The format string
  * @param ... Arguments for format string
  */
 void logger_log(LogLevel level, const char *restrict msg, ...);
 
+/**
+ * @brief Write the messages to the file instead of stdout (info and below) and stderr (warnings and above).
+ *
+ * @note Not thread-safe, call it before logging from other threads.
+ *
+ * @param file The file (NULL to go back to stdout and stderr)
+ */
+void logger_set_output(FILE *file);
+
+/**
+ * @brief Start the asynchronous mode.
+ *
+ * Every thread logging gets a lock-free ring buffer of LOGGER_RING_RECORDS
+ * pre-formatted records and a background thread drains them to the output,
+ * so logging does not wait for the output. The messages of one thread keep
+ * their order, messages of different threads are written in the order they
+ * are drained. A message is dropped (and counted) when its ring buffer is
+ * full. The mode is stopped at exit if it is still running.
+ *
+ * @return false if asynchronous mode is not available (built without C11 threads) or the thread could not be started.
+ */
+bool logger_start_async(void);
+
+/**
+ * @brief Wait until every message logged so far is written.
+ */
+void logger_flush(void);
+
+/**
+ * @brief Write the pending messages, stop the background thread and log synchronously again.
+ */
+void logger_stop_async(void);
+
+/**
+ * @brief Get the counters of the asynchronous mode.
+ *
+ * @param stats Pointer to store the counters
+ */
+void logger_get_stats(LoggerStats *stats);
+
 /**
  * @brief Log a Fatal message
  *
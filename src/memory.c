@@ -5,17 +5,30 @@
 
 #include <stdlib.h>
 
-/**
- * @brief Amount of bytes required to store the size.
- */
-#define HEADER_SIZE (sizeof(size_t))
+#ifdef RE_MEMORY_ACCOUNTING
+#include <stdatomic.h>
+#endif
 
 #define KIB (1024)
 #define MIB (KIB * 1024)
 #define GIB (MIB * 1024)
 
-static size_t allocated_bytes = 0;
-static size_t allocation_count = 0;
+#ifdef RE_MEMORY_ACCOUNTING
+// Atomic, so that regexes can be created and matched from several threads
+static atomic_size_t allocated_bytes = 0;
+static atomic_size_t allocation_count = 0;
+static atomic_size_t peak_allocated_bytes = 0;
+
+/**
+ * @brief Account the change in allocated bytes.
+ *
+ * @param added Bytes allocated
+ * @param removed Bytes freed
+ */
+static void memory_account(size_t added, size_t removed);
+#else
+#define memory_account(added, removed)
+#endif
 
 /**
  * @brief Format the ext (of length 4) and return the size according to the extension.
@@ -27,61 +40,155 @@ static size_t allocation_count = 0;
  */
 static double format_ext_and_get_size(size_t bytes, char *ext);
 
-void *memory_allocate(size_t size) {
-    void *ptr = malloc(size + HEADER_SIZE);
+/**
+ * @brief Default allocate function (malloc()).
+ */
+static void *default_allocate(void *context, size_t size);
+
+/**
+ * @brief Default reallocate function (realloc()).
+ */
+static void *default_reallocate(void *context, void *ptr, size_t old_size, size_t new_size);
+
+/**
+ * @brief Default free function (free()).
+ */
+static void default_free(void *context, void *ptr, size_t size);
+
+static const Allocator default_allocator = {
+    .allocate = default_allocate,
+    .reallocate = default_reallocate,
+    .free = default_free,
+    .context = NULL,
+};
+
+const Allocator *memory_default_allocator(void) {
+    return &default_allocator;
+}
+
+void *memory_allocate(const Allocator *allocator, size_t size) {
+    void *ptr = memory_try_allocate(allocator, size);
 
     if (!ptr) QUIT_WITH_FATAL_MSG("Failed to allocate memory");
 
-    allocation_count++;
-    allocated_bytes += size;
-    *((size_t *)ptr) = size;
-    ptr = ((char *)ptr) + HEADER_SIZE;
+    return ptr;
+}
+
+void *memory_try_allocate(const Allocator *allocator, size_t size) {
+    if (!allocator) allocator = &default_allocator;
+
+    void *ptr = allocator->allocate(allocator->context, size);
+    if (!ptr) return NULL;
+
+#ifdef RE_MEMORY_ACCOUNTING
+    atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+#endif
+    memory_account(size, 0);
 
     return ptr;
 }
 
-void memory_free(void *ptr) {
-    ptr = ((char *)ptr) - HEADER_SIZE;
-    allocation_count--;
-    allocated_bytes -= *((size_t *)ptr);
-    free(ptr);
+void memory_free(const Allocator *allocator, void *ptr, size_t size) {
+    if (!ptr) return;
+    if (!allocator) allocator = &default_allocator;
+
+#ifdef RE_MEMORY_ACCOUNTING
+    atomic_fetch_sub_explicit(&allocation_count, 1, memory_order_relaxed);
+#endif
+    memory_account(0, size);
+
+    allocator->free(allocator->context, ptr, size);
 }
 
-void *memory_reallocate(void *ptr, size_t new_size) {
+void *memory_reallocate(const Allocator *allocator, void *ptr, size_t old_size, size_t new_size) {
     if (!ptr && !new_size) return NULL;
-    if (!ptr) return memory_allocate(new_size);
+    if (!ptr) return memory_allocate(allocator, new_size);
     if (!new_size) {
-        memory_free(ptr);
+        memory_free(allocator, ptr, old_size);
         return NULL;
     }
 
-    ptr = ((char *)ptr) - HEADER_SIZE;
-    ptr = realloc(ptr, new_size + HEADER_SIZE);
+    ptr = memory_try_reallocate(allocator, ptr, old_size, new_size);
 
     if (!ptr) QUIT_WITH_FATAL_MSG("Failed to reallocate memory");
 
-    allocated_bytes += new_size;
-    allocated_bytes -= *((size_t *)ptr);
-    *((size_t *)ptr) = new_size;
-    ptr = ((char *)ptr) + HEADER_SIZE;
-
     return ptr;
 }
 
-void print_memory_usage(void) {
-    LOG_INFO("Allocation count: %lu", allocation_count);
+void *memory_try_reallocate(const Allocator *allocator, void *ptr, size_t old_size, size_t new_size) {
+    if (!ptr) return memory_try_allocate(allocator, new_size);
+    if (!allocator) allocator = &default_allocator;
 
+    ptr = allocator->reallocate(allocator->context, ptr, old_size, new_size);
+    if (ptr) memory_account(new_size, old_size);
+
+    return ptr;
+}
+
+void print_memory_usage(const MemoryReport *report) {
     char ext[4];
     double size;
 
-    size = format_ext_and_get_size(allocated_bytes, ext);
+    if (report) {
+        size = format_ext_and_get_size(report->program_bytes, ext);
+        LOG_INFO("Program (nfa states): %.4lf %s", size, ext);
+
+        size = format_ext_and_get_size(report->table_bytes, ext);
+        LOG_INFO("Tables: %.4lf %s", size, ext);
+
+        size = format_ext_and_get_size(report->scratch_bytes, ext);
+        LOG_INFO("Scratch (matching buffers): %.4lf %s", size, ext);
+
+        size = format_ext_and_get_size(report->program_bytes + report->table_bytes + report->scratch_bytes, ext);
+        LOG_INFO("Total regex memory: %.4lf %s", size, ext);
+    }
+
+#ifdef RE_MEMORY_ACCOUNTING
+    LOG_INFO("Allocation count: %zu", atomic_load_explicit(&allocation_count, memory_order_relaxed));
+
+    size = format_ext_and_get_size(atomic_load_explicit(&allocated_bytes, memory_order_relaxed), ext);
     LOG_INFO("Allocation size: %.4lf %s", size, ext);
+#endif
+}
 
-    size = format_ext_and_get_size(HEADER_SIZE * allocation_count, ext);
-    LOG_INFO("Memory used for the header: %.4lf %s", size, ext);
+size_t memory_get_peak_usage(void) {
+#ifdef RE_MEMORY_ACCOUNTING
+    return atomic_load_explicit(&peak_allocated_bytes, memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
+
+void memory_reset_peak_usage(void) {
+#ifdef RE_MEMORY_ACCOUNTING
+    atomic_store_explicit(&peak_allocated_bytes, atomic_load_explicit(&allocated_bytes, memory_order_relaxed), memory_order_relaxed);
+#endif
+}
+
+#ifdef RE_MEMORY_ACCOUNTING
+static void memory_account(size_t added, size_t removed) {
+    size_t bytes = atomic_fetch_add_explicit(&allocated_bytes, added - removed, memory_order_relaxed) + added - removed;
+
+    size_t peak = atomic_load_explicit(&peak_allocated_bytes, memory_order_relaxed);
+    while (bytes > peak && !atomic_compare_exchange_weak_explicit(&peak_allocated_bytes, &peak, bytes, memory_order_relaxed, memory_order_relaxed));
+}
+#endif
 
-    size = format_ext_and_get_size(allocated_bytes + (HEADER_SIZE * allocation_count), ext);
-    LOG_INFO("Total memory used: %.4lf %s", size, ext);
+static void *default_allocate(void *context, size_t size) {
+    (void)context;
+    return malloc(size);
+}
+
+static void *default_reallocate(void *context, void *ptr, size_t old_size, size_t new_size) {
+    (void)context;
+    (void)old_size;
+    return realloc(ptr, new_size);
+}
+
+static void default_free(void *context, void *ptr, size_t size) {
+    (void)context;
+    (void)size;
+    free(ptr);
 }
 
 static double format_ext_and_get_size(size_t bytes, char *ext) {
@@ -107,4 +214,3 @@ static double format_ext_and_get_size(size_t bytes, char *ext) {
 
     return size;
 }
-
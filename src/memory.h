@@ -2,32 +2,106 @@
 
 #include <stddef.h>
 
+/**
+ * @struct Allocator memory.h
+ * @brief User supplied allocation functions.
+ *
+ * The sizes of the allocations are always passed back to reallocate and free,
+ * so the allocator does not need to store them.
+ */
+typedef struct Allocator {
+    void *(*allocate)(void *context, size_t size); /**< Allocate size bytes */
+    void *(*reallocate)(void *context, void *ptr, size_t old_size, size_t new_size); /**< Resize the allocation */
+    void (*free)(void *context, void *ptr, size_t size); /**< Free the allocation */
+    void *context; /**< Passed as first argument to all the functions */
+} Allocator;
+
+/**
+ * @struct MemoryReport memory.h
+ * @brief Memory used by a compiled regex.
+ */
+typedef struct MemoryReport {
+    size_t program_bytes; /**< Bytes used by the NFA states */
+    size_t table_bytes; /**< Bytes used by the transition tables */
+    size_t scratch_bytes; /**< Bytes used by the buffers needed while matching */
+} MemoryReport;
+
+/**
+ * @brief Get the default allocator (uses malloc(), realloc() and free()).
+ *
+ * @return Pointer to the default allocator.
+ */
+const Allocator *memory_default_allocator(void);
+
 /**
  * @brief Allocate memory (same as malloc()).
  *
+ * @param allocator The allocator to use (NULL for the default allocator)
  * @param size Bytes to allocate
  *
  * @return Pointer to allocated memory.
  */
-void *memory_allocate(size_t size);
+void *memory_allocate(const Allocator *allocator, size_t size);
+
+/**
+ * @brief Allocate memory, returning NULL instead of quitting if the allocator fails.
+ *
+ * @param allocator The allocator to use (NULL for the default allocator)
+ * @param size Bytes to allocate
+ *
+ * @return Pointer to allocated memory, or NULL.
+ */
+void *memory_try_allocate(const Allocator *allocator, size_t size);
 
 /**
  * @brief Free memory (same as free()).
  *
+ * @param allocator The allocator used to allocate (NULL for the default allocator)
  * @param ptr Pointer to allocated memory
+ * @param size Size that was requested for the memory
  */
-void memory_free(void *ptr);
+void memory_free(const Allocator *allocator, void *ptr, size_t size);
 
 /**
  * @brief Reallocate memory (same as realloc()).
  *
+ * @param allocator The allocator used to allocate (NULL for the default allocator)
  * @param ptr Pointer to the memory to reallocate
+ * @param old_size Size that was requested for the memory
  * @param new_size New size of the memory
  */
-void *memory_reallocate(void *ptr, size_t new_size);
+void *memory_reallocate(const Allocator *allocator, void *ptr, size_t old_size, size_t new_size);
+
+/**
+ * @brief Reallocate memory, returning NULL instead of quitting if the allocator fails (the memory is kept then).
+ *
+ * @param allocator The allocator used to allocate (NULL for the default allocator)
+ * @param ptr Pointer to the memory to reallocate
+ * @param old_size Size that was requested for the memory
+ * @param new_size New size of the memory (not 0)
+ *
+ * @return Pointer to the reallocated memory, or NULL.
+ */
+void *memory_try_reallocate(const Allocator *allocator, void *ptr, size_t old_size, size_t new_size);
 
 /**
- * @brief Print the memory usage.
+ * @brief Print the memory report of a regex and the global memory usage.
+ *
+ * @param report The memory report of a regex (NULL to print only the global usage)
  */
-void print_memory_usage(void);
+void print_memory_usage(const MemoryReport *report);
 
+/**
+ * @brief Get the highest number of bytes that were allocated at once since
+ * the last @ref memory_reset_peak_usage.
+ *
+ * @note Always 0 when built without RE_MEMORY_ACCOUNTING.
+ *
+ * @return Peak allocated bytes.
+ */
+size_t memory_get_peak_usage(void);
+
+/**
+ * @brief Reset the peak usage to the currently allocated bytes.
+ */
+void memory_reset_peak_usage(void);
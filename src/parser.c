@@ -3,8 +3,17 @@
 #include "utils.h"
 #include "range.h"
 #include "memory.h"
+#include "regex.h"
+#include "utf8.h"
 
+#include <stdarg.h>
 #include <stdbool.h>
+#include <stdio.h>
+
+/**
+ * @brief Surrogates are not valid code points in UTF-8.
+ */
+static const Range utf8_surrogates = {0xD800, 0xDFFF};
 
 /**
  * @enum RepetitionType
@@ -22,10 +31,22 @@ typedef enum RepetitionType {
  * @brief Structure to represent the token.
  */
 typedef struct Token {
-    int input; /**< Input character */
-    RepetitionType repetition; /**< repetition type */
+    AstNode *node; /**< The character, class or group (with its repetition) */
+    bool group_end; /**< The token is ')' (node is NULL then) */
 } Token;
 
+/**
+ * @brief Record why the regex is invalid (only the first error is kept), the parsing stops.
+ *
+ * The functions keep returning valid nodes after an error, so the tree built
+ * so far can always be destroyed.
+ *
+ * @param parser Pointer to parser state
+ * @param format The format of the message
+ * @param ... Arguments to the format
+ */
+static void parser_fail(Parser *parser, const char *format, ...);
+
 /**
  * @brief Parse and get the next character from source.
  *
@@ -44,6 +65,16 @@ static int parser_parse_character(Parser *parser);
  */
 static RepetitionType parser_parse_repetition(Parser *parser);
 
+/**
+ * @brief Parse the repetition after the node and apply it.
+ *
+ * @param parser Pointer to parser state
+ * @param node The node repeated
+ *
+ * @return The node, or the repeat node of it.
+ */
+static AstNode *parser_repeat(Parser *parser, AstNode *node);
+
 /**
  * @brief Helper function to get the next token.
  *
@@ -55,70 +86,138 @@ static RepetitionType parser_parse_repetition(Parser *parser);
 static bool parser_get_next_token(Parser *parser, Token *token);
 
 /**
- * @brief Add nfa fragment for a input with no repetition.
+ * @brief Create the node matching the input character.
+ *
+ * In case-insensitive mode a letter is stored in one case, the compiler matches both.
  *
  * @param parser Pointer to parser state
  * @param input The input character
+ *
+ * @return The node.
  */
-static void parser_add_repetition_once(Parser *parser, int input);
+static AstNode *parser_character_node(Parser *parser, int input);
 
 /**
- * @brief Add nfa fragment for a input with zero or more repetition.
+ * @brief Add (or remove when negated) the range and, in case-insensitive mode, its other case.
  *
  * @param parser Pointer to parser state
- * @param input The input character
+ * @param range The range
+ * @param range_list The range_list array
+ * @param range_list_len The length of range_list
+ * @param negate Whether the range should be removed
+ *
+ * @return Range list array.
  */
-static void parser_add_repetition_zero_or_more(Parser *parser, int input);
+static Range *parser_update_range_list(Parser *parser, Range range, Range *range_list, int *range_list_len, bool negate);
 
 /**
- * @brief Add nfa fragment for a input with one or more repetition.
+ * @brief In multi-line mode, remove the new line from the ranges of '.' or a negated class (they don't match it).
  *
  * @param parser Pointer to parser state
- * @param input The input character
+ * @param range_list The range_list array
+ * @param range_list_len The length of range_list
+ *
+ * @return Range list array.
  */
-static void parser_add_repetition_one_or_more(Parser *parser, int input);
+static Range *parser_remove_new_line(Parser *parser, Range *range_list, int *range_list_len);
 
 /**
- * @brief Add nfa fragment for a input with zero or one repetition.
+ * @brief Parse the assertion at the index ('\\b', '\\B', '\\A' or '\\z'), if there is one.
+ *
+ * An assertion is not repeated, a repetition character after it is a character.
  *
  * @param parser Pointer to parser state
- * @param input The input character
+ *
+ * @return The node, NULL if there is no assertion at the index.
  */
-static void parser_add_repetition_zero_or_one(Parser *parser, int input);
+static AstNode *parser_parse_assertion(Parser *parser);
 
 /**
- * @brief Parse and generate nfa for character class/set.
+ * @brief Parse character class/set.
  *
  * @param parser Pointer to the parser state
+ *
+ * @return The node.
  */
-static void parser_parse_and_generate_character_class(Parser *parser);
+static AstNode *parser_parse_character_class(Parser *parser);
 
 /**
- * @brief Function to add the given input character as class character.
+ * @brief Create the node matching any of the ranges.
+ *
+ * A single code point is a string of its bytes, so that it can be merged with its neighbours.
  *
  * @param parser Pointer to parser state
- * @param merge Pointer to the merging state
- * @param range The range
+ * @param range_list The ranges (owned by the node)
+ * @param range_list_len Number of ranges
+ *
+ * @return The node.
+ */
+static AstNode *parser_class_node(Parser *parser, Range *range_list, int range_list_len);
+
+/**
+ * @brief Parse '.' or a multi-byte character in UTF-8 mode.
+ *
+ * @param parser Pointer to parser state
+ *
+ * @return The node.
  */
-static void parser_add_input_range_to_character_class(Parser *parser, State *merge, Range range);
+static AstNode *parser_parse_utf8_character(Parser *parser);
 
 /**
- * @brief Function to parse from wherever index is till alternation or NULL character.
+ * @brief Get the character (byte, or code point in UTF-8 mode) at given index.
+ *
+ * @param parser Pointer to parser state
+ * @param index Index of the character in src
+ * @param len Pointer to store number of bytes of the character
  *
- * @param parser Pointer to parser state.
+ * @return The character.
  */
-static State *parser_parse_alternation(Parser *parser);
+static unsigned int parser_decode_character(Parser *parser, int index, int *len);
 
 /**
- * @brief Parse and generate character group.
+ * @brief Check whether the character at index should be parsed by
+ * @ref parser_parse_utf8_character.
  *
  * @param parser Pointer to parser state
+ *
+ * @return true in UTF-8 mode for '.' and multi-byte characters.
  */
-static void parser_parse_and_generate_group(Parser *parser);
+static bool parser_at_utf8_character(Parser *parser);
 
-void parser_create(Parser *parser, const char *src) {
+/**
+ * @brief Get the last character (byte, or code point in UTF-8 mode).
+ *
+ * @param parser Pointer to parser state
+ *
+ * @return The last character.
+ */
+static unsigned int parser_last_character(Parser *parser);
+
+/**
+ * @brief Parse the tokens from wherever index is till alternation, end of the group or NULL character.
+ *
+ * @param parser Pointer to parser state
+ * @param concat The concatenation to add the tokens to
+ * @param group Whether the tokens are in a group (')' is a character otherwise)
+ *
+ * @return true if the group was terminated.
+ */
+static bool parser_parse_sequence(Parser *parser, AstNode *concat, bool group);
+
+/**
+ * @brief Parse character group.
+ *
+ * @param parser Pointer to parser state
+ *
+ * @return The alternation of the group.
+ */
+static AstNode *parser_parse_group(Parser *parser);
+
+void parser_create(Parser *parser, const char *src, const Allocator *allocator, int flags) {
     *parser = (Parser){0};
     parser->src = src;
+    parser->allocator = allocator;
+    parser->flags = flags;
 }
 
 void parser_destroy(Parser *parser) {
@@ -127,29 +226,54 @@ void parser_destroy(Parser *parser) {
 
 void parser_reset(Parser *parser) {
     parser->index = 0;
+    parser->failed = false;
+    parser->error[0] = '\0';
 }
 
-State *parser_parse(Parser *parser) {
-    if (!parser->src[parser->index]) QUIT_WITH_FATAL_MSG("Empty regex?"); // Maybe forgot to reset?
+AstNode *parser_parse(Parser *parser) {
+    if (!parser->src[parser->index]) {
+        parser_fail(parser, "Empty regex?"); // Maybe forgot to reset?
+        return NULL;
+    }
 
-    parser->total_states = 0;
-    parser->match = state_create(MATCH);
-    parser->total_states++;
+    AstNode *root = ast_create(parser->allocator, AST_KIND_ALTERNATION);
 
-    parser->head = parser_parse_alternation(parser);
+    while (true) {
+        if (parser->src[parser->index] == '|') {
+            parser_fail(parser, "Expected alternative expression before '|'");
+            break;
+        }
+
+        AstNode *alternative = ast_create(parser->allocator, AST_KIND_CONCAT);
+        if (parser->src[parser->index] == '^') {
+            parser->index++;
+            ast_add_child(parser->allocator, alternative, ast_create(parser->allocator, AST_KIND_LINE_START));
+        }
+
+        parser_parse_sequence(parser, alternative, false);
+        ast_add_child(parser->allocator, root, alternative);
+
+        if (parser->failed || parser->src[parser->index] != '|') break;
 
-    while (parser->src[parser->index] == '|') {
         parser->index++;
         if (!parser->src[parser->index])
-            QUIT_WITH_FATAL_MSG("Expected alternative expression after '|'");
-        State *branch = state_create(BRANCH);
-        parser->total_states++;
-        branch->out = parser_parse_alternation(parser);
-        branch->out1 = parser->head;
-        parser->head = branch;
+            parser_fail(parser, "Expected alternative expression after '|'");
     }
 
-    return parser->head;
+    if (!parser->failed) return root;
+
+    ast_destroy(parser->allocator, root);
+    return NULL;
+}
+
+static void parser_fail(Parser *parser, const char *format, ...) {
+    if (parser->failed) return;
+    parser->failed = true;
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(parser->error, sizeof(parser->error), format, args);
+    va_end(args);
 }
 
 static int parser_parse_character(Parser *parser) {
@@ -157,10 +281,13 @@ static int parser_parse_character(Parser *parser) {
     switch (parser->src[parser->index]) {
         case '\\': /** for escaping the special characters (ex: \*) */
             parser->index++;
-            if (!parser->src[parser->index]) QUIT_WITH_FATAL_MSG("Expected another character after '\\'");
+            if (!parser->src[parser->index]) {
+                parser_fail(parser, "Expected another character after '\\'");
+                return input;
+            }
             /* fallthrough */
         default: /** Anything (if the special characters are in the first, then they are directly taken as the characters */
-            input = parser->src[parser->index];
+            input = (unsigned char)parser->src[parser->index];
             break;
         case '.': /** The special character which matchs to any character */
             input = ANY_CHAR;
@@ -194,379 +321,326 @@ static RepetitionType parser_parse_repetition(Parser *parser) {
     return repetition;
 }
 
-static void parser_add_input_range_to_character_class(Parser *parser, State *merge, Range range) {
-    State *branch = state_create(BRANCH);
-    State *new = state_create(RANGE);
-    new->range = range;
+static unsigned int parser_decode_character(Parser *parser, int index, int *len) {
+    if (!(parser->flags & REGEX_FLAG_UTF8)) {
+        *len = 1;
+        return (unsigned char)parser->src[index];
+    }
 
-    branch->out1 = new;
-    new->out = merge;
+    unsigned int codepoint;
+    *len = utf8_decode(&parser->src[index], &codepoint);
+    if (!*len) {
+        parser_fail(parser, "Invalid UTF-8 in the regex at index %d", index);
+        // Step over the byte, the caller moves on
+        *len = 1;
+        codepoint = 0;
+    }
 
-    *parser->cur = branch;
-    parser->cur = &branch->out;
+    return codepoint;
+}
 
-    parser->total_states += 2;
+static AstNode *parser_parse_assertion(Parser *parser) {
+    if (parser->src[parser->index] != '\\') return NULL;
+
+    AstAssertion assertion;
+    switch (parser->src[parser->index + 1]) {
+        case 'b':
+            assertion = AST_ASSERTION_WORD_BOUNDARY;
+            break;
+        case 'B':
+            assertion = AST_ASSERTION_NOT_WORD_BOUNDARY;
+            break;
+        case 'A':
+            assertion = AST_ASSERTION_TEXT_START;
+            break;
+        case 'z':
+            assertion = AST_ASSERTION_TEXT_END;
+            break;
+        default:
+            return NULL;
+    }
+    parser->index += 2;
+
+    AstNode *node = ast_create(parser->allocator, AST_KIND_ASSERTION);
+    node->assertion = assertion;
+    return node;
 }
 
-static void parser_parse_and_generate_character_class(Parser *parser) {
-    if (!parser->src[parser->index]) QUIT_WITH_FATAL_MSG("Expected characters in character class");
+static AstNode *parser_parse_character_class(Parser *parser) {
+    if (!parser->src[parser->index]) {
+        parser_fail(parser, "Expected characters in character class");
+        return parser_class_node(parser, NULL, 0);
+    }
 
     bool negate = parser->src[parser->index] == '^';
     if (negate) parser->index++;
 
-    State *start = state_create(EPSILON);
-    State *merge = state_create(EPSILON);
-    parser->total_states += 2;
-
     Range *range_list = NULL;
     int range_list_len = 0;
-    if (negate) range_list = add_range_to_range_list((Range){0, LITERAL_CHAR_LAST}, range_list, &range_list_len);
-
-    State **previous_frag_out = parser->cur;
-    parser->cur = &start->out;
+    if (negate) {
+        range_list = add_range_to_range_list((Range){0, parser_last_character(parser)}, range_list, &range_list_len, parser->allocator);
+        if (parser->flags & REGEX_FLAG_UTF8)
+            range_list = remove_range_from_range_list(utf8_surrogates, range_list, &range_list_len, parser->allocator);
+        range_list = parser_remove_new_line(parser, range_list, &range_list_len);
+    }
 
-    if (!parser->src[parser->index]) QUIT_WITH_FATAL_MSG("Expected characters in character class");
+    if (!parser->src[parser->index]) {
+        parser_fail(parser, "Expected characters in character class");
+        return parser_class_node(parser, range_list, range_list_len);
+    }
 
     if (parser->src[parser->index] == ']') {
-        if (negate) range_list = remove_range_from_range_list((Range){']', ']'}, range_list, &range_list_len);
-        else range_list = add_range_to_range_list((Range){']', ']'}, range_list, &range_list_len);
+        range_list = parser_update_range_list(parser, (Range){']', ']'}, range_list, &range_list_len, negate);
         parser->index++;
     }
 
-    while (parser->src[parser->index] && parser->src[parser->index] != ']') {
+    while (!parser->failed && parser->src[parser->index] && parser->src[parser->index] != ']') {
         // Parsing time!
-        switch(parser->src[parser->index]) {
-            case '\\':
-                parser->index++;
-                if (!parser->src[parser->index]) QUIT_WITH_FATAL_MSG("Expected another character after '\\'");
-                /* fallthrough */
-            default:
-                if (parser->src[parser->index + 1] && parser->src[parser->index + 2]) {
-                    if (parser->src[parser->index + 1] == '-' && parser->src[parser->index + 2] != ']') {
-                        int end_range_index = parser->index + 2;
-                        if (parser->src[end_range_index] == '\\') {
-                            if (!parser->src[parser->index + 3]) QUIT_WITH_FATAL_MSG("Expected another character after '\\'");
-                            end_range_index++;
-                        }
-
-                        if (parser->src[parser->index] >= parser->src[end_range_index])
-                            QUIT_WITH_FATAL_MSG("Invalid range '%c-%c' in the character class", parser->src[parser->index], parser->src[end_range_index]);
-
-                        if (negate) range_list = remove_range_from_range_list((Range){parser->src[parser->index], parser->src[end_range_index]}, range_list, &range_list_len);
-                        else range_list = add_range_to_range_list((Range){parser->src[parser->index], parser->src[end_range_index]}, range_list, &range_list_len);
-
-                        parser->index = end_range_index;
-                        break;
-                    }
+        if (parser->src[parser->index] == '\\') {
+            parser->index++;
+            if (!parser->src[parser->index]) {
+                parser_fail(parser, "Expected another character after '\\'");
+                break;
+            }
+        }
+
+        int start_index = parser->index, len;
+        Range range;
+        range.start = range.end = parser_decode_character(parser, parser->index, &len);
+        int next_index = parser->index + len;
+
+        if (parser->src[next_index] == '-' && parser->src[next_index + 1] && parser->src[next_index + 1] != ']') {
+            int end_range_index = next_index + 1;
+            if (parser->src[end_range_index] == '\\') {
+                if (!parser->src[end_range_index + 1]) {
+                    parser_fail(parser, "Expected another character after '\\'");
+                    break;
                 }
-                if (negate) range_list = remove_range_from_range_list((Range){parser->src[parser->index], parser->src[parser->index]}, range_list, &range_list_len);
-                else range_list = add_range_to_range_list((Range){parser->src[parser->index], parser->src[parser->index]}, range_list, &range_list_len);
+                end_range_index++;
+            }
+
+            range.end = parser_decode_character(parser, end_range_index, &len);
+            next_index = end_range_index + len;
+
+            if (range.start >= range.end) {
+                parser_fail(parser, "Invalid range '%.*s' in the character class", next_index - start_index,
+                    &parser->src[start_index]);
                 break;
+            }
         }
-        parser->index++;
+
+        range_list = parser_update_range_list(parser, range, range_list, &range_list_len, negate);
+
+        parser->index = next_index;
     }
 
-    // Now time to add all the ranges into nfa!
-    for (int i = 0; i < range_list_len; ++i)
-        parser_add_input_range_to_character_class(parser, merge, range_list[i]);
+    if (parser->failed) return parser_class_node(parser, range_list, range_list_len);
 
-    if (parser->src[parser->index] != ']')
-        QUIT_WITH_FATAL_MSG("The character class was not closed");
+    if (parser->src[parser->index] != ']') parser_fail(parser, "The character class was not closed");
+    else parser->index++;
 
-    parser->index++;
+    return parser_class_node(parser, range_list, range_list_len);
+}
 
-    *parser->cur = state_create(DEAD);
-    parser->total_states++;
+static Range *parser_update_range_list(Parser *parser, Range range, Range *range_list, int *range_list_len, bool negate) {
+    Range folded[RANGE_MAX_CASE_FOLDED + 1] = {range};
+    int folded_len = 1;
+    if (parser->flags & REGEX_FLAG_ICASE)
+        folded_len += get_case_folded_ranges(range, parser->flags & REGEX_FLAG_UTF8 ? UTF8_CODEPOINT_LAST : 0x7F, &folded[1]);
+
+    for (int i = 0; i < folded_len; ++i) {
+        if (negate) range_list = remove_range_from_range_list(folded[i], range_list, range_list_len, parser->allocator);
+        else range_list = add_range_to_range_list(folded[i], range_list, range_list_len, parser->allocator);
+    }
 
-    memory_free(range_list);
+    return range_list;
+}
 
-    // Handle the repetitions of the character class
-    RepetitionType repetition = parser_parse_repetition(parser);
-    switch (repetition) {
+static AstNode *parser_repeat(Parser *parser, AstNode *node) {
+    switch (parser_parse_repetition(parser)) {
         case REPETITION_TYPE_ONCE:
-            *previous_frag_out = start;
-            parser->cur = &merge->out;
-            break;
+            return node;
         case REPETITION_TYPE_ZERO_OR_MORE:
-            {
-                State *branch = state_create(BRANCH);
-                parser->total_states++;
-                branch->out1 = start;
-                merge->out = branch;
-
-                *previous_frag_out = branch;
-                parser->cur = &branch->out;
-            } break;
+            return ast_create_repeat(parser->allocator, node, AST_REPEAT_ZERO_OR_MORE);
         case REPETITION_TYPE_ONE_OR_MORE:
-            {
-                State *branch = state_create(BRANCH);
-                parser->total_states++;
-
-                merge->out = branch;
-                branch->out1 = start;
-
-                *previous_frag_out = start;
-                parser->cur = &branch->out;
-            } break;
+            return ast_create_repeat(parser->allocator, node, AST_REPEAT_ONE_OR_MORE);
         case REPETITION_TYPE_ZERO_OR_ONE:
-            {
-                state_destroy(*parser->cur);
-                parser->total_states--;
-                *parser->cur = merge;
-
-                *previous_frag_out = start;
-                parser->cur = &merge->out;
-            } break;
+            return ast_create_repeat(parser->allocator, node, AST_REPEAT_ZERO_OR_ONE);
     }
-}
-
-static void parser_parse_and_generate_group(Parser *parser) {
-    if (!parser->src[parser->index] || parser->src[parser->index] == ')') QUIT_WITH_FATAL_MSG("Expected characters in group");
 
-    State *start = state_create(EPSILON);
-    State *end = state_create(EPSILON);
-    parser->total_states += 2;
-
-    State **previous_frag_out = parser->cur;
-    parser->cur = &start->out;
+    SHOULD_NOT_REACH_HERE;
+}
 
-    Token token;
-do_parsing:
-    while (parser_get_next_token(parser, &token) && token.input != ')') {
-        switch (token.repetition) {
-            case REPETITION_TYPE_ONCE:
-                parser_add_repetition_once(parser, token.input);
-                break;
-            case REPETITION_TYPE_ZERO_OR_MORE:
-                parser_add_repetition_zero_or_more(parser, token.input);
-                break;
-            case REPETITION_TYPE_ONE_OR_MORE:
-                parser_add_repetition_one_or_more(parser, token.input);
-                break;
-            case REPETITION_TYPE_ZERO_OR_ONE:
-                parser_add_repetition_zero_or_one(parser, token.input);
-                break;
-        }
+static AstNode *parser_character_node(Parser *parser, int input) {
+    if (input == ANY_CHAR && (parser->flags & REGEX_FLAG_MULTILINE)) {
+        Range *range_list = NULL;
+        int range_list_len = 0;
+        range_list = add_range_to_range_list((Range){0, LITERAL_CHAR_LAST}, range_list, &range_list_len, parser->allocator);
+        range_list = parser_remove_new_line(parser, range_list, &range_list_len);
+        return parser_class_node(parser, range_list, range_list_len);
     }
+    if (input == ANY_CHAR) return ast_create(parser->allocator, AST_KIND_ANY);
 
-    *parser->cur = end;
-
-    if (parser->src[parser->index] == '|') {
-        parser->index++;
-        if (!parser->src[parser->index])
-            QUIT_WITH_FATAL_MSG("Expected alternative expression after '|'");
-        State *branch = state_create(BRANCH);
-        parser->total_states++;
+    // Both cases of a letter are the same string, so that they are factored together
+    Range folded[RANGE_MAX_CASE_FOLDED];
+    if ((parser->flags & REGEX_FLAG_ICASE) && get_case_folded_ranges((Range){input, input}, 0x7F, folded)
+        && folded[0].start < (unsigned int)input)
+        input = (int)folded[0].start;
 
-        branch->out1 = start->out;
-        start->out = branch;
+    unsigned char byte = (unsigned char)input;
+    return ast_create_string(parser->allocator, &byte, 1);
+}
 
-        parser->cur = &branch->out;
-        goto do_parsing;
-    }
+static Range *parser_remove_new_line(Parser *parser, Range *range_list, int *range_list_len) {
+    if (!(parser->flags & REGEX_FLAG_MULTILINE)) return range_list;
+    return remove_range_from_range_list((Range){'\n', '\n'}, range_list, range_list_len, parser->allocator);
+}
 
-    if (token.input != ')') QUIT_WITH_FATAL_MSG("Expected termination of the group");
+static AstNode *parser_class_node(Parser *parser, Range *range_list, int range_list_len) {
+    Range folded[RANGE_MAX_CASE_FOLDED];
+    bool single = range_list_len == 1 && range_list[0].start == range_list[0].end
+        && !((parser->flags & REGEX_FLAG_ICASE) && get_case_folded_ranges(range_list[0], 0x7F, folded));
 
-    switch (token.repetition) {
-        case REPETITION_TYPE_ONCE:
-            *previous_frag_out = start;
-            parser->cur = &end->out;
-            break;
-        case REPETITION_TYPE_ZERO_OR_MORE:
-            {
-                State *branch = state_create(BRANCH);
-                parser->total_states++;
+    if (!single) {
+        AstNode *node = ast_create(parser->allocator, AST_KIND_CLASS);
+        node->ranges = range_list;
+        node->range_count = range_list_len;
+        return node;
+    }
 
-                *previous_frag_out = branch;
+    unsigned char bytes[UTF8_MAX_BYTES] = {(unsigned char)range_list[0].start};
+    int len = 1;
+    if (parser->flags & REGEX_FLAG_UTF8) {
+        // A single code point is one sequence of single bytes
+        Utf8Sequence sequences[UTF8_MAX_SEQUENCES];
+        utf8_split_range(range_list[0], sequences);
+        len = sequences[0].len;
+        for (int i = 0; i < len; ++i) bytes[i] = (unsigned char)sequences[0].ranges[i].start;
+    }
 
-                branch->out1 = start;
-                end->out = branch;
+    memory_free(parser->allocator, range_list, range_list_len * sizeof(Range));
+    return ast_create_string(parser->allocator, bytes, len);
+}
 
-                parser->cur = &branch->out;
-            } break;
-        case REPETITION_TYPE_ONE_OR_MORE:
-            {
-                State *branch = state_create(BRANCH);
-                parser->total_states++;
+static AstNode *parser_parse_utf8_character(Parser *parser) {
+    Range range = {0, UTF8_CODEPOINT_LAST};
+    Range *range_list = NULL;
+    int range_list_len = 0;
 
-                *previous_frag_out = start;
+    if (parser->src[parser->index] == '.') {
+        parser->index++;
+        range_list = add_range_to_range_list(range, range_list, &range_list_len, parser->allocator);
+        range_list = remove_range_from_range_list(utf8_surrogates, range_list, &range_list_len, parser->allocator);
+        range_list = parser_remove_new_line(parser, range_list, &range_list_len);
+    } else {
+        if (parser->src[parser->index] == '\\') parser->index++;
 
-                end->out = branch;
+        int len;
+        range.start = range.end = parser_decode_character(parser, parser->index, &len);
+        parser->index += len;
+        range_list = parser_update_range_list(parser, range, range_list, &range_list_len, false);
+    }
 
-                branch->out1 = start;
+    return parser_class_node(parser, range_list, range_list_len);
+}
 
-                parser->cur = &branch->out;
-            } break;
-        case REPETITION_TYPE_ZERO_OR_ONE:
-            {
-                State *branch = state_create(BRANCH);
-                State *merge = state_create(EPSILON);
-                parser->total_states += 2;
+static AstNode *parser_parse_group(Parser *parser) {
+    AstNode *group = ast_create(parser->allocator, AST_KIND_ALTERNATION);
+    if (!parser->src[parser->index] || parser->src[parser->index] == ')') {
+        parser_fail(parser, "Expected characters in group");
+        return group;
+    }
 
-                branch->out = merge;
-                branch->out1 = start;
+    while (true) {
+        AstNode *alternative = ast_create(parser->allocator, AST_KIND_CONCAT);
+        bool terminated = parser_parse_sequence(parser, alternative, true);
+        ast_add_child(parser->allocator, group, alternative);
 
-                end->out = merge;
+        if (terminated || parser->failed) break;
 
-                parser->cur = &merge->out;
+        if (parser->src[parser->index] != '|') {
+            parser_fail(parser, "Expected termination of the group");
+            break;
+        }
 
-                *previous_frag_out = branch;
-            } break;
+        parser->index++;
+        if (!parser->src[parser->index]) {
+            parser_fail(parser, "Expected alternative expression after '|'");
+            break;
+        }
     }
+
+    return group;
 }
 
 static bool parser_get_next_token(Parser *parser, Token *token) {
-    // If parsing is completed, return false
-    if (!parser->src[parser->index]) return false;
+    *token = (Token){0};
+
+    // If parsing is completed (or failed), return false
+    if (parser->failed || !parser->src[parser->index]) return false;
 
     // Say this is the end of this part of alternation
     if (parser->src[parser->index] == '|') return false;
 
     if ((!parser->src[parser->index + 1] || parser->src[parser->index + 1] == '|') && parser->src[parser->index] == '$') {
-        token->input = LINE_END;
-        token->repetition = REPETITION_TYPE_ONCE;
+        unsigned char line_end = LINE_END;
+        token->node = ast_create_string(parser->allocator, &line_end, 1);
         parser->index++;
         return true;
     }
 
-    if (parser->src[parser->index] == '[') {
+    if (parser->src[parser->index] == ')') {
+        // Only unescaped ')' ends the group
+        token->group_end = true;
         parser->index++;
-        parser_parse_and_generate_character_class(parser);
-        if (!parser->src[parser->index]) return false;
+        return true;
     }
 
-    if (parser->src[parser->index] == '(') {
+    if ((token->node = parser_parse_assertion(parser))) return true;
+
+    AstNode *node;
+    if (parser->src[parser->index] == '[') {
+        parser->index++;
+        node = parser_parse_character_class(parser);
+    } else if (parser->src[parser->index] == '(') {
         parser->index++;
-        parser_parse_and_generate_group(parser);
-        if (!parser->src[parser->index]) return false;
+        node = parser_parse_group(parser);
+    } else if (parser_at_utf8_character(parser)) {
+        node = parser_parse_utf8_character(parser);
+    } else {
+        node = parser_character_node(parser, parser_parse_character(parser));
     }
 
-    token->input = parser_parse_character(parser);
-    token->repetition = parser_parse_repetition(parser);
+    token->node = parser_repeat(parser, node);
 
     return true;
 }
 
-static void parser_add_repetition_once(Parser *parser, int input) {
-    // transition on input character, that's all 
-    State *new = state_create(input);
-
-    // Previous fragment's output is to this new state
-    *parser->cur = new;
-    // out goes to next fragment
-    parser->cur = &new->out;
-
-    parser->total_states++;
-}
-
-static void parser_add_repetition_zero_or_more(Parser *parser, int input) {
-    // Create a branch
-    State *branch = state_create(BRANCH);
-    State *new = state_create(input);
-
-    // One out goes to the state with the input character
-    branch->out1 = new;
-    // state with input character goes back to branch
-    new->out = branch;
-
-    // Previous fragment's output is to the branch
-    *parser->cur = branch;
-    // And another out is to next fragment
-    parser->cur = &branch->out;
-    
-    parser->total_states += 2;
-}
-
-static void parser_add_repetition_one_or_more(Parser *parser, int input) {
-    State *new = state_create(input);
-    // Create a branch
-    State *branch = state_create(BRANCH);
-
-    // State with input character goes to branch
-    new->out = branch;
-    // branch's one output goes back to new state
-    branch->out1 = new;
+static bool parser_parse_sequence(Parser *parser, AstNode *concat, bool group) {
+    Token token;
+    while (parser_get_next_token(parser, &token)) {
+        if (token.group_end) {
+            if (group) return true;
+            // Outside of groups it is just a character
+            token.node = parser_repeat(parser, parser_character_node(parser, ')'));
+        }
 
-    // Previous fragment's output is to new state
-    *parser->cur = new;
-    // Branch's another output goes to next fragment
-    parser->cur = &branch->out;
+        ast_add_child(parser->allocator, concat, token.node);
+    }
 
-    parser->total_states += 2;
+    return false;
 }
 
-static void parser_add_repetition_zero_or_one(Parser *parser, int input) {
-    // Create a branch
-    State *branch = state_create(BRANCH);
-    State *new = state_create(input);
-    // Crate state with epsilon transition for merging outputs from branch
-    State *merge = state_create(EPSILON);
-
-    // Branch's output goes to merge and new state
-    branch->out = merge;
-    branch->out1 = new;
-
-    // New State's output goes to merge
-    new->out = merge;
+static bool parser_at_utf8_character(Parser *parser) {
+    if (!(parser->flags & REGEX_FLAG_UTF8)) return false;
 
-    // Previous fragment's output goes to the branch
-    *parser->cur = branch;
-    // Merge's output goes to next fragment
-    parser->cur = &merge->out;
+    unsigned char c = parser->src[parser->index];
+    if (c == '\\') c = parser->src[parser->index + 1];
+    else if (c == '.') return true;
 
-    parser->total_states += 3;
+    return c >= 0x80;
 }
 
-static State *parser_parse_alternation(Parser *parser) {
-    // Create a dummy fragment
-    State *head = NULL;
-    // Set the dummy fragment's output to next fragment
-    parser->cur = &head;
-
-    if (parser->src[parser->index] == '|') QUIT_WITH_FATAL_MSG("Expected alternative expression before '|'");
-
-    if (parser->src[parser->index] != '^') {
-        // Create a infinity loop matching any character in the beginning so that
-        // nfa does not die when first character doesn't match
-        State *branch = state_create(BRANCH);
-        State *any_char = state_create(ANY_CHAR);
-        parser->total_states += 2;
-
-        // branch's one out goes to any_char
-        branch->out1 = any_char;
-        // any_char's output goes back to branch
-        any_char->out = branch;
-
-        // Previous fragment's output goes to branch
-        *parser->cur = branch;
-        // branch's out goes to next fragment
-        parser->cur = &branch->out;
-    } else {
-        parser->index++;
-    }
-
-    Token token;
-    while (parser_get_next_token(parser, &token)) {
-        switch (token.repetition) {
-            case REPETITION_TYPE_ONCE:
-                parser_add_repetition_once(parser, token.input);
-                break;
-            case REPETITION_TYPE_ZERO_OR_MORE:
-                parser_add_repetition_zero_or_more(parser, token.input);
-                break;
-            case REPETITION_TYPE_ONE_OR_MORE:
-                parser_add_repetition_one_or_more(parser, token.input);
-                break;
-            case REPETITION_TYPE_ZERO_OR_ONE:
-                parser_add_repetition_zero_or_one(parser, token.input);
-                break;
-        }
-    }
-
-    // Add a state with match to indicate accepting state
-    *parser->cur = parser->match;
-    parser->cur = NULL;
-
-    return head;
+static unsigned int parser_last_character(Parser *parser) {
+    return parser->flags & REGEX_FLAG_UTF8 ? UTF8_CODEPOINT_LAST : LITERAL_CHAR_LAST;
 }
-
@@ -1,6 +1,13 @@
 #pragma once
 
-#include "state.h"
+#include "ast.h"
+
+#include <stdbool.h>
+
+/**
+ * @brief Longest error message of the parser (with the NUL).
+ */
+#define PARSER_ERROR_SIZE 128
 
 /**
  * @struct parser.h
@@ -9,19 +16,21 @@
 typedef struct Parser {
     const char *src; /**< Pointer to src (the regex) */
     int index; /**< The index in src parser is at currently */
-    State *head;
-    State *match;
-    State **cur; /**< Internal pointer used by parser to generate the NFA */
-    int total_states; /**< Total number of states allocated */
+    const Allocator *allocator; /**< Allocator for the tree */
+    int flags; /**< Combination of RegexFlag */
+    bool failed; /**< The regex is invalid, nothing more is parsed */
+    char error[PARSER_ERROR_SIZE]; /**< Why the regex is invalid (the first error found) */
 } Parser;
 
 /**
  * @brief Create the parser.
  *
  * @param parser Pointer to parser state
- * @param src The regex to compile
+ * @param src The regex to parse
+ * @param allocator The allocator for the tree (NULL for default allocator)
+ * @param flags Combination of RegexFlag
  */
-void parser_create(Parser *parser, const char *src);
+void parser_create(Parser *parser, const char *src, const Allocator *allocator, int flags);
 
 /**
  * @brief Destroy the parser.
@@ -31,18 +40,24 @@ void parser_create(Parser *parser, const char *src);
 void parser_destroy(Parser *parser);
 
 /**
- * @brief Reset the parser (so that can generate nfa again).
+ * @brief Reset the parser (so that can parse again).
  *
  * @param parser Pointer to parser state.
  */
 void parser_reset(Parser *parser);
 
 /**
- * @brief Parse and generate NFA.
+ * @brief Parse the regex into its syntax tree.
+ *
+ * The tree is an alternation of the top-level alternatives, each a
+ * concatenation starting with AST_KIND_LINE_START if the alternative starts
+ * with '^'.
+ *
+ * An invalid regex stops the parsing at the first error, which is kept in
+ * the parser, and the part of the tree already built is destroyed.
  *
  * @param parser Pointer to the parser state
  *
- * @return Pointer to starting state of NFA.
+ * @return The tree (destroy with @ref ast_destroy), NULL if the regex is invalid.
  */
-State *parser_parse(Parser *parser);
-
+AstNode *parser_parse(Parser *parser);
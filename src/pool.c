@@ -0,0 +1,264 @@
+// sysconf() is POSIX, not part of C17
+#define _POSIX_C_SOURCE 200809L
+
+#include "pool.h"
+
+#include "defines.h"
+#include "utils.h"
+
+#ifdef OS_WINDOWS
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Initial number of tasks a deque can hold.
+ */
+#define POOL_DEQUE_INITIAL_CAPACITY 64
+
+/**
+ * @brief Main loop of a worker thread.
+ *
+ * @param arg Pointer to the PoolWorker
+ *
+ * @return Always 0.
+ */
+static int pool_worker_run(void *arg);
+
+/**
+ * @brief Count a task (or held work) as finished, the last one wakes up everyone to stop.
+ *
+ * @param pool Pointer to the pool
+ */
+static void pool_finish(Pool *pool);
+
+/**
+ * @brief Push a task at the tail of the deque.
+ *
+ * @param pool Pointer to the pool
+ * @param deque Pointer to the deque
+ * @param task The task
+ *
+ * @return false if the deque is full and could not grow.
+ */
+static bool pool_deque_push(Pool *pool, PoolDeque *deque, PoolTask task);
+
+/**
+ * @brief Take a task from the tail (newest) or the head (oldest) of the deque.
+ *
+ * @param deque Pointer to the deque
+ * @param newest Take the newest task instead of the oldest
+ * @param task Pointer to store the task
+ *
+ * @return false if the deque is empty.
+ */
+static bool pool_deque_take(PoolDeque *deque, bool newest, PoolTask *task);
+
+/**
+ * @brief Find a task for the worker, first in its own deque then in the others.
+ *
+ * @param worker Pointer to the worker
+ * @param task Pointer to store the task
+ *
+ * @return false if no task was found.
+ */
+static bool pool_find_task(PoolWorker *worker, PoolTask *task);
+
+/**
+ * @brief Queue the task in the deque of the worker and wake up a sleeping worker.
+ *
+ * @param pool Pointer to the pool
+ * @param worker Index of the worker
+ * @param task The task
+ *
+ * @return false if the deque could not grow (the task is not queued).
+ */
+static bool pool_queue(Pool *pool, int worker, PoolTask task);
+
+bool pool_create(Pool *pool, int worker_count, void *context, const Allocator *allocator) {
+    *pool = (Pool){
+        .context = context,
+        .worker_count = worker_count ? worker_count : pool_processor_count(),
+        .allocator = allocator,
+    };
+
+    pool->workers = memory_try_allocate(allocator, sizeof(PoolWorker) * pool->worker_count);
+    if (!pool->workers) return false;
+
+    for (int i = 0; i < pool->worker_count; ++i) {
+        PoolWorker *worker = &pool->workers[i];
+        *worker = (PoolWorker){.pool = pool, .index = i, .deque.capacity = POOL_DEQUE_INITIAL_CAPACITY};
+        worker->deque.tasks = memory_try_allocate(allocator, sizeof(PoolTask) * worker->deque.capacity);
+        if (!worker->deque.tasks) {
+            // Only the deques before this one were created
+            for (int j = 0; j < i; ++j) {
+                mtx_destroy(&pool->workers[j].deque.lock);
+                memory_free(allocator, pool->workers[j].deque.tasks, sizeof(PoolTask) * POOL_DEQUE_INITIAL_CAPACITY);
+            }
+            memory_free(allocator, pool->workers, sizeof(PoolWorker) * pool->worker_count);
+            return false;
+        }
+        if (mtx_init(&worker->deque.lock, mtx_plain) != thrd_success)
+            QUIT_WITH_FATAL_MSG("Failed to create the pool deque lock");
+    }
+
+    if (mtx_init(&pool->idle_lock, mtx_plain) != thrd_success || cnd_init(&pool->idle) != thrd_success)
+        QUIT_WITH_FATAL_MSG("Failed to create the pool idle lock");
+
+    return true;
+}
+
+void pool_destroy(Pool *pool) {
+    for (int i = 0; i < pool->worker_count; ++i) {
+        mtx_destroy(&pool->workers[i].deque.lock);
+        memory_free(pool->allocator, pool->workers[i].deque.tasks, sizeof(PoolTask) * pool->workers[i].deque.capacity);
+    }
+    memory_free(pool->allocator, pool->workers, sizeof(PoolWorker) * pool->worker_count);
+
+    mtx_destroy(&pool->idle_lock);
+    cnd_destroy(&pool->idle);
+}
+
+void pool_start(Pool *pool, PoolTaskFunction function, void *arg) {
+    atomic_fetch_add(&pool->pending, 1);
+    // NOTE: the deques are empty, so the first task always fits
+    pool_queue(pool, 0, (PoolTask){function, arg});
+
+    for (int i = 0; i < pool->worker_count; ++i) {
+        if (thrd_create(&pool->workers[i].thread, pool_worker_run, &pool->workers[i]) != thrd_success)
+            QUIT_WITH_FATAL_MSG("Failed to start pool worker %d", i);
+    }
+}
+
+void pool_submit(Pool *pool, int worker, PoolTaskFunction function, void *arg) {
+    // Counted before the submitting task finishes, so pending can't reach 0 meanwhile
+    atomic_fetch_add(&pool->pending, 1);
+    if (pool_queue(pool, worker, (PoolTask){function, arg})) return;
+
+    function(pool, worker, arg);
+    pool_finish(pool);
+}
+
+void pool_hold(Pool *pool) {
+    atomic_fetch_add(&pool->pending, 1);
+}
+
+void pool_release(Pool *pool) {
+    pool_finish(pool);
+}
+
+void pool_join(Pool *pool) {
+    for (int i = 0; i < pool->worker_count; ++i) thrd_join(pool->workers[i].thread, NULL);
+}
+
+int pool_processor_count(void) {
+#ifdef OS_WINDOWS
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+static int pool_worker_run(void *arg) {
+    PoolWorker *worker = arg;
+    Pool *pool = worker->pool;
+
+    for (;;) {
+        PoolTask task;
+        if (pool_find_task(worker, &task)) {
+            task.function(pool, worker->index, task.arg);
+            pool_finish(pool);
+            continue;
+        }
+
+        if (pool->idle_function && pool->idle_function(pool, worker->index)) continue;
+
+        if (!atomic_load(&pool->pending)) break;
+
+        // NOTE: sleepers is incremented before checking queued and pool_queue()
+        // increments queued before checking sleepers, so a wake up is never lost
+        mtx_lock(&pool->idle_lock);
+        atomic_fetch_add(&pool->sleepers, 1);
+        while (!atomic_load(&pool->queued) && atomic_load(&pool->pending)) cnd_wait(&pool->idle, &pool->idle_lock);
+        atomic_fetch_sub(&pool->sleepers, 1);
+        mtx_unlock(&pool->idle_lock);
+    }
+
+    return 0;
+}
+
+static void pool_finish(Pool *pool) {
+    if (atomic_fetch_sub(&pool->pending, 1) == 1) {
+        mtx_lock(&pool->idle_lock);
+        cnd_broadcast(&pool->idle);
+        mtx_unlock(&pool->idle_lock);
+    }
+}
+
+static bool pool_deque_push(Pool *pool, PoolDeque *deque, PoolTask task) {
+    mtx_lock(&deque->lock);
+
+    if (deque->len == deque->capacity) {
+        PoolTask *tasks = memory_try_allocate(pool->allocator, sizeof(PoolTask) * deque->capacity * 2);
+        if (!tasks) {
+            mtx_unlock(&deque->lock);
+            return false;
+        }
+        for (size_t i = 0; i < deque->len; ++i) tasks[i] = deque->tasks[(deque->head + i) & (deque->capacity - 1)];
+
+        memory_free(pool->allocator, deque->tasks, sizeof(PoolTask) * deque->capacity);
+        deque->tasks = tasks;
+        deque->head = 0;
+        deque->capacity *= 2;
+    }
+
+    deque->tasks[(deque->head + deque->len++) & (deque->capacity - 1)] = task;
+
+    mtx_unlock(&deque->lock);
+    return true;
+}
+
+static bool pool_deque_take(PoolDeque *deque, bool newest, PoolTask *task) {
+    mtx_lock(&deque->lock);
+
+    bool found = deque->len;
+    if (found && newest) {
+        *task = deque->tasks[(deque->head + --deque->len) & (deque->capacity - 1)];
+    } else if (found) {
+        *task = deque->tasks[deque->head];
+        deque->head = (deque->head + 1) & (deque->capacity - 1);
+        deque->len--;
+    }
+
+    mtx_unlock(&deque->lock);
+    return found;
+}
+
+static bool pool_find_task(PoolWorker *worker, PoolTask *task) {
+    Pool *pool = worker->pool;
+
+    bool found = pool_deque_take(&worker->deque, true, task);
+    // Steal, starting from the next worker so that the victims are spread
+    for (int i = 1; !found && i < pool->worker_count; ++i)
+        found = pool_deque_take(&pool->workers[(worker->index + i) % pool->worker_count].deque, false, task);
+
+    if (found) atomic_fetch_sub(&pool->queued, 1);
+    return found;
+}
+
+static bool pool_queue(Pool *pool, int worker, PoolTask task) {
+    if (!pool_deque_push(pool, &pool->workers[worker].deque, task)) return false;
+    atomic_fetch_add(&pool->queued, 1);
+
+    if (atomic_load(&pool->sleepers)) {
+        mtx_lock(&pool->idle_lock);
+        cnd_signal(&pool->idle);
+        mtx_unlock(&pool->idle_lock);
+    }
+
+    return true;
+}
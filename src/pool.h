@@ -0,0 +1,156 @@
+#pragma once
+
+#include "memory.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <threads.h>
+
+typedef struct Pool Pool;
+
+/**
+ * @brief A task run by a worker of the pool.
+ *
+ * @param pool The pool running the task
+ * @param worker Index of the worker running the task
+ * @param arg Argument given when the task was submitted
+ */
+typedef void (*PoolTaskFunction)(Pool *pool, int worker, void *arg);
+
+/**
+ * @brief Called when the worker finds no task, before it goes to sleep.
+ *
+ * Lets a worker finish work it started asynchronously (see @ref pool_hold).
+ *
+ * @param pool The pool
+ * @param worker Index of the worker
+ *
+ * @return true if some work was done (the worker looks for tasks again instead of sleeping).
+ */
+typedef bool (*PoolIdleFunction)(Pool *pool, int worker);
+
+/**
+ * @struct PoolTask pool.h
+ * @brief A task waiting in a deque.
+ */
+typedef struct PoolTask {
+    PoolTaskFunction function; /**< Function to run */
+    void *arg; /**< Argument of the function */
+} PoolTask;
+
+/**
+ * @struct PoolDeque pool.h
+ * @brief Tasks of one worker (ring buffer).
+ *
+ * The owner pushes and pops at the tail (newest first), the other workers
+ * steal from the head (oldest first), which are usually the biggest tasks.
+ */
+typedef struct PoolDeque {
+    mtx_t lock; /**< Guards the deque */
+    PoolTask *tasks; /**< The ring buffer */
+    size_t head; /**< Index of the oldest task */
+    size_t len; /**< Number of tasks */
+    size_t capacity; /**< Size of the ring buffer (power of 2) */
+} PoolDeque;
+
+/**
+ * @struct PoolWorker pool.h
+ * @brief A worker thread and its tasks.
+ */
+typedef struct PoolWorker {
+    Pool *pool; /**< The pool of the worker */
+    int index; /**< Index of the worker */
+    thrd_t thread; /**< The thread */
+    PoolDeque deque; /**< Tasks of the worker */
+} PoolWorker;
+
+/**
+ * @struct Pool pool.h
+ * @brief Work-stealing pool of worker threads.
+ *
+ * Tasks submitted by a task go to the deque of its worker, idle workers steal
+ * from the others. The pool runs until every task (including the ones
+ * submitted by tasks) has finished.
+ */
+struct Pool {
+    void *context; /**< Shared by all the tasks */
+    PoolIdleFunction idle_function; /**< Called by idle workers (can be NULL) */
+    int worker_count; /**< Number of worker threads */
+    PoolWorker *workers; /**< The workers */
+    const Allocator *allocator; /**< Allocator of the workers and their deques (NULL for default allocator) */
+
+    atomic_size_t pending; /**< Tasks submitted but not finished */
+    atomic_size_t queued; /**< Tasks waiting in the deques */
+    atomic_int sleepers; /**< Workers waiting for tasks */
+    mtx_t idle_lock; /**< Guards sleeping */
+    cnd_t idle; /**< Signaled when tasks are queued or all have finished */
+};
+
+/**
+ * @brief Create the pool (threads are started by @ref pool_start).
+ *
+ * @param pool Pointer to the pool
+ * @param worker_count Number of workers (0 for number of online processors)
+ * @param context Context shared by the tasks
+ * @param allocator Allocator of the workers and their deques (NULL for default allocator)
+ *
+ * @return false if the workers could not be allocated (nothing to destroy then).
+ */
+bool pool_create(Pool *pool, int worker_count, void *context, const Allocator *allocator);
+
+/**
+ * @brief Destroy the pool (should not be running).
+ *
+ * @param pool Pointer to the pool
+ */
+void pool_destroy(Pool *pool);
+
+/**
+ * @brief Start the workers with the first task.
+ *
+ * @param pool Pointer to the pool
+ * @param function The first task
+ * @param arg Argument of the first task
+ */
+void pool_start(Pool *pool, PoolTaskFunction function, void *arg);
+
+/**
+ * @brief Submit a task (only from a task running in the pool).
+ *
+ * If the deque of the worker can't grow, the task runs right away instead.
+ *
+ * @param pool Pointer to the pool
+ * @param worker Index of the worker running the calling task
+ * @param function The task
+ * @param arg Argument of the task
+ */
+void pool_submit(Pool *pool, int worker, PoolTaskFunction function, void *arg);
+
+/**
+ * @brief Keep the pool running until @ref pool_release, for work a task started but did not finish.
+ *
+ * @param pool Pointer to the pool
+ */
+void pool_hold(Pool *pool);
+
+/**
+ * @brief Release a @ref pool_hold (only from a worker).
+ *
+ * @param pool Pointer to the pool
+ */
+void pool_release(Pool *pool);
+
+/**
+ * @brief Wait until every task has finished and stop the workers.
+ *
+ * @param pool Pointer to the pool
+ */
+void pool_join(Pool *pool);
+
+/**
+ * @brief Get the number of online processors.
+ *
+ * @return Number of processors (at least 1).
+ */
+int pool_processor_count(void);
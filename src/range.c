@@ -1,10 +1,29 @@
 #include "range.h"
 
 #include "memory.h"
-#include "utils.h"
 
 #include <string.h>
 
+/**
+ * @struct CaseFold
+ * @brief Upper case letters [start, end] whose lower case letters are at [start + delta, end + delta].
+ */
+typedef struct CaseFold {
+    unsigned int start;
+    unsigned int end;
+    unsigned int delta;
+} CaseFold;
+
+static const CaseFold case_folds[] = {
+    {'A', 'Z', 0x20},
+    {0xC0, 0xD6, 0x20}, // À-Ö
+    {0xD8, 0xDE, 0x20}, // Ø-Þ
+    {0x391, 0x3A1, 0x20}, // Α-Ρ
+    {0x3A3, 0x3AB, 0x20}, // Σ-Ϋ
+    {0x400, 0x40F, 0x50}, // Ѐ-Џ
+    {0x410, 0x42F, 0x20}, // А-Я
+};
+
 RangeOverlapType get_range_overlap_type(Range first, Range second) {
     if (first.end < second.start || first.start > second.end) return RANGE_OVERLAP_TYPE_NO_OVERLAP;
 
@@ -21,134 +40,87 @@ RangeOverlapType get_range_overlap_type(Range first, Range second) {
     return RANGE_OVERLAP_TYPE_NO_OVERLAP; // Should not reach here
 }
 
-Range *add_range_to_range_list(Range range, Range *range_list, int *range_list_len) {
-    int start = 0, end = 0;
-    RangeOverlapType start_type = RANGE_OVERLAP_TYPE_NO_OVERLAP;
-    for (start = 0; start < *range_list_len; ++start) {
-        start_type = get_range_overlap_type(range, range_list[start]);
-        if (start_type != RANGE_OVERLAP_TYPE_NO_OVERLAP) break;
-    }
-    RangeOverlapType end_type = start_type;
+Range *add_range_to_range_list(Range range, Range *range_list, int *range_list_len, const Allocator *allocator) {
+    // Ranges in [start, end) overlap with the given range
+    int start = 0;
+    while (start < *range_list_len && range_list[start].end < range.start) start++;
 
-    for (end = start; end < *range_list_len; ++end) {
-        RangeOverlapType type = get_range_overlap_type(range, range_list[end]);
-        if (type == RANGE_OVERLAP_TYPE_NO_OVERLAP) {
-            end--;
-            break;
-        }
-        end_type = type;
-    }
+    int end = start;
+    while (end < *range_list_len && range_list[end].start <= range.end) end++;
 
-    switch (start_type) {
-        case RANGE_OVERLAP_TYPE_NO_OVERLAP:
-            goto no_overlap;
-        case RANGE_OVERLAP_TYPE_ENCLOSES_START:
-            range_list[start].start = range.start;
-            return range_list;
-        case RANGE_OVERLAP_TYPE_ENCLOSES_COMPLETELY:
-            range_list[start].start = range.start;
-            break;
-        case RANGE_OVERLAP_TYPE_ENCLOSES_END:
-            break;
-        case RANGE_OVERLAP_TYPE_ENCLOSED:
-            return range_list;
+    if (start == end) {
+        range_list = memory_reallocate(allocator, range_list, *range_list_len * sizeof(Range), (*range_list_len + 1) * sizeof(Range));
+        memmove(&range_list[start + 1], &range_list[start], (*range_list_len - start) * sizeof(Range));
+        range_list[start] = range;
+        (*range_list_len)++;
+        return range_list;
     }
 
-    switch (end_type) {
-        case RANGE_OVERLAP_TYPE_ENCLOSES_START:
-            range_list[start].end = range_list[end].end;
-            break;
-        case RANGE_OVERLAP_TYPE_ENCLOSES_COMPLETELY:
-            range_list[start].end = range.end;
-            break;
-        case RANGE_OVERLAP_TYPE_ENCLOSES_END:
-        case RANGE_OVERLAP_TYPE_NO_OVERLAP:
-        case RANGE_OVERLAP_TYPE_ENCLOSED:
-            SHOULD_NOT_REACH_HERE;
-    }
+    // Merge all the overlapping ranges into the first one
+    if (range_list[start].start < range.start) range.start = range_list[start].start;
+    if (range_list[end - 1].end > range.end) range.end = range_list[end - 1].end;
+    range_list[start] = range;
 
-    int new_size = *range_list_len - (end - start);
-    memmove(&range_list[start + 1], &range_list[end + 1], (*range_list_len - end) * sizeof(Range));
-    range_list = memory_reallocate(range_list, new_size * sizeof(Range));
+    int new_size = *range_list_len - (end - start - 1);
+    memmove(&range_list[start + 1], &range_list[end], (*range_list_len - end) * sizeof(Range));
+    range_list = memory_reallocate(allocator, range_list, *range_list_len * sizeof(Range), new_size * sizeof(Range));
     *range_list_len = new_size;
 
     return range_list;
+}
 
-no_overlap:
-    range_list = memory_reallocate(range_list, (*range_list_len + 1) * sizeof(Range));
-    int i;
-    for (i = 0; i < *range_list_len; ++i)
-        if (range_list[i].start > range.start)
-            break;
+Range *remove_range_from_range_list(Range range, Range *range_list, int *range_list_len, const Allocator *allocator) {
+    // Ranges in [start, end) overlap with the given range
+    int start = 0;
+    while (start < *range_list_len && range_list[start].end < range.start) start++;
 
-    memmove(&range_list[i + 1], &range_list[i], (*range_list_len - i) * sizeof(Range));
-    (*range_list_len)++;
-    range_list[i] = range;
+    int end = start;
+    while (end < *range_list_len && range_list[end].start <= range.end) end++;
 
-    return range_list;
-}
-
-Range *remove_range_from_range_list(Range range, Range *range_list, int *range_list_len) {
-    int start = 0, end = 0;
-    RangeOverlapType start_type = RANGE_OVERLAP_TYPE_NO_OVERLAP;
-    for (start = 0; start < *range_list_len; ++start) {
-        start_type = get_range_overlap_type(range, range_list[start]);
-        if (start_type != RANGE_OVERLAP_TYPE_NO_OVERLAP) break;
-    }
-    RangeOverlapType end_type = start_type;
+    if (start == end) return range_list;
 
-    for (end = start; end < *range_list_len; ++end) {
-        RangeOverlapType type = get_range_overlap_type(range, range_list[end]);
-        if (type == RANGE_OVERLAP_TYPE_NO_OVERLAP) {
-            end--;
-            break;
-        }
-        end_type = type;
-    }
+    // Parts of the first and last overlapping ranges which are left after removing
+    Range pieces[2];
+    int piece_count = 0;
+    if (range_list[start].start < range.start)
+        pieces[piece_count++] = (Range){range_list[start].start, range.start - 1};
+    if (range_list[end - 1].end > range.end)
+        pieces[piece_count++] = (Range){range.end + 1, range_list[end - 1].end};
 
-    int remove_from;
-    switch (start_type) {
-        case RANGE_OVERLAP_TYPE_NO_OVERLAP:
-            return range_list;
-        case RANGE_OVERLAP_TYPE_ENCLOSES_START:
-            range_list[start].start = range.end;
-            return range_list;
-        case RANGE_OVERLAP_TYPE_ENCLOSES_COMPLETELY:
-            remove_from = start;
-            break;
-        case RANGE_OVERLAP_TYPE_ENCLOSES_END:
-            range_list[start].end = range.start - 1;
-            remove_from = start + 1;
-            break;
-        case RANGE_OVERLAP_TYPE_ENCLOSED:
-            range_list = memory_reallocate(range_list, (*range_list_len + 1) * sizeof(Range));
-            memmove(&range_list[start + 2], &range_list[start + 1], (*range_list_len - (start + 1)) * sizeof(Range));
-            range_list[start + 1] = (Range){.start = range.end + 1, .end = range_list[start].end};
-            range_list[start].end = range.start - 1;
-            (*range_list_len)++;
-            return range_list;
-    }
+    int new_size = *range_list_len - (end - start) + piece_count;
+    if (new_size > *range_list_len)
+        range_list = memory_reallocate(allocator, range_list, *range_list_len * sizeof(Range), new_size * sizeof(Range));
 
-    int remove_till;
-    switch (end_type) {
-        case RANGE_OVERLAP_TYPE_ENCLOSES_START:
-            range_list[end].start = range.end + 1;
-            remove_till = end;
-            break;
-        case RANGE_OVERLAP_TYPE_ENCLOSES_COMPLETELY:
-            remove_till = end + 1;
-            break;
-        case RANGE_OVERLAP_TYPE_ENCLOSES_END:
-        case RANGE_OVERLAP_TYPE_NO_OVERLAP:
-        case RANGE_OVERLAP_TYPE_ENCLOSED:
-            SHOULD_NOT_REACH_HERE;
-    }
+    memmove(&range_list[start + piece_count], &range_list[end], (*range_list_len - end) * sizeof(Range));
+    for (int i = 0; i < piece_count; ++i) range_list[start + i] = pieces[i];
 
-    int new_size = *range_list_len - (remove_till - remove_from);
-    memmove(&range_list[remove_from], &range_list[remove_till], (*range_list_len - remove_till) * sizeof(Range));
-    range_list = memory_reallocate(range_list, new_size);
+    if (new_size < *range_list_len)
+        range_list = memory_reallocate(allocator, range_list, *range_list_len * sizeof(Range), new_size * sizeof(Range));
     *range_list_len = new_size;
 
     return range_list;
 }
 
+int get_case_folded_ranges(Range range, unsigned int last, Range *folded) {
+    int len = 0;
+    for (size_t i = 0; i < sizeof(case_folds) / sizeof(case_folds[0]); ++i) {
+        const CaseFold *fold = &case_folds[i];
+        if (fold->end + fold->delta > last) continue;
+
+        // Upper case part of the range to lower case
+        if (range.start <= fold->end && range.end >= fold->start) {
+            unsigned int start = range.start > fold->start ? range.start : fold->start;
+            unsigned int end = range.end < fold->end ? range.end : fold->end;
+            folded[len++] = (Range){start + fold->delta, end + fold->delta};
+        }
+
+        // Lower case part of the range to upper case
+        if (range.start <= fold->end + fold->delta && range.end >= fold->start + fold->delta) {
+            unsigned int start = range.start > fold->start + fold->delta ? range.start : fold->start + fold->delta;
+            unsigned int end = range.end < fold->end + fold->delta ? range.end : fold->end + fold->delta;
+            folded[len++] = (Range){start - fold->delta, end - fold->delta};
+        }
+    }
+
+    return len;
+}
@@ -1,14 +1,21 @@
 #pragma once
 
+#include "memory.h"
+
 /**
  * @struct Range range.h
- * @brief Structure to represent the range
+ * @brief Structure to represent the range (of bytes or unicode code points)
  */
 typedef struct Range {
-    unsigned short start;
-    unsigned short end;
+    unsigned int start;
+    unsigned int end;
 } Range;
 
+/**
+ * @brief Maximum number of ranges get_case_folded_ranges() can return.
+ */
+#define RANGE_MAX_CASE_FOLDED 16
+
 /**
  * @enum RnageOverlapType
  * @brief Type of the overlap between two ranges.
@@ -40,10 +47,11 @@ RangeOverlapType get_range_overlap_type(Range first, Range second);
  * @param range The range to add
  * @param range_list The range_list array
  * @param range_list_len The lenght of range_list
+ * @param allocator The allocator used for range_list (NULL for default allocator)
  *
  * @return Range list array.
  */
-Range *add_range_to_range_list(Range range, Range *range_list, int *range_list_len);
+Range *add_range_to_range_list(Range range, Range *range_list, int *range_list_len, const Allocator *allocator);
 
 /**
  * @brief Remove the given range from the given range list (reallocates as required).
@@ -51,7 +59,22 @@ Range *add_range_to_range_list(Range range, Range *range_list, int *range_list_l
  * @param range The range to remove
  * @param range_list The range_list array
  * @param range_list_len The lenght of range_list
+ * @param allocator The allocator used for range_list (NULL for default allocator)
  *
  * @return Range list array.
  */
-Range *remove_range_from_range_list(Range range, Range *range_list, int *range_list_len);
+Range *remove_range_from_range_list(Range range, Range *range_list, int *range_list_len, const Allocator *allocator);
+
+/**
+ * @brief Get the other case of the letters in the given range.
+ *
+ * Only the simple one-to-one case mappings of ASCII, Latin-1, Greek and
+ * Cyrillic letters are folded.
+ *
+ * @param range The range
+ * @param last Letters after this character are not folded
+ * @param folded Array of at least RANGE_MAX_CASE_FOLDED ranges to store the folded ranges
+ *
+ * @return Number of folded ranges.
+ */
+int get_case_folded_ranges(Range range, unsigned int last, Range *folded);
@@ -1,10 +1,309 @@
 #include "regex.h"
 
 #include "parser.h"
+#include "compiler.h"
 #include "memory.h"
+#include "reverse.h"
+#include "dot.h"
 #include "utils.h"
 
+#include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+_Static_assert(REGEX_STATE_LABEL_SIZE >= DOT_LABEL_SIZE, "dot_state_label() writes the labels of the hot states");
+_Static_assert(REGEX_ERROR_MESSAGE_SIZE >= PARSER_ERROR_SIZE, "The errors of the parser are the messages of the regex");
+
+/**
+ * @brief Get the current time in seconds.
+ *
+ * @return Time in seconds.
+ */
+static double regex_now(void);
+
+#ifdef RE_STATS
+/**
+ * @brief Run the statement only if stats are enabled for the regex.
+ *
+ * @param regex Pointer to the regex state
+ * @param stmt Statement to update the stats
+ */
+#define REGEX_STATS(regex, stmt) do { if ((regex)->stats_enabled) { stmt; } } while (0)
+
+/**
+ * @brief Check whether the visits of the states are counted.
+ *
+ * @param regex Pointer to the regex state
+ */
+#define REGEX_PROFILING(regex) ((regex)->profile_enabled)
+
+/**
+ * @brief Search the input by simulating the nfa, counting the visits of the nfa and dfa states.
+ *
+ * @param regex Pointer to the regex state
+ * @param input The input
+ * @param len Length of the input
+ * @param end_of_line Whether the end of the input ends a line (a new line is stepped there if it isn't the last byte)
+ *
+ * @return true if input contains regex pattern.
+ */
+static bool regex_profile_match(Regex *regex, const unsigned char *input, size_t len, bool end_of_line);
+
+/**
+ * @brief Count a visit of each current nfa state.
+ *
+ * @param regex Pointer to the regex state
+ */
+static void regex_profile_count(Regex *regex);
+#else
+#define REGEX_STATS(regex, stmt)
+#define REGEX_PROFILING(regex) false
+#endif
+
+/**
+ * @brief Search the input for the pattern by simulating the nfa.
+ *
+ * @param regex Pointer to the regex state
+ * @param input The input
+ * @param len Length of the input
+ * @param end_of_line Whether the end of the input ends a line (a new line is stepped there if it isn't the last byte)
+ *
+ * @return true if input contains regex pattern.
+ */
+static bool regex_nfa_match(Regex *regex, const unsigned char *input, size_t len, bool end_of_line);
+
+/**
+ * @brief Search the input for the pattern with the dfa.
+ *
+ * @param regex Pointer to the regex state
+ * @param input The input
+ * @param len Length of the input
+ * @param end_of_line Whether the end of the input ends a line (a new line is stepped there if it isn't the last byte)
+ * @param start The start state (see @ref dfa_start_at)
+ *
+ * @return true if input contains regex pattern.
+ */
+static bool regex_dfa_match(Regex *regex, const unsigned char *input, size_t len, bool end_of_line, int start);
+
+/**
+ * @brief Search the input for the pattern with the position automaton (bit-parallel).
+ *
+ * @param regex Pointer to the regex state
+ * @param input The input
+ * @param len Length of the input
+ * @param end_of_line Whether the end of the input ends a line (a new line is stepped there if it isn't the last byte)
+ *
+ * @return true if input contains regex pattern.
+ */
+static bool regex_shift_and_match(Regex *regex, const unsigned char *input, size_t len, bool end_of_line);
+
+/**
+ * @brief Search the input for the pattern with the dfa of the reversed pattern, from the end of the input.
+ *
+ * @param regex Pointer to the regex state
+ * @param input The input (without new line before its end, ending a line)
+ * @param len Length of the input
+ *
+ * @return true if input contains regex pattern.
+ */
+static bool regex_reverse_dfa_match(Regex *regex, const unsigned char *input, size_t len);
+
+/**
+ * @brief Search the input for the pattern with the fastest engine available.
+ *
+ * @param regex Pointer to the regex state
+ * @param input The input
+ * @param len Length of the input
+ * @param end_of_line Whether the end of the input ends a line (a new line is stepped there if it isn't the last byte)
+ *
+ * @return true if input contains regex pattern.
+ */
+static bool regex_match(Regex *regex, const unsigned char *input, size_t len, bool end_of_line);
+
+/**
+ * @brief Find the first line with a match with the dfa of a multi-line regex, which restarts after each new line.
+ *
+ * @param regex Pointer to the regex state
+ * @param input The input
+ * @param from Offset of the line to start at
+ * @param len Length of the input
+ * @param end_of_line Whether the end of the input ends a line
+ * @param at Pointer to store the offset of a byte of the line (the last one of the match, or the one after it)
+ *
+ * @return false if no line matches.
+ */
+static bool regex_dfa_find_line(Regex *regex, const unsigned char *input, size_t from, size_t len, bool end_of_line,
+    size_t *at);
+
+/**
+ * @brief Find the first line with a match by simulating the nfa of a multi-line regex, like regex_dfa_find_line().
+ *
+ * @param regex Pointer to the regex state
+ * @param input The input
+ * @param from Offset of the line to start at
+ * @param len Length of the input
+ * @param end_of_line Whether the end of the input ends a line
+ * @param at Pointer to store the offset of a byte of the line (the last one of the match, or the one after it)
+ *
+ * @return false if no line matches.
+ */
+static bool regex_nfa_find_line(Regex *regex, const unsigned char *input, size_t from, size_t len, bool end_of_line,
+    size_t *at);
+
+/**
+ * @brief Get the length of the text of the input, without the new line ending it.
+ *
+ * @param input The input
+ * @param len Length of the input
+ * @param end_of_line Whether the end of the input ends a line
+ *
+ * @return len, or len - 1 if the input ends a line with a new line.
+ */
+static size_t regex_text_len(const unsigned char *input, size_t len, bool end_of_line);
+
+/**
+ * @brief Put the nfa in its start states, at a position of the input.
+ *
+ * @param regex Pointer to the regex state
+ * @param before What is before the position
+ */
+static void regex_start_at(Regex *regex, Side before);
+
+/**
+ * @brief Follow the assertions waiting in the current states, now that the byte after the position is known.
+ *
+ * @param regex Pointer to the regex state
+ * @param after What is after the position
+ * @param starts Whether the current states have starts (see regex_find_add_state())
+ */
+static void regex_resolve(Regex *regex, Side after, bool starts);
+
+/**
+ * @brief Step the nfa over the end of the text (see regex_text_len()), and the new line ending the line.
+ *
+ * @param regex Pointer to the regex state
+ * @param new_line Whether the input ends a line
+ *
+ * @return true if the nfa matched.
+ */
+static bool regex_nfa_end(Regex *regex, bool new_line);
+
+/**
+ * @brief Remove the states going back to the start (see state_is_restart()) from the current states.
+ *
+ * @param regex Pointer to regex state
+ */
+static void regex_drop_restarts(Regex *regex);
+
+/**
+ * @brief Compile the regex (see @ref regex_compile), sharing its nfa states through the interner.
+ *
+ * @param regex Pointer to the regex state
+ * @param re The regex string
+ * @param options The options (NULL for defaults)
+ * @param interner The interner (NULL to own the states)
+ *
+ * @return REGEX_OK, or why the regex failed to compile.
+ */
+static RegexError regex_build(Regex *regex, const char *re, const RegexOptions *options, CompilerInterner *interner);
+
+/**
+ * @brief Keep only the error in the regex (whatever it owned is already freed).
+ *
+ * @param regex Pointer to the regex state
+ * @param error The error
+ * @param format The format of the message
+ * @param ... Arguments to the format
+ *
+ * @return The error.
+ */
+static RegexError regex_fail(Regex *regex, RegexError error, const char *format, ...);
+
+/**
+ * @brief Build the dfa of the reversed pattern if every match has to end at the end of the line.
+ *
+ * @param regex Pointer to the regex state
+ * @param max_states Maximum number of dfa states
+ * @param max_bytes Maximum bytes of its table
+ */
+static void regex_create_reverse_dfa(Regex *regex, int max_states, size_t max_bytes);
+
+/**
+ * @brief Build the position automaton if the pattern has at most GLUSHKOV_MAX_POSITIONS positions.
+ *
+ * @param regex Pointer to the regex state
+ * @param max_bytes Maximum bytes of its tables
+ */
+static void regex_create_glushkov(Regex *regex, size_t max_bytes);
+
+/**
+ * @brief Start a call matching an input: no step taken yet, and the deadline counts from now.
+ *
+ * @param regex Pointer to the regex state
+ */
+static void regex_limits_start(Regex *regex);
+
+/**
+ * @brief Check the limits before stepping the input from the offset, and cut the run to a window.
+ *
+ * The bytes of the window are taken from the step budget before they are
+ * stepped, so a run stops exactly at the budget.
+ *
+ * @param regex Pointer to the regex state
+ * @param from Offset stepping continues at (or number of bytes stepped backwards)
+ * @param stop Pointer to the offset the run would stop at, brought down to the end of the window
+ * @param window Most bytes of the window
+ *
+ * @return false if a limit is hit (the error of the regex tells which).
+ */
+static inline bool regex_limit(Regex *regex, size_t from, size_t *stop, size_t window);
+
+/**
+ * @brief Check the limits of a limited regex (see regex_limit()).
+ *
+ * @param regex Pointer to the regex state
+ * @param from Offset stepping continues at
+ * @param stop Pointer to the offset the run would stop at
+ * @param window Most bytes of the window
+ *
+ * @return false if a limit is hit.
+ */
+static bool regex_check_limits(Regex *regex, size_t from, size_t *stop, size_t window);
+
+/**
+ * @brief Find the leftmost-longest match starting at or after the offset (see @ref regex_find_bytes).
+ *
+ * @param regex Pointer to the regex state
+ * @param input The bytes
+ * @param len Number of bytes
+ * @param from Offset to start looking at
+ * @param flags Combination of @ref RegexMatchFlag
+ * @param span Pointer to store the match
+ *
+ * @return false if there is no match (or a limit is hit).
+ */
+static bool regex_find_from(Regex *regex, const unsigned char *input, size_t len, size_t from, int flags, RegexSpan *span);
+
+/**
+ * @brief Get the next match of the iterator (see @ref regex_iterator_next), within the limits of the current call.
+ *
+ * @param iterator Pointer to the iterator
+ * @param span Pointer to store the match
+ *
+ * @return false if there are no more matches.
+ */
+static bool regex_iterator_find(RegexIterator *iterator, RegexSpan *span);
+
+/**
+ * @brief Match the inputs with the dfa, advancing groups of REGEX_BATCH_LANES inputs in lock-step.
+ *
+ * @param regex Pointer to the regex state
+ * @param inputs The inputs
+ * @param count Number of inputs
+ * @param results The result bitmap (zeroed)
+ */
+static void regex_dfa_match_batch(Regex *regex, const RegexInput *inputs, size_t count, uint64_t *results);
 
 /**
  * @brief Add given state to set of new states.
@@ -14,6 +313,85 @@
  */
 static void regex_add_state_to_new_states(Regex *regex, State *state);
 
+/**
+ * @brief Add given state to set of new states, remembering where its match started.
+ *
+ * @param regex Pointer to regex state
+ * @param state Pointer to state to add
+ * @param start Offset where the match started (kept if the state is already in the set)
+ */
+static void regex_find_add_state(Regex *regex, State *state, size_t start);
+
+/**
+ * @brief Add given state to set of new states like regex_find_add_state(), following the assertions that hold.
+ *
+ * The assertions are states of their own in regex_add_state_to_new_states()
+ * and regex_find_add_state(), they wait in the set for the byte after the
+ * position. Following them there would make the closure of every state of
+ * every regex slower.
+ *
+ * @param regex Pointer to regex state
+ * @param state Pointer to state to add
+ * @param start Offset where the match started (kept if the state is already in the set)
+ * @param after What is after the position
+ */
+static void regex_resolve_add_state(Regex *regex, State *state, size_t start, Side after);
+
+/**
+ * @brief Find the bytes that can start a match (see first_bytes of Regex).
+ *
+ * @param regex Pointer to the regex state
+ */
+static void regex_find_first_bytes(Regex *regex);
+
+/**
+ * @brief Make sure the buffer has room for more bytes and the NUL.
+ *
+ * @param buffer Pointer to the buffer
+ * @param len Number of bytes that will be appended
+ */
+static void regex_buffer_reserve(RegexBuffer *buffer, size_t len);
+
+/**
+ * @brief Append the bytes to the buffer.
+ *
+ * @param buffer Pointer to the buffer
+ * @param data The bytes
+ * @param len Number of bytes
+ */
+static void regex_buffer_append(RegexBuffer *buffer, const char *data, size_t len);
+
+/**
+ * @brief Check that the replacement template has no invalid or unsupported '$' sequence.
+ *
+ * @param regex Pointer to the regex state, its error is set if the template is rejected
+ * @param template The template
+ *
+ * @return false if the template is rejected.
+ */
+static bool regex_template_check(Regex *regex, const char *template);
+
+/**
+ * @brief Append the template to the buffer, substituting the match.
+ *
+ * @param buffer Pointer to the buffer
+ * @param template The template (checked by regex_template_check())
+ * @param template_len Length of the template
+ * @param match The matched text
+ * @param match_len Length of the matched text
+ */
+static void regex_buffer_append_template(RegexBuffer *buffer, const char *template, size_t template_len,
+    const char *match, size_t match_len);
+
+/**
+ * @brief Check whether the machine is currently in accepting state.
+ *
+ * @param regex Pointer to regex state
+ *
+ * @return true if the match state is one of the current states.
+ */
+static bool regex_is_matching(const Regex *regex);
+
 /**
  * @brief Swap the current states set and new states set.
  *
@@ -40,41 +418,99 @@ static void regex_collect_states(Regex *regex, State *state);
 static bool regex_collect_states_helper(Regex *regex, State *state);
 
 void regex_create(Regex *regex, const char *re) {
-    *regex = (Regex){0};
-
-    // Parse (compile) the regex and generate the nfa.
-    Parser parser;
-    parser_create(&parser, re);
-
-    regex->start = parser_parse(&parser);
-    regex->total_states = parser.total_states;
-
-    parser_destroy(&parser);
+    regex_create_with_options(regex, re, NULL);
+}
 
-    // At max automata might be in all the states nfa.
-    regex->cur_states = (State **)memory_allocate(sizeof(State *) * regex->total_states);
-    regex->new_states = (State **)memory_allocate(sizeof(State *) * regex->total_states);
+void regex_create_with_options(Regex *regex, const char *re, const RegexOptions *options) {
+    regex_create_interned(regex, re, options, NULL);
+}
 
-    regex_reset(regex);
+RegexError regex_compile(Regex *regex, const char *re, const RegexOptions *options) {
+    return regex_build(regex, re, options, NULL);
 }
 
+void regex_create_interned(Regex *regex, const char *re, const RegexOptions *options, CompilerInterner *interner) {
+    if (regex_build(regex, re, options, interner)) QUIT_WITH_FATAL_MSG("%s", regex->error_message);
+}
 
 void regex_destroy(Regex *regex) {
-    // Collect and destroy all states
+    // Nothing is kept from a regex that failed to compile
+    if (!regex->start) return;
+
+    // Collect and destroy all states, unless the interner owns them
     regex->cur_states_len = 0;
     regex->new_states_len = 0;
 
-    regex_collect_states(regex, regex->start);
+    if (!regex->shared_states) {
+        regex_collect_states(regex, regex->start);
+
+        if (regex->new_states_len != regex->total_states) LOG_ERROR("Not all states destroyed");
+
+        for (int i = 0; i < regex->new_states_len; ++i) state_destroy(&regex->allocator, regex->new_states[i]);
+    }
+
+    memory_free(&regex->allocator, regex->cur_states, sizeof(State *) * regex->total_states);
+    memory_free(&regex->allocator, regex->new_states, sizeof(State *) * regex->total_states);
+    memory_free(&regex->allocator, regex->cur_starts, sizeof(size_t) * regex->total_states);
+    memory_free(&regex->allocator, regex->new_starts, sizeof(size_t) * regex->total_states);
+    memory_free(&regex->allocator, regex->entries, sizeof(RegexEntry) * regex->entry_count);
+
+#ifdef RE_STATS
+    if (regex->nfa_visits)
+        memory_free(&regex->allocator, regex->nfa_visits, sizeof(unsigned long long) * regex->index_count);
+    if (regex->dfa_visits)
+        memory_free(&regex->allocator, regex->dfa_visits, sizeof(unsigned long long) * regex->dfa.state_count);
+#endif
 
-    if (regex->new_states_len != regex->total_states) LOG_ERROR("Not all states destroyed");
+    if (regex->use_dfa) dfa_destroy(&regex->dfa, &regex->allocator);
+    if (regex->use_reverse_dfa) dfa_destroy(&regex->reverse_dfa, &regex->allocator);
+    if (regex->use_shift_and) glushkov_destroy(&regex->glushkov, &regex->allocator);
+}
+
+void regex_set_limits(Regex *regex, const RegexLimits *limits) {
+    regex->limits = limits ? *limits : (RegexLimits){0};
+    regex->limited = regex->limits.step_budget || regex->limits.time_limit > 0 || regex->limits.cancel;
+    regex->error = REGEX_OK;
+}
 
-    for (int i = 0; i < regex->new_states_len; ++i) state_destroy(regex->new_states[i]);
+const char *regex_error_string(RegexError error) {
+    switch (error) {
+        case REGEX_OK:
+            return "No error";
+        case REGEX_ERROR_SYNTAX:
+            return "Invalid regex";
+        case REGEX_ERROR_TOO_MANY_STATES:
+            return "Too many nfa states";
+        case REGEX_ERROR_TOO_MUCH_MEMORY:
+            return "Too much memory";
+        case REGEX_ERROR_STEP_BUDGET:
+            return "Step budget exhausted";
+        case REGEX_ERROR_DEADLINE:
+            return "Deadline passed";
+        case REGEX_ERROR_CANCELLED:
+            return "Cancelled";
+        case REGEX_ERROR_UNSUPPORTED:
+            return "Unsupported regex";
+        case REGEX_ERROR_OUT_OF_MEMORY:
+            return "Out of memory";
+    }
 
-    memory_free(regex->cur_states);
-    memory_free(regex->new_states);
+    return "Unknown error";
 }
 
-bool regex_step(Regex *regex, char input) {
+bool regex_step(Regex *regex, unsigned char input) {
+    REGEX_STATS(regex,
+        regex->stats.bytes_scanned++;
+        regex->stats.nfa_steps++;
+        regex->stats.active_states_total += regex->cur_states_len;
+        if (regex->cur_states_len > regex->stats.active_states_max) regex->stats.active_states_max = regex->cur_states_len);
+
+    // The assertions waiting at this position see the byte first
+    if (regex->assertions) {
+        regex_resolve(regex, state_side_of(input), false);
+        regex->before = state_side_of(input);
+    }
+
     for (int i = 0; i < regex->cur_states_len; ++i) {
         switch (regex->cur_states[i]->c) {
             case MATCH:
@@ -95,67 +531,1024 @@ bool regex_step(Regex *regex, char input) {
 
     regex_swap_cur_and_new(regex);
 
-    // Check whether the machine is currently in accepting state
-    if (regex->match && (regex->match->id < regex->cur_states_len) && (regex->match == regex->cur_states[regex->match->id]))
-        return true;
-    else return false;
+    return regex_is_matching(regex);
 }
 
 void regex_reset(Regex *regex) {
-    regex->cur_states_len = 0;
-    regex->new_states_len = 0;
-
-    regex_add_state_to_new_states(regex, regex->start);
-    regex_swap_cur_and_new(regex);
+    regex_start_at(regex, SIDE_EDGE);
 }
 
 bool regex_pattern_in_line(Regex *regex, const char *line) {
-    regex_reset(regex);
-    bool matched = false;
-    int i;
-    for (i = 0; line[i]; ++i) matched = regex_step(regex, line[i]);
-    // Add new line at the end of each line, if they aren't there
-    if (line[i - 1] != '\n') matched = regex_step(regex, '\n');
-    return matched;
+    return regex_match_bytes(regex, (const uint8_t *)line, strlen(line), REGEX_MATCH_EOL);
 }
 
-static void regex_add_state_to_new_states(Regex *regex, State *state) {
-    switch (state->c) {
-        case BRANCH:
-            regex_add_state_to_new_states(regex, state->out1);
-            /* fallthrough */
-        case EPSILON:
-            regex_add_state_to_new_states(regex, state->out);
-            return;
-        case MATCH:
-            // NOTE: Thompson's nfa has exactly one accepting state
-            regex->match = state;
-            break;
-    }
+bool regex_match_bytes(Regex *regex, const uint8_t *buf, size_t len, int flags) {
+#ifdef RE_STATS
+    double start = regex->stats_enabled ? regex_now() : 0;
+#endif
 
-    if (state->id < regex->new_states_len && regex->new_states[state->id] == state) return;
+    regex_limits_start(regex);
+    bool matched = regex_match(regex, buf, len, flags & REGEX_MATCH_EOL);
 
-    state->id = regex->new_states_len;
-    regex->new_states[regex->new_states_len++] = state;
+    REGEX_STATS(regex,
+        regex->stats.lines++;
+        regex->stats.matched_lines += matched;
+        regex->stats.match_seconds += regex_now() - start);
+
+    return matched;
 }
 
-static void regex_swap_cur_and_new(Regex *regex) {
-    State **temp = regex->new_states;
-    regex->new_states = regex->cur_states;
-    regex->cur_states = temp;
+void regex_match_batch(Regex *regex, const RegexInput *inputs, size_t count, uint64_t *results) {
+#ifdef RE_STATS
+    double start = regex->stats_enabled ? regex_now() : 0;
+#endif
 
-    regex->cur_states_len = regex->new_states_len;
-    regex->new_states_len = 0;
-}
+    memset(results, 0, sizeof(uint64_t) * ((count + 63) / 64));
+    regex_limits_start(regex);
 
-static void regex_collect_states(Regex *regex, State *state) {
-    if (!regex_collect_states_helper(regex, state)) {
-        if (state->out) regex_collect_states(regex, state->out);
-        if (state->out1) regex_collect_states(regex, state->out1);
+    // Matching backwards usually reads only a few bytes of each input, nothing to overlap
+    if (regex->use_dfa && !regex->use_reverse_dfa && !REGEX_PROFILING(regex)) {
+        regex_dfa_match_batch(regex, inputs, count, results);
+    } else {
+        for (size_t i = 0; i < count && !regex->error; ++i) {
+            if (regex_match(regex, (const unsigned char *)inputs[i].data, inputs[i].len, true))
+                results[i / 64] |= (uint64_t)1 << (i % 64);
+        }
     }
+
+    REGEX_STATS(regex,
+        regex->stats.lines += count;
+        for (size_t i = 0; i < (count + 63) / 64; ++i)
+            for (uint64_t word = results[i]; word; word &= word - 1) regex->stats.matched_lines++;
+        regex->stats.match_seconds += regex_now() - start);
 }
 
-static bool regex_collect_states_helper(Regex *regex, State *state) {
+bool regex_find(Regex *regex, const char *data, size_t len, size_t from, RegexSpan *span) {
+    return regex_find_bytes(regex, (const uint8_t *)data, len, from, REGEX_MATCH_EOL, span);
+}
+
+bool regex_find_bytes(Regex *regex, const uint8_t *buf, size_t len, size_t from, int flags, RegexSpan *span) {
+    regex_limits_start(regex);
+    return regex_find_from(regex, buf, len, from, flags, span);
+}
+
+void regex_iterator_create(RegexIterator *iterator, Regex *regex, const char *data, size_t len) {
+    regex_iterator_create_bytes(iterator, regex, (const uint8_t *)data, len, REGEX_MATCH_EOL);
+}
+
+void regex_iterator_create_bytes(RegexIterator *iterator, Regex *regex, const uint8_t *buf, size_t len, int flags) {
+    *iterator = (RegexIterator){
+        .regex = regex,
+        .data = (const char *)buf,
+        .len = len,
+        .previous_end = SIZE_MAX,
+        .flags = flags,
+    };
+}
+
+bool regex_iterator_next(RegexIterator *iterator, RegexSpan *span) {
+    regex_limits_start(iterator->regex);
+    return regex_iterator_find(iterator, span);
+}
+
+bool regex_iterator_next_line(RegexIterator *iterator, RegexLine *line) {
+    Regex *regex = iterator->regex;
+    const unsigned char *input = (const unsigned char *)iterator->data;
+    size_t len = iterator->len;
+    bool end_of_line = iterator->flags & REGEX_MATCH_EOL;
+
+    regex_limits_start(regex);
+    while (!iterator->done && iterator->from < len) {
+        size_t start = iterator->from, end;
+
+        // The reverse dfa reads only the end of each line, then cutting the lines is faster.
+        // The assertions see the whole input, the nfa runs over it too rather than over each line.
+        bool dfa_pass = regex->use_dfa && !regex->use_reverse_dfa && !REGEX_PROFILING(regex);
+        if (regex->multiline && (dfa_pass || regex->assertions)) {
+            size_t at;
+            if (dfa_pass ? !regex_dfa_find_line(regex, input, start, len, end_of_line, &at)
+                : !regex_nfa_find_line(regex, input, start, len, end_of_line, &at)) break;
+
+            // Count the lines before the one around the last byte of the match
+            for (const unsigned char *new_line; (new_line = memchr(input + start, '\n', at - start));) {
+                start = (size_t)(new_line - input) + 1;
+                iterator->line_count++;
+            }
+            const unsigned char *new_line = at < len ? memchr(input + at, '\n', len - at) : NULL;
+            end = new_line ? (size_t)(new_line - input) : len;
+        } else {
+            const unsigned char *new_line = memchr(input + start, '\n', len - start);
+            end = new_line ? (size_t)(new_line - input) : len;
+            if (!regex_match(regex, input + start, end - start, new_line || end_of_line)) {
+                if (regex->error) break;
+                iterator->from = end + 1;
+                iterator->line_count++;
+                continue;
+            }
+        }
+
+        *line = (RegexLine){iterator->line_count + 1, start, end};
+
+        iterator->from = end + 1;
+        iterator->line_count++;
+        return true;
+    }
+
+    iterator->done = true;
+    return false;
+}
+
+size_t regex_split(Regex *regex, const char *data, size_t len, RegexSpan *fields, size_t max_fields) {
+    RegexIterator iterator;
+    regex_iterator_create(&iterator, regex, data, len);
+    regex_limits_start(regex);
+
+    size_t count = 0, start = 0;
+    RegexSpan span;
+    while (count + 1 < max_fields && regex_iterator_find(&iterator, &span)) {
+        fields[count++] = (RegexSpan){start, span.start};
+        start = span.end;
+    }
+    fields[count++] = (RegexSpan){start, len};
+
+    return count;
+}
+
+RegexError regex_replace_all(Regex *regex, const char *data, size_t len, const char *template, RegexBuffer *out,
+    size_t *count) {
+    *count = 0;
+    regex->error = REGEX_OK;
+    if (!regex_template_check(regex, template)) return regex->error;
+    size_t template_len = strlen(template);
+
+    RegexIterator iterator;
+    regex_iterator_create(&iterator, regex, data, len);
+    regex_limits_start(regex);
+
+    size_t copied = 0;
+    RegexSpan span;
+    while (regex_iterator_find(&iterator, &span)) {
+        regex_buffer_append(out, data + copied, span.start - copied);
+        regex_buffer_append_template(out, template, template_len, data + span.start, span.end - span.start);
+        copied = span.end;
+        (*count)++;
+    }
+    regex_buffer_append(out, data + copied, len - copied);
+
+    return regex->error;
+}
+
+void regex_buffer_create(RegexBuffer *buffer, const Allocator *allocator) {
+    *buffer = (RegexBuffer){.allocator = allocator};
+}
+
+void regex_buffer_destroy(RegexBuffer *buffer) {
+    memory_free(buffer->allocator, buffer->data, buffer->capacity);
+    *buffer = (RegexBuffer){0};
+}
+
+void regex_get_memory_report(const Regex *regex, MemoryReport *report) {
+    *report = regex->memory;
+}
+
+void regex_enable_stats(Regex *regex, bool enable) {
+#ifdef RE_STATS
+    regex->stats_enabled = enable;
+#else
+    (void)regex;
+    (void)enable;
+#endif
+}
+
+bool regex_get_stats(const Regex *regex, RegexStats *stats) {
+#ifdef RE_STATS
+    *stats = regex->stats;
+    if (stats->nfa_steps) stats->active_states_avg = (double)stats->active_states_total / stats->nfa_steps;
+    stats->dfa_states = regex->use_dfa ? regex->dfa.state_count : 0;
+    stats->dfa_accelerated_states = regex->use_dfa ? regex->dfa.accel_count : 0;
+    stats->shift_and_positions = regex->use_shift_and ? regex->glushkov.position_count : 0;
+    return true;
+#else
+    (void)regex;
+    *stats = (RegexStats){0};
+    return false;
+#endif
+}
+
+void regex_reset_stats(Regex *regex) {
+#ifdef RE_STATS
+    double compile_seconds = regex->stats.compile_seconds;
+    regex->stats = (RegexStats){0};
+    regex->stats.compile_seconds = compile_seconds;
+
+    if (regex->nfa_visits) memset(regex->nfa_visits, 0, sizeof(unsigned long long) * regex->index_count);
+    if (regex->dfa_visits) memset(regex->dfa_visits, 0, sizeof(unsigned long long) * regex->dfa.state_count);
+#else
+    (void)regex;
+#endif
+}
+
+bool regex_enable_profile(Regex *regex, bool enable) {
+#ifdef RE_STATS
+    regex->profile_enabled = enable;
+    if (enable && !regex->nfa_visits) {
+        regex->nfa_visits = memory_allocate(&regex->allocator, sizeof(unsigned long long) * regex->index_count);
+        memset(regex->nfa_visits, 0, sizeof(unsigned long long) * regex->index_count);
+    }
+    if (enable && regex->use_dfa && !regex->dfa_visits) {
+        regex->dfa_visits = memory_allocate(&regex->allocator, sizeof(unsigned long long) * regex->dfa.state_count);
+        memset(regex->dfa_visits, 0, sizeof(unsigned long long) * regex->dfa.state_count);
+    }
+    return true;
+#else
+    (void)regex;
+    (void)enable;
+    return false;
+#endif
+}
+
+size_t regex_get_hot_states(const Regex *regex, RegexHotState *states, size_t max_states) {
+#ifdef RE_STATS
+    if (!regex->nfa_visits) return 0;
+
+    State **nfa = memory_allocate(&regex->allocator, sizeof(State *) * regex->index_count);
+    dot_index_states(regex->start, regex->total_states, regex->index_count, nfa, &regex->allocator);
+
+    // Insertion sort into the few slots asked for, the hottest first
+    size_t count = 0;
+    for (int i = 0; i < regex->index_count; ++i) {
+        unsigned long long visits = regex->nfa_visits[i];
+        if (!nfa[i] || !visits) continue;
+
+        size_t slot = count < max_states ? count++ : max_states;
+        while (slot > 0 && states[slot - 1].visits < visits) {
+            if (slot < max_states) states[slot] = states[slot - 1];
+            slot--;
+        }
+        if (slot == max_states) continue;
+
+        states[slot] = (RegexHotState){.index = i, .visits = visits};
+        dot_state_label(nfa[i], states[slot].label);
+    }
+
+    memory_free(&regex->allocator, nfa, sizeof(State *) * regex->index_count);
+    return count;
+#else
+    (void)regex;
+    (void)states;
+    (void)max_states;
+    return 0;
+#endif
+}
+
+void regex_write_dot(const Regex *regex, FILE *out) {
+    DotGraph graph = {
+        .start = regex->start,
+        .total_states = regex->total_states,
+        .index_count = regex->index_count,
+        .dfa = regex->use_dfa ? &regex->dfa : NULL,
+    };
+#ifdef RE_STATS
+    graph.nfa_visits = regex->nfa_visits;
+    graph.dfa_visits = regex->dfa_visits;
+#endif
+
+    dot_write(&graph, out, &regex->allocator);
+}
+
+static bool regex_nfa_match(Regex *regex, const unsigned char *input, size_t len, bool end_of_line) {
+    regex_reset(regex);
+    // Without the end of line, an empty input steps nothing
+    bool matched = regex_is_matching(regex);
+    // Nothing changes after matching, or once no state is left (only '^' alternatives)
+    size_t i = 0, text_len = regex_text_len(input, len, end_of_line);
+    while (i < text_len && !matched && regex->cur_states_len) {
+        size_t stop = text_len;
+        if (!regex_limit(regex, i, &stop, REGEX_LIMIT_NFA_WINDOW)) return false;
+        for (; i < stop && !matched && regex->cur_states_len; ++i) matched = regex_step(regex, input[i]);
+    }
+    if (i == text_len && !matched) matched = regex_nfa_end(regex, end_of_line);
+
+    return matched;
+}
+
+static bool regex_dfa_match(Regex *regex, const unsigned char *input, size_t len, bool end_of_line, int start) {
+    const Dfa *dfa = &regex->dfa;
+
+    // Nothing changes after reaching the dead or match state
+    size_t i = 0, text_len = regex_text_len(input, len, end_of_line);
+    int state = start;
+    while (i < text_len && !dfa_is_final(dfa, state)) {
+        size_t stop = text_len;
+        if (!regex_limit(regex, i, &stop, REGEX_LIMIT_WINDOW)) return false;
+        state = dfa_run(dfa, state, input, stop, &i);
+    }
+    // The end of the text, and the new line ending the line
+    if (!dfa_is_final(dfa, state)) {
+        state = dfa_end(dfa, state, end_of_line);
+        i += end_of_line;
+    }
+
+    REGEX_STATS(regex, regex->stats.bytes_scanned += i);
+
+    return state == dfa->match;
+}
+
+static bool regex_shift_and_match(Regex *regex, const unsigned char *input, size_t len, bool end_of_line) {
+    uint64_t set = 0;
+    size_t i = 0;
+    bool done = false;
+    while (i < len && !done) {
+        size_t stop = len;
+        if (!regex_limit(regex, i, &stop, REGEX_LIMIT_WINDOW)) return false;
+        done = glushkov_run(&regex->glushkov, &set, input, &i, stop);
+    }
+    bool matched = glushkov_end(&regex->glushkov, set, input, len, end_of_line, &i);
+
+    REGEX_STATS(regex, regex->stats.bytes_scanned += i);
+
+    return matched;
+}
+
+static bool regex_reverse_dfa_match(Regex *regex, const unsigned char *input, size_t len) {
+    const Dfa *dfa = &regex->reverse_dfa;
+    int state = dfa->start;
+
+    // The reversed pattern starts with the new line at the end of the line
+    size_t i = len;
+    if (!len || input[len - 1] != '\n') state = dfa_next(dfa, state, '\n');
+    while (i > 0 && !dfa_is_final(dfa, state)) {
+        // The windows count the bytes stepped backwards
+        size_t stop = len;
+        if (!regex_limit(regex, len - i, &stop, REGEX_LIMIT_WINDOW)) return false;
+        for (size_t low = len - stop; i > low && !dfa_is_final(dfa, state);) state = dfa_next(dfa, state, input[--i]);
+    }
+
+    REGEX_STATS(regex, regex->stats.bytes_scanned += len - i + (!len || input[len - 1] != '\n'));
+
+    return state == dfa->match;
+}
+
+static bool regex_match(Regex *regex, const unsigned char *input, size_t len, bool end_of_line) {
+#ifdef RE_STATS
+    if (REGEX_PROFILING(regex)) return regex_profile_match(regex, input, len, end_of_line);
+#endif
+
+    // A new line before the end can end a match too, then search forwards.
+    // The reversed pattern starts at the end of a line, the input must end one.
+    if (regex->use_reverse_dfa && (end_of_line || (len && input[len - 1] == '\n'))
+        && (len < 2 || !memchr(input, '\n', len - 1)))
+        return regex_reverse_dfa_match(regex, input, len);
+
+    if (regex->use_dfa) return regex_dfa_match(regex, input, len, end_of_line, regex->dfa.start);
+    return regex->use_shift_and ? regex_shift_and_match(regex, input, len, end_of_line)
+        : regex_nfa_match(regex, input, len, end_of_line);
+}
+
+static bool regex_dfa_find_line(Regex *regex, const unsigned char *input, size_t from, size_t len, bool end_of_line,
+    size_t *at) {
+    const Dfa *dfa = &regex->dfa;
+
+    // The dfa never dies, a line that doesn't match leads back to the start. It
+    // stops skipping after a few short skips, like in a line full of exit
+    // bytes, so the run is cut in windows to skip again in the next lines.
+    size_t i = from, text_len = regex_text_len(input, len, end_of_line);
+    int state = dfa_start_at(dfa, input, from);
+    while (i < text_len && !dfa_is_final(dfa, state)) {
+        size_t stop = text_len;
+        if (!regex_limit(regex, i, &stop, REGEX_LIMIT_WINDOW)) return false;
+        while (i < stop && !dfa_is_final(dfa, state))
+            state = dfa_run(dfa, state, input, stop - i > REGEX_LINE_WINDOW ? i + REGEX_LINE_WINDOW : stop, &i);
+    }
+    if (!dfa_is_final(dfa, state)) {
+        state = dfa_end(dfa, state, end_of_line);
+        i += end_of_line;
+    }
+
+    REGEX_STATS(regex, regex->stats.bytes_scanned += i - from);
+
+    *at = i > from ? i - 1 : from;
+    return state == dfa->match;
+}
+
+static bool regex_nfa_find_line(Regex *regex, const unsigned char *input, size_t from, size_t len, bool end_of_line,
+    size_t *at) {
+    // Like the dfa, the skip loop in front of the nfa brings it back to its start after each new line
+    regex_start_at(regex, from ? state_side_of(input[from - 1]) : SIDE_EDGE);
+    bool matched = regex_is_matching(regex);
+    size_t i = from, text_len = regex_text_len(input, len, end_of_line);
+    while (i < text_len && !matched) {
+        size_t stop = text_len;
+        if (!regex_limit(regex, i, &stop, REGEX_LIMIT_NFA_WINDOW)) return false;
+        for (; i < stop && !matched; ++i) {
+            matched = regex_step(regex, input[i]);
+#ifdef RE_STATS
+            if (REGEX_PROFILING(regex)) regex_profile_count(regex);
+#endif
+        }
+    }
+    if (!matched) {
+        matched = regex_nfa_end(regex, end_of_line);
+        i += end_of_line;
+    }
+
+    *at = i > from ? i - 1 : from;
+    return matched;
+}
+
+static size_t regex_text_len(const unsigned char *input, size_t len, bool end_of_line) {
+    return len - (end_of_line && len && input[len - 1] == '\n');
+}
+
+static void regex_start_at(Regex *regex, Side before) {
+    regex->cur_states_len = 0;
+    regex->new_states_len = 0;
+    regex->before = before;
+
+    regex_add_state_to_new_states(regex, regex->start);
+    regex_swap_cur_and_new(regex);
+}
+
+static void regex_resolve(Regex *regex, Side after, bool starts) {
+    // Added again in the same order (the order of the starts), the rest of the set is kept
+    for (int i = 0; i < regex->cur_states_len; ++i)
+        regex_resolve_add_state(regex, regex->cur_states[i], starts ? regex->cur_starts[i] : 0, after);
+    regex_swap_cur_and_new(regex);
+}
+
+static bool regex_nfa_end(Regex *regex, bool new_line) {
+    if (regex->assertions) regex_resolve(regex, SIDE_EDGE, false);
+    if (!new_line || regex_is_matching(regex)) return regex_is_matching(regex);
+
+    // The new line is after the end of the text, and is itself the end of the input. Only the states
+    // consuming it go on: no match starts after it, where nothing is left but the end of the input
+    regex_drop_restarts(regex);
+    regex_step(regex, '\n');
+    if (regex->assertions) regex_resolve(regex, SIDE_EDGE, false);
+    return regex_is_matching(regex);
+}
+
+static void regex_drop_restarts(Regex *regex) {
+    int len = 0;
+    for (int i = 0; i < regex->cur_states_len; ++i) {
+        State *state = regex->cur_states[i];
+        if (state_is_restart(state, regex->restarts)) continue;
+
+        state->id = len;
+        regex->cur_starts[len] = regex->cur_starts[i];
+        regex->cur_states[len++] = state;
+    }
+    regex->cur_states_len = len;
+}
+
+static RegexError regex_build(Regex *regex, const char *re, const RegexOptions *options, CompilerInterner *interner) {
+    *regex = (Regex){0};
+    regex->allocator = options && options->allocator ? *options->allocator : *memory_default_allocator();
+
+#ifdef RE_STATS
+    double start = regex_now();
+#endif
+
+    // Parse the regex, simplify the tree and generate the nfa.
+    Parser parser;
+    parser_create(&parser, re, &regex->allocator, options ? options->flags : REGEX_FLAG_NONE);
+    AstNode *ast = parser_parse(&parser);
+    if (!ast) {
+        regex_fail(regex, REGEX_ERROR_SYNTAX, "%s", parser.error);
+        parser_destroy(&parser);
+        return regex->error;
+    }
+    ast = ast_simplify(&regex->allocator, ast);
+    parser_destroy(&parser);
+
+    Compiler compiler;
+    compiler_create(&compiler, &regex->allocator, options ? options->flags : REGEX_FLAG_NONE);
+    compiler.interner = interner;
+    regex->start = compiler_compile(&compiler, ast);
+    regex->total_states = compiler.total_states;
+    regex->index_count = compiler.index_count;
+    regex->shared_states = interner != NULL;
+    regex->multiline = options && (options->flags & REGEX_FLAG_MULTILINE);
+    regex->assertions = compiler.assertions;
+    regex->entries = compiler.entries;
+    regex->entry_count = compiler.entry_count;
+    memcpy(regex->restarts, compiler.restarts, sizeof(regex->restarts));
+    compiler_destroy(&compiler);
+
+    // The interned loops are looked up by their nodes
+    if (interner) compiler_interner_keep(interner, ast);
+    else ast_destroy(&regex->allocator, ast);
+
+    // At max automata might be in all the states nfa.
+    regex->cur_states = (State **)memory_allocate(&regex->allocator, sizeof(State *) * regex->total_states);
+    regex->new_states = (State **)memory_allocate(&regex->allocator, sizeof(State *) * regex->total_states);
+    regex->cur_starts = (size_t *)memory_allocate(&regex->allocator, sizeof(size_t) * regex->total_states);
+    regex->new_starts = (size_t *)memory_allocate(&regex->allocator, sizeof(size_t) * regex->total_states);
+
+    regex->memory.program_bytes = sizeof(State) * regex->total_states + sizeof(RegexEntry) * regex->entry_count;
+    regex->memory.scratch_bytes = 2 * (sizeof(State *) + sizeof(size_t)) * regex->total_states;
+
+    // The nfa is always needed, it is too big if it doesn't fit alone
+    int max_states = options ? options->max_states : 0;
+    size_t max_memory = options ? options->max_memory : 0;
+    size_t nfa_bytes = regex->memory.program_bytes + regex->memory.scratch_bytes;
+    if (max_states && regex->total_states > max_states) {
+        int total_states = regex->total_states;
+        regex_destroy(regex);
+        return regex_fail(regex, REGEX_ERROR_TOO_MANY_STATES, "The regex needs %d states, at most %d are allowed",
+            total_states, max_states);
+    }
+    if (max_memory && nfa_bytes > max_memory) {
+        regex_destroy(regex);
+        return regex_fail(regex, REGEX_ERROR_TOO_MUCH_MEMORY, "The regex needs %zu bytes, at most %zu are allowed",
+            nfa_bytes, max_memory);
+    }
+
+    // Build the dfa unless it gets too big, then the nfa is simulated instead
+    int flags = options ? options->flags : REGEX_FLAG_NONE;
+    int dfa_max_states = options && options->dfa_max_states ? options->dfa_max_states : DFA_DEFAULT_MAX_STATES;
+    size_t table_max_bytes = max_memory ? max_memory - nfa_bytes : SIZE_MAX;
+    if (!(flags & REGEX_FLAG_NO_DFA))
+        regex->use_dfa = dfa_create(&regex->dfa, regex->start, regex->restarts, regex->total_states, dfa_max_states,
+            table_max_bytes, &regex->allocator);
+    if (regex->use_dfa && !(flags & REGEX_FLAG_NO_ACCEL)) dfa_accelerate(&regex->dfa, &regex->allocator);
+    // The limit only stopped the transitions, the rest of the table may not fit
+    if (regex->use_dfa && dfa_table_bytes(&regex->dfa) > table_max_bytes) {
+        dfa_destroy(&regex->dfa, &regex->allocator);
+        regex->use_dfa = false;
+    }
+    if (regex->use_dfa) regex->memory.table_bytes = dfa_table_bytes(&regex->dfa);
+    if (regex->use_dfa) regex_create_reverse_dfa(regex, dfa_max_states, table_max_bytes - regex->memory.table_bytes);
+    // The dfa is faster, the position automaton replaces the nfa simulation when it fits
+    if (!regex->use_dfa && !(flags & REGEX_FLAG_NO_SHIFT_AND)) regex_create_glushkov(regex, table_max_bytes);
+
+    regex_find_first_bytes(regex);
+    regex_reset(regex);
+    if (options) regex_set_limits(regex, &options->limits);
+
+#ifdef RE_STATS
+    regex->stats.compile_seconds = regex_now() - start;
+#endif
+
+    return REGEX_OK;
+}
+
+static RegexError regex_fail(Regex *regex, RegexError error, const char *format, ...) {
+    *regex = (Regex){.error = error};
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(regex->error_message, sizeof(regex->error_message), format, args);
+    va_end(args);
+
+    return error;
+}
+
+static void regex_limits_start(Regex *regex) {
+    if (!regex->limited) return;
+
+    regex->steps = 0;
+    regex->deadline = regex->limits.time_limit > 0 ? regex_now() + regex->limits.time_limit : 0;
+    regex->error = REGEX_OK;
+}
+
+static inline bool regex_limit(Regex *regex, size_t from, size_t *stop, size_t window) {
+    // Without limits the run goes on to its end
+    if (!regex->limited) return true;
+    return regex_check_limits(regex, from, stop, window);
+}
+
+static bool regex_check_limits(Regex *regex, size_t from, size_t *stop, size_t window) {
+    if (regex->limits.cancel && atomic_load_explicit(regex->limits.cancel, memory_order_relaxed)) {
+        regex->error = REGEX_ERROR_CANCELLED;
+        return false;
+    }
+    // The deadline was just set before the first window
+    if (regex->deadline && regex->steps && regex_now() > regex->deadline) {
+        regex->error = REGEX_ERROR_DEADLINE;
+        return false;
+    }
+
+    if (*stop - from > window) *stop = from + window;
+    if (regex->limits.step_budget) {
+        unsigned long long left = regex->limits.step_budget - regex->steps;
+        if (!left) {
+            regex->error = REGEX_ERROR_STEP_BUDGET;
+            return false;
+        }
+        if (*stop - from > left) *stop = from + left;
+    }
+    regex->steps += *stop - from;
+
+    return true;
+}
+
+static bool regex_find_from(Regex *regex, const unsigned char *input, size_t len, size_t from, int flags, RegexSpan *span) {
+    if (from > len) return false;
+    bool end_of_line = flags & REGEX_MATCH_EOL;
+
+    bool anchored = false, unanchored = false;
+    for (int e = 0; e < regex->entry_count; ++e) {
+        anchored |= regex->entries[e].anchored;
+        unanchored |= !regex->entries[e].anchored;
+    }
+
+    // Most inputs (and the rest of the input after the last match) don't
+    // match at all, the dfa tells that faster than locating a match, unless
+    // memchr() finds that there is no first byte. Its start state can match
+    // '^' alternatives, so it is only used from the start of the input for them.
+    if (regex->use_dfa && regex->first_byte < 0 && (!from || !anchored)
+        && !regex_dfa_match(regex, input + from, len - from, end_of_line, dfa_start_at(&regex->dfa, input, from)))
+        return false;
+
+    // Add new line at the end of each line, if they aren't there
+    size_t text_len = regex_text_len(input, len, end_of_line), end = text_len + end_of_line;
+    bool found = false;
+    RegexSpan best = {0};
+
+    // The bytes up to stop are within the limits (all of them without limits)
+    size_t stop = end;
+    if (from < end && !regex_limit(regex, from, &stop, REGEX_LIMIT_NFA_WINDOW)) return false;
+
+    regex->new_states_len = 0;
+    for (size_t i = from;; ++i) {
+        // Start matches at every offset until one is found. The states are
+        // added in the order of their start, so the earlier start wins when a
+        // state is reached twice and the sets stay sorted by start.
+        if (!found && i <= len) {
+            // Nothing is alive, skip to the next byte that can start a match
+            if (!regex->new_states_len && i < len && !regex->first_bytes[input[i]]) {
+                size_t skip_end = stop < len ? stop : len;
+                const unsigned char *next = regex->first_byte >= 0 ? memchr(input + i, regex->first_byte, skip_end - i) : NULL;
+                if (regex->first_byte >= 0) i = next ? (size_t)(next - input) : skip_end;
+                else while (i < skip_end && !regex->first_bytes[input[i]]) i++;
+            }
+
+            regex->before = i ? state_side_of(input[i - 1]) : SIDE_EDGE;
+            bool line_start = !i || (regex->multiline && input[i - 1] == '\n');
+            for (int e = 0; e < regex->entry_count; ++e)
+                if (!regex->entries[e].anchored || line_start) regex_find_add_state(regex, regex->entries[e].state, i);
+        }
+        regex_swap_cur_and_new(regex);
+
+        // The assertions waiting at this position see the next byte, in the order of the starts
+        if (regex->assertions) regex_resolve(regex, i < text_len ? state_side_of(input[i]) : SIDE_EDGE, true);
+
+        State *match = regex->match;
+        if (match && match->id < regex->cur_states_len && regex->cur_states[match->id] == match) {
+            // Leftmost first, then longest
+            size_t start = regex->cur_starts[match->id];
+            if (!found || start <= best.start) best = (RegexSpan){start, i};
+            found = true;
+        }
+
+        if (i == end) break;
+        if (i >= stop) {
+            stop = end;
+            if (!regex_limit(regex, i, &stop, REGEX_LIMIT_NFA_WINDOW)) return false;
+        }
+
+        unsigned char c = i < text_len ? input[i] : '\n';
+        regex->before = state_side_of(c);
+        for (int k = 0; k < regex->cur_states_len; ++k) {
+            State *state = regex->cur_states[k];
+            size_t start = regex->cur_starts[k];
+            // Matches starting after the one found can't win anymore
+            if (found && start > best.start) break;
+
+            switch (state->c) {
+                case MATCH:
+                    break;
+                default:
+                    if (c != state->c) break;
+                    /* fallthrough */
+                case ANY_CHAR:
+                    regex_find_add_state(regex, state->out, start);
+                    break;
+                case RANGE:
+                    if (state->range.start <= c && c <= state->range.end) regex_find_add_state(regex, state->out, start);
+                    break;
+            }
+        }
+
+        if (!regex->new_states_len && (found || (!unanchored && !regex->multiline))) break;
+    }
+
+    if (!found) return false;
+
+    // The new line added at the end is not part of the input
+    span->start = best.start;
+    span->end = best.end < len ? best.end : len;
+    return true;
+}
+
+static bool regex_iterator_find(RegexIterator *iterator, RegexSpan *span) {
+    const uint8_t *data = (const uint8_t *)iterator->data;
+    while (!iterator->done && regex_find_from(iterator->regex, data, iterator->len, iterator->from, iterator->flags, span)) {
+        bool empty = span->start == span->end;
+        // Step over an empty match so that it is not found again
+        if (empty && span->end >= iterator->len) iterator->done = true;
+        iterator->from = empty ? span->end + 1 : span->end;
+
+        if (empty && span->start == iterator->previous_end) continue;
+        iterator->previous_end = span->end;
+        return true;
+    }
+
+    iterator->done = true;
+    return false;
+}
+
+static void regex_create_reverse_dfa(Regex *regex, int max_states, size_t max_bytes) {
+    // The reversed nfa has no assertions
+    if (regex->assertions) return;
+
+    // A '^' alternative can't start anywhere, the reversed pattern would have to reach the start of the line
+    for (int e = 0; e < regex->entry_count; ++e)
+        if (regex->entries[e].anchored) return;
+
+    State **entries = memory_allocate(&regex->allocator, sizeof(State *) * regex->entry_count);
+    for (int e = 0; e < regex->entry_count; ++e) entries[e] = regex->entries[e].state;
+
+    ReverseNfa reverse;
+    if (reverse_nfa_create(&reverse, entries, regex->entry_count, regex->total_states, &regex->allocator)) {
+        regex->use_reverse_dfa = dfa_create(&regex->reverse_dfa, reverse.start, NULL, reverse.state_count, max_states,
+            max_bytes, &regex->allocator);
+        reverse_nfa_destroy(&reverse, &regex->allocator);
+    }
+    if (regex->use_reverse_dfa && dfa_table_bytes(&regex->reverse_dfa) > max_bytes) {
+        dfa_destroy(&regex->reverse_dfa, &regex->allocator);
+        regex->use_reverse_dfa = false;
+    }
+    if (regex->use_reverse_dfa) regex->memory.table_bytes += dfa_table_bytes(&regex->reverse_dfa);
+
+    memory_free(&regex->allocator, entries, sizeof(State *) * regex->entry_count);
+}
+
+static void regex_create_glushkov(Regex *regex, size_t max_bytes) {
+    // Positions are bytes, an assertion is not one
+    if (regex->assertions) return;
+
+    // The position automaton only starts the '^' alternatives at the first byte
+    for (int e = 0; e < regex->entry_count && regex->multiline; ++e)
+        if (regex->entries[e].anchored) return;
+
+    State **entries = memory_allocate(&regex->allocator, sizeof(State *) * regex->entry_count);
+    bool *anchored = memory_allocate(&regex->allocator, sizeof(bool) * regex->entry_count);
+    for (int e = 0; e < regex->entry_count; ++e) {
+        entries[e] = regex->entries[e].state;
+        anchored[e] = regex->entries[e].anchored;
+    }
+
+    regex->use_shift_and = glushkov_create(&regex->glushkov, entries, anchored, regex->entry_count, regex->total_states,
+        &regex->allocator);
+    if (regex->use_shift_and && glushkov_table_bytes(&regex->glushkov) > max_bytes) {
+        glushkov_destroy(&regex->glushkov, &regex->allocator);
+        regex->use_shift_and = false;
+    }
+    if (regex->use_shift_and) regex->memory.table_bytes += glushkov_table_bytes(&regex->glushkov);
+
+    memory_free(&regex->allocator, entries, sizeof(State *) * regex->entry_count);
+    memory_free(&regex->allocator, anchored, sizeof(bool) * regex->entry_count);
+}
+
+static void regex_dfa_match_batch(Regex *regex, const RegexInput *inputs, size_t count, uint64_t *results) {
+    const Dfa *dfa = &regex->dfa;
+
+    for (size_t first = 0; first < count; first += REGEX_BATCH_LANES) {
+        int lanes = count - first < REGEX_BATCH_LANES ? (int)(count - first) : REGEX_BATCH_LANES;
+        const unsigned char *data[REGEX_BATCH_LANES];
+        size_t len[REGEX_BATCH_LANES], min_len = SIZE_MAX;
+        int state[REGEX_BATCH_LANES];
+
+        for (int l = 0; l < lanes; ++l) {
+            data[l] = (const unsigned char *)inputs[first + l].data;
+            // The lock-step stops at the shortest text, the ends are stepped on their own
+            len[l] = regex_text_len(data[l], inputs[first + l].len, true);
+            state[l] = dfa->start;
+            if (len[l] < min_len) min_len = len[l];
+        }
+
+        // Step all the lanes in lock-step while none of them has ended. The
+        // lookups of different lanes are independent, so they overlap instead
+        // of waiting for each other,
+        // unless the lanes start by skipping to a few bytes, which each lane does faster on its own.
+        // With limits each lane is stepped on its own, in windows
+        size_t i = 0;
+        if (lanes == REGEX_BATCH_LANES && !dfa_is_accelerated(dfa, dfa->start) && !regex->limited) {
+            while (i < min_len) {
+                for (int l = 0; l < REGEX_BATCH_LANES; ++l) state[l] = dfa_next(dfa, state[l], data[l][i]);
+                i++;
+
+                // Stop early once nothing can change anymore
+                if (i % REGEX_BATCH_LANES == 0) {
+                    bool final = true;
+                    for (int l = 0; l < REGEX_BATCH_LANES; ++l) final &= dfa_is_final(dfa, state[l]);
+                    if (final) break;
+                }
+            }
+        }
+
+        // Finish the remaining bytes of each lane on its own
+        for (int l = 0; l < lanes; ++l) {
+            size_t j = i;
+            while (j < len[l] && !dfa_is_final(dfa, state[l])) {
+                size_t stop = len[l];
+                if (!regex_limit(regex, j, &stop, REGEX_LIMIT_WINDOW)) return;
+                state[l] = dfa_run(dfa, state[l], data[l], stop, &j);
+            }
+            // The end of the text, and the new line ending the line
+            if (!dfa_is_final(dfa, state[l])) {
+                state[l] = dfa_end(dfa, state[l], true);
+                j++;
+            }
+
+            if (state[l] == dfa->match) results[(first + l) / 64] |= (uint64_t)1 << ((first + l) % 64);
+            REGEX_STATS(regex, regex->stats.bytes_scanned += j);
+        }
+    }
+}
+
+static void regex_add_state_to_new_states(Regex *regex, State *state) {
+    switch (state->c) {
+        case BRANCH:
+            REGEX_STATS(regex, regex->stats.closure_expansions++);
+            regex_add_state_to_new_states(regex, state->out1);
+            /* fallthrough */
+        case EPSILON:
+            REGEX_STATS(regex, regex->stats.closure_expansions++);
+            regex_add_state_to_new_states(regex, state->out);
+            return;
+        case MATCH:
+            // NOTE: Thompson's nfa has exactly one accepting state
+            regex->match = state;
+            break;
+    }
+
+    if (state->id < regex->new_states_len && regex->new_states[state->id] == state) return;
+
+    state->id = regex->new_states_len;
+    regex->new_states[regex->new_states_len++] = state;
+}
+
+static void regex_find_add_state(Regex *regex, State *state, size_t start) {
+    switch (state->c) {
+        case BRANCH:
+            regex_find_add_state(regex, state->out1, start);
+            /* fallthrough */
+        case EPSILON:
+            regex_find_add_state(regex, state->out, start);
+            return;
+        case MATCH:
+            regex->match = state;
+            break;
+    }
+
+    if (state->id < regex->new_states_len && regex->new_states[state->id] == state) return;
+
+    state->id = regex->new_states_len;
+    regex->new_starts[regex->new_states_len] = start;
+    regex->new_states[regex->new_states_len++] = state;
+}
+
+static void regex_resolve_add_state(Regex *regex, State *state, size_t start, Side after) {
+    switch (state->c) {
+        case BRANCH:
+            REGEX_STATS(regex, regex->stats.closure_expansions++);
+            regex_resolve_add_state(regex, state->out1, start, after);
+            /* fallthrough */
+        case EPSILON:
+            REGEX_STATS(regex, regex->stats.closure_expansions++);
+            regex_resolve_add_state(regex, state->out, start, after);
+            return;
+        case MATCH:
+            regex->match = state;
+            break;
+    }
+
+    if (state->id < regex->new_states_len && regex->new_states[state->id] == state) return;
+
+    state->id = regex->new_states_len;
+    regex->new_starts[regex->new_states_len] = start;
+    regex->new_states[regex->new_states_len++] = state;
+
+    // The assertion stays in the set (stepping drops it), so a loop around it is followed once
+    if (state_is_assertion(state->c) && state_assertion_holds(state->c, regex->before, after))
+        regex_resolve_add_state(regex, state->out, start, after);
+}
+
+static void regex_find_first_bytes(Regex *regex) {
+    regex->new_states_len = 0;
+    for (int e = 0; e < regex->entry_count; ++e) regex_find_add_state(regex, regex->entries[e].state, 0);
+
+    memset(regex->first_bytes, 0, sizeof(regex->first_bytes));
+    for (int k = 0; k < regex->new_states_len; ++k) {
+        const State *state = regex->new_states[k];
+        switch (state->c) {
+            case MATCH:
+            case ANY_CHAR:
+                memset(regex->first_bytes, true, sizeof(regex->first_bytes));
+                break;
+            case RANGE:
+                for (unsigned c = state->range.start; c <= state->range.end && c < 256; ++c) regex->first_bytes[c] = true;
+                break;
+            case WORD_BOUNDARY:
+            case NOT_WORD_BOUNDARY:
+            case TEXT_START:
+            case TEXT_END:
+            case LOOP_BACK:
+                // An assertion only makes a match fail, what follows it may start one
+                regex_find_add_state(regex, state->out, 0);
+                break;
+            default:
+                if (state->c <= LITERAL_CHAR_LAST) regex->first_bytes[state->c] = true;
+                break;
+        }
+    }
+    regex->new_states_len = 0;
+
+    regex->first_byte = -1;
+    for (int c = 0, count = 0; c < 256; ++c) {
+        if (!regex->first_bytes[c]) continue;
+        regex->first_byte = ++count == 1 ? c : -1;
+    }
+}
+
+static void regex_buffer_reserve(RegexBuffer *buffer, size_t len) {
+    if (buffer->len + len < buffer->capacity) return;
+
+    size_t capacity = buffer->capacity ? buffer->capacity : 64;
+    while (buffer->len + len >= capacity) capacity *= 2;
+
+    buffer->data = memory_reallocate(buffer->allocator, buffer->data, buffer->capacity, capacity);
+    buffer->capacity = capacity;
+}
+
+static void regex_buffer_append(RegexBuffer *buffer, const char *data, size_t len) {
+    regex_buffer_reserve(buffer, len);
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+    buffer->data[buffer->len] = '\0';
+}
+
+static bool regex_template_check(Regex *regex, const char *template) {
+    for (const char *c = template; (c = strchr(c, '$')); c += 2) {
+        if (c[1] == '0' || c[1] == '&' || c[1] == '$') continue;
+
+        regex->error = REGEX_ERROR_SYNTAX;
+        if ('1' <= c[1] && c[1] <= '9')
+            snprintf(regex->error_message, sizeof(regex->error_message),
+                "Template references group %c, but groups don't capture", c[1]);
+        else
+            snprintf(regex->error_message, sizeof(regex->error_message),
+                "Expected '0', '&' or '$' after '$' in template");
+        return false;
+    }
+
+    return true;
+}
+
+static void regex_buffer_append_template(RegexBuffer *buffer, const char *template, size_t template_len,
+    const char *match, size_t match_len) {
+    const char *end = template + template_len;
+    while (template < end) {
+        // Copy the text up to the next '$' at once
+        const char *dollar = memchr(template, '$', end - template);
+        if (!dollar) dollar = end;
+        regex_buffer_append(buffer, template, dollar - template);
+        if (dollar == end) break;
+
+        if (dollar[1] == '$') regex_buffer_append(buffer, "$", 1);
+        else regex_buffer_append(buffer, match, match_len);
+        template = dollar + 2;
+    }
+}
+
+static bool regex_is_matching(const Regex *regex) {
+    return regex->match && regex->match->id < regex->cur_states_len && regex->match == regex->cur_states[regex->match->id];
+}
+
+static void regex_swap_cur_and_new(Regex *regex) {
+    State **temp = regex->new_states;
+    regex->new_states = regex->cur_states;
+    regex->cur_states = temp;
+
+    size_t *temp_starts = regex->new_starts;
+    regex->new_starts = regex->cur_starts;
+    regex->cur_starts = temp_starts;
+
+    regex->cur_states_len = regex->new_states_len;
+    regex->new_states_len = 0;
+}
+
+static void regex_collect_states(Regex *regex, State *state) {
+    if (!regex_collect_states_helper(regex, state)) {
+        if (state->out) regex_collect_states(regex, state->out);
+        if (state->out1) regex_collect_states(regex, state->out1);
+    }
+}
+
+static bool regex_collect_states_helper(Regex *regex, State *state) {
     if (state->id < regex->new_states_len && regex->new_states[state->id] == state) return true;
 
     state->id = regex->new_states_len;
@@ -163,3 +1556,44 @@ static bool regex_collect_states_helper(Regex *regex, State *state) {
     return false;
 }
 
+static double regex_now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+#ifdef RE_STATS
+static bool regex_profile_match(Regex *regex, const unsigned char *input, size_t len, bool end_of_line) {
+    bool newline = end_of_line && (!len || input[len - 1] != '\n');
+
+    // Step the dfa over the same bytes, it stops at the same place as the nfa
+    if (regex->use_dfa) {
+        const Dfa *dfa = &regex->dfa;
+        int state = dfa->start;
+        regex->dfa_visits[state / dfa->class_count]++;
+        for (size_t i = 0; i < len + newline && !dfa_is_final(dfa, state); ++i) {
+            state = dfa_next(dfa, state, i < len ? input[i] : '\n');
+            regex->dfa_visits[state / dfa->class_count]++;
+        }
+    }
+
+    regex_reset(regex);
+    regex_profile_count(regex);
+    bool matched = regex_is_matching(regex);
+    size_t i, text_len = regex_text_len(input, len, end_of_line);
+    for (i = 0; i < text_len && !matched && regex->cur_states_len; ++i) {
+        matched = regex_step(regex, input[i]);
+        regex_profile_count(regex);
+    }
+    if (i == text_len && !matched) {
+        matched = regex_nfa_end(regex, end_of_line);
+        if (end_of_line) regex_profile_count(regex);
+    }
+
+    return matched;
+}
+
+static void regex_profile_count(Regex *regex) {
+    for (int i = 0; i < regex->cur_states_len; ++i) regex->nfa_visits[regex->cur_states[i]->index]++;
+}
+#endif
@@ -1,7 +1,202 @@
 #pragma once
 
 #include "state.h"
+#include "memory.h"
+#include "dfa.h"
+#include "glushkov.h"
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @enum RegexFlag
+ * @brief Flags changing how the regex is compiled (combine with |).
+ */
+typedef enum RegexFlag {
+    REGEX_FLAG_NONE = 0,
+    REGEX_FLAG_UTF8 = 1 << 0, /**< Regex and input are UTF-8, '.' and character classes match code points */
+    REGEX_FLAG_ICASE = 1 << 1, /**< Letters match both cases (folded when compiling, matching is unchanged) */
+    REGEX_FLAG_NO_DFA = 1 << 2, /**< Do not build the dfa (the Shift-And automaton or the nfa is used) */
+    REGEX_FLAG_NO_SHIFT_AND = 1 << 3, /**< Do not build the bit-parallel (Shift-And) position automaton */
+    REGEX_FLAG_NO_ACCEL = 1 << 4, /**< Step the dfa byte by byte, even in states that only leave on a few bytes */
+    REGEX_FLAG_MULTILINE = 1 << 5, /**< '^' and '$' match at every line, '.' and negated classes don't match '\n' */
+} RegexFlag;
+
+/**
+ * @enum RegexMatchFlag
+ * @brief Flags changing how an input is matched (combine with |).
+ */
+typedef enum RegexMatchFlag {
+    REGEX_MATCH_NONE = 0,
+    REGEX_MATCH_EOL = 1 << 0, /**< The end of the input ends a line, '$' matches there (implied by the string functions) */
+} RegexMatchFlag;
+
+/**
+ * @enum RegexError
+ * @brief Why a regex failed to compile (see @ref regex_compile), or why a call stopped early (see @ref RegexLimits).
+ */
+typedef enum RegexError {
+    REGEX_OK = 0, /**< No error */
+    REGEX_ERROR_SYNTAX, /**< The pattern (or the template of @ref regex_replace_all) is invalid */
+    REGEX_ERROR_TOO_MANY_STATES, /**< The nfa needs more states than max_states */
+    REGEX_ERROR_TOO_MUCH_MEMORY, /**< The nfa and the buffers to simulate it need more bytes than max_memory */
+    REGEX_ERROR_STEP_BUDGET, /**< The call stepped over step_budget bytes without finishing */
+    REGEX_ERROR_DEADLINE, /**< The call took longer than time_limit */
+    REGEX_ERROR_CANCELLED, /**< The cancel flag was set */
+    REGEX_ERROR_UNSUPPORTED, /**< The regex can't be matched this way (see @ref approx_create) */
+    REGEX_ERROR_OUT_OF_MEMORY, /**< The allocator failed (see @ref bulk_create) */
+} RegexError;
+
+/**
+ * @brief Longest error message of a regex that failed to compile (with the NUL).
+ */
+#define REGEX_ERROR_MESSAGE_SIZE 128
+
+/**
+ * @brief Bytes the dfa and the Shift-And automaton step between two checks of the limits.
+ */
+#define REGEX_LIMIT_WINDOW 4096
+
+/**
+ * @brief Bytes the nfa simulation steps between two checks of the limits (each byte costs more).
+ */
+#define REGEX_LIMIT_NFA_WINDOW 256
+
+/**
+ * @struct RegexLimits regex.h
+ * @brief Limits of each call matching an input (see @ref regex_set_limits).
+ *
+ * The calls are @ref regex_match_bytes, @ref regex_pattern_in_line,
+ * @ref regex_match_batch, @ref regex_find, @ref regex_find_bytes,
+ * @ref regex_iterator_next, @ref regex_iterator_next_line, @ref regex_split
+ * and @ref regex_replace_all (a call over many matches or lines is limited
+ * as a whole). A call hitting a limit stops and returns no match: the
+ * iterators find no more matches, @ref regex_split keeps the rest of the
+ * input as its last field and @ref regex_replace_all copies it unchanged.
+ * The error of the regex tells which limit was hit.
+ *
+ * Nothing is checked per byte: the input is stepped in windows of
+ * REGEX_LIMIT_WINDOW bytes (REGEX_LIMIT_NFA_WINDOW for the nfa simulation)
+ * and the limits are checked before each one, so a call runs at most one
+ * window past its deadline or cancellation. Without limits the whole input
+ * is a single window.
+ */
+typedef struct RegexLimits {
+    unsigned long long step_budget; /**< Most input bytes a call steps over, whatever the engine (0 for no limit) */
+    double time_limit; /**< Most seconds a call takes (0 for no limit, reads the clock once per call and per window) */
+    const atomic_bool *cancel; /**< Stops the calls while set, from any thread (NULL for none) */
+} RegexLimits;
+
+/**
+ * @struct RegexOptions regex.h
+ * @brief Options used when compiling the regex.
+ */
+typedef struct RegexOptions {
+    const Allocator *allocator; /**< Allocator for everything the regex owns (NULL for default allocator) */
+    int flags; /**< Combination of @ref RegexFlag */
+    int dfa_max_states; /**< The nfa is simulated if the dfa needs more states (0 for DFA_DEFAULT_MAX_STATES) */
+    int max_states; /**< Fail with REGEX_ERROR_TOO_MANY_STATES if the nfa needs more states (0 for no limit) */
+    size_t max_memory; /**< Fail with REGEX_ERROR_TOO_MUCH_MEMORY if the nfa needs more bytes, the tables are only built in what is left (0 for no limit) */
+    RegexLimits limits; /**< Limits of each call matching an input */
+} RegexOptions;
+
+/**
+ * @struct RegexInput regex.h
+ * @brief One input of @ref regex_match_batch.
+ */
+typedef struct RegexInput {
+    const char *data; /**< The line (need not be NUL-terminated) */
+    size_t len; /**< Length of the line */
+} RegexInput;
+
+/**
+ * @struct RegexSpan regex.h
+ * @brief Location of a match, input[start] up to (not including) input[end].
+ */
+typedef struct RegexSpan {
+    size_t start; /**< Offset of the first character of the match */
+    size_t end; /**< Offset after the last character of the match */
+} RegexSpan;
+
+/**
+ * @struct RegexLine regex.h
+ * @brief A line of the input containing a match (see @ref regex_iterator_next_line).
+ */
+typedef struct RegexLine {
+    size_t number; /**< Number of the line, counting from 1 */
+    size_t start; /**< Offset of the first character of the line */
+    size_t end; /**< Offset of the new line character ending the line (or the length of the input) */
+} RegexLine;
+
+/**
+ * @struct RegexBuffer regex.h
+ * @brief Growable output buffer owned by the caller (kept NUL-terminated).
+ *
+ * Reuse the same buffer for many calls (set len to 0 between them), so that
+ * it stops growing once it is large enough.
+ */
+typedef struct RegexBuffer {
+    char *data; /**< The bytes written */
+    size_t len; /**< Number of bytes written (without the NUL) */
+    size_t capacity; /**< Bytes allocated for data */
+    const Allocator *allocator; /**< Allocator for data (NULL for default allocator) */
+} RegexBuffer;
+
+/**
+ * @struct RegexEntry regex.h
+ * @brief Where a match of one top-level alternative starts (after the loop skipping characters).
+ */
+typedef struct RegexEntry {
+    State *state; /**< First state of the alternative */
+    bool anchored; /**< The alternative starts with '^' (matches only at the start of the input, or of a line in multi-line mode) */
+} RegexEntry;
+
+/**
+ * @brief Number of inputs @ref regex_match_batch advances in lock-step.
+ */
+#define REGEX_BATCH_LANES 8
+
+/**
+ * @brief Bytes of the input @ref regex_iterator_next_line steps the multi-line dfa over at once.
+ */
+#define REGEX_LINE_WINDOW 256
+
+/**
+ * @struct RegexStats regex.h
+ * @brief Counters collected on the match path (see @ref regex_get_stats).
+ */
+typedef struct RegexStats {
+    unsigned long long lines; /**< Number of lines searched */
+    unsigned long long matched_lines; /**< Number of lines that matched */
+    unsigned long long bytes_scanned; /**< Number of input characters stepped */
+    unsigned long long nfa_steps; /**< Number of characters the nfa was simulated on (0 if only the dfa ran) */
+    unsigned long long active_states_total; /**< Sum of the current states set size over every step */
+    double active_states_avg; /**< Average current states set size per step */
+    int active_states_max; /**< Largest current states set size seen */
+    unsigned long long closure_expansions; /**< Number of epsilon/branch edges followed */
+    double compile_seconds; /**< Time spent in regex_create() */
+    double match_seconds; /**< Time spent in regex_pattern_in_line() */
+    int dfa_states; /**< Number of dfa states (0 if the nfa is simulated) */
+    int dfa_accelerated_states; /**< Number of dfa states skipping to their exit bytes with memchr() or SIMD */
+    int shift_and_positions; /**< Number of positions of the Shift-And automaton (0 if it is not built) */
+} RegexStats;
+
+/**
+ * @brief Longest label of @ref RegexHotState (with the NUL).
+ */
+#define REGEX_STATE_LABEL_SIZE 32
+
+/**
+ * @struct RegexHotState regex.h
+ * @brief Visits of one nfa state counted while profiling (see @ref regex_get_hot_states).
+ */
+typedef struct RegexHotState {
+    int index; /**< Number of the nfa state (the node of @ref regex_write_dot) */
+    unsigned long long visits; /**< Number of steps the state was in the set of current states */
+    char label[REGEX_STATE_LABEL_SIZE]; /**< What the state matches ("'a'", "[0-9]", "any", "branch"...) */
+} RegexHotState;
 
 /**
  * @struct regex.h
@@ -12,22 +207,123 @@ typedef struct Regex {
     State *match; /**< Pointer to matching state of nfa */
 
     int total_states; /**< Total number of states in nfa */
+    int index_count; /**< Bound of the indexes of the nfa states (total_states unless they are shared) */
+    bool shared_states; /**< The states belong to an interner (see @ref regex_create_interned) and are not destroyed with the regex */
+    bool multiline; /**< Compiled with REGEX_FLAG_MULTILINE, the automata go back to their start after each new line */
+    bool assertions; /**< The nfa has assertion states ('\\b', '\\B', '\\A', '\\z' or LOOP_BACK), the waiting ones are followed before each step */
+    State *restarts[STATE_MAX_RESTARTS]; /**< States going back to the start after a byte (see state_is_restart()) */
+    Side before; /**< What is before the position the current nfa states are at */
 
     State **cur_states; /**< Set of current states the nfa is in */
     int cur_states_len; /**< Lenght of the current states set */
 
     State **new_states; /**< Set of new states the nfa will be on getting input */
     int new_states_len; /**< Length of the new states set */
+
+    RegexEntry *entries; /**< Start of each top-level alternative (used to locate the matches) */
+    int entry_count; /**< Number of entries */
+    size_t *cur_starts; /**< Offset where the match of each current state started */
+    size_t *new_starts; /**< Offset where the match of each new state started */
+    bool first_bytes[256]; /**< Bytes that can start a match (all of them if the match can be empty) */
+    int first_byte; /**< The only byte that can start a match (-1 if there are more) */
+
+    Dfa dfa; /**< The dfa of the nfa (valid only if use_dfa) */
+    bool use_dfa; /**< Whether to match with the dfa */
+    Dfa reverse_dfa; /**< The dfa of the reversed pattern (valid only if use_reverse_dfa) */
+    bool use_reverse_dfa; /**< Whether lines are matched backwards from their end (every alternative ends with '$') */
+    Glushkov glushkov; /**< The position automaton (valid only if use_shift_and) */
+    bool use_shift_and; /**< Whether to match with the position automaton (only built if the dfa is not used) */
+
+    Allocator allocator; /**< Allocator used for everything the regex owns */
+    MemoryReport memory; /**< Memory used by the regex */
+
+    RegexLimits limits; /**< Limits of each call matching an input */
+    bool limited; /**< A limit is set, the input is stepped in windows to check it */
+    unsigned long long steps; /**< Bytes of input the current call has been given to step (a window at a time) */
+    double deadline; /**< When the current call runs out of time (0 without time limit) */
+    RegexError error; /**< Why the regex failed to compile, or why the last call stopped early */
+    char error_message[REGEX_ERROR_MESSAGE_SIZE]; /**< Why the regex failed to compile, or why the template was rejected */
+
+    // The stats are always there, so that the layout doesn't depend on RE_STATS (they stay zero without it)
+    bool stats_enabled; /**< Collect the stats while matching */
+    RegexStats stats; /**< The collected stats */
+    bool profile_enabled; /**< Count the visits of each state while matching */
+    unsigned long long *nfa_visits; /**< Steps each nfa state (by its index) was current (NULL until profiled) */
+    unsigned long long *dfa_visits; /**< Times each dfa state (by its row) was entered (NULL until profiled) */
 } Regex;
 
+/**
+ * @struct RegexIterator regex.h
+ * @brief Successive non-overlapping matches of one input (see @ref regex_iterator_next).
+ */
+typedef struct RegexIterator {
+    Regex *regex; /**< The regex */
+    const char *data; /**< The input */
+    size_t len; /**< Length of the input */
+    size_t from; /**< Offset to look for the next match at */
+    size_t previous_end; /**< End of the last match (SIZE_MAX before the first one) */
+    int flags; /**< Combination of @ref RegexMatchFlag */
+    size_t line_count; /**< New lines before from (counted by @ref regex_iterator_next_line) */
+    bool done; /**< No more matches */
+} RegexIterator;
+
 /**
  * @brief Create the regex.
  *
+ * @note Quits with the error if the regex fails to compile, see @ref regex_compile.
+ *
  * @param regex Pointer to the regex state
  * @param re The regex string
  */
 void regex_create(Regex *regex, const char *re);
 
+/**
+ * @brief Create the regex with given options.
+ *
+ * @note Quits with the error if the regex fails to compile, see @ref regex_compile.
+ *
+ * @param regex Pointer to the regex state
+ * @param re The regex string
+ * @param options The options (NULL for defaults)
+ */
+void regex_create_with_options(Regex *regex, const char *re, const RegexOptions *options);
+
+/**
+ * @brief Compile the regex with given options, returning the error instead of quitting.
+ *
+ * Meant for patterns that can't be trusted. An invalid pattern, an nfa of
+ * more than max_states states or more than max_memory bytes fail the
+ * compilation: nothing is kept allocated, and the error and its message are
+ * stored in the regex (destroying it does nothing). The nfa has a few states
+ * per byte of the pattern at most (there is no counted repetition), so it is
+ * checked once compiled. The dfa and the other tables are optional: those
+ * that don't fit in the states and bytes left are not built, and the nfa is
+ * simulated instead.
+ *
+ * @param regex Pointer to the regex state
+ * @param re The regex string
+ * @param options The options (NULL for defaults)
+ *
+ * @return REGEX_OK, or why the regex failed to compile.
+ */
+RegexError regex_compile(Regex *regex, const char *re, const RegexOptions *options);
+
+struct CompilerInterner;
+
+/**
+ * @brief Create the regex, sharing its nfa states with the other regexes created with the interner.
+ *
+ * The states stay owned by the interner (see CompilerInterner in
+ * compiler.h), destroy the regexes before it. Everything else (the dfa,
+ * the buffers...) is owned by the regex as usual.
+ *
+ * @param regex Pointer to the regex state
+ * @param re The regex string
+ * @param options The options (NULL for defaults, the allocator must be the one of the interner)
+ * @param interner The interner
+ */
+void regex_create_interned(Regex *regex, const char *re, const RegexOptions *options, struct CompilerInterner *interner);
+
 /**
  * @brief Destroy the regex.
  *
@@ -35,6 +331,23 @@ void regex_create(Regex *regex, const char *re);
  */
 void regex_destroy(Regex *regex);
 
+/**
+ * @brief Set the limits of each call matching an input (see @ref RegexLimits).
+ *
+ * @param regex Pointer to the regex state
+ * @param limits The limits (NULL for none)
+ */
+void regex_set_limits(Regex *regex, const RegexLimits *limits);
+
+/**
+ * @brief Get the description of the error.
+ *
+ * @param error The error
+ *
+ * @return The description (a static string).
+ */
+const char *regex_error_string(RegexError error);
+
 /**
  * @brief Step in nfa by taking the input character.
  *
@@ -43,7 +356,7 @@ void regex_destroy(Regex *regex);
  *
  * @return Returns true if nfa is in accepting state (text matched).
  */
-bool regex_step(Regex *regex, char input); 
+bool regex_step(Regex *regex, unsigned char input);
 
 /**
  * @brief Reset the regex state (so that restart the matching).
@@ -62,5 +375,263 @@ void regex_reset(Regex *regex);
  */
 bool regex_pattern_in_line(Regex *regex, const char *line);
 
+/**
+ * @brief Search the bytes for the regex pattern.
+ *
+ * Every byte value is input, NUL included, nothing is read past len. Unless
+ * REGEX_MATCH_EOL is given, the end of the buffer is not the end of a line:
+ * a '$' only matches a new line byte of the buffer, so a payload can be
+ * matched in place without a new line being assumed after it.
+ * regex_pattern_in_line(regex, line) is the same as
+ * regex_match_bytes(regex, (const uint8_t *)line, strlen(line), REGEX_MATCH_EOL).
+ *
+ * @param regex Pointer to the regex state
+ * @param buf The bytes (need not be NUL-terminated)
+ * @param len Number of bytes
+ * @param flags Combination of @ref RegexMatchFlag
+ *
+ * @return true if the bytes contain the regex pattern.
+ */
+bool regex_match_bytes(Regex *regex, const uint8_t *buf, size_t len, int flags);
+
+/**
+ * @brief Search each of the inputs for the regex pattern.
+ *
+ * Same as calling @ref regex_pattern_in_line on each input, but with the dfa
+ * @ref REGEX_BATCH_LANES inputs are advanced together, so that the table
+ * lookups of different inputs do not wait for each other.
+ *
+ * @param regex Pointer to the regex state
+ * @param inputs The inputs
+ * @param count Number of inputs
+ * @param results Bitmap of (count + 63) / 64 words, bit i % 64 of word i / 64 is set if input i matched
+ */
+void regex_match_batch(Regex *regex, const RegexInput *inputs, size_t count, uint64_t *results);
+
+/**
+ * @brief Find the leftmost-longest match starting at or after the offset.
+ *
+ * The input is matched as one line like @ref regex_pattern_in_line, so a '$'
+ * matches the new line character (which is part of the span) or the end of
+ * the input, and a '^' only matches at offset 0 (and after each new line in
+ * multi-line mode).
+ *
+ * @param regex Pointer to the regex state
+ * @param data The input (need not be NUL-terminated)
+ * @param len Length of the input
+ * @param from Offset to start looking at
+ * @param span Pointer to store the match
+ *
+ * @return false if there is no match.
+ */
+bool regex_find(Regex *regex, const char *data, size_t len, size_t from, RegexSpan *span);
+
+/**
+ * @brief Find the leftmost-longest match of the bytes starting at or after the offset.
+ *
+ * Same as @ref regex_find, which passes REGEX_MATCH_EOL, but without that
+ * flag a '$' does not match at the end of the buffer.
+ *
+ * @param regex Pointer to the regex state
+ * @param buf The bytes (need not be NUL-terminated)
+ * @param len Number of bytes
+ * @param from Offset to start looking at
+ * @param flags Combination of @ref RegexMatchFlag
+ * @param span Pointer to store the match
+ *
+ * @return false if there is no match.
+ */
+bool regex_find_bytes(Regex *regex, const uint8_t *buf, size_t len, size_t from, int flags, RegexSpan *span);
+
+/**
+ * @brief Start iterating over the matches of the input.
+ *
+ * Nothing is allocated, the iterator only remembers where to continue.
+ *
+ * @param iterator Pointer to the iterator
+ * @param regex Pointer to the regex state (must not be used for other inputs until the iteration ends)
+ * @param data The input (need not be NUL-terminated)
+ * @param len Length of the input
+ */
+void regex_iterator_create(RegexIterator *iterator, Regex *regex, const char *data, size_t len);
+
+/**
+ * @brief Start iterating over the matches of the bytes (found with @ref regex_find_bytes).
+ *
+ * @param iterator Pointer to the iterator
+ * @param regex Pointer to the regex state (must not be used for other inputs until the iteration ends)
+ * @param buf The bytes (need not be NUL-terminated)
+ * @param len Number of bytes
+ * @param flags Combination of @ref RegexMatchFlag
+ */
+void regex_iterator_create_bytes(RegexIterator *iterator, Regex *regex, const uint8_t *buf, size_t len, int flags);
+
+/**
+ * @brief Get the next match, left to right and without overlapping the previous one.
+ *
+ * The search continues where the previous match ended, so every byte is
+ * scanned about once. Empty matches are reported too, except right after
+ * another match (like sed), and then the search moves one byte forward.
+ *
+ * @param iterator Pointer to the iterator
+ * @param span Pointer to store the match
+ *
+ * @return false if there are no more matches.
+ */
+bool regex_iterator_next(RegexIterator *iterator, RegexSpan *span);
+
+/**
+ * @brief Get the next line containing a match.
+ *
+ * Each line is matched like @ref regex_pattern_in_line would match it on its
+ * own (the last line ends the input only with REGEX_MATCH_EOL). With
+ * REGEX_FLAG_MULTILINE the dfa goes back to its start after each new line,
+ * so the lines are not cut and reset one by one: a single dfa run skips
+ * every line that doesn't match and stops in the one that does. Otherwise
+ * the lines are matched one at a time. Don't mix with @ref regex_iterator_next
+ * on the same iterator.
+ *
+ * @param iterator Pointer to the iterator
+ * @param line Pointer to store the line
+ *
+ * @return false if no line is left.
+ */
+bool regex_iterator_next_line(RegexIterator *iterator, RegexLine *line);
+
+/**
+ * @brief Split the input at every match (the matches are not part of the fields).
+ *
+ * The input is split into one more field than there are matches, so empty
+ * fields are kept (matches at the ends or next to each other). If there are
+ * more than max_fields fields, the last one holds the rest of the input.
+ *
+ * @param regex Pointer to the regex state
+ * @param data The input (need not be NUL-terminated)
+ * @param len Length of the input
+ * @param fields Array to store the fields
+ * @param max_fields Length of the array (at least 1)
+ *
+ * @return Number of fields stored.
+ */
+size_t regex_split(Regex *regex, const char *data, size_t len, RegexSpan *fields, size_t max_fields);
+
+/**
+ * @brief Replace every match with the template, appending the result to the buffer.
+ *
+ * In the template "$0" and "$&" are replaced by the matched text and "$$" by
+ * '$', everything else is copied as is. The text between the matches is
+ * copied with one memcpy() per span and nothing is allocated per match
+ * (the buffer only grows when it is too small). The matches are the ones of
+ * @ref regex_iterator_next.
+ *
+ * The template is checked before anything is replaced: any other '$'
+ * sequence, and group references ("$1"...) until the groups capture, fail
+ * with REGEX_ERROR_SYNTAX and the reason in the error message of the regex,
+ * and nothing is appended.
+ *
+ * @param regex Pointer to the regex state
+ * @param data The input (need not be NUL-terminated)
+ * @param len Length of the input
+ * @param template The replacement template
+ * @param out The buffer to append the result to
+ * @param count Pointer to store the number of matches replaced
+ *
+ * @return REGEX_OK, REGEX_ERROR_SYNTAX for an invalid template, or the limit hit (see @ref RegexLimits).
+ */
+RegexError regex_replace_all(Regex *regex, const char *data, size_t len, const char *template, RegexBuffer *out,
+    size_t *count);
+
+/**
+ * @brief Create an empty buffer.
+ *
+ * @param buffer Pointer to the buffer
+ * @param allocator Allocator for the data (NULL for default allocator)
+ */
+void regex_buffer_create(RegexBuffer *buffer, const Allocator *allocator);
+
+/**
+ * @brief Free the data of the buffer.
+ *
+ * @param buffer Pointer to the buffer
+ */
+void regex_buffer_destroy(RegexBuffer *buffer);
+
+/**
+ * @brief Get the memory used by the regex.
+ *
+ * @param regex Pointer to the regex state
+ * @param report Pointer to store the report
+ */
+void regex_get_memory_report(const Regex *regex, MemoryReport *report);
+
+/**
+ * @brief Enable or disable collecting stats on the match path (disabled by default).
+ *
+ * @note Does nothing if the library is built without RE_STATS.
+ *
+ * @param regex Pointer to the regex state
+ * @param enable Whether to collect the stats
+ */
+void regex_enable_stats(Regex *regex, bool enable);
+
+/**
+ * @brief Get the stats collected so far.
+ *
+ * @param regex Pointer to the regex state
+ * @param stats Pointer to store the stats
+ *
+ * @return false if the library is built without RE_STATS (stats are zeroed).
+ */
+bool regex_get_stats(const Regex *regex, RegexStats *stats);
+
+/**
+ * @brief Clear the collected stats (compile time is kept).
+ *
+ * @param regex Pointer to the regex state
+ */
+void regex_reset_stats(Regex *regex);
+
+/**
+ * @brief Enable or disable counting how often each state is visited (disabled by default).
+ *
+ * While profiling, @ref regex_pattern_in_line and @ref regex_match_batch
+ * simulate the nfa whatever engine was built, counting the steps each nfa
+ * state spends in the set of current states, and step the dfa (if it is
+ * built) over the same bytes, counting how often each of its states is
+ * entered. This is much slower than matching, it is meant to find the hot
+ * loops of a pattern (a leading '.*', long chains of classes...). The
+ * counts are kept until @ref regex_reset_stats.
+ *
+ * @note Does nothing if the library is built without RE_STATS.
+ *
+ * @param regex Pointer to the regex state
+ * @param enable Whether to count the visits
+ *
+ * @return false if the library is built without RE_STATS.
+ */
+bool regex_enable_profile(Regex *regex, bool enable);
+
+/**
+ * @brief Get the most visited nfa states, the hottest first.
+ *
+ * @param regex Pointer to the regex state
+ * @param states Array to store the states
+ * @param max_states Length of the array
+ *
+ * @return Number of states stored (only visited states are stored, none if nothing was profiled).
+ */
+size_t regex_get_hot_states(const Regex *regex, RegexHotState *states, size_t max_states);
+
+/**
+ * @brief Write the nfa, and the dfa if it is built, as a Graphviz digraph.
+ *
+ * If visits were counted (see @ref regex_enable_profile), the states are
+ * labelled with them and filled from white (never visited) to red (hottest).
+ *
+ * @param regex Pointer to the regex state
+ * @param out The stream to write to
+ */
+void regex_write_dot(const Regex *regex, FILE *out);
+
 // void regex_run(Regex *regex, const char *input_line);
 
@@ -0,0 +1,316 @@
+#include "reverse.h"
+
+#include "utils.h"
+
+#include <string.h>
+
+/**
+ * @struct ReverseBuilder
+ * @brief State needed only while reversing the nfa.
+ */
+typedef struct ReverseBuilder {
+    ReverseNfa *reverse;
+    const Allocator *allocator;
+    int total_states; /**< Number of nfa states the buffers are allocated for */
+
+    State **nfa; /**< The nfa states reachable from the entries, indexed by their id */
+    int nfa_len; /**< Number of nfa states */
+
+    State **stack; /**< Stack used to follow the epsilon edges */
+    unsigned int *seen; /**< Generation in which the nfa state was last visited */
+    unsigned int generation; /**< Current generation */
+    int *closure; /**< Consuming and MATCH states of the last closure */
+    int closure_len; /**< Length of the closure */
+
+    int *edge_head; /**< First edge into each nfa state (-1 if none) */
+    int *edge_from; /**< Nfa state each edge comes from */
+    int *edge_next; /**< Next edge into the same nfa state */
+    int edge_count; /**< Number of edges */
+    int edge_capacity; /**< Number of edges allocated */
+
+    bool *initial; /**< The nfa state can be the first state of a match */
+    int *finals; /**< Nfa states whose out leads to MATCH */
+    int final_count; /**< Number of finals */
+
+    State **mirror; /**< Reversed state of each nfa state (NULL until created) */
+    int *queue; /**< Nfa states whose reversed state has no out yet */
+    int queue_len; /**< Number of nfa states queued */
+    State *match; /**< The MATCH state of the reversed nfa (NULL until needed) */
+    State **targets; /**< Outs of the reversed state being built */
+} ReverseBuilder;
+
+/**
+ * @brief Check whether the nfa state consumes a byte.
+ *
+ * @param state The nfa state
+ *
+ * @return true for literal, any character and range states.
+ */
+static bool reverse_is_consuming(const State *state);
+
+/**
+ * @brief Number the nfa states reachable from the state (without the loop skipping characters).
+ *
+ * @param builder Pointer to the builder
+ * @param state The nfa state
+ */
+static void reverse_builder_collect(ReverseBuilder *builder, State *state);
+
+/**
+ * @brief Compute the consuming and MATCH states reachable by epsilon edges from the state.
+ *
+ * @param builder Pointer to the builder
+ * @param state The nfa state
+ */
+static void reverse_builder_closure(ReverseBuilder *builder, State *state);
+
+/**
+ * @brief Record that the nfa goes from one state to the other on its byte.
+ *
+ * @param builder Pointer to the builder
+ * @param from Id of the consuming state
+ * @param to Id of the state reached
+ */
+static void reverse_builder_add_edge(ReverseBuilder *builder, int from, int to);
+
+/**
+ * @brief Create a state of the reversed nfa.
+ *
+ * @param builder Pointer to the builder
+ * @param c The character of the state
+ *
+ * @return The new state.
+ */
+static State *reverse_builder_new_state(ReverseBuilder *builder, int c);
+
+/**
+ * @brief Get the reversed state of the nfa state, creating and queueing it the first time.
+ *
+ * @param builder Pointer to the builder
+ * @param id Id of the nfa state
+ *
+ * @return The reversed state.
+ */
+static State *reverse_builder_mirror(ReverseBuilder *builder, int id);
+
+/**
+ * @brief Join the targets with branch states.
+ *
+ * @param builder Pointer to the builder
+ * @param count Number of targets (at least 1)
+ *
+ * @return State leading to all the targets.
+ */
+static State *reverse_builder_join(ReverseBuilder *builder, int count);
+
+/**
+ * @brief Free the buffers of the builder.
+ *
+ * @param builder Pointer to the builder
+ */
+static void reverse_builder_destroy(ReverseBuilder *builder);
+
+bool reverse_nfa_create(ReverseNfa *reverse, State *const *entries, int entry_count, int total_states,
+    const Allocator *allocator) {
+    *reverse = (ReverseNfa){0};
+
+    ReverseBuilder builder = {.reverse = reverse, .allocator = allocator, .total_states = total_states};
+    builder.nfa = memory_allocate(allocator, sizeof(State *) * total_states);
+    builder.stack = memory_allocate(allocator, sizeof(State *) * total_states);
+    builder.seen = memory_allocate(allocator, sizeof(unsigned int) * total_states);
+    builder.closure = memory_allocate(allocator, sizeof(int) * total_states);
+    builder.edge_head = memory_allocate(allocator, sizeof(int) * total_states);
+    builder.initial = memory_allocate(allocator, sizeof(bool) * total_states);
+    builder.finals = memory_allocate(allocator, sizeof(int) * total_states);
+    builder.mirror = memory_allocate(allocator, sizeof(State *) * total_states);
+    builder.queue = memory_allocate(allocator, sizeof(int) * total_states);
+    builder.targets = memory_allocate(allocator, sizeof(State *) * (total_states + 1));
+
+    memset(builder.seen, 0, sizeof(unsigned int) * total_states);
+    for (int i = 0; i < entry_count; ++i) reverse_builder_collect(&builder, entries[i]);
+    for (int i = 0; i < builder.nfa_len; ++i) {
+        builder.edge_head[i] = -1;
+        builder.initial[i] = false;
+        builder.mirror[i] = NULL;
+    }
+
+    bool reversible = true;
+
+    // A match starts in the closure of an entry, it must not be empty
+    for (int i = 0; i < entry_count && reversible; ++i) {
+        reverse_builder_closure(&builder, entries[i]);
+        for (int j = 0; j < builder.closure_len; ++j) {
+            reversible &= builder.nfa[builder.closure[j]]->c != MATCH;
+            builder.initial[builder.closure[j]] = true;
+        }
+    }
+
+    // Reverse the edges, the ones reaching MATCH must consume the new line
+    for (int from = 0; from < builder.nfa_len && reversible; ++from) {
+        const State *state = builder.nfa[from];
+        if (!reverse_is_consuming(state)) continue;
+
+        reverse_builder_closure(&builder, state->out);
+        for (int j = 0; j < builder.closure_len; ++j) {
+            if (builder.nfa[builder.closure[j]]->c != MATCH) {
+                reverse_builder_add_edge(&builder, from, builder.closure[j]);
+                continue;
+            }
+
+            bool new_line = state->c == LINE_END
+                || (state->c == RANGE && state->range.start == LINE_END && state->range.end == LINE_END);
+            reversible &= new_line;
+            builder.finals[builder.final_count++] = from;
+        }
+    }
+
+    if (!reversible || !builder.final_count) {
+        reverse_builder_destroy(&builder);
+        return false;
+    }
+
+    // Start at the states consuming the new line, then follow the edges backwards
+    for (int i = 0; i < builder.final_count; ++i) builder.targets[i] = reverse_builder_mirror(&builder, builder.finals[i]);
+    reverse->start = reverse_builder_join(&builder, builder.final_count);
+
+    while (builder.queue_len) {
+        int id = builder.queue[--builder.queue_len];
+
+        int count = 0;
+        for (int edge = builder.edge_head[id]; edge >= 0; edge = builder.edge_next[edge])
+            builder.targets[count++] = reverse_builder_mirror(&builder, builder.edge_from[edge]);
+        if (builder.initial[id]) {
+            if (!builder.match) builder.match = reverse_builder_new_state(&builder, MATCH);
+            builder.targets[count++] = builder.match;
+        }
+
+        // Every state is reached from an entry, so it is initial or has an edge into it
+        builder.mirror[id]->out = reverse_builder_join(&builder, count);
+    }
+
+    reverse_builder_destroy(&builder);
+    return true;
+}
+
+void reverse_nfa_destroy(ReverseNfa *reverse, const Allocator *allocator) {
+    for (int i = 0; i < reverse->state_count; ++i) state_destroy(allocator, reverse->states[i]);
+    memory_free(allocator, reverse->states, sizeof(State *) * reverse->state_capacity);
+    *reverse = (ReverseNfa){0};
+}
+
+static bool reverse_is_consuming(const State *state) {
+    return state->c <= LITERAL_CHAR_LAST || state->c == ANY_CHAR || state->c == RANGE;
+}
+
+static void reverse_builder_collect(ReverseBuilder *builder, State *state) {
+    // Same depth first walk as the other passes, ids are the visiting order
+    if (!state || (state->id < builder->nfa_len && builder->nfa[state->id] == state)) return;
+
+    state->id = builder->nfa_len;
+    builder->nfa[builder->nfa_len++] = state;
+
+    reverse_builder_collect(builder, state->out);
+    reverse_builder_collect(builder, state->out1);
+}
+
+static void reverse_builder_closure(ReverseBuilder *builder, State *state) {
+    builder->generation++;
+    builder->closure_len = 0;
+
+    int top = 0;
+    builder->stack[top++] = state;
+    builder->seen[state->id] = builder->generation;
+
+    while (top) {
+        State *current = builder->stack[--top];
+        State *outs[2] = {NULL, NULL};
+        switch (current->c) {
+            case BRANCH:
+                outs[1] = current->out1;
+                /* fallthrough */
+            case EPSILON:
+                outs[0] = current->out;
+                break;
+            default:
+                builder->closure[builder->closure_len++] = current->id;
+                break;
+        }
+
+        for (int i = 0; i < 2; ++i) {
+            if (!outs[i] || builder->seen[outs[i]->id] == builder->generation) continue;
+            builder->seen[outs[i]->id] = builder->generation;
+            builder->stack[top++] = outs[i];
+        }
+    }
+}
+
+static void reverse_builder_add_edge(ReverseBuilder *builder, int from, int to) {
+    if (builder->edge_count == builder->edge_capacity) {
+        int capacity = builder->edge_capacity ? builder->edge_capacity * 2 : 64;
+        builder->edge_from = memory_reallocate(builder->allocator, builder->edge_from,
+            sizeof(int) * builder->edge_capacity, sizeof(int) * capacity);
+        builder->edge_next = memory_reallocate(builder->allocator, builder->edge_next,
+            sizeof(int) * builder->edge_capacity, sizeof(int) * capacity);
+        builder->edge_capacity = capacity;
+    }
+
+    builder->edge_from[builder->edge_count] = from;
+    builder->edge_next[builder->edge_count] = builder->edge_head[to];
+    builder->edge_head[to] = builder->edge_count++;
+}
+
+static State *reverse_builder_new_state(ReverseBuilder *builder, int c) {
+    ReverseNfa *reverse = builder->reverse;
+    if (reverse->state_count == reverse->state_capacity) {
+        int capacity = reverse->state_capacity ? reverse->state_capacity * 2 : 16;
+        reverse->states = memory_reallocate(builder->allocator, reverse->states,
+            sizeof(State *) * reverse->state_capacity, sizeof(State *) * capacity);
+        reverse->state_capacity = capacity;
+    }
+
+    State *state = state_create(builder->allocator, c);
+    reverse->states[reverse->state_count++] = state;
+    return state;
+}
+
+static State *reverse_builder_mirror(ReverseBuilder *builder, int id) {
+    if (builder->mirror[id]) return builder->mirror[id];
+
+    const State *state = builder->nfa[id];
+    State *mirror = reverse_builder_new_state(builder, state->c);
+    mirror->range = state->range;
+
+    builder->mirror[id] = mirror;
+    builder->queue[builder->queue_len++] = id;
+    return mirror;
+}
+
+static State *reverse_builder_join(ReverseBuilder *builder, int count) {
+    State *joined = builder->targets[count - 1];
+    for (int i = count - 2; i >= 0; --i) {
+        State *branch = reverse_builder_new_state(builder, BRANCH);
+        branch->out = builder->targets[i];
+        branch->out1 = joined;
+        joined = branch;
+    }
+
+    return joined;
+}
+
+static void reverse_builder_destroy(ReverseBuilder *builder) {
+    const Allocator *allocator = builder->allocator;
+    int total_states = builder->total_states;
+
+    memory_free(allocator, builder->nfa, sizeof(State *) * total_states);
+    memory_free(allocator, builder->stack, sizeof(State *) * total_states);
+    memory_free(allocator, builder->seen, sizeof(unsigned int) * total_states);
+    memory_free(allocator, builder->closure, sizeof(int) * total_states);
+    memory_free(allocator, builder->edge_head, sizeof(int) * total_states);
+    memory_free(allocator, builder->edge_from, sizeof(int) * builder->edge_capacity);
+    memory_free(allocator, builder->edge_next, sizeof(int) * builder->edge_capacity);
+    memory_free(allocator, builder->initial, sizeof(bool) * total_states);
+    memory_free(allocator, builder->finals, sizeof(int) * total_states);
+    memory_free(allocator, builder->mirror, sizeof(State *) * total_states);
+    memory_free(allocator, builder->queue, sizeof(int) * total_states);
+    memory_free(allocator, builder->targets, sizeof(State *) * (total_states + 1));
+}
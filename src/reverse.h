@@ -0,0 +1,46 @@
+#pragma once
+
+#include "state.h"
+#include "memory.h"
+
+#include <stdbool.h>
+
+/**
+ * @struct ReverseNfa reverse.h
+ * @brief Nfa of the reversed pattern, stepped from the end of the line towards its start.
+ *
+ * Only built for patterns whose every match ends by consuming the new line
+ * at the end of the line (every alternative ends with '$'), so it starts at
+ * the end of the line and reaches its MATCH state as soon as the bytes read
+ * backwards contain a whole match.
+ */
+typedef struct ReverseNfa {
+    State *start; /**< Start state (reads the new line first) */
+    State **states; /**< All the states, to destroy them */
+    int state_count; /**< Number of states */
+    int state_capacity; /**< Number of states the array can hold */
+} ReverseNfa;
+
+/**
+ * @brief Build the reversed nfa of the alternatives.
+ *
+ * @note Overwrites the id of the nfa states, so the nfa should not be stepped meanwhile.
+ *
+ * @param reverse Pointer to the reversed nfa
+ * @param entries First state of each top-level alternative (without the loop skipping characters)
+ * @param entry_count Number of entries
+ * @param total_states Total number of states in the nfa
+ * @param allocator The allocator to use
+ *
+ * @return false if a match can end before the end of the line (nothing is allocated then).
+ */
+bool reverse_nfa_create(ReverseNfa *reverse, State *const *entries, int entry_count, int total_states,
+    const Allocator *allocator);
+
+/**
+ * @brief Destroy the reversed nfa.
+ *
+ * @param reverse Pointer to the reversed nfa
+ * @param allocator The allocator used to create it
+ */
+void reverse_nfa_destroy(ReverseNfa *reverse, const Allocator *allocator);
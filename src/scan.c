@@ -0,0 +1,296 @@
+#include "scan.h"
+
+#include "memory.h"
+#include "pool.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+typedef struct Scan Scan;
+
+/**
+ * @struct ScanChunk
+ * @brief One leaf of the reduction tree.
+ */
+typedef struct ScanChunk {
+    Scan *scan; /**< The scan */
+    int node; /**< Node of the chunk in the tree */
+    size_t offset; /**< Offset of the chunk in the input */
+    size_t length; /**< Length of the chunk (0 for the leaves after the last chunk) */
+} ScanChunk;
+
+/**
+ * @struct ScanWorker
+ * @brief Buffers of one worker, reused for each chunk it maps.
+ */
+typedef struct ScanWorker {
+    int *current; /**< The distinct states reached from the start states */
+    int *start_of; /**< Index in current of the state each start state reached (-1 for the final states) */
+    int *merged; /**< Index each entry of current moves to when merging */
+    int *seen; /**< Index + 1 in current of each state while merging (0 if not seen) */
+    unsigned long long steps; /**< Dfa steps taken */
+} ScanWorker;
+
+/**
+ * @struct Scan
+ * @brief State shared by the tasks of one @ref scan_match.
+ *
+ * The tree is stored like a heap, node 1 is the root and the children of
+ * node n are 2n (earlier bytes) and 2n + 1. Each node holds the map of its
+ * bytes, from the row of the state entering them to the state leaving them.
+ */
+struct Scan {
+    const Dfa *dfa; /**< The dfa */
+    const unsigned char *input; /**< The input */
+    Pool pool; /**< The workers */
+    ScanWorker *workers; /**< Buffers of each worker */
+
+    int leaf_count; /**< Number of leaves (power of 2, at least the number of chunks) */
+    ScanChunk *chunks; /**< The leaves, chunk i is node leaf_count + i */
+    int *maps; /**< Map of each node (state_count states each) */
+    atomic_int *pending; /**< Children of each inner node still mapping their bytes */
+};
+
+/**
+ * @brief Submit the task of each chunk.
+ *
+ * @param pool The pool running the task
+ * @param worker Index of the worker running the task
+ * @param arg The scan
+ */
+static void scan_task_root(Pool *pool, int worker, void *arg);
+
+/**
+ * @brief Map the chunk, then compose the maps of the nodes it was the last child to finish.
+ *
+ * @param pool The pool running the task
+ * @param worker Index of the worker running the task
+ * @param arg The chunk
+ */
+static void scan_task_chunk(Pool *pool, int worker, void *arg);
+
+/**
+ * @brief Run the bytes through the dfa from every state.
+ *
+ * @param scan The scan
+ * @param worker Buffers of the worker
+ * @param input The bytes
+ * @param len Number of bytes
+ * @param map Array of state_count to store the state each row leads to
+ */
+static void scan_map_chunk(const Scan *scan, ScanWorker *worker, const unsigned char *input, size_t len, int *map);
+
+/**
+ * @brief Compose the maps of the children of the node.
+ *
+ * @param scan The scan
+ * @param node The inner node
+ */
+static void scan_compose(Scan *scan, int node);
+
+/**
+ * @brief Get the map of the node.
+ *
+ * @param scan The scan
+ * @param node The node
+ *
+ * @return The map.
+ */
+static int *scan_map(const Scan *scan, int node);
+
+bool scan_match(Regex *regex, const char *data, size_t len, const ScanOptions *options, ScanSummary *summary) {
+    static const ScanOptions default_options = {0};
+    if (!options) options = &default_options;
+
+    const unsigned char *input = (const unsigned char *)data;
+    size_t chunk_bytes = options->chunk_bytes ? options->chunk_bytes : SCAN_DEFAULT_CHUNK_BYTES;
+    // The new line ending the input is stepped after the text, like regex_match_batch() does
+    size_t text_len = len - (len && input[len - 1] == '\n');
+    size_t chunk_count = text_len ? (text_len + chunk_bytes - 1) / chunk_bytes : 1;
+
+    const Dfa *dfa = &regex->dfa;
+    Scan scan = {.dfa = dfa, .input = input, .leaf_count = 1};
+    while ((size_t)scan.leaf_count < chunk_count) scan.leaf_count *= 2;
+
+    // Nothing to split, no dfa to map the chunks with, or no workers
+    if (!regex->use_dfa || chunk_count == 1 || !pool_create(&scan.pool, options->threads, &scan, &regex->allocator)) {
+        bool matched;
+        size_t decided_at = len;
+        if (regex->use_dfa && !regex->limited) {
+            // The steps of regex_match_batch(), keeping the offset the result was decided at
+            size_t offset = 0;
+            int state = dfa_run(dfa, dfa->start, input, text_len, &offset);
+            if (dfa_is_final(dfa, state)) decided_at = offset;
+            else state = dfa_end(dfa, state, true);
+            matched = state == dfa->match;
+        } else {
+            RegexInput whole = {data, len};
+            uint64_t results;
+            regex_match_batch(regex, &whole, 1, &results);
+            matched = results;
+        }
+
+        if (summary) *summary = (ScanSummary){.threads = 1, .chunks = 1, .decided_at = decided_at, .states_per_byte = 1};
+        return matched;
+    }
+
+    const Allocator *allocator = &regex->allocator;
+    scan.workers = memory_allocate(allocator, sizeof(ScanWorker) * scan.pool.worker_count);
+    scan.chunks = memory_allocate(allocator, sizeof(ScanChunk) * scan.leaf_count);
+    scan.maps = memory_allocate(allocator, sizeof(int) * 2 * scan.leaf_count * dfa->state_count);
+    scan.pending = memory_allocate(allocator, sizeof(atomic_int) * scan.leaf_count);
+
+    for (int i = 0; i < scan.pool.worker_count; ++i) {
+        ScanWorker *worker = &scan.workers[i];
+        *worker = (ScanWorker){
+            .current = memory_allocate(allocator, sizeof(int) * dfa->state_count),
+            .start_of = memory_allocate(allocator, sizeof(int) * dfa->state_count),
+            .merged = memory_allocate(allocator, sizeof(int) * dfa->state_count),
+            .seen = memory_allocate(allocator, sizeof(int) * dfa->state_count),
+        };
+        memset(worker->seen, 0, sizeof(int) * dfa->state_count);
+    }
+
+    for (int node = 1; node < scan.leaf_count; ++node) atomic_init(&scan.pending[node], 2);
+    for (int i = 0; i < scan.leaf_count; ++i) {
+        size_t offset = (size_t)i * chunk_bytes;
+        scan.chunks[i] = (ScanChunk){
+            .scan = &scan,
+            .node = scan.leaf_count + i,
+            .offset = offset < text_len ? offset : text_len,
+            .length = offset < text_len ? (text_len - offset < chunk_bytes ? text_len - offset : chunk_bytes) : 0,
+        };
+    }
+
+    pool_start(&scan.pool, scan_task_root, &scan);
+    pool_join(&scan.pool);
+
+    // Walk the tree down, the state entering the right child is the one leaving the left child
+    int state = dfa->start;
+    int node = 1;
+    size_t decided_at = len;
+    while (node < scan.leaf_count) {
+        int left = scan_map(&scan, 2 * node)[state / dfa->class_count];
+        // The scan would stop in the first bytes that reach a final state
+        if (dfa_is_final(dfa, left)) {
+            node = 2 * node;
+        } else {
+            state = left;
+            node = 2 * node + 1;
+        }
+    }
+
+    // Find where the serial scan stops in that chunk, and the state it leaves with
+    const ScanChunk *chunk = &scan.chunks[node - scan.leaf_count];
+    if (dfa_is_final(dfa, scan_map(&scan, node)[state / dfa->class_count])) {
+        size_t offset = chunk->offset;
+        state = dfa_run(dfa, state, input, chunk->offset + chunk->length, &offset);
+        decided_at = offset;
+    } else {
+        state = scan_map(&scan, 1)[dfa->start / dfa->class_count];
+    }
+
+    // The end of the text, and the new line ending the line
+    if (!dfa_is_final(dfa, state)) state = dfa_end(dfa, state, true);
+
+    unsigned long long steps = 0;
+    for (int i = 0; i < scan.pool.worker_count; ++i) steps += scan.workers[i].steps;
+    if (summary) {
+        *summary = (ScanSummary){
+            .parallel = true,
+            .threads = scan.pool.worker_count,
+            .chunks = chunk_count,
+            .decided_at = decided_at,
+            .states_per_byte = (double)steps / len,
+        };
+    }
+
+    for (int i = 0; i < scan.pool.worker_count; ++i) {
+        memory_free(allocator, scan.workers[i].current, sizeof(int) * dfa->state_count);
+        memory_free(allocator, scan.workers[i].start_of, sizeof(int) * dfa->state_count);
+        memory_free(allocator, scan.workers[i].merged, sizeof(int) * dfa->state_count);
+        memory_free(allocator, scan.workers[i].seen, sizeof(int) * dfa->state_count);
+    }
+    memory_free(allocator, scan.workers, sizeof(ScanWorker) * scan.pool.worker_count);
+    memory_free(allocator, scan.chunks, sizeof(ScanChunk) * scan.leaf_count);
+    memory_free(allocator, scan.maps, sizeof(int) * 2 * scan.leaf_count * dfa->state_count);
+    memory_free(allocator, scan.pending, sizeof(atomic_int) * scan.leaf_count);
+    pool_destroy(&scan.pool);
+
+    return state == dfa->match;
+}
+
+static void scan_task_root(Pool *pool, int worker, void *arg) {
+    Scan *scan = arg;
+    for (int i = 0; i < scan->leaf_count; ++i) pool_submit(pool, worker, scan_task_chunk, &scan->chunks[i]);
+}
+
+static void scan_task_chunk(Pool *pool, int worker, void *arg) {
+    ScanChunk *chunk = arg;
+    Scan *scan = chunk->scan;
+    (void)pool;
+
+    scan_map_chunk(scan, &scan->workers[worker], scan->input + chunk->offset, chunk->length, scan_map(scan, chunk->node));
+
+    // The last of the two children to finish composes their parent
+    for (int node = chunk->node / 2; node >= 1; node /= 2) {
+        if (atomic_fetch_sub(&scan->pending[node], 1) != 1) break;
+        scan_compose(scan, node);
+    }
+}
+
+static void scan_map_chunk(const Scan *scan, ScanWorker *worker, const unsigned char *input, size_t len, int *map) {
+    const Dfa *dfa = scan->dfa;
+    int class_count = dfa->class_count;
+
+    // The dead and match states never change, every other state is stepped
+    int count = 0;
+    for (int row = 0; row < dfa->state_count; ++row) {
+        bool final = dfa_is_final(dfa, row * class_count);
+        worker->start_of[row] = final ? -1 : count;
+        if (!final) worker->current[count++] = row * class_count;
+    }
+
+    size_t i = 0;
+    while (i < len && count > 1) {
+        size_t end = len - i < SCAN_MERGE_BYTES ? len : i + SCAN_MERGE_BYTES;
+        worker->steps += (unsigned long long)count * (end - i);
+        for (; i < end; ++i)
+            for (int s = 0; s < count; ++s) worker->current[s] = dfa_next(dfa, worker->current[s], input[i]);
+
+        // Start states that reached the same state go on together
+        int distinct = 0;
+        for (int s = 0; s < count; ++s) {
+            int row = worker->current[s] / class_count;
+            if (!worker->seen[row]) {
+                worker->seen[row] = distinct + 1;
+                worker->current[distinct++] = worker->current[s];
+            }
+            worker->merged[s] = worker->seen[row] - 1;
+        }
+        for (int s = 0; s < distinct; ++s) worker->seen[worker->current[s] / class_count] = 0;
+        for (int row = 0; row < dfa->state_count; ++row)
+            if (worker->start_of[row] >= 0) worker->start_of[row] = worker->merged[worker->start_of[row]];
+        count = distinct;
+    }
+
+    // A single state left steps like the serial scan (skipping ahead in accelerated states)
+    if (count == 1 && i < len) {
+        size_t start = i;
+        worker->current[0] = dfa_run(dfa, worker->current[0], input, len, &i);
+        worker->steps += i - start;
+    }
+
+    for (int row = 0; row < dfa->state_count; ++row)
+        map[row] = worker->start_of[row] < 0 ? row * class_count : worker->current[worker->start_of[row]];
+}
+
+static void scan_compose(Scan *scan, int node) {
+    const int *left = scan_map(scan, 2 * node), *right = scan_map(scan, 2 * node + 1);
+    int *map = scan_map(scan, node);
+    for (int row = 0; row < scan->dfa->state_count; ++row) map[row] = right[left[row] / scan->dfa->class_count];
+}
+
+static int *scan_map(const Scan *scan, int node) {
+    return &scan->maps[(size_t)node * scan->dfa->state_count];
+}
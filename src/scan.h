@@ -0,0 +1,68 @@
+#pragma once
+
+#include "regex.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Inputs are cut into chunks of this size by default.
+ */
+#define SCAN_DEFAULT_CHUNK_BYTES (1024 * 1024)
+
+/**
+ * @brief Bytes stepped from every start state between merging the ones that reached the same state.
+ */
+#define SCAN_MERGE_BYTES 64
+
+/**
+ * @struct ScanOptions scan.h
+ * @brief Options of @ref scan_match.
+ */
+typedef struct ScanOptions {
+    int threads; /**< Number of workers (0 for number of online processors) */
+    size_t chunk_bytes; /**< Bytes of input each task maps (0 for SCAN_DEFAULT_CHUNK_BYTES) */
+} ScanOptions;
+
+/**
+ * @struct ScanSummary scan.h
+ * @brief How one @ref scan_match went.
+ */
+typedef struct ScanSummary {
+    bool parallel; /**< false if the input was matched serially (no dfa, a single chunk, or no workers could be allocated) */
+    int threads; /**< Number of workers used */
+    size_t chunks; /**< Number of chunks the input was cut into */
+    size_t decided_at; /**< Offset after the byte that decided the result, like a serial scan (end of the first match if it matched, the length without a dfa or with limits) */
+    double states_per_byte; /**< Dfa states stepped per byte of input (1 once every start state of a chunk converged) */
+} ScanSummary;
+
+/**
+ * @brief Search one large input for the pattern with several threads, wherever the chunks are cut.
+ *
+ * The input is matched as one line, exactly like @ref regex_match_batch
+ * would match it, but it can not be split at new lines (multi-line records,
+ * binary data). Each chunk is run through the dfa from every state at once,
+ * which gives the function mapping the state entering the chunk to the state
+ * leaving it. The starts reaching the same state are merged every
+ * SCAN_MERGE_BYTES bytes, and once they all converged the chunk costs about
+ * as much as a serial scan. The maps are composed with a parallel prefix (a
+ * reduction tree walked by the workers as their chunks finish, then the
+ * state entering each chunk is read top down), so the state leaving the
+ * input is the one of the serial scan.
+ *
+ * Meant for patterns with small dfas, mapping a chunk costs up to its
+ * length times the number of dfa states. Patterns without a dfa, and inputs
+ * of a single chunk, are matched serially.
+ *
+ * @note If the dfa is built the regex is only read, so other threads can match with it meanwhile. The
+ * maps and the buffers of the workers are allocated with the allocator of the regex.
+ *
+ * @param regex Pointer to the regex state
+ * @param data The input (need not be NUL-terminated)
+ * @param len Length of the input
+ * @param options The options (NULL for defaults)
+ * @param summary Pointer to store how the scan went (can be NULL)
+ *
+ * @return true if the input contains the pattern.
+ */
+bool scan_match(Regex *regex, const char *data, size_t len, const ScanOptions *options, ScanSummary *summary);
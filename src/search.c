@@ -0,0 +1,1015 @@
+// Directory listing, pread() and mmap() are POSIX, d_type is a BSD extension
+#define _DEFAULT_SOURCE
+
+#include "search.h"
+
+#include "memory.h"
+#include "pool.h"
+#include "uring.h"
+#include "utils.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <threads.h>
+#include <unistd.h>
+
+/**
+ * @brief Bytes read at a time to find the end of the last line of a chunk.
+ */
+#define SEARCH_LINE_READ_BYTES 4096
+
+/**
+ * @enum SearchNodeKind
+ * @brief Kinds of nodes in the search tree.
+ */
+typedef enum SearchNodeKind {
+    SEARCH_NODE_DIRECTORY, /**< Children are the sorted entries */
+    SEARCH_NODE_FILE, /**< Children are the chunks */
+    SEARCH_NODE_CHUNK, /**< Holds the matching lines */
+} SearchNodeKind;
+
+/**
+ * @struct SearchNode
+ * @brief One node of the search tree, printed in depth first order.
+ *
+ * A node is filled by one task and handed over to the printing thread by
+ * setting done, nothing else is shared.
+ */
+typedef struct SearchNode {
+    SearchNodeKind kind;
+    char *path; /**< Path of the directory or file (NULL for chunks) */
+    struct SearchNode *file; /**< File of the chunk */
+    size_t offset; /**< Offset of the chunk in the file */
+    size_t length; /**< Length of the chunk */
+
+    struct SearchNode *children; /**< Entries of the directory or chunks of the file */
+    size_t child_count; /**< Number of children */
+    size_t child_capacity; /**< Number of children allocated */
+
+    char *output; /**< Matching lines of the chunk, each ending with a new line */
+    size_t output_len; /**< Bytes used in output */
+    size_t output_capacity; /**< Bytes allocated for output */
+    size_t *match_lines; /**< Line number (in the chunk) of each matching line */
+    size_t match_count; /**< Number of matching lines */
+    size_t match_capacity; /**< Number of line numbers allocated */
+    size_t line_count; /**< Number of lines starting in the chunk */
+
+    char *map; /**< The mapped file (SEARCH_IO_MMAP) */
+    size_t map_len; /**< Length of the mapping */
+    atomic_size_t map_users; /**< Chunks not searched yet, the last one unmaps the file */
+
+    atomic_bool done; /**< The node is ready to be printed */
+} SearchNode;
+
+/**
+ * @struct SearchBuffer
+ * @brief Growable buffer reused for reading chunks.
+ */
+typedef struct SearchBuffer {
+    char *data;
+    size_t len; /**< Bytes read */
+    size_t capacity; /**< Bytes allocated */
+} SearchBuffer;
+
+/**
+ * @struct SearchSlot
+ * @brief A read in flight (SEARCH_IO_URING).
+ */
+typedef struct SearchSlot {
+    SearchNode *chunk; /**< The chunk being read */
+    int fd; /**< The opened file, closed when the chunk is searched */
+    bool binary_probe; /**< The chunk is the whole file, skip it if binary */
+    SearchBuffer buffer; /**< Where the chunk is read (kept for the next reads) */
+} SearchSlot;
+
+/**
+ * @struct SearchReader
+ * @brief Reads of one worker.
+ */
+typedef struct SearchReader {
+    SearchBuffer buffer; /**< Buffer of plain reads */
+    Uring uring; /**< Queue of the reads (SEARCH_IO_URING) */
+    SearchSlot *slots; /**< One slot for each read that can be in flight */
+    int slot_count; /**< Number of slots (the queue depth) */
+    int *free_slots; /**< Stack of the free slots */
+    int free_count; /**< Number of free slots */
+} SearchReader;
+
+/**
+ * @struct Search
+ * @brief State shared by the tasks of one search.
+ */
+typedef struct Search {
+    Pool pool;
+    const Allocator *allocator; /**< Allocator of every buffer (the one of the regexes, NULL for default allocator) */
+    Regex *regexes; /**< Regex of each worker */
+    SearchReader *readers; /**< Reads of each worker */
+    SearchIo io; /**< How the files are read */
+    size_t chunk_bytes; /**< Chunk size of large files */
+    SearchNode root; /**< Children are the searched paths */
+
+    mtx_t lock; /**< Guards waiting for progress */
+    cnd_t progress; /**< Signaled when a node is done */
+
+    atomic_size_t directories; /**< Directories listed (see SearchSummary) */
+    atomic_size_t files; /**< Files searched */
+    atomic_size_t binary_files; /**< Files skipped as binary */
+    atomic_size_t errors; /**< Paths that could not be opened, read or allocated */
+    atomic_ullong bytes; /**< Bytes searched */
+    atomic_ullong matched_lines; /**< Lines that matched, counted by the workers as the chunks finish */
+} Search;
+
+/**
+ * @brief Create the workers, their readers and regexes, and the root of the search tree.
+ *
+ * @param search Pointer to the search, holding the options already
+ * @param re The regex
+ * @param path_count Number of searched paths
+ * @param options The options
+ *
+ * @return false if the search could not be allocated (nothing to destroy then).
+ */
+static bool search_create(Search *search, const char *re, size_t path_count, const SearchOptions *options);
+
+/**
+ * @brief Destroy the workers, their readers and regexes.
+ *
+ * @param search Pointer to the search
+ */
+static void search_destroy(Search *search);
+
+/**
+ * @brief Create the readers of the workers.
+ *
+ * @param search Pointer to the search
+ * @param queue_depth Reads in flight per worker (SEARCH_IO_URING)
+ *
+ * @return false if io_uring is not available or the readers could not be allocated (no readers are created then).
+ */
+static bool search_readers_create(Search *search, int queue_depth);
+
+/**
+ * @brief Destroy the readers of the workers.
+ *
+ * @param search Pointer to the search
+ */
+static void search_readers_destroy(Search *search);
+
+/**
+ * @brief Submit a task for each child of the root.
+ *
+ * @param pool The pool
+ * @param worker Index of the worker
+ * @param arg Pointer to the root node
+ */
+static void search_task_root(Pool *pool, int worker, void *arg);
+
+/**
+ * @brief List the directory and submit a task for each entry.
+ *
+ * @param pool The pool
+ * @param worker Index of the worker
+ * @param arg Pointer to the directory node
+ */
+static void search_task_directory(Pool *pool, int worker, void *arg);
+
+/**
+ * @brief Search a small file or split a large file in chunks.
+ *
+ * @param pool The pool
+ * @param worker Index of the worker
+ * @param arg Pointer to the file node
+ */
+static void search_task_file(Pool *pool, int worker, void *arg);
+
+/**
+ * @brief Search one chunk of a large file.
+ *
+ * @param pool The pool
+ * @param worker Index of the worker
+ * @param arg Pointer to the chunk node
+ */
+static void search_task_chunk(Pool *pool, int worker, void *arg);
+
+/**
+ * @brief Read the chunk and search it, or queue the read (SEARCH_IO_URING).
+ *
+ * @param search Pointer to the search
+ * @param worker Index of the worker
+ * @param chunk Pointer to the chunk node
+ * @param fd The opened file (closed when the chunk is searched)
+ * @param binary_probe The chunk is the whole file, skip it if binary
+ */
+static void search_read_chunk(Search *search, int worker, SearchNode *chunk, int fd, bool binary_probe);
+
+/**
+ * @brief Queue the read of the chunk in a free slot (SEARCH_IO_URING).
+ *
+ * @param search Pointer to the search
+ * @param worker Index of the worker
+ * @param chunk Pointer to the chunk node
+ * @param fd The opened file (closed when the chunk is searched)
+ * @param binary_probe The chunk is the whole file, skip it if binary
+ *
+ * @return false if io_uring failed (logged and counted), the chunk should be read with pread() then.
+ */
+static bool search_queue_chunk(Search *search, int worker, SearchNode *chunk, int fd, bool binary_probe);
+
+/**
+ * @brief Search the chunks whose reads have completed.
+ *
+ * @param search Pointer to the search
+ * @param worker Index of the worker
+ * @param wait Wait for at least one read to complete
+ *
+ * @return true if any chunk was searched.
+ */
+static bool search_reader_complete(Search *search, int worker, bool wait);
+
+/**
+ * @brief Search the reads in flight of an idle worker (PoolIdleFunction).
+ *
+ * @param pool The pool
+ * @param worker Index of the worker
+ *
+ * @return true if any chunk was searched.
+ */
+static bool search_reader_idle(Pool *pool, int worker);
+
+/**
+ * @brief Read the rest of the chunk (and the byte before it) up to the end of its last line.
+ *
+ * @param search Pointer to the search
+ * @param chunk Pointer to the chunk node
+ * @param fd The opened file
+ * @param buffer The buffer, holding the first len bytes already
+ *
+ * @return false if the buffer could not grow (logged and counted), the chunk should not be searched then.
+ */
+static bool search_read_rest(Search *search, SearchNode *chunk, int fd, SearchBuffer *buffer);
+
+/**
+ * @brief Search the lines starting in the chunk.
+ *
+ * @param search Pointer to the search
+ * @param worker Index of the worker
+ * @param chunk Pointer to the chunk node
+ * @param data The chunk and the byte before it, up to the end of its last line (or more)
+ * @param len Length of the data
+ * @param binary_probe The chunk is the whole file, skip it if binary
+ */
+static void search_match_chunk(Search *search, int worker, SearchNode *chunk, const char *data, size_t len,
+    bool binary_probe);
+
+/**
+ * @brief Grow the buffer to at least the capacity.
+ *
+ * @param search Pointer to the search
+ * @param buffer Pointer to the buffer
+ * @param capacity Bytes required
+ *
+ * @return false if the buffer could not grow (it is kept as it was).
+ */
+static bool search_buffer_reserve(Search *search, SearchBuffer *buffer, size_t capacity);
+
+/**
+ * @brief Match the lines starting in the chunk.
+ *
+ * @param search Pointer to the search
+ * @param worker Index of the worker
+ * @param chunk Pointer to the chunk node
+ * @param data The chunk starting at its first line, up to the end of its last line
+ * @param len Length of the data
+ * @param end Lines starting at or after this offset in the data belong to the next chunk
+ */
+static void search_match_lines(Search *search, int worker, SearchNode *chunk, const char *data, size_t len,
+    size_t end);
+
+/**
+ * @brief Append a matching line to the chunk.
+ *
+ * @param search Pointer to the search
+ * @param chunk Pointer to the chunk node
+ * @param line The line (without new line)
+ * @param len Length of the line
+ * @param line_number Line number in the chunk
+ *
+ * @return false if the output of the chunk could not grow (the line is dropped).
+ */
+static bool search_add_match(Search *search, SearchNode *chunk, const char *line, size_t len, size_t line_number);
+
+/**
+ * @brief Initialize the node of a path.
+ *
+ * @param node Pointer to the node
+ * @param kind Kind of the node
+ * @param path The path (owned by the node)
+ */
+static void search_node_init(SearchNode *node, SearchNodeKind kind, char *path);
+
+/**
+ * @brief Mark the node done and wake up the printing thread.
+ *
+ * @param search Pointer to the search
+ * @param node Pointer to the node
+ */
+static void search_node_finish(Search *search, SearchNode *node);
+
+/**
+ * @brief Wait until the node is done.
+ *
+ * @param search Pointer to the search
+ * @param node Pointer to the node
+ */
+static void search_node_wait(Search *search, SearchNode *node);
+
+/**
+ * @brief Free the path of the node.
+ *
+ * @param search Pointer to the search
+ * @param path The path (can be NULL)
+ */
+static void search_free_path(Search *search, char *path);
+
+/**
+ * @brief Print the node (as soon as it is done) and its children, then free them.
+ *
+ * @param search Pointer to the search
+ * @param node Pointer to the node
+ * @param out Where to write the matching lines
+ */
+static void search_print_node(Search *search, SearchNode *node, FILE *out);
+
+/**
+ * @brief Join the directory path and the entry name.
+ *
+ * @param search Pointer to the search
+ * @param directory The directory path
+ * @param name The entry name
+ *
+ * @return Newly allocated path, or NULL if it could not be allocated.
+ */
+static char *search_join_path(Search *search, const char *directory, const char *name);
+
+/**
+ * @brief Compare the paths of two nodes (for qsort).
+ *
+ * @param a Pointer to the first node
+ * @param b Pointer to the second node
+ *
+ * @return Result of strcmp on the paths.
+ */
+static int search_compare_nodes(const void *a, const void *b);
+
+const char *search_io_name(SearchIo io) {
+    static const char *names[] = {"read", "mmap", "uring"};
+    return names[io];
+}
+
+bool search_io_from_name(const char *name, SearchIo *io) {
+    for (SearchIo i = SEARCH_IO_READ; i <= SEARCH_IO_URING; ++i) {
+        if (!strcmp(name, search_io_name(i))) {
+            *io = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool search_paths(const char *re, const char *const *paths, size_t path_count, const SearchOptions *options,
+    FILE *out, SearchSummary *summary) {
+    static const SearchOptions default_options = {0};
+    if (!options) options = &default_options;
+
+    Search search = {
+        .allocator = options->regex.allocator,
+        .chunk_bytes = options->chunk_bytes ? options->chunk_bytes : SEARCH_DEFAULT_CHUNK_BYTES,
+        .io = options->io,
+    };
+    if (!search_create(&search, re, path_count, options)) {
+        LOG_ERROR("Failed to allocate the search");
+        if (summary) *summary = (SearchSummary){.errors = 1, .io = search.io};
+        return false;
+    }
+
+    // The given paths are followed even if they are symbolic links
+    for (size_t i = 0; i < path_count; ++i) {
+        struct stat info;
+        if (stat(paths[i], &info)) {
+            LOG_ERROR("Can not open '%s'", paths[i]);
+            search.errors++;
+            continue;
+        }
+
+        char *path = memory_try_allocate(search.allocator, strlen(paths[i]) + 1);
+        if (!path) {
+            LOG_ERROR("Failed to allocate the path '%s'", paths[i]);
+            search.errors++;
+            continue;
+        }
+        strcpy(path, paths[i]);
+
+        SearchNodeKind kind = S_ISDIR(info.st_mode) ? SEARCH_NODE_DIRECTORY : SEARCH_NODE_FILE;
+        search_node_init(&search.root.children[search.root.child_count++], kind, path);
+    }
+    atomic_store(&search.root.done, true);
+
+    pool_start(&search.pool, search_task_root, &search.root);
+    search_print_node(&search, &search.root, out);
+    pool_join(&search.pool);
+
+    if (summary) {
+        *summary = (SearchSummary){
+            .directories = search.directories,
+            .files = search.files,
+            .binary_files = search.binary_files,
+            .errors = search.errors,
+            .bytes = search.bytes,
+            .matched_lines = search.matched_lines,
+            .threads = search.pool.worker_count,
+            .io = search.io,
+        };
+    }
+
+    search_destroy(&search);
+
+    return search.matched_lines;
+}
+
+static bool search_create(Search *search, const char *re, size_t path_count, const SearchOptions *options) {
+    if (!pool_create(&search->pool, options->threads, search, search->allocator)) return false;
+    search->pool.idle_function = search_reader_idle;
+
+    if (!search_readers_create(search, options->queue_depth ? options->queue_depth : SEARCH_DEFAULT_QUEUE_DEPTH)) {
+        LOG_WARN("io_uring is not available, reading the files with read()");
+        search->io = SEARCH_IO_READ;
+        if (!search_readers_create(search, 0)) {
+            pool_destroy(&search->pool);
+            return false;
+        }
+    }
+
+    // Every worker matches with its own regex (the match buffers are not shared)
+    int worker_count = search->pool.worker_count;
+    size_t root_capacity = path_count ? path_count : 1;
+    search->regexes = memory_try_allocate(search->allocator, sizeof(Regex) * worker_count);
+    search_node_init(&search->root, SEARCH_NODE_DIRECTORY, NULL);
+    search->root.children = memory_try_allocate(search->allocator, sizeof(SearchNode) * root_capacity);
+    if (!search->regexes || !search->root.children) {
+        memory_free(search->allocator, search->regexes, sizeof(Regex) * worker_count);
+        memory_free(search->allocator, search->root.children, sizeof(SearchNode) * root_capacity);
+        search_readers_destroy(search);
+        pool_destroy(&search->pool);
+        return false;
+    }
+    search->root.child_capacity = root_capacity;
+
+    if (mtx_init(&search->lock, mtx_plain) != thrd_success || cnd_init(&search->progress) != thrd_success)
+        QUIT_WITH_FATAL_MSG("Failed to create the search lock");
+    for (int i = 0; i < worker_count; ++i) regex_create_with_options(&search->regexes[i], re, &options->regex);
+
+    return true;
+}
+
+static void search_destroy(Search *search) {
+    for (int i = 0; i < search->pool.worker_count; ++i) regex_destroy(&search->regexes[i]);
+    memory_free(search->allocator, search->regexes, sizeof(Regex) * search->pool.worker_count);
+    search_readers_destroy(search);
+    mtx_destroy(&search->lock);
+    cnd_destroy(&search->progress);
+    pool_destroy(&search->pool);
+}
+
+static bool search_readers_create(Search *search, int queue_depth) {
+    int worker_count = search->pool.worker_count;
+    search->readers = memory_try_allocate(search->allocator, sizeof(SearchReader) * worker_count);
+    if (!search->readers) {
+        LOG_ERROR("Failed to allocate %d search readers", worker_count);
+        return false;
+    }
+    for (int i = 0; i < worker_count; ++i) search->readers[i] = (SearchReader){.uring.fd = -1};
+    if (search->io != SEARCH_IO_URING) return true;
+
+    for (int i = 0; i < worker_count; ++i) {
+        SearchReader *reader = &search->readers[i];
+        if (!uring_create(&reader->uring, queue_depth)) {
+            search_readers_destroy(search);
+            return false;
+        }
+
+        // Counted first, so that the slots are freed with their size
+        reader->slot_count = queue_depth;
+        reader->slots = memory_try_allocate(search->allocator, sizeof(SearchSlot) * queue_depth);
+        reader->free_slots = memory_try_allocate(search->allocator, sizeof(int) * queue_depth);
+        if (reader->slots) memset(reader->slots, 0, sizeof(SearchSlot) * queue_depth);
+        if (!reader->slots || !reader->free_slots) {
+            LOG_ERROR("Failed to allocate %d search slots", queue_depth);
+            search_readers_destroy(search);
+            return false;
+        }
+
+        reader->free_count = queue_depth;
+        for (int j = 0; j < queue_depth; ++j) reader->free_slots[j] = j;
+    }
+
+    return true;
+}
+
+static void search_readers_destroy(Search *search) {
+    if (!search->readers) return;
+
+    for (int i = 0; i < search->pool.worker_count; ++i) {
+        SearchReader *reader = &search->readers[i];
+        for (int j = 0; reader->slots && j < reader->slot_count; ++j)
+            memory_free(search->allocator, reader->slots[j].buffer.data, reader->slots[j].buffer.capacity);
+        memory_free(search->allocator, reader->slots, sizeof(SearchSlot) * reader->slot_count);
+        memory_free(search->allocator, reader->free_slots, sizeof(int) * reader->slot_count);
+        memory_free(search->allocator, reader->buffer.data, reader->buffer.capacity);
+        uring_destroy(&reader->uring);
+    }
+
+    memory_free(search->allocator, search->readers, sizeof(SearchReader) * search->pool.worker_count);
+    search->readers = NULL;
+}
+
+static void search_task_root(Pool *pool, int worker, void *arg) {
+    SearchNode *root = arg;
+    for (size_t i = 0; i < root->child_count; ++i) {
+        SearchNode *child = &root->children[i];
+        pool_submit(pool, worker, child->kind == SEARCH_NODE_DIRECTORY ? search_task_directory : search_task_file, child);
+    }
+}
+
+static void search_task_directory(Pool *pool, int worker, void *arg) {
+    Search *search = pool->context;
+    SearchNode *node = arg;
+
+    DIR *dir = opendir(node->path);
+    if (!dir) {
+        LOG_ERROR("Can not open directory '%s'", node->path);
+        search->errors++;
+        search_node_finish(search, node);
+        return;
+    }
+    search->directories++;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
+
+        char *path = search_join_path(search, node->path, entry->d_name);
+        if (!path) {
+            LOG_ERROR("Failed to allocate the path of '%s' in '%s'", entry->d_name, node->path);
+            search->errors++;
+            continue;
+        }
+
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+            // Not every file system fills d_type
+            struct stat info;
+            type = lstat(path, &info) ? DT_UNKNOWN : S_ISDIR(info.st_mode) ? DT_DIR : S_ISREG(info.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+
+        // Symbolic links and special files are skipped
+        if (type != DT_DIR && type != DT_REG) {
+            search_free_path(search, path);
+            continue;
+        }
+
+        if (node->child_count == node->child_capacity) {
+            size_t capacity = node->child_capacity ? node->child_capacity * 2 : 16;
+            SearchNode *children = memory_try_reallocate(search->allocator, node->children,
+                sizeof(SearchNode) * node->child_capacity, sizeof(SearchNode) * capacity);
+            if (!children) {
+                // The entries listed so far are still searched
+                LOG_ERROR("Failed to allocate the entries of '%s'", node->path);
+                search->errors++;
+                search_free_path(search, path);
+                break;
+            }
+            node->children = children;
+            node->child_capacity = capacity;
+        }
+        search_node_init(&node->children[node->child_count++], type == DT_DIR ? SEARCH_NODE_DIRECTORY : SEARCH_NODE_FILE, path);
+    }
+    closedir(dir);
+
+    // Sorted, so that the output does not depend on the file system or the scheduling
+    if (node->child_count) qsort(node->children, node->child_count, sizeof(SearchNode), search_compare_nodes);
+
+    for (size_t i = 0; i < node->child_count; ++i) {
+        SearchNode *child = &node->children[i];
+        pool_submit(pool, worker, child->kind == SEARCH_NODE_DIRECTORY ? search_task_directory : search_task_file, child);
+    }
+
+    search_node_finish(search, node);
+}
+
+static void search_task_file(Pool *pool, int worker, void *arg) {
+    Search *search = pool->context;
+    SearchNode *node = arg;
+
+    int fd = open(node->path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info)) {
+        LOG_ERROR("Can not open file '%s'", node->path);
+        search->errors++;
+        if (fd >= 0) close(fd);
+        search_node_finish(search, node);
+        return;
+    }
+
+    size_t size = info.st_size;
+    size_t chunk_count = size > search->chunk_bytes ? (size + search->chunk_bytes - 1) / search->chunk_bytes : 1;
+    node->children = memory_try_allocate(search->allocator, sizeof(SearchNode) * chunk_count);
+    if (!node->children) {
+        LOG_ERROR("Failed to allocate %zu chunks of '%s'", chunk_count, node->path);
+        search->errors++;
+        close(fd);
+        search_node_finish(search, node);
+        return;
+    }
+    node->child_capacity = chunk_count;
+
+    for (size_t i = 0; i < chunk_count; ++i) {
+        SearchNode *chunk = &node->children[i];
+        search_node_init(chunk, SEARCH_NODE_CHUNK, NULL);
+        chunk->file = node;
+        chunk->offset = i * search->chunk_bytes;
+        chunk->length = i + 1 < chunk_count ? search->chunk_bytes : size - chunk->offset;
+    }
+    node->child_count = chunk_count;
+
+    if (search->io == SEARCH_IO_MMAP && size) {
+        node->map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (node->map == MAP_FAILED) {
+            LOG_ERROR("Can not map file '%s'", node->path);
+            search->errors++;
+            node->map = NULL;
+            node->child_count = 0;
+        } else {
+            madvise(node->map, size, MADV_SEQUENTIAL);
+            node->map_len = size;
+            atomic_init(&node->map_users, chunk_count);
+        }
+        close(fd);
+        fd = -1;
+    }
+
+    // Only the start of a small file is probed when its only chunk is read
+    bool binary = false;
+    if (node->map) {
+        binary = memchr(node->map, '\0', size < SEARCH_BINARY_PROBE_BYTES ? size : SEARCH_BINARY_PROBE_BYTES);
+    } else if (fd >= 0 && chunk_count > 1) {
+        char probe[SEARCH_BINARY_PROBE_BYTES];
+        ssize_t probed = pread(fd, probe, sizeof(probe), 0);
+        binary = probed > 0 && memchr(probe, '\0', probed);
+    }
+
+    if (binary) {
+        search->binary_files++;
+        if (node->map) munmap(node->map, node->map_len);
+        if (fd >= 0) close(fd);
+        node->child_count = 0;
+    } else if (fd >= 0 && chunk_count == 1) {
+        search_read_chunk(search, worker, &node->children[0], fd, true);
+    } else if (node->child_count) {
+        // Large files are spread over the workers
+        search->files++;
+        if (fd >= 0) close(fd);
+        for (size_t i = 1; i < chunk_count; ++i) pool_submit(pool, worker, search_task_chunk, &node->children[i]);
+        search_task_chunk(pool, worker, &node->children[0]);
+    }
+
+    search_node_finish(search, node);
+}
+
+static void search_task_chunk(Pool *pool, int worker, void *arg) {
+    Search *search = pool->context;
+    SearchNode *chunk = arg;
+    SearchNode *file = chunk->file;
+
+    if (file->map) {
+        size_t begin = chunk->offset ? chunk->offset - 1 : 0;
+        search_match_chunk(search, worker, chunk, file->map + begin, file->map_len - begin, false);
+        // The last chunk unmaps the file
+        if (atomic_fetch_sub(&file->map_users, 1) == 1) munmap(file->map, file->map_len);
+        search_node_finish(search, chunk);
+        return;
+    }
+
+    int fd = open(file->path, O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR("Can not open file '%s'", file->path);
+        search->errors++;
+        search_node_finish(search, chunk);
+        return;
+    }
+
+    search_read_chunk(search, worker, chunk, fd, false);
+}
+
+static void search_read_chunk(Search *search, int worker, SearchNode *chunk, int fd, bool binary_probe) {
+    SearchReader *reader = &search->readers[worker];
+    if (search->io == SEARCH_IO_URING && search_queue_chunk(search, worker, chunk, fd, binary_probe)) return;
+
+    reader->buffer.len = 0;
+    if (search_read_rest(search, chunk, fd, &reader->buffer))
+        search_match_chunk(search, worker, chunk, reader->buffer.data, reader->buffer.len, binary_probe);
+    close(fd);
+    search_node_finish(search, chunk);
+}
+
+static bool search_queue_chunk(Search *search, int worker, SearchNode *chunk, int fd, bool binary_probe) {
+    SearchReader *reader = &search->readers[worker];
+
+    // Make room by matching the reads that complete first
+    while (!reader->free_count) {
+        if (!search_reader_complete(search, worker, true)) return false;
+    }
+
+    int index = reader->free_slots[--reader->free_count];
+    SearchSlot *slot = &reader->slots[index];
+    slot->chunk = chunk;
+    slot->fd = fd;
+    slot->binary_probe = binary_probe;
+
+    // The chunk and the byte before it, with some room for the end of its last line
+    size_t begin = chunk->offset ? chunk->offset - 1 : 0;
+    size_t want = chunk->offset + chunk->length - begin + SEARCH_LINE_READ_BYTES;
+    if (!search_buffer_reserve(search, &slot->buffer, want)) {
+        reader->free_slots[reader->free_count++] = index;
+        return false;
+    }
+    slot->buffer.len = 0;
+
+    // NOTE: the queue has an entry for every slot, so it is never full here
+    uring_queue_read(&reader->uring, fd, slot->buffer.data, want, begin, index);
+    if (!uring_submit(&reader->uring, 0)) {
+        LOG_ERROR("io_uring rejected the read of '%s', reading it with read()", chunk->file->path);
+        search->errors++;
+        uring_drop_queued(&reader->uring);
+        reader->free_slots[reader->free_count++] = index;
+        return false;
+    }
+    pool_hold(&search->pool);
+
+    // Overlap the reads in flight with matching the ones already done
+    search_reader_complete(search, worker, false);
+    return true;
+}
+
+static bool search_reader_complete(Search *search, int worker, bool wait) {
+    SearchReader *reader = &search->readers[worker];
+    if (wait && !uring_submit(&reader->uring, 1)) {
+        // The reads in flight are still reaped once they complete, without waiting
+        LOG_ERROR("Failed to wait for io_uring completions");
+        search->errors++;
+        wait = false;
+    }
+
+    bool completed = false;
+    uint64_t index;
+    int result;
+    while (uring_reap(&reader->uring, &index, &result)) {
+        SearchSlot *slot = &reader->slots[index];
+        SearchNode *chunk = slot->chunk;
+
+        if (result < 0) {
+            LOG_ERROR("Can not read file '%s'", chunk->file->path);
+            search->errors++;
+        } else {
+            // Usually the whole chunk up to the end of its last line is already there
+            slot->buffer.len = result;
+            if (search_read_rest(search, chunk, slot->fd, &slot->buffer))
+                search_match_chunk(search, worker, chunk, slot->buffer.data, slot->buffer.len, slot->binary_probe);
+        }
+
+        close(slot->fd);
+        search_node_finish(search, chunk);
+        reader->free_slots[reader->free_count++] = index;
+        pool_release(&search->pool);
+        completed = true;
+    }
+
+    return completed;
+}
+
+static bool search_reader_idle(Pool *pool, int worker) {
+    Search *search = pool->context;
+    SearchReader *reader = &search->readers[worker];
+
+    // Wait for the reads in flight instead of sleeping (polling them if waiting fails)
+    if (reader->free_count == reader->slot_count) return false;
+    search_reader_complete(search, worker, true);
+    return true;
+}
+
+static bool search_read_rest(Search *search, SearchNode *chunk, int fd, SearchBuffer *buffer) {
+    // The byte before the chunk tells whether a line starts at the chunk
+    size_t begin = chunk->offset ? chunk->offset - 1 : 0;
+    size_t end = chunk->offset + chunk->length - begin;
+    size_t scanned = end ? end - 1 : 0;
+    bool reserved = search_buffer_reserve(search, buffer, end + SEARCH_LINE_READ_BYTES);
+
+    // Read the chunk and then up to the end of its last line
+    while (reserved) {
+        if (buffer->len >= end) {
+            if (memchr(buffer->data + scanned, '\n', buffer->len - scanned)) break;
+            scanned = buffer->len;
+        }
+
+        if (buffer->len == buffer->capacity) reserved = search_buffer_reserve(search, buffer, buffer->capacity * 2);
+        if (!reserved) break;
+
+        size_t want = buffer->len < end ? end - buffer->len : buffer->capacity - buffer->len;
+        ssize_t got = pread(fd, buffer->data + buffer->len, want, begin + buffer->len);
+        if (got < 0) {
+            LOG_ERROR("Can not read file '%s'", chunk->file->path);
+            search->errors++;
+        }
+        if (got <= 0) break;
+        buffer->len += got;
+    }
+
+    if (!reserved) {
+        LOG_ERROR("Failed to allocate the buffer of '%s'", chunk->file->path);
+        search->errors++;
+    }
+
+    return reserved;
+}
+
+static void search_match_chunk(Search *search, int worker, SearchNode *chunk, const char *data, size_t len,
+    bool binary_probe) {
+    if (binary_probe) {
+        bool binary = memchr(data, '\0', len < SEARCH_BINARY_PROBE_BYTES ? len : SEARCH_BINARY_PROBE_BYTES);
+        if (binary) {
+            search->binary_files++;
+            return;
+        }
+        search->files++;
+    }
+
+    // Skip the end of the line started by the previous chunk
+    size_t first = 0;
+    if (chunk->offset) {
+        const char *new_line = memchr(data, '\n', len);
+        first = new_line ? (size_t)(new_line - data) + 1 : len;
+    }
+
+    // A line may start in an earlier chunk and cover all of this one
+    size_t end = chunk->offset + chunk->length - (chunk->offset ? chunk->offset - 1 : 0);
+    size_t owned = end > first ? end - first : 0;
+    search_match_lines(search, worker, chunk, data + first, len - first, owned);
+    search->bytes += chunk->length;
+}
+
+static bool search_buffer_reserve(Search *search, SearchBuffer *buffer, size_t capacity) {
+    if (buffer->capacity >= capacity) return true;
+
+    char *data = memory_try_reallocate(search->allocator, buffer->data, buffer->capacity, capacity);
+    if (!data) return false;
+    buffer->data = data;
+    buffer->capacity = capacity;
+
+    return true;
+}
+
+static void search_match_lines(Search *search, int worker, SearchNode *chunk, const char *data, size_t len,
+    size_t end) {
+    RegexInput inputs[64];
+    uint64_t matched;
+    size_t pos = 0, dropped = 0;
+
+    while (pos < len && pos < end) {
+        // Match the lines 64 at a time, one bit each
+        size_t count = 0;
+        for (; count < 64 && pos < len && pos < end; ++count) {
+            const char *new_line = memchr(data + pos, '\n', len - pos);
+            size_t line_len = new_line ? (size_t)(new_line - data) - pos : len - pos;
+            inputs[count] = (RegexInput){data + pos, line_len};
+            pos += line_len + 1;
+        }
+
+        regex_match_batch(&search->regexes[worker], inputs, count, &matched);
+        for (size_t i = 0; i < count; ++i) {
+            if (matched >> i & 1) dropped += !search_add_match(search, chunk, inputs[i].data, inputs[i].len, chunk->line_count + i);
+        }
+        chunk->line_count += count;
+    }
+
+    // The line numbers of the next chunks stay right, only the dropped lines are missing
+    if (dropped) {
+        LOG_ERROR("Failed to allocate %zu matching lines of '%s'", dropped, chunk->file->path);
+        search->errors++;
+    }
+
+    search->matched_lines += chunk->match_count;
+}
+
+static bool search_add_match(Search *search, SearchNode *chunk, const char *line, size_t len, size_t line_number) {
+    if (chunk->output_len + len + 1 > chunk->output_capacity) {
+        size_t capacity = chunk->output_capacity ? chunk->output_capacity * 2 : 256;
+        while (capacity < chunk->output_len + len + 1) capacity *= 2;
+        char *output = memory_try_reallocate(search->allocator, chunk->output, chunk->output_capacity, capacity);
+        if (!output) return false;
+        chunk->output = output;
+        chunk->output_capacity = capacity;
+    }
+
+    if (chunk->match_count == chunk->match_capacity) {
+        size_t capacity = chunk->match_capacity ? chunk->match_capacity * 2 : 16;
+        size_t *match_lines = memory_try_reallocate(search->allocator, chunk->match_lines,
+            sizeof(size_t) * chunk->match_capacity, sizeof(size_t) * capacity);
+        if (!match_lines) return false;
+        chunk->match_lines = match_lines;
+        chunk->match_capacity = capacity;
+    }
+
+    memcpy(chunk->output + chunk->output_len, line, len);
+    chunk->output_len += len;
+    chunk->output[chunk->output_len++] = '\n';
+    chunk->match_lines[chunk->match_count++] = line_number;
+
+    return true;
+}
+
+static void search_node_init(SearchNode *node, SearchNodeKind kind, char *path) {
+    *node = (SearchNode){.kind = kind, .path = path};
+    atomic_init(&node->done, false);
+}
+
+static void search_node_finish(Search *search, SearchNode *node) {
+    mtx_lock(&search->lock);
+    atomic_store(&node->done, true);
+    cnd_signal(&search->progress);
+    mtx_unlock(&search->lock);
+}
+
+static void search_node_wait(Search *search, SearchNode *node) {
+    if (atomic_load(&node->done)) return;
+
+    mtx_lock(&search->lock);
+    while (!atomic_load(&node->done)) cnd_wait(&search->progress, &search->lock);
+    mtx_unlock(&search->lock);
+}
+
+static void search_free_path(Search *search, char *path) {
+    if (path) memory_free(search->allocator, path, strlen(path) + 1);
+}
+
+static void search_print_node(Search *search, SearchNode *node, FILE *out) {
+    search_node_wait(search, node);
+
+    // Line numbers continue from the previous chunk
+    size_t line_base = 0;
+    for (size_t i = 0; i < node->child_count; ++i) {
+        SearchNode *child = &node->children[i];
+        if (child->kind != SEARCH_NODE_CHUNK) {
+            search_print_node(search, child, out);
+            continue;
+        }
+
+        search_node_wait(search, child);
+        const char *line = child->output;
+        for (size_t j = 0; j < child->match_count; ++j) {
+            const char *new_line = memchr(line, '\n', child->output + child->output_len - line);
+            fprintf(out, "%s:%zu:", node->path, line_base + child->match_lines[j] + 1);
+            fwrite(line, 1, new_line - line + 1, out);
+            line = new_line + 1;
+        }
+        line_base += child->line_count;
+
+        memory_free(search->allocator, child->output, child->output_capacity);
+        memory_free(search->allocator, child->match_lines, sizeof(size_t) * child->match_capacity);
+    }
+
+    memory_free(search->allocator, node->children, sizeof(SearchNode) * node->child_capacity);
+    search_free_path(search, node->path);
+}
+
+static char *search_join_path(Search *search, const char *directory, const char *name) {
+    size_t directory_len = strlen(directory), name_len = strlen(name);
+    bool separator = directory_len && directory[directory_len - 1] != '/';
+
+    char *path = memory_try_allocate(search->allocator, directory_len + separator + name_len + 1);
+    if (!path) return NULL;
+
+    memcpy(path, directory, directory_len);
+    if (separator) path[directory_len] = '/';
+    memcpy(path + directory_len + separator, name, name_len + 1);
+
+    return path;
+}
+
+static int search_compare_nodes(const void *a, const void *b) {
+    return strcmp(((const SearchNode *)a)->path, ((const SearchNode *)b)->path);
+}
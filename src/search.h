@@ -0,0 +1,104 @@
+#pragma once
+
+#include "regex.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * @brief Files larger than this are split in chunks of this size by default.
+ */
+#define SEARCH_DEFAULT_CHUNK_BYTES (1024 * 1024)
+
+/**
+ * @brief Files with a NUL byte in their first this many bytes are skipped as binary.
+ */
+#define SEARCH_BINARY_PROBE_BYTES 8192
+
+/**
+ * @brief Reads in flight per worker with SEARCH_IO_URING by default.
+ */
+#define SEARCH_DEFAULT_QUEUE_DEPTH 16
+
+/**
+ * @enum SearchIo
+ * @brief How the files are read.
+ */
+typedef enum SearchIo {
+    SEARCH_IO_READ, /**< Blocking pread() into a reused buffer */
+    SEARCH_IO_MMAP, /**< Map the files */
+    SEARCH_IO_URING, /**< Keep reads in flight with io_uring (Linux), falls back to SEARCH_IO_READ */
+} SearchIo;
+
+/**
+ * @struct SearchOptions search.h
+ * @brief Options of @ref search_paths.
+ */
+typedef struct SearchOptions {
+    RegexOptions regex; /**< Options used to compile the regex (one copy per worker) */
+    int threads; /**< Number of workers (0 for number of online processors) */
+    size_t chunk_bytes; /**< Chunk size of large files (0 for SEARCH_DEFAULT_CHUNK_BYTES) */
+    SearchIo io; /**< How the files are read */
+    int queue_depth; /**< Reads in flight per worker with SEARCH_IO_URING (0 for SEARCH_DEFAULT_QUEUE_DEPTH) */
+} SearchOptions;
+
+/**
+ * @struct SearchSummary search.h
+ * @brief Totals of one @ref search_paths.
+ */
+typedef struct SearchSummary {
+    size_t directories; /**< Directories listed */
+    size_t files; /**< Files searched */
+    size_t binary_files; /**< Files skipped as binary */
+    size_t errors; /**< Paths that could not be opened or read */
+    unsigned long long bytes; /**< Bytes searched */
+    unsigned long long matched_lines; /**< Lines that matched */
+    int threads; /**< Number of workers used */
+    SearchIo io; /**< How the files were read (after falling back) */
+} SearchSummary;
+
+/**
+ * @brief Get the name of the io (used in reports).
+ *
+ * @param io The io
+ *
+ * @return Name of the io.
+ */
+const char *search_io_name(SearchIo io);
+
+/**
+ * @brief Get the io from its name.
+ *
+ * @param name Name of the io ("read", "mmap" or "uring")
+ * @param io Pointer to store the io
+ *
+ * @return false if the name is unknown.
+ */
+bool search_io_from_name(const char *name, SearchIo *io);
+
+/**
+ * @brief Search the files under the paths (recursively) for the regex pattern.
+ *
+ * Directories are listed and files (or chunks of large files) are matched in
+ * parallel by a work-stealing pool, while the calling thread writes every
+ * matching line as "path:line number:line" as soon as all the output before
+ * it is ready. The output is always in the same order: paths in the given
+ * order, directory entries sorted by name and lines in file order.
+ * Symbolic links and special files inside directories are not followed.
+ *
+ * With SEARCH_IO_URING every worker keeps up to queue_depth reads in flight
+ * into buffers that are reused, and searches the chunks whose reads have
+ * completed meanwhile, so that matching overlaps the reads.
+ *
+ * @param re The regex string
+ * @param paths Files and directories to search
+ * @param path_count Number of paths
+ * @param options The options (NULL for defaults)
+ * @param out Where to write the matching lines
+ * @param summary Pointer to store the totals (can be NULL)
+ *
+ * @return true if any line matched.
+ */
+bool search_paths(const char *re, const char *const *paths, size_t path_count, const SearchOptions *options,
+    FILE *out, SearchSummary *summary);
@@ -3,8 +3,8 @@
 #include <stdlib.h>
 #include "memory.h"
 
-State *state_create(int c) {
-    State *state = (State *)memory_allocate(sizeof(State));
+State *state_create(const Allocator *allocator, int c) {
+    State *state = (State *)memory_allocate(allocator, sizeof(State));
 
     *state = (State){0};
     state->c = c;
@@ -12,6 +12,6 @@ State *state_create(int c) {
     return state;
 }
 
-void state_destroy(State *state) {
-    memory_free(state);
+void state_destroy(const Allocator *allocator, State *state) {
+    memory_free(allocator, state, sizeof(State));
 }
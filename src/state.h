@@ -1,6 +1,14 @@
 #pragma once
 
 #include "range.h"
+#include "memory.h"
+
+#include <stdbool.h>
+
+/**
+ * @brief Most states of an nfa going back to its start after a byte (see @ref state_is_restart).
+ */
+#define STATE_MAX_RESTARTS 2
 
 /**
  * @enum Character
@@ -16,8 +24,24 @@ typedef enum Character {
     LINE_START, /**< Match start of line */
     DEAD, /**< Dead state */
     RANGE, /**< Range of characters */
+    WORD_BOUNDARY, /**< Match between a word byte and anything else ('\\b') */
+    NOT_WORD_BOUNDARY, /**< Match between two word bytes or two other bytes ('\\B') */
+    TEXT_START, /**< Match at the start of the input ('\\A') */
+    TEXT_END, /**< Match at the end of the input ('\\z') */
+    LOOP_BACK, /**< Go back to the start of a loop whose body can match nothing (an assertion that always holds) */
 } Character;
 
+/**
+ * @enum Side
+ * @brief What is on one side of a position of the input, as the assertions see it.
+ */
+typedef enum Side {
+    SIDE_EDGE, /**< The start or the end of the input */
+    SIDE_WORD, /**< A word byte (see @ref state_is_word_byte) */
+    SIDE_OTHER, /**< Any other byte */
+    SIDE_UNKNOWN, /**< Not read yet, the assertions looking at it wait for it */
+} Side;
+
 typedef struct State State;
 
 /**
@@ -30,21 +54,111 @@ struct State {
     State *out1; /**< out edge 2 (used when branching is required). */
     Range range; /**< range of the characters incase c is RANGE */
     int id; /**< The index of the state node in the set of states nfa can exists. */
+    int index; /**< Number of the state in the nfa (0 to total states - 1), unlike id it never changes. */
 };
 
 /**
  * @brief Allocates and returns pointer to State.
  *
+ * @param allocator The allocator to use (NULL for default allocator)
  * @param c The character to transition to next state
  *
  * @return Malloced pointer to the state.
  */
-State *state_create(int c);
+State *state_create(const Allocator *allocator, int c);
 
 /**
  * @brief Frees the allocated state.
  *
+ * @param allocator The allocator used to create the state
  * @param state Pointer to state
  */
-void state_destroy(State *state);
+void state_destroy(const Allocator *allocator, State *state);
+
+/**
+ * @brief Check whether the byte is a word byte ([0-9A-Za-z_], the bytes of UTF-8 sequences are not).
+ *
+ * @param byte The byte
+ *
+ * @return true for a word byte.
+ */
+static inline bool state_is_word_byte(unsigned char byte) {
+    return ('0' <= byte && byte <= '9') || ('A' <= byte && byte <= 'Z') || ('a' <= byte && byte <= 'z') || byte == '_';
+}
+
+/**
+ * @brief Get the side the byte is on either side of a position.
+ *
+ * @param byte The byte
+ *
+ * @return SIDE_WORD or SIDE_OTHER.
+ */
+static inline Side state_side_of(unsigned char byte) {
+    return state_is_word_byte(byte) ? SIDE_WORD : SIDE_OTHER;
+}
+
+/**
+ * @brief Check whether the state is an assertion (matches a position, not a character).
+ *
+ * @param c The character (or kind) of the state
+ *
+ * @return true for WORD_BOUNDARY, NOT_WORD_BOUNDARY, TEXT_START, TEXT_END and LOOP_BACK.
+ */
+static inline bool state_is_assertion(int c) {
+    return c >= WORD_BOUNDARY && c <= LOOP_BACK;
+}
+
+/**
+ * @brief Check whether the assertion can be decided, only '\\A' and LOOP_BACK never look at the byte after the position.
+ *
+ * @param c The assertion
+ * @param after What is after the position
+ *
+ * @return false if the assertion has to wait for the next byte.
+ */
+static inline bool state_assertion_known(int c, Side after) {
+    return after != SIDE_UNKNOWN || c == TEXT_START || c == LOOP_BACK;
+}
+
+/**
+ * @brief Check whether the assertion holds at a position.
+ *
+ * @param c The assertion
+ * @param before What is before the position
+ * @param after What is after the position (known, see @ref state_assertion_known)
+ *
+ * @return true if the assertion holds.
+ */
+static inline bool state_assertion_holds(int c, Side before, Side after) {
+    switch (c) {
+        case WORD_BOUNDARY:
+            return (before == SIDE_WORD) != (after == SIDE_WORD);
+        case NOT_WORD_BOUNDARY:
+            return (before == SIDE_WORD) == (after == SIDE_WORD);
+        case TEXT_START:
+            return before == SIDE_EDGE;
+        case LOOP_BACK:
+            return true;
+        default:
+            return after == SIDE_EDGE;
+    }
+}
+
+/**
+ * @brief Check whether the state goes back to the start of the nfa after a byte.
+ *
+ * These are the loop skipping characters in front of an unanchored pattern
+ * and, in multi-line mode, its new line. They start new matches, which must
+ * not happen after the new line added at the end of a line.
+ *
+ * @param state The state
+ * @param restarts The restart states of the nfa (STATE_MAX_RESTARTS of them, NULL if unused)
+ *
+ * @return true if the state is one of the restarts.
+ */
+static inline bool state_is_restart(const State *state, State *const *restarts) {
+    for (int i = 0; i < STATE_MAX_RESTARTS; ++i)
+        if (state == restarts[i]) return true;
 
+    return false;
+}
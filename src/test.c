@@ -14,30 +14,30 @@ int main(void) {
     Range *range_list = NULL;
     int range_list_len = 0;
 
-    range_list = add_range_to_range_list((Range){10, 25}, range_list, &range_list_len);
+    range_list = add_range_to_range_list((Range){10, 25}, range_list, &range_list_len, NULL);
     print_range_list(range_list, range_list_len);
-    range_list = add_range_to_range_list((Range){15, 25}, range_list, &range_list_len);
+    range_list = add_range_to_range_list((Range){15, 25}, range_list, &range_list_len, NULL);
     print_range_list(range_list, range_list_len);
-    range_list = add_range_to_range_list((Range){5, 5}, range_list, &range_list_len);
+    range_list = add_range_to_range_list((Range){5, 5}, range_list, &range_list_len, NULL);
     print_range_list(range_list, range_list_len);
-    range_list = add_range_to_range_list((Range){5, 8}, range_list, &range_list_len);
+    range_list = add_range_to_range_list((Range){5, 8}, range_list, &range_list_len, NULL);
     print_range_list(range_list, range_list_len);
-    range_list = add_range_to_range_list((Range){8, 10}, range_list, &range_list_len);
+    range_list = add_range_to_range_list((Range){8, 10}, range_list, &range_list_len, NULL);
     print_range_list(range_list, range_list_len);
 
     LOG_INFO("Testing remove_range_from_range_list: ");
-    range_list = add_range_to_range_list((Range){0, -1}, range_list, &range_list_len);
+    range_list = add_range_to_range_list((Range){0, -1}, range_list, &range_list_len, NULL);
     print_range_list(range_list, range_list_len);
 
-    range_list = remove_range_from_range_list((Range){5, 5}, range_list, &range_list_len);
+    range_list = remove_range_from_range_list((Range){5, 5}, range_list, &range_list_len, NULL);
     print_range_list(range_list, range_list_len);
 
-    range_list = remove_range_from_range_list((Range){10, 20}, range_list, &range_list_len);
+    range_list = remove_range_from_range_list((Range){10, 20}, range_list, &range_list_len, NULL);
     print_range_list(range_list, range_list_len);
 
-    range_list = remove_range_from_range_list((Range){5, 10}, range_list, &range_list_len);
+    range_list = remove_range_from_range_list((Range){5, 10}, range_list, &range_list_len, NULL);
     print_range_list(range_list, range_list_len);
 
-    range_list = remove_range_from_range_list((Range){8, 10}, range_list, &range_list_len);
+    range_list = remove_range_from_range_list((Range){8, 10}, range_list, &range_list_len, NULL);
     print_range_list(range_list, range_list_len);
 }
@@ -0,0 +1,177 @@
+// mmap() and syscall() are POSIX/glibc, not part of C17
+#define _DEFAULT_SOURCE
+
+#include "uring.h"
+
+#ifdef RE_IO_URING
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * @brief Get the pointer at the offset of the mapping.
+ *
+ * @param base The mapping
+ * @param offset Offset in bytes
+ *
+ * @return The pointer.
+ */
+static inline void *uring_at(void *base, unsigned offset) {
+    return (char *)base + offset;
+}
+
+bool uring_create(Uring *uring, unsigned entries) {
+    *uring = (Uring){.fd = -1};
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) return false;
+
+    uring->fd = fd;
+    uring->entries = params.sq_entries;
+    uring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    uring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    // Since 5.4 both rings are in one mapping
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && uring->cq_ring_size > uring->sq_ring_size) uring->sq_ring_size = uring->cq_ring_size;
+
+    uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    uring->cq_ring = single_mmap ? uring->sq_ring
+        : mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+    if (uring->sq_ring == MAP_FAILED || uring->cq_ring == MAP_FAILED || uring->sqes == MAP_FAILED) {
+        if (uring->sq_ring != MAP_FAILED) munmap(uring->sq_ring, uring->sq_ring_size);
+        if (!single_mmap && uring->cq_ring != MAP_FAILED) munmap(uring->cq_ring, uring->cq_ring_size);
+        if (uring->sqes != MAP_FAILED) munmap(uring->sqes, uring->sqes_size);
+        close(fd);
+        *uring = (Uring){.fd = -1};
+        return false;
+    }
+
+    uring->sq_head = uring_at(uring->sq_ring, params.sq_off.head);
+    uring->sq_tail = uring_at(uring->sq_ring, params.sq_off.tail);
+    uring->sq_mask = *(unsigned *)uring_at(uring->sq_ring, params.sq_off.ring_mask);
+    uring->sq_array = uring_at(uring->sq_ring, params.sq_off.array);
+    uring->cq_head = uring_at(uring->cq_ring, params.cq_off.head);
+    uring->cq_tail = uring_at(uring->cq_ring, params.cq_off.tail);
+    uring->cq_mask = *(unsigned *)uring_at(uring->cq_ring, params.cq_off.ring_mask);
+    uring->cqes = uring_at(uring->cq_ring, params.cq_off.cqes);
+
+    return true;
+}
+
+void uring_destroy(Uring *uring) {
+    if (uring->fd < 0) return;
+
+    munmap(uring->sqes, uring->sqes_size);
+    if (uring->cq_ring != uring->sq_ring) munmap(uring->cq_ring, uring->cq_ring_size);
+    munmap(uring->sq_ring, uring->sq_ring_size);
+    close(uring->fd);
+    uring->fd = -1;
+}
+
+bool uring_queue_read(Uring *uring, int fd, void *buffer, unsigned len, uint64_t offset, uint64_t user_data) {
+    // The kernel advances the head, the tail is only written here
+    unsigned head = atomic_load_explicit((_Atomic unsigned *)uring->sq_head, memory_order_acquire);
+    unsigned tail = *uring->sq_tail;
+    if (tail - head >= uring->entries) return false;
+
+    unsigned index = tail & uring->sq_mask;
+    struct io_uring_sqe *sqe = &((struct io_uring_sqe *)uring->sqes)[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t)buffer;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+
+    uring->sq_array[index] = index;
+    atomic_store_explicit((_Atomic unsigned *)uring->sq_tail, tail + 1, memory_order_release);
+    uring->queued++;
+
+    return true;
+}
+
+bool uring_submit(Uring *uring, unsigned wait) {
+    while (uring->queued || wait) {
+        long submitted = syscall(__NR_io_uring_enter, uring->fd, uring->queued, wait, wait ? IORING_ENTER_GETEVENTS : 0,
+            NULL, 0);
+        if (submitted < 0 && errno == EINTR) continue;
+        if (submitted < 0) return false;
+
+        uring->queued -= submitted;
+        wait = 0;
+    }
+
+    return true;
+}
+
+void uring_drop_queued(Uring *uring) {
+    // The kernel only takes entries in io_uring_enter(), the ones after the submitted ones are still ours
+    unsigned tail = *uring->sq_tail;
+    atomic_store_explicit((_Atomic unsigned *)uring->sq_tail, tail - uring->queued, memory_order_release);
+    uring->queued = 0;
+}
+
+bool uring_reap(Uring *uring, uint64_t *user_data, int *result) {
+    unsigned head = *uring->cq_head;
+    if (head == atomic_load_explicit((_Atomic unsigned *)uring->cq_tail, memory_order_acquire)) return false;
+
+    const struct io_uring_cqe *cqe = &((struct io_uring_cqe *)uring->cqes)[head & uring->cq_mask];
+    *user_data = cqe->user_data;
+    *result = cqe->res;
+    atomic_store_explicit((_Atomic unsigned *)uring->cq_head, head + 1, memory_order_release);
+
+    return true;
+}
+
+#else
+
+bool uring_create(Uring *uring, unsigned entries) {
+    (void)entries;
+    *uring = (Uring){.fd = -1};
+    return false;
+}
+
+void uring_destroy(Uring *uring) {
+    (void)uring;
+}
+
+bool uring_queue_read(Uring *uring, int fd, void *buffer, unsigned len, uint64_t offset, uint64_t user_data) {
+    (void)uring;
+    (void)fd;
+    (void)buffer;
+    (void)len;
+    (void)offset;
+    (void)user_data;
+    return false;
+}
+
+bool uring_submit(Uring *uring, unsigned wait) {
+    (void)uring;
+    (void)wait;
+    return false;
+}
+
+void uring_drop_queued(Uring *uring) {
+    (void)uring;
+}
+
+bool uring_reap(Uring *uring, uint64_t *user_data, int *result) {
+    (void)uring;
+    (void)user_data;
+    (void)result;
+    return false;
+}
+
+#endif
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @struct Uring uring.h
+ * @brief Minimal Linux io_uring used to queue file reads (no liburing needed).
+ *
+ * Without RE_IO_URING (not Linux, or old kernel headers) @ref uring_create
+ * always fails, so that callers fall back to plain reads.
+ */
+typedef struct Uring {
+    int fd; /**< The io_uring file descriptor (-1 if not created) */
+    unsigned entries; /**< Number of submission queue entries */
+    unsigned queued; /**< Entries queued but not submitted yet */
+
+    unsigned *sq_head; /**< Submission queue head (advanced by the kernel) */
+    unsigned *sq_tail; /**< Submission queue tail */
+    unsigned sq_mask; /**< Submission queue index mask */
+    unsigned *sq_array; /**< Indices of the submitted entries */
+    void *sqes; /**< The submission queue entries */
+
+    unsigned *cq_head; /**< Completion queue head */
+    unsigned *cq_tail; /**< Completion queue tail (advanced by the kernel) */
+    unsigned cq_mask; /**< Completion queue index mask */
+    void *cqes; /**< The completion queue entries */
+
+    void *sq_ring; /**< Mapped submission ring */
+    size_t sq_ring_size; /**< Size of the submission ring mapping */
+    void *cq_ring; /**< Mapped completion ring (same as sq_ring with single mmap) */
+    size_t cq_ring_size; /**< Size of the completion ring mapping */
+    size_t sqes_size; /**< Size of the entries mapping */
+} Uring;
+
+/**
+ * @brief Create the io_uring.
+ *
+ * @param uring Pointer to the uring
+ * @param entries Number of reads that can be in flight
+ *
+ * @return false if io_uring is not available (nothing to destroy then).
+ */
+bool uring_create(Uring *uring, unsigned entries);
+
+/**
+ * @brief Destroy the io_uring (reads still in flight are dropped).
+ *
+ * @param uring Pointer to the uring
+ */
+void uring_destroy(Uring *uring);
+
+/**
+ * @brief Queue a read, submitted by the next @ref uring_submit.
+ *
+ * @param uring Pointer to the uring
+ * @param fd File to read
+ * @param buffer Where to read
+ * @param len Number of bytes to read
+ * @param offset Offset in the file
+ * @param user_data Returned with the completion
+ *
+ * @return false if the submission queue is full.
+ */
+bool uring_queue_read(Uring *uring, int fd, void *buffer, unsigned len, uint64_t offset, uint64_t user_data);
+
+/**
+ * @brief Submit the queued reads and wait for some completions.
+ *
+ * @param uring Pointer to the uring
+ * @param wait Number of completions to wait for
+ *
+ * @return false if the kernel rejected the submission.
+ */
+bool uring_submit(Uring *uring, unsigned wait);
+
+/**
+ * @brief Drop the reads queued but not submitted (after @ref uring_submit failed).
+ *
+ * @param uring Pointer to the uring
+ */
+void uring_drop_queued(Uring *uring);
+
+/**
+ * @brief Take a completion if any is ready (does not wait).
+ *
+ * @param uring Pointer to the uring
+ * @param user_data Pointer to store the user data of the read
+ * @param result Pointer to store the bytes read (negative errno on failure)
+ *
+ * @return false if no completion is ready.
+ */
+bool uring_reap(Uring *uring, uint64_t *user_data, int *result);
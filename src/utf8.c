@@ -0,0 +1,155 @@
+#include "utf8.h"
+
+#include "utils.h"
+
+/**
+ * @brief Last code point encoded with given number of bytes (index 1 to 4).
+ */
+static const unsigned int utf8_length_last[] = {0, 0x7F, 0x7FF, 0xFFFF, UTF8_CODEPOINT_LAST};
+
+/**
+ * @brief Get the number of bytes needed to encode the code point.
+ *
+ * @param codepoint The code point
+ *
+ * @return Number of bytes.
+ */
+static int utf8_encoded_length(unsigned int codepoint);
+
+/**
+ * @brief Encode the code point.
+ *
+ * @param codepoint The code point
+ * @param bytes Array of UTF8_MAX_BYTES bytes
+ *
+ * @return Number of bytes.
+ */
+static int utf8_encode(unsigned int codepoint, unsigned char *bytes);
+
+/**
+ * @brief Split the range whose both ends are encoded with same number of bytes.
+ *
+ * @param start Start of the range
+ * @param end End of the range
+ * @param sequences The array of sequences
+ * @param len Number of sequences in the array
+ *
+ * @return New number of sequences in the array.
+ */
+static int utf8_split_same_length(unsigned int start, unsigned int end, Utf8Sequence *sequences, int len);
+
+int utf8_decode(const char *src, unsigned int *codepoint) {
+    const unsigned char *bytes = (const unsigned char *)src;
+
+    int len;
+    unsigned int value;
+    if (bytes[0] < 0x80) {
+        *codepoint = bytes[0];
+        return 1;
+    } else if ((bytes[0] & 0xE0) == 0xC0) {
+        len = 2;
+        value = bytes[0] & 0x1F;
+    } else if ((bytes[0] & 0xF0) == 0xE0) {
+        len = 3;
+        value = bytes[0] & 0x0F;
+    } else if ((bytes[0] & 0xF8) == 0xF0) {
+        len = 4;
+        value = bytes[0] & 0x07;
+    } else {
+        return 0;
+    }
+
+    for (int i = 1; i < len; ++i) {
+        // Also stops at the NUL terminator
+        if ((bytes[i] & 0xC0) != 0x80) return 0;
+        value = (value << 6) | (bytes[i] & 0x3F);
+    }
+
+    // Overlong encodings, surrogates and too large values are invalid
+    if (utf8_encoded_length(value) != len || (value >= 0xD800 && value <= 0xDFFF) || value > UTF8_CODEPOINT_LAST)
+        return 0;
+
+    *codepoint = value;
+    return len;
+}
+
+int utf8_split_range(Range range, Utf8Sequence *sequences) {
+    int len = 0;
+    unsigned int start = range.start;
+    unsigned int end = range.end > UTF8_CODEPOINT_LAST ? UTF8_CODEPOINT_LAST : range.end;
+
+    // Split on the boundaries where the encoded length changes
+    for (int bytes = 1; bytes <= UTF8_MAX_BYTES && start <= end; ++bytes) {
+        if (start > utf8_length_last[bytes]) continue;
+
+        unsigned int last = end < utf8_length_last[bytes] ? end : utf8_length_last[bytes];
+        len = utf8_split_same_length(start, last, sequences, len);
+        start = last + 1;
+    }
+
+    return len;
+}
+
+static int utf8_encoded_length(unsigned int codepoint) {
+    if (codepoint <= utf8_length_last[1]) return 1;
+    if (codepoint <= utf8_length_last[2]) return 2;
+    if (codepoint <= utf8_length_last[3]) return 3;
+    return 4;
+}
+
+static int utf8_encode(unsigned int codepoint, unsigned char *bytes) {
+    int len = utf8_encoded_length(codepoint);
+    switch (len) {
+        case 1:
+            bytes[0] = (unsigned char)codepoint;
+            break;
+        case 2:
+            bytes[0] = (unsigned char)(0xC0 | (codepoint >> 6));
+            bytes[1] = (unsigned char)(0x80 | (codepoint & 0x3F));
+            break;
+        case 3:
+            bytes[0] = (unsigned char)(0xE0 | (codepoint >> 12));
+            bytes[1] = (unsigned char)(0x80 | ((codepoint >> 6) & 0x3F));
+            bytes[2] = (unsigned char)(0x80 | (codepoint & 0x3F));
+            break;
+        case 4:
+            bytes[0] = (unsigned char)(0xF0 | (codepoint >> 18));
+            bytes[1] = (unsigned char)(0x80 | ((codepoint >> 12) & 0x3F));
+            bytes[2] = (unsigned char)(0x80 | ((codepoint >> 6) & 0x3F));
+            bytes[3] = (unsigned char)(0x80 | (codepoint & 0x3F));
+            break;
+    }
+    return len;
+}
+
+static int utf8_split_same_length(unsigned int start, unsigned int end, Utf8Sequence *sequences, int len) {
+    int bytes = utf8_encoded_length(start);
+
+    // The trailing bytes should cover their full range (80-BF) except for the
+    // first byte that differs, otherwise split the range so that they do.
+    for (int i = 1; i < bytes; ++i) {
+        unsigned int mask = (1u << (6 * i)) - 1;
+        if ((start & ~mask) == (end & ~mask)) continue;
+
+        if (start & mask) {
+            len = utf8_split_same_length(start, start | mask, sequences, len);
+            return utf8_split_same_length((start | mask) + 1, end, sequences, len);
+        }
+
+        if ((end & mask) != mask) {
+            len = utf8_split_same_length(start, (end & ~mask) - 1, sequences, len);
+            return utf8_split_same_length(end & ~mask, end, sequences, len);
+        }
+    }
+
+    if (len >= UTF8_MAX_SEQUENCES) SHOULD_NOT_REACH_HERE;
+
+    unsigned char start_bytes[UTF8_MAX_BYTES], end_bytes[UTF8_MAX_BYTES];
+    utf8_encode(start, start_bytes);
+    utf8_encode(end, end_bytes);
+
+    sequences[len].len = bytes;
+    for (int i = 0; i < bytes; ++i) sequences[len].ranges[i] = (Range){start_bytes[i], end_bytes[i]};
+
+    return len + 1;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "range.h"
+
+/**
+ * @brief The last valid unicode code point.
+ */
+#define UTF8_CODEPOINT_LAST 0x10FFFF
+
+/**
+ * @brief Maximum number of bytes used to encode a code point.
+ */
+#define UTF8_MAX_BYTES 4
+
+/**
+ * @brief Maximum number of sequences a single code point range is split into.
+ */
+#define UTF8_MAX_SEQUENCES 32
+
+/**
+ * @struct Utf8Sequence utf8.h
+ * @brief Sequence of byte ranges matching the UTF-8 encoding of some code points.
+ *
+ * Example: code points U+0400 to U+04FF are the sequence [D0-D3][80-BF].
+ */
+typedef struct Utf8Sequence {
+    Range ranges[UTF8_MAX_BYTES]; /**< Byte range for each byte of the encoding */
+    int len; /**< Number of bytes */
+} Utf8Sequence;
+
+/**
+ * @brief Decode one code point.
+ *
+ * @param src The UTF-8 encoded string
+ * @param codepoint Pointer to store the code point
+ *
+ * @return Number of bytes decoded, 0 if src is not valid UTF-8.
+ */
+int utf8_decode(const char *src, unsigned int *codepoint);
+
+/**
+ * @brief Split the code point range into sequences of byte ranges.
+ *
+ * Matching any of the sequences is same as matching the UTF-8 encoding of
+ * any code point in the range, so the automaton never has to decode.
+ *
+ * @param range The code point range
+ * @param sequences Array of at least UTF8_MAX_SEQUENCES sequences
+ *
+ * @return Number of sequences.
+ */
+int utf8_split_range(Range range, Utf8Sequence *sequences);
@@ -1,27 +1,171 @@
-// gcc -g -std=c17 test.c logger.c range.c memory.c
 #include <stdio.h>
 
 #include "src/regex.h"
+#include "src/approx.h"
 #include "src/memory.h"
 #include "src/logger.h"
+#ifdef RE_SEARCH
+#include "src/search.h"
+#endif
 
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * @brief Print the usage of regexer.
+ */
+static void print_usage(void);
+
+/**
+ * @brief Print the matching stats of the regex.
+ *
+ * @param regex Pointer to the regex state
+ */
+static void print_stats(const Regex *regex);
+
+/**
+ * @brief Stop the asynchronous logging and print its counters.
+ *
+ * @param stats Print the counters (only stop otherwise)
+ */
+static void print_log_stats(bool stats);
+
+/**
+ * @brief Print the most visited nfa states of the regex.
+ *
+ * @param regex Pointer to the regex state
+ */
+static void print_profile(const Regex *regex);
+
+/**
+ * @brief Write the automata of the regex in DOT format.
+ *
+ * @param regex Pointer to the regex state
+ * @param path The file to write ("-" for the standard output)
+ *
+ * @return false if the file can't be opened.
+ */
+static bool write_dot(const Regex *regex, const char *path);
+
+#ifdef RE_SEARCH
+/**
+ * @brief Search the paths recursively and print the matching lines.
+ *
+ * @param re The regex string
+ * @param paths Files and directories to search
+ * @param path_count Number of paths
+ * @param options Pointer to the search options
+ * @param stats Print the totals after the matching lines
+ *
+ * @return 0 if any line matched, 1 otherwise.
+ */
+static int search_files(const char *re, const char *const *paths, int path_count, const SearchOptions *options, bool stats);
+#endif
 
 int main(int argc, const char **argv) {
-    if (argc != 3) {
-        LOG_ERROR("Error with arguments. Requried 2 arguments but %d were given", argc - 1);
-        LOG_INFO("Usage: regexer \"<text>\" \"<regex>\"");
+    bool stats = false;
+    bool recursive = false;
+    int threads = 0;
+    int queue_depth = 0;
+    const char *io = "read";
+    const char *replace = NULL;
+    bool split = false;
+    int errors = 0;
+    bool async_log = false;
+    bool profile = false;
+    const char *dot = NULL;
+    RegexOptions options = {0};
+
+    int arg;
+    for (arg = 1; arg < argc && !strncmp(argv[arg], "--", 2); ++arg) {
+        if (!strcmp(argv[arg], "--stats")) {
+            stats = true;
+        } else if (!strcmp(argv[arg], "--utf8")) {
+            options.flags |= REGEX_FLAG_UTF8;
+        } else if (!strcmp(argv[arg], "--icase")) {
+            options.flags |= REGEX_FLAG_ICASE;
+        } else if (!strcmp(argv[arg], "--multiline")) {
+            options.flags |= REGEX_FLAG_MULTILINE;
+        } else if (!strcmp(argv[arg], "--recursive")) {
+            recursive = true;
+        } else if (!strcmp(argv[arg], "--threads") && arg + 1 < argc) {
+            threads = atoi(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--io") && arg + 1 < argc) {
+            io = argv[++arg];
+        } else if (!strcmp(argv[arg], "--queue-depth") && arg + 1 < argc) {
+            queue_depth = atoi(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--replace") && arg + 1 < argc) {
+            replace = argv[++arg];
+        } else if (!strcmp(argv[arg], "--split")) {
+            split = true;
+        } else if (!strcmp(argv[arg], "--errors") && arg + 1 < argc) {
+            errors = atoi(argv[++arg]);
+            if (errors < 0 || errors > APPROX_MAX_ERRORS) {
+                LOG_ERROR("Errors should be between 0 and %d", APPROX_MAX_ERRORS);
+                return -1;
+            }
+        } else if (!strcmp(argv[arg], "--async-log")) {
+            async_log = true;
+        } else if (!strcmp(argv[arg], "--profile")) {
+            profile = true;
+        } else if (!strcmp(argv[arg], "--dot") && arg + 1 < argc) {
+            dot = argv[++arg];
+        } else {
+            LOG_ERROR("Unknown option '%s'", argv[arg]);
+            print_usage();
+            return -1;
+        }
+    }
+
+    if (async_log && !logger_start_async()) LOG_WARN("regexer was built without C11 threads, logging synchronously");
+
+    if (recursive) {
+#ifdef RE_SEARCH
+        if (argc - arg < 2) {
+            LOG_ERROR("Error with arguments. Requried regex and at least one path but %d arguments were given", argc - arg);
+            print_usage();
+            return -1;
+        }
+
+        SearchOptions search_options = {.regex = options, .threads = threads, .queue_depth = queue_depth};
+        if (!search_io_from_name(io, &search_options.io)) {
+            LOG_ERROR("Unknown io '%s'", io);
+            print_usage();
+            return -1;
+        }
+
+        int status = search_files(argv[arg], argv + arg + 1, argc - arg - 1, &search_options, stats);
+        if (async_log) print_log_stats(stats);
+        return status;
+#else
+        LOG_ERROR("regexer was built without recursive search (C11 threads or dirent.h missing)");
         return -1;
+#endif
     }
 
-    const char *text = argv[1];
-    const char *re = argv[2];
+    if (argc - arg != 2) {
+        LOG_ERROR("Error with arguments. Requried 2 arguments but %d were given", argc - arg);
+        print_usage();
+        return -1;
+    }
+
+    const char *text = argv[arg];
+    const char *re = argv[arg + 1];
     // const char *text = "somebody saw nobody";
     // const char *re = "saw";
 
     Regex regex;
-    regex_create(&regex, re);
-    print_memory_usage();
+    regex_create_with_options(&regex, re, &options);
+
+    MemoryReport report;
+    regex_get_memory_report(&regex, &report);
+    print_memory_usage(&report);
+
+    regex_enable_stats(&regex, stats);
+    if (profile && !regex_enable_profile(&regex, true))
+        LOG_WARN("regexer was built without stats (RE_STATS), nothing to profile");
 
     bool matched = false;
     // for (int i = 0; text[i] && !matched; ++i) {
@@ -31,11 +175,149 @@ int main(int argc, const char **argv) {
     // }
     // matched = regex_pattern_in_text(&regex, text);
     // for (int i = 0; text[i]; ++i) matched = regex_step(&regex, text[i]);
-    matched = regex_pattern_in_line(&regex, text);
+    if (replace) {
+        RegexBuffer replaced;
+        regex_buffer_create(&replaced, NULL);
+        size_t count;
+        if (regex_replace_all(&regex, text, strlen(text), replace, &replaced, &count) != REGEX_OK) {
+            LOG_ERROR("Can't replace with '%s': %s", replace, regex.error_message);
+            regex_buffer_destroy(&replaced);
+            regex_destroy(&regex);
+            return -1;
+        }
+        LOG_INFO("REPLACED %zu: %s", count, replaced.data);
+        regex_buffer_destroy(&replaced);
+    } else if (split) {
+        RegexSpan fields[64];
+        size_t count = regex_split(&regex, text, strlen(text), fields, sizeof(fields) / sizeof(fields[0]));
+        LOG_INFO("SPLIT %zu:", count);
+        for (size_t i = 0; i < count; ++i)
+            LOG_INFO("[%zu] \"%.*s\"", i, (int)(fields[i].end - fields[i].start), text + fields[i].start);
+    } else if (errors) {
+        Approx approx;
+        if (approx_create(&approx, &regex) != REGEX_OK) {
+            LOG_ERROR("'%s' can't be matched with errors (assertions, multi-line mode or more than %d positions)", re,
+                GLUSHKOV_MAX_POSITIONS);
+            regex_destroy(&regex);
+            return -1;
+        }
+
+        int distance = approx_match_line(&approx, text, errors);
+        approx_destroy(&approx);
 
-    if (matched) LOG_INFO("MATCHED!!!");
-    else LOG_INFO("NOT MATCHED!!!");
+        matched = distance >= 0;
+        if (matched) LOG_INFO("MATCHED WITH %d ERRORS!!!", distance);
+        else LOG_INFO("NOT MATCHED!!!");
+    } else if (options.flags & REGEX_FLAG_MULTILINE) {
+        RegexIterator iterator;
+        regex_iterator_create(&iterator, &regex, text, strlen(text));
+        RegexLine line;
+        while (regex_iterator_next_line(&iterator, &line)) {
+            LOG_INFO("LINE %zu: %.*s", line.number, (int)(line.end - line.start), text + line.start);
+            matched = true;
+        }
+
+        if (matched) LOG_INFO("MATCHED!!!");
+        else LOG_INFO("NOT MATCHED!!!");
+    } else {
+        matched = regex_pattern_in_line(&regex, text);
+
+        if (matched) LOG_INFO("MATCHED!!!");
+        else LOG_INFO("NOT MATCHED!!!");
+    }
+
+    if (stats) print_stats(&regex);
+    if (profile) print_profile(&regex);
+    bool dot_written = !dot || write_dot(&regex, dot);
 
     regex_destroy(&regex);
-    print_memory_usage();
+    print_memory_usage(NULL);
+
+    if (async_log) print_log_stats(stats);
+
+    return dot_written ? 0 : -1;
+}
+
+static void print_usage(void) {
+    LOG_INFO("Usage: regexer [--stats] [--utf8] [--icase] [--async-log] [--profile] [--dot <file>]"
+        " [--replace <template> | --split | --multiline | --errors <count>] \"<text>\" \"<regex>\"");
+    LOG_INFO("       regexer --recursive [--threads <count>] [--io <read|mmap|uring>] [--queue-depth <reads>]"
+        " [--stats] [--utf8] [--icase] [--async-log] \"<regex>\" <path>...");
+}
+
+static void print_stats(const Regex *regex) {
+    RegexStats stats;
+    if (!regex_get_stats(regex, &stats)) {
+        LOG_WARN("regexer was built without stats (RE_STATS), nothing to print");
+        return;
+    }
+
+    LOG_INFO("Lines searched: %llu (matched: %llu)", stats.lines, stats.matched_lines);
+    LOG_INFO("Bytes scanned: %llu", stats.bytes_scanned);
+    // The dfa and Shift-And paths don't keep a set of states, zeros would read like a free match
+    if (stats.nfa_steps) {
+        LOG_INFO("Active states per byte: avg %.2lf, max %d", stats.active_states_avg, stats.active_states_max);
+        LOG_INFO("Closure expansions: %llu", stats.closure_expansions);
+    } else {
+        LOG_INFO("Active states per byte: not collected (dfa path)");
+        LOG_INFO("Closure expansions: not collected (dfa path)");
+    }
+    if (stats.dfa_states)
+        LOG_INFO("DFA states: %d (%d accelerated)", stats.dfa_states, stats.dfa_accelerated_states);
+    if (stats.shift_and_positions) LOG_INFO("Shift-And positions: %d", stats.shift_and_positions);
+    LOG_INFO("Compile time: %.3lf us", stats.compile_seconds * 1e6);
+    LOG_INFO("Match time: %.3lf us", stats.match_seconds * 1e6);
+}
+
+static void print_log_stats(bool stats) {
+    logger_stop_async();
+    if (!stats) return;
+
+    LoggerStats log_stats;
+    logger_get_stats(&log_stats);
+    LOG_INFO("Log records: %zu written, %zu dropped, %zu truncated", log_stats.written, log_stats.dropped,
+        log_stats.truncated);
+}
+
+static void print_profile(const Regex *regex) {
+    RegexHotState hot[8];
+    size_t count = regex_get_hot_states(regex, hot, sizeof(hot) / sizeof(hot[0]));
+    if (!count) return;
+
+    LOG_INFO("Hottest nfa states (steps spent in the current states):");
+    for (size_t i = 0; i < count; ++i) LOG_INFO("  %d: %s %llu", hot[i].index, hot[i].label, hot[i].visits);
+}
+
+static bool write_dot(const Regex *regex, const char *path) {
+    FILE *out = strcmp(path, "-") ? fopen(path, "w") : stdout;
+    if (!out) {
+        LOG_ERROR("Can't open '%s' to write the automata", path);
+        return false;
+    }
+
+    regex_write_dot(regex, out);
+
+    if (out != stdout) fclose(out);
+    return true;
+}
+
+#ifdef RE_SEARCH
+static int search_files(const char *re, const char *const *paths, int path_count, const SearchOptions *options, bool stats) {
+    SearchSummary summary;
+    struct timespec begin, end;
+    timespec_get(&begin, TIME_UTC);
+    bool matched = search_paths(re, paths, path_count, options, stdout, &summary);
+    timespec_get(&end, TIME_UTC);
+
+    if (stats) {
+        double seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+        LOG_INFO("Searched %zu files in %zu directories with %d threads and %s (%zu binary files skipped, %zu errors)",
+            summary.files, summary.directories, summary.threads, search_io_name(summary.io), summary.binary_files,
+            summary.errors);
+        LOG_INFO("Matched lines: %llu", summary.matched_lines);
+        LOG_INFO("Bytes searched: %llu in %.3lf s (%.1lf MB/s)", summary.bytes, seconds, summary.bytes / seconds / 1e6);
+    }
+
+    return matched ? 0 : 1;
 }
+#endif